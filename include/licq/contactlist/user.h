@@ -34,7 +34,7 @@
 namespace LicqIcq
 {
 class IcqProtocol;
-void* MonitorSockets_func();
+class SocketMonitor;
 }
 
 namespace LicqMsn
@@ -105,11 +105,21 @@ public:
 
   /**
    * Write user data to file
+   * Data is written shortly after by the daemon so changes made close
+   * together only cause a single write.
    *
    * @param group Sub part of data to update (from SaveGroups above)
    */
   void save(unsigned group = SaveAll);
 
+  /**
+   * Write user data to file immediately
+   * Any changes from earlier calls to save() are written as well.
+   *
+   * @param group Sub part of data to update (from SaveGroups above)
+   */
+  void saveNow(unsigned group = SaveAll);
+
   /**
    * Get id for user. This is an id used locally by Licq and is persistant for
    * each user.
@@ -491,6 +501,42 @@ public:
   int GetHistory(HistoryList& history) const;
   static void ClearHistory(HistoryList& h);
 
+  /**
+   * Get number of entries in history
+   * Entries that don't produce an event (e.g. cancelled file transfers) are
+   * included so the returned lists may be shorter than requested.
+   */
+  size_t historySize() const;
+
+  /**
+   * Get the last entries from history
+   *
+   * @param history List to put events in, free with ClearHistory()
+   * @param count Number of entries to get
+   * @return True if history was read
+   */
+  bool getHistoryLast(HistoryList& history, size_t count) const;
+
+  /**
+   * Get a range of entries from history
+   *
+   * @param history List to put events in, free with ClearHistory()
+   * @param first Index of first entry to get, zero is the oldest
+   * @param count Number of entries to get
+   * @return True if history was read
+   */
+  bool getHistoryRange(HistoryList& history, size_t first, size_t count) const;
+
+  /**
+   * Get entries from history in a time window
+   *
+   * @param history List to put events in, free with ClearHistory()
+   * @param from Start of time window
+   * @param to End of time window (inclusive)
+   * @return True if history was read
+   */
+  bool getHistoryTime(HistoryList& history, time_t from, time_t to) const;
+
   /**
    * Get user groups this user is member of
    *
@@ -742,7 +788,7 @@ protected:
   static pthread_mutex_t mutex_nNumUserEvents;
 
   friend class LicqIcq::IcqProtocol;
-  friend void* LicqIcq::MonitorSockets_func();
+  friend class LicqIcq::SocketMonitor;
   friend class LicqMsn::CMSN;
   friend class LicqJabber::Plugin;
 
@@ -28,9 +28,10 @@
 namespace LicqIcq
 {
 class COscarService;
+class EventList;
 class IcqProtocol;
+class ServerSendQueue;
 void* ProcessRunningEvent_Client_tep(void* p);
-void* ProcessRunningEvent_Server_tep(void* p);
 void* OscarServiceSendQueue_tep(void* p);
 }
 
@@ -315,9 +316,10 @@ protected:
   unsigned long  m_nEventId;
 
   friend class LicqIcq::COscarService;
+  friend class LicqIcq::EventList;
   friend class LicqIcq::IcqProtocol;
+  friend class LicqIcq::ServerSendQueue;
   friend void* LicqIcq::ProcessRunningEvent_Client_tep(void* p);
-  friend void* LicqIcq::ProcessRunningEvent_Server_tep(void* p);
   friend void* LicqIcq::OscarServiceSendQueue_tep(void* p);
   friend class LicqMsn::CMSN;
   friend class LicqJabber::Plugin;
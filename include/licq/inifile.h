@@ -20,18 +20,25 @@
 #ifndef LICQ_INIFILE_H
 #define LICQ_INIFILE_H
 
+#include "macro.h"
+
 #include <ctime>
 #include <list>
 #include <string>
 #include <boost/any.hpp>
+#include <boost/noncopyable.hpp>
 
 namespace Licq
 {
 
 /**
  * This class provides access to ini style configuration files
+ *
+ * The configuration is kept parsed with an index of sections and of the keys
+ * in each section so lookups don't depend on the size of the file. Order of
+ * lines and any comments are kept when the configuration is written back.
  */
-class IniFile
+class IniFile : private boost::noncopyable
 {
 public:
   /**
@@ -287,9 +294,8 @@ public:
   bool unset(const std::string& key);
 
 private:
-  std::string myConfigData;
-  std::string::size_type mySectionStart;
-  std::string::size_type mySectionEnd;
+  LICQ_DECLARE_PRIVATE();
+
   std::string myFilename;
   bool myIsModified;
   time_t myLastTimestamp;
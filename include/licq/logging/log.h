@@ -96,8 +96,10 @@ public:
     /// Automatic conversion to std::ostream
     operator std::ostream&();
 
+    /// Append to message, does nothing if the level isn't logged
     template<typename T>
-    Stream& operator<<(const T& msg) { *myStream << msg; return *this; }
+    Stream& operator<<(const T& msg)
+    { if (myEnabled) *myStream << msg; return *this; }
 
   private:
     Stream(Log* log, Level level, const uint8_t* data, size_t size);
@@ -106,11 +108,25 @@ public:
     Level myLevel;
     const uint8_t* myData;
     size_t mySize;
+    bool myEnabled;
     std::ostringstream* myStream;
   };
 
 protected:
   virtual ~Log() { /* Empty */ }
+
+public:
+  /**
+   * Check if messages at a level will be logged by anyone
+   *
+   * The printf style and stream variants check this before formatting the
+   * message so disabled levels are cheap to use.
+   * Declared last so the existing virtual functions keep their vtable slots.
+   *
+   * @param level Level to check
+   * @return True if messages at level are logged
+   */
+  virtual bool isLogging(Level level) const = 0;
 };
 
 inline void Log::unknown(const char* format, ...)
@@ -165,10 +181,11 @@ inline void Log::packet(Level level, const uint8_t* data, size_t size,
 class ThreadLog : public Log
 {
 private:
-  Log* getLog();
+  Log* getLog() const;
 
 public:
   // From Log
+  inline bool isLogging(Level level) const;
   inline void log(Level level, const std::string& msg);
   inline void packet(Level level, const uint8_t* data, size_t size,
                      const std::string& msg);
@@ -178,6 +195,11 @@ public:
   using Log::packet;
 };
 
+inline bool ThreadLog::isLogging(Level level) const
+{
+  return getLog()->isLogging(level);
+}
+
 inline void ThreadLog::log(Level level, const std::string& msg)
 {
   getLog()->log(level, msg);
@@ -79,10 +79,22 @@ protected:
 class MainLoop : private boost::noncopyable
 {
 public:
+  /**
+   * Mechanism used to wait for file events
+   */
+  enum Backend
+  {
+    BackendDefault,     // Best backend available on this system
+    BackendPoll,        // poll(), rebuilds the complete list on changes
+    BackendEpoll,       // epoll (Linux only), files are registered once
+  };
+
   /**
    * Constructor
+   *
+   * @param backend Backend to use, if not available poll will be used
    */
-  MainLoop();
+  MainLoop(Backend backend = BackendDefault);
 
   /**
    * Destructor
@@ -95,6 +107,13 @@ public:
    */
   void run();
 
+  /**
+   * Get backend used by this main loop
+   *
+   * @return Backend actually used, never BackendDefault
+   */
+  Backend backend() const;
+
   /**
    * Exit mainloop and let run function return
    */
@@ -118,6 +137,9 @@ public:
 
   /**
    * Start monitoring a socket
+   * While the socket has data in its send queue, it is also monitored for
+   * POLLOUT and the queue is flushed when writable. The callback only gets
+   * POLLOUT if it was requested in events.
    *
    * @param inetSocket Socket to monitor
    * @param callback Object to call socketEvent on when events occour
@@ -166,7 +188,16 @@ public:
   INetSocket* getSocketFromFd(int fd);
 
 private:
+  /**
+   * Called by a monitored socket when data is put in its empty send queue
+   *
+   * @param fd Descriptor of socket
+   */
+  void sendQueueStarted(int fd);
+
   LICQ_DECLARE_PRIVATE();
+
+  friend class INetSocket;
 };
 
 } // namespace Licq
@@ -26,9 +26,13 @@
 #include "generalplugininterface.h"
 #include "../macro.h"
 
+#include <cstddef>
+
 namespace Licq
 {
 
+class UserId;
+
 /**
  * Implements part of the GeneralPluginInterface to help make the
  * implementation of a general plugin easier.
@@ -58,12 +62,30 @@ public:
   /// Returns true if signalType is in the signal mask set by setSignalMask
   bool wantSignal(unsigned long signalType) const;
 
-  /// Queues the signal and writes PipeSignal to the pipe
+  /// Queues the signal and writes PipeSignal to the pipe if queue was empty
   void pushSignal(boost::shared_ptr<const PluginSignal> signal);
 
-  // Queues the event and writes PipeEvent to the pipe
+  /// Queues the event and writes PipeEvent to the pipe if queue was empty
   void pushEvent(boost::shared_ptr<const Event> event);
 
+  /// Returns true if signal matches the subscriptions made by the plugin
+  bool isSubscribed(const PluginSignal& signal) const;
+
+  /**
+   * Get number of signals waiting for the plugin
+   * Signals already taken from the queue by the plugin are not counted.
+   *
+   * @return Number of signals in queue
+   */
+  size_t signalQueueLength() const;
+
+  /**
+   * Get number of signals replaced by signal coalescing
+   *
+   * @return Number of waiting signals replaced by a newer signal since start
+   */
+  unsigned long mergedSignalCount() const;
+
 protected:
   GeneralPluginHelper();
 
@@ -83,11 +105,68 @@ protected:
    */
   void setSignalMask(unsigned long signalMask);
 
+  /**
+   * Only forward some sub signals of a signal type
+   *
+   * Can be called several times to add more sub signals. Signal types that
+   * have no subscribed sub signals are forwarded regardless of sub signal.
+   *
+   * @param signalType A signal type from PluginSignal::SignalType
+   * @param subSignal Sub signal to forward
+   */
+  void subscribeSubSignal(unsigned long signalType, unsigned subSignal);
+
+  /**
+   * Only forward user signals for contacts of a protocol
+   *
+   * Protocol, owner and user subscriptions only apply to
+   * PluginSignal::SignalUser. If any of them are made, a user signal is
+   * forwarded if it matches at least one of them.
+   *
+   * @param protocolId Protocol to forward user signals for
+   */
+  void subscribeProtocol(unsigned long protocolId);
+
+  /**
+   * Only forward user signals for contacts of an owner
+   *
+   * @param ownerId Owner to forward user signals for
+   */
+  void subscribeOwner(const UserId& ownerId);
+
+  /**
+   * Only forward user signals for a specific user
+   *
+   * @param userId User to forward signals for
+   */
+  void subscribeUser(const UserId& userId);
+
+  /**
+   * Remove all subscriptions
+   * All signals in the signal mask will be forwarded again.
+   */
+  void clearSubscriptions();
+
+  /**
+   * Merge user signals while they are waiting in the queue
+   *
+   * When enabled, a user signal replaces any waiting signal for the same user
+   * with the same sub type and is moved last in the queue, so the plugin
+   * always gets the newest argument. Signals for new user events are never
+   * merged. This is useful for plugins that only read
+   * current user data when getting a signal and may fall behind during
+   * update storms, like at logon.
+   *
+   * @param coalesce True to merge user signals, default is false
+   */
+  void setSignalCoalescing(bool coalesce);
+
   /**
    * Get a signal from the signal queue
    *
-   * The plugin must call this function to fetch a signal after getting
-   * notified via its pipe.
+   * PipeSignal is only written when the queue goes from empty to non-empty.
+   * After getting notified via its pipe, the plugin must call this function
+   * until it returns NULL to fetch all signals.
    *
    * @return The oldest signal on the queue, or NULL if queue is empty
    */
@@ -96,8 +175,9 @@ protected:
   /**
    * Get an event from the event queue
    *
-   * The plugin must call this function to fetch an event after getting
-   * notified via its pipe.
+   * PipeEvent is only written when the queue goes from empty to non-empty.
+   * After getting notified via its pipe, the plugin must call this function
+   * until it returns NULL to fetch all events.
    *
    * @return The oldest event on the queue, or NULL if queue is empty
    */
@@ -72,6 +72,19 @@ public:
    * event for later processing).
    */
   virtual void pushEvent(boost::shared_ptr<const Event> event) = 0;
+
+  /**
+   * Check if a signal matches the subscriptions of the plugin
+   *
+   * Only called for signals where wantSignal() returned true. Plugins that
+   * don't filter on anything besides signal type can keep the default
+   * implementation which accepts all signals.
+   *
+   * @param signal Signal to check
+   * @return True if the signal should be forwarded to the plugin
+   */
+  virtual bool isSubscribed(const PluginSignal& signal) const
+  { (void)signal; return true; }
 };
 
 } // namespace Licq
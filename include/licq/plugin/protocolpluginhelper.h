@@ -46,7 +46,7 @@ public:
   /// Writes PipeShutdown to the pipe
   void shutdown();
 
-  /// Queues the signal and writes PipeSignal to the pipe
+  /// Queues the signal and writes PipeSignal to the pipe if queue was empty
   void pushSignal(boost::shared_ptr<const ProtocolSignal> signal);
 
 protected:
@@ -65,8 +65,9 @@ protected:
    * Get a signal from the signal queue
    * Called from protocol plugin
    *
-   * The plugin must call this function to fetch a signal after getting
-   * notified via its pipe.
+   * PipeSignal is only written when the queue goes from empty to non-empty.
+   * After getting notified via its pipe, the plugin must call this function
+   * until it returns NULL to fetch all signals.
    *
    * @return The oldest signal on the queue, or NULL if queue is empty
    */
@@ -20,9 +20,11 @@
 #ifndef LICQ_SOCKET_H
 #define LICQ_SOCKET_H
 
+#include <deque>
 #include <stdint.h>
 #include <string>
 #include <sys/socket.h> // AF_UNSPEC, struct sockaddr
+#include <vector>
 
 #include "thread/mutex.h"
 #include "userid.h"
@@ -36,6 +38,7 @@
 namespace Licq
 {
 class Buffer;
+class MainLoop;
 class Proxy;
 
 
@@ -142,11 +145,47 @@ public:
    * Send one "packet"
    * Writes the contents of a buffer to the socket
    *
+   * If the send queue is enabled, data that cannot be written without
+   * blocking is queued instead. If the queue is already at its limit the
+   * packet is rejected without sending any of it, sendQueueFull() will then
+   * return true.
+   *
    * @param b Buffer with packet to send
    * @return False on any failure
    */
   virtual bool send(Buffer& b);
 
+  /**
+   * Enable queued sending
+   *
+   * With the send queue enabled, send() never blocks. Data the socket can't
+   * take right away is queued and written when the socket becomes writable.
+   * A MainLoop monitoring the socket will watch for POLLOUT while there is
+   * queued data and flush the queue without involving the callback.
+   *
+   * Data is only queued while the socket is busy so the queue should be
+   * used from the thread running the MainLoop for the socket. SSL
+   * connections don't use the queue and always block.
+   *
+   * @param highWatermark Maximum number of bytes to queue, a packet that
+   *                      would grow the queue past this is rejected. Zero
+   *                      disables the queue once it has been emptied.
+   */
+  void setSendQueueLimit(size_t highWatermark);
+
+  /**
+   * Write as much queued data as possible without blocking
+   *
+   * @return False if socket failed, true otherwise even if data remains
+   */
+  bool flushSendQueue();
+
+  /// Number of bytes waiting in the send queue
+  size_t sendQueueSize() const;
+
+  /// True if last send failed because the send queue was full
+  bool sendQueueFull() const { return myErrorType == ErrorQueueFull; }
+
   /**
    * Receive one "packet"
    * Makes a single read from the socket
@@ -158,6 +197,18 @@ public:
    */
   virtual bool receive(Buffer& b, size_t maxlength = MAX_RECV_SIZE, bool dump = true);
 
+  /**
+   * Receive data into a chain of buffers
+   * Makes a single read from the socket, filling the free space of each
+   * buffer in order. Buffers that are empty (not created) or full are
+   * skipped.
+   *
+   * @param bufs Buffers to store data in
+   * @param bytesReceived Set to total number of bytes read
+   * @return False on any failure otherwise true regardless of data length
+   */
+  virtual bool receive(const std::vector<Buffer*>& bufs, size_t& bytesReceived);
+
   void Lock();
   void Unlock();
 
@@ -213,11 +264,24 @@ protected:
     ErrorErrno          = 1,
     ErrorInternal       = 2,
     ErrorProxy          = 3,
+    ErrorQueueFull      = 4,
   };
 
   bool SetLocalAddress(bool bIp = true);
   void DumpPacket(Buffer* b, bool isReceiver);
 
+  /// Send or queue data without blocking, send queue mutex must be held
+  bool queueSend(const char* data, size_t size);
+
+  /// Write queued data until socket would block, send queue mutex must be held
+  bool writeSendQueue();
+
+  /// Drop all queued data, send queue mutex must be held
+  void clearSendQueue();
+
+  /// Tell MainLoop that queue has got data, send queue mutex must be held
+  void sendQueueStarted();
+
   // sockaddr is too small to hold a sockaddr_in6 so use union to allocate the extra space
   union
   {
@@ -238,6 +302,25 @@ protected:
   Proxy* myProxy;
   UserId myUserId;
   Mutex myMutex;
+
+  std::deque<std::string> mySendQueue;
+  size_t mySendQueueSize;
+  size_t mySendQueueOffset;
+  size_t mySendQueueLimit;
+  mutable Mutex mySendMutex;
+
+private:
+  /// Set MainLoop to tell when send queue gets data, NULL for none
+  void setMainLoop(MainLoop* mainLoop);
+
+  // Descriptor when added to SocketManager, guarded by the SocketManager
+  int myManagerFd;
+
+  // MainLoop monitoring the socket, guarded by mySendMutex
+  MainLoop* myMainLoop;
+
+  friend class MainLoop;
+  friend class SocketManager;
 };
 
 
@@ -257,6 +340,9 @@ public:
   /// Overloaded to add SSL support
   bool receive(Buffer& b, size_t maxlength = MAX_RECV_SIZE, bool dump = true);
 
+  /// Overloaded to add SSL support
+  bool receive(const std::vector<Buffer*>& bufs, size_t& bytesReceived);
+
   bool Secure() { return m_p_SSL != NULL; }
   bool SSL_Pending();
 
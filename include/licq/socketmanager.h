@@ -22,33 +22,16 @@
 
 #include <vector>
 #include <list>
+#include <map>
 #include <sys/select.h> // fd_set
 
+#include "thread/condition.h"
 #include "thread/mutex.h"
-#include "thread/readwritemutex.h"
 
 namespace Licq
 {
 class INetSocket;
 
-class SocketHashTable
-{
-public:
-  SocketHashTable(unsigned short _nSize);
-  ~SocketHashTable();
-
-  INetSocket *Retrieve(int _nSd);
-  void Store(INetSocket *s, int _nSd);
-  void Remove(int _nSd);
-
-protected:
-  unsigned short HashValue(int _nSd);
-  std::vector < std::list<INetSocket *> > m_vlTable;
-
-  ReadWriteMutex myMutex;
-};
-
-
 class SocketSet
 {
 friend class SocketManager;
@@ -57,13 +40,34 @@ public:
   SocketSet();
   ~SocketSet();
 
+  typedef std::map<int, unsigned long> SerialMap;
+
   unsigned short Num();
   int Largest();
+
+  /**
+   * Get set as an fd_set
+   * Note: Descriptors larger than FD_SETSIZE are not included
+   */
   fd_set socketSet();
 
+  /**
+   * Get all descriptors in the set
+   *
+   * @return Map from descriptor to a serial that is unique each time a
+   *         descriptor is added, to detect when a descriptor has been reused
+   */
+  SerialMap serials();
+
+  /// Counter that is increased each time the set changes
+  unsigned long changeCount();
+
 protected:
   fd_set sFd;
   std::list<int> lFd;
+  SerialMap mySerials;
+  unsigned long myNextSerial;
+  unsigned long myChangeCount;
   void Set(int _nSD);
   void Clear(int _nSD);
 
@@ -71,25 +75,97 @@ protected:
 };
 
 
+/**
+ * Registry of open sockets, indexed by descriptor
+ *
+ * Sockets are stored in slots indexed by descriptor. Slots are allocated in
+ * pages that are never freed while the manager exists, so FetchSocket() and
+ * DropSocket() can use them without taking any lock besides the lock of the
+ * socket itself.
+ *
+ * Each slot has a count of threads that have fetched its socket. A fetcher
+ * increases the count before reading the socket pointer, and CloseSocket()
+ * clears the pointer before waiting for the count to reach zero. Once it
+ * has, no thread can have the socket and it can be closed and deleted.
+ */
 class SocketManager
 {
 public:
   SocketManager();
   virtual ~SocketManager();
 
+  /**
+   * Get a socket and lock it
+   *
+   * @param _nSd Socket descriptor
+   * @return Locked socket or NULL if not found, must be released with
+   *         DropSocket()
+   */
   INetSocket* FetchSocket(int _nSd);
+
+  /**
+   * Unlock a socket returned by FetchSocket() or AddSocket()
+   *
+   * @param s Socket to release, may be NULL
+   */
   void DropSocket(INetSocket *s);
-  void AddSocket(INetSocket *s);
+
+  /**
+   * Add a socket
+   * The socket is returned locked and must be released with DropSocket()
+   *
+   * @param s Connected socket to add
+   * @return True if socket was added, false if descriptor is too large to
+   *         be managed in which case the socket is not locked
+   */
+  bool AddSocket(INetSocket *s);
+
+  /**
+   * Remove a socket and close it
+   * Caller must not have the socket fetched.
+   *
+   * @param nSd Socket descriptor
+   * @param bClearUser True to clear socket from the user it belongs to
+   * @param bDelete True to delete the socket object
+   */
   void CloseSocket (int nSd, bool bClearUser = true, bool bDelete = true);
 
   fd_set socketSet()   { return m_sSockets.socketSet(); }
   int LargestSocket()  { return m_sSockets.Largest(); }
   unsigned short Num() { return m_sSockets.Num(); }
+  SocketSet::SerialMap socketSerials() { return m_sSockets.serials(); }
+  unsigned long changeCount() { return m_sSockets.changeCount(); }
 
 protected:
+  static const int SlotsPerPage = 256;
+  static const int MaxPages = 4096;
+
+  struct Slot
+  {
+    INetSocket* volatile socket;
+    // Number of threads that have fetched the socket in this slot
+    volatile int refs;
+    // Set when CloseSocket() waits for refs to reach zero
+    volatile bool closing;
+  };
+
+  /**
+   * Get slot for a descriptor
+   *
+   * @param sd Socket descriptor
+   * @param create True to allocate the page for the slot if missing
+   * @return Slot or NULL if descriptor is out of range or page is missing
+   */
+  Slot* slot(int sd, bool create = false);
+
   SocketSet m_sSockets;
-  SocketHashTable m_hSockets;
+
+  // Pages are only allocated (with myMutex held) and freed by destructor
+  Slot* volatile myPages[MaxPages];
+
+  // Used by CloseSocket() to wait for fetchers to drop the socket
   Mutex myMutex;
+  Condition myReleased;
 };
 
 } // namespace Licq
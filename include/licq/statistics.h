@@ -39,9 +39,10 @@ public:
     EventsReceivedCounter = 1,
     EventsRejectedCounter = 2,
     AutoResponseCheckedCounter = 3,
+    EventsDroppedCounter = 4,
   };
 
-  static const int NumCounters = 4;
+  static const int NumCounters = 5;
 
   /**
    * Get value of a statistics counter
@@ -27,12 +27,24 @@
 #ifndef LICQ_TRANSLATOR_H
 #define LICQ_TRANSLATOR_H
 
+#include "macro.h"
+
+#include <boost/noncopyable.hpp>
 #include <string>
 
 namespace Licq
 {
 
-class Translator
+/**
+ * Conversion of strings between encodings
+ *
+ * Opened iconv descriptors are kept in a pool for each pair of encodings and
+ * reused by later conversions. Strings that only contain ASCII characters
+ * are returned as is when both encodings are known to be ASCII compatible.
+ *
+ * All functions are thread safe.
+ */
+class Translator : private boost::noncopyable
 {
 public:
   Translator();
@@ -40,6 +52,14 @@ public:
 
   bool isAscii(const std::string& s);
 
+  /**
+   * Check if a string is valid UTF-8
+   *
+   * @param s String to check
+   * @return True if s is valid UTF-8
+   */
+  bool isUtf8(const std::string& s);
+
   std::string fromUnicode(const std::string& s, const std::string& toEncoding = "");
   std::string toUnicode(const std::string& s, const std::string& fromEncoding = "");
   std::string fromUtf16(const std::string& s, const std::string& toEncoding);
@@ -53,11 +73,28 @@ public:
    */
   std::string returnToDos(const std::string& s);
 
+  /**
+   * Converts a unix style string (LF) to dos style (LFCR)
+   *
+   * @param s String to convert
+   * @param out String to write result to, existing contents are replaced
+   *            but allocated memory is reused
+   */
+  void returnToDos(const std::string& s, std::string& out);
+
   /**
    * Converts a dos (CRLF) or mac style (CR) style string to unix style (LF)
    */
   std::string returnToUnix(const std::string& s);
 
+  /**
+   * Converts a dos (CRLF) or mac style (CR) style string to unix style (LF)
+   * The string is only modified if it contains any CR.
+   *
+   * @param s String to convert in place
+   */
+  void returnToUnixInPlace(std::string& s);
+
   bool utf16to8(unsigned long c, std::string &s);
 
 protected:
@@ -65,6 +102,9 @@ protected:
 
   std::string iconvConvert(const std::string& s, const std::string& to,
       const std::string& from, bool& ok);
+
+private:
+  LICQ_DECLARE_PRIVATE();
 };
 
 extern Translator gTranslator;
@@ -42,6 +42,10 @@ int AosdPlugin::run()
       Licq::PluginSignal::SignalUser |
       Licq::PluginSignal::SignalLogon |
       Licq::PluginSignal::SignalLogoff);
+  subscribeSubSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserStatus);
+  subscribeSubSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserEvents);
   bool finita = false;
 
   Iface* iface = new Iface();
@@ -54,14 +58,14 @@ int AosdPlugin::run()
     switch (msg)
     {
       case PipeSignal:
-        if (!myBlocked)
-          iface->processSignal(popSignal().get());
-        else
-          popSignal();
+        while (boost::shared_ptr<const Licq::PluginSignal> sig = popSignal())
+          if (!myBlocked)
+            iface->processSignal(sig.get());
         break;
 
       case PipeEvent:
-        popEvent();
+        while (popEvent())
+          ;
         break;
 
       case PipeShutdown:
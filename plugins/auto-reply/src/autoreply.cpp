@@ -109,9 +109,11 @@ bool CLicqAutoReply::init(int argc, char** argv)
  *-------------------------------------------------------------------------*/
 int CLicqAutoReply::run()
 {
-  // Register with the daemon, we only want the update user signal
+  // Register with the daemon, we only want signals for new user events
   m_nPipe = getReadPipe();
   setSignalMask(Licq::PluginSignal::SignalUser);
+  subscribeSubSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserEvents);
 
   Licq::IniFile conf("licq_autoreply.conf");
   conf.loadFile();
@@ -185,18 +187,16 @@ void CLicqAutoReply::ProcessPipe()
   switch (buf[0])
   {
     case PipeSignal:
-      if (myIsEnabled)
-        ProcessSignal(popSignal().get());
-      else
-        popSignal();
+      while (boost::shared_ptr<const Licq::PluginSignal> s = popSignal())
+        if (myIsEnabled)
+          ProcessSignal(s.get());
       break;
 
     case PipeEvent:
       // An event is pending (should never happen)
-      if (myIsEnabled)
-        ProcessEvent(popEvent().get());
-      else
-        popEvent();
+      while (boost::shared_ptr<const Licq::Event> e = popEvent())
+        if (myIsEnabled)
+          ProcessEvent(e.get());
       break;
 
     case PipeShutdown:
@@ -104,9 +104,11 @@ bool CLicqForwarder::init(int argc, char** argv)
  *-------------------------------------------------------------------------*/
 int CLicqForwarder::run()
 {
-  // Register with the daemon, we only want the update user signal
+  // Register with the daemon, we only want signals for new user events
   m_nPipe = getReadPipe();
   setSignalMask(Licq::PluginSignal::SignalUser);
+  subscribeSubSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserEvents);
 
   // Create our smtp information
   m_nSMTPPort = 25; //getservicebyname("smtp");
@@ -218,18 +220,16 @@ void CLicqForwarder::ProcessPipe()
   switch (buf[0])
   {
     case PipeSignal:
-      if (myIsEnabled)
-        ProcessSignal(popSignal().get());
-      else
-        popSignal();
+      while (boost::shared_ptr<const Licq::PluginSignal> s = popSignal())
+        if (myIsEnabled)
+          ProcessSignal(s.get());
       break;
 
     case PipeEvent:
       // An event is pending (should never happen)
-      if (myIsEnabled)
-        ProcessEvent(popEvent().get());
-      else
-        popEvent();
+      while (boost::shared_ptr<const Licq::Event> e = popEvent())
+        if (myIsEnabled)
+          ProcessEvent(e.get());
       break;
 
     case PipeShutdown:
@@ -735,7 +735,11 @@ bool ChatManager::StartChatServer()
   }
 
   // Add the server to the sock manager
-  sockman.AddSocket(&chatServer);
+  if (!sockman.AddSocket(&chatServer))
+  {
+    chatServer.CloseConnection();
+    return false;
+  }
   sockman.DropSocket(&chatServer);
 
   return true;
@@ -882,7 +886,11 @@ bool ChatManager::SendChatHandshake(ChatUser* u)
 
   u->state = CHAT_STATE_WAITxFORxCOLORxFONT;
 
-  sockman.AddSocket(&u->sock);
+  if (!sockman.AddSocket(&u->sock))
+  {
+    u->sock.CloseConnection();
+    return false;
+  }
   sockman.DropSocket(&u->sock);
 
   return true;
@@ -909,11 +917,17 @@ void ChatManager::AcceptReverseConnection(DcSocket* s)
 
   u->myUserId = s->userId();
   u->state = CHAT_STATE_WAITxFORxCOLOR;
+
+  if (!sockman.AddSocket(&u->sock))
+  {
+    delete u->m_pClient;
+    delete u;
+    return;
+  }
+  sockman.DropSocket(&u->sock);
   chatUsers.push_back(u);
 
   // Reload the socket information
-  sockman.AddSocket(&u->sock);
-  sockman.DropSocket(&u->sock);
   myThreadPipe.putChar('R');
 
   gLog.info(tr("Chat: Received reverse connection."));
@@ -2423,9 +2437,9 @@ void* LicqIcq::ChatManager_tep(void* arg)
             ChatUser* u = new ChatUser;
             u->m_pClient = new ChatClient;
 
-            if (chatman->chatServer.RecvConnection(u->sock))
+            if (chatman->chatServer.RecvConnection(u->sock) &&
+                chatman->sockman.AddSocket(&u->sock))
             {
-              chatman->sockman.AddSocket(&u->sock);
               chatman->sockman.DropSocket(&u->sock);
 
               u->state = CHAT_STATE_HANDSHAKE;
@@ -0,0 +1,168 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "eventlist.h"
+
+#include <cassert>
+
+#include <licq/event.h>
+
+using namespace LicqIcq;
+using std::make_pair;
+
+EventList::EventList()
+  : myNextSerial(0)
+{
+  // Empty
+}
+
+void EventList::push(Licq::Event* event)
+{
+  assert(event != NULL);
+  assert(myEvents.count(event) == 0);
+
+  Entry entry;
+  entry.event = event;
+  entry.serial = myNextSerial++;
+  entry.sequence = event->Sequence();
+  entry.subSequence = event->SubSequence();
+  entry.tag = event->EventId();
+
+  EntryList::iterator i = myEntries.insert(myEntries.end(), entry);
+  myEvents.insert(make_pair(event, i));
+  addKeys(i);
+}
+
+bool EventList::remove(const Licq::Event* event)
+{
+  EventMap::iterator e = myEvents.find(event);
+  if (e == myEvents.end())
+    return false;
+
+  removeKeys(e->second);
+  myEntries.erase(e->second);
+  myEvents.erase(e);
+  return true;
+}
+
+void EventList::update(const Licq::Event* event)
+{
+  EventMap::iterator e = myEvents.find(event);
+  if (e == myEvents.end())
+    return;
+
+  EntryList::iterator i = e->second;
+  removeKeys(i);
+  i->sequence = event->Sequence();
+  i->subSequence = event->SubSequence();
+  i->tag = event->EventId();
+  addKeys(i);
+}
+
+Licq::Event* EventList::find(int socket, unsigned short sequence) const
+{
+  Index::const_iterator b = mySequences.find(sequence);
+  if (b == mySequences.end())
+    return NULL;
+
+  for (Bucket::const_iterator i = b->second.begin(); i != b->second.end(); ++i)
+  {
+    Licq::Event* e = (*i)->event;
+    if (e->CompareEvent(socket, sequence))
+      return e;
+  }
+  return NULL;
+}
+
+Licq::Event* EventList::findByTag(unsigned long tag) const
+{
+  Index::const_iterator b = myTags.find(tag);
+  if (b == myTags.end())
+    return NULL;
+  return b->second.front()->event;
+}
+
+Licq::Event* EventList::findBySubSequence(unsigned long subSequence) const
+{
+  Index::const_iterator b = mySubSequences.find(subSequence);
+  if (b == mySubSequences.end())
+    return NULL;
+  return b->second.front()->event;
+}
+
+Licq::Event* EventList::findBySocket(int socket) const
+{
+  for (EntryList::const_iterator i = myEntries.begin(); i != myEntries.end(); ++i)
+    if (i->event->m_nSocketDesc == socket)
+      return i->event;
+  return NULL;
+}
+
+std::list<Licq::Event*> EventList::events() const
+{
+  std::list<Licq::Event*> ret;
+  for (EntryList::const_iterator i = myEntries.begin(); i != myEntries.end(); ++i)
+    ret.push_back(i->event);
+  return ret;
+}
+
+void EventList::addKeys(EntryList::iterator entry)
+{
+  addKey(mySequences, entry->sequence, entry);
+  addKey(mySubSequences, entry->subSequence, entry);
+  addKey(myTags, entry->tag, entry);
+}
+
+void EventList::removeKeys(EntryList::iterator entry)
+{
+  removeKey(mySequences, entry->sequence, entry);
+  removeKey(mySubSequences, entry->subSequence, entry);
+  removeKey(myTags, entry->tag, entry);
+}
+
+void EventList::addKey(Index& index, unsigned long key,
+    EntryList::iterator entry)
+{
+  // An updated event may be older than the events already in the bucket
+  Bucket& bucket = index[key];
+  Bucket::iterator pos = bucket.end();
+  while (pos != bucket.begin() && (*(pos - 1))->serial > entry->serial)
+    --pos;
+  bucket.insert(pos, entry);
+}
+
+void EventList::removeKey(Index& index, unsigned long key,
+    EntryList::iterator entry)
+{
+  Index::iterator b = index.find(key);
+  if (b == index.end())
+    return;
+
+  Bucket& bucket = b->second;
+  for (Bucket::iterator i = bucket.begin(); i != bucket.end(); ++i)
+  {
+    if (*i == entry)
+    {
+      bucket.erase(i);
+      break;
+    }
+  }
+  if (bucket.empty())
+    index.erase(b);
+}
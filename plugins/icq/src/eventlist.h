@@ -0,0 +1,167 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQICQ_EVENTLIST_H
+#define LICQICQ_EVENTLIST_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <list>
+#include <vector>
+
+namespace Licq
+{
+class Event;
+}
+
+namespace LicqIcq
+{
+
+/**
+ * List of events waiting for a reply
+ *
+ * Events are indexed by sequence, subsequence and event tag so acks can be
+ * matched without scanning all outstanding events. Lookups return the oldest
+ * matching event, same as a scan of the events in the order they were added.
+ *
+ * Socket descriptor is not indexed as it may change while the event is in the
+ * list, it is only checked for events that match the sequence. If sequence or
+ * subsequence of an event changes, update() must be called to index the new
+ * values.
+ *
+ * This class is not thread safe, caller must hold the mutex for the list.
+ */
+class EventList : private boost::noncopyable
+{
+public:
+  EventList();
+
+  /**
+   * Add an event to the list
+   *
+   * @param event Event to add, must not already be in the list
+   */
+  void push(Licq::Event* event);
+
+  /**
+   * Remove an event from the list
+   *
+   * @param event Event to remove
+   * @return True if event was in the list
+   */
+  bool remove(const Licq::Event* event);
+
+  /**
+   * Update indexes after sequence or subsequence of an event has changed
+   *
+   * @param event Event to reindex, ignored if not in the list
+   */
+  void update(const Licq::Event* event);
+
+  /**
+   * Find an event by socket and sequence
+   *
+   * @param socket Socket descriptor event was sent on
+   * @param sequence Sequence of event
+   * @return Oldest matching event or NULL if not found
+   */
+  Licq::Event* find(int socket, unsigned short sequence) const;
+
+  /**
+   * Find an event by event tag
+   *
+   * @param tag Event tag as returned to plugins
+   * @return Oldest matching event or NULL if not found
+   */
+  Licq::Event* findByTag(unsigned long tag) const;
+
+  /**
+   * Find an event by subsequence
+   *
+   * @param subSequence Subsequence (SNAC request id) of event
+   * @return Oldest matching event or NULL if not found
+   */
+  Licq::Event* findBySubSequence(unsigned long subSequence) const;
+
+  /**
+   * Find an event by socket
+   * Socket is not indexed so this will check all events.
+   *
+   * @param socket Socket descriptor event was sent on
+   * @return Oldest matching event or NULL if not found
+   */
+  Licq::Event* findBySocket(int socket) const;
+
+  /**
+   * Get all events
+   *
+   * @return A copy of the list with events in the order they were added
+   */
+  std::list<Licq::Event*> events() const;
+
+  /// Number of events in the list
+  size_t size() const { return myEvents.size(); }
+
+  /// Check if the list is empty
+  bool empty() const { return myEntries.empty(); }
+
+private:
+  // Keys are stored with the entry so the indexes can be cleaned up even if
+  // the event has been changed since it was added
+  struct Entry
+  {
+    Licq::Event* event;
+    unsigned long serial;
+    unsigned short sequence;
+    unsigned short subSequence;
+    unsigned long tag;
+  };
+
+  // Events are numbered when added to keep lookups in insertion order
+  typedef std::list<Entry> EntryList;
+  typedef boost::unordered_map<const Licq::Event*, EntryList::iterator> EventMap;
+
+  // Entries with the same key, oldest first. Keys are rarely shared so a
+  // bucket is usually a single entry.
+  typedef std::vector<EntryList::iterator> Bucket;
+  typedef boost::unordered_map<unsigned long, Bucket> Index;
+
+  /// Add entry to all indexes
+  void addKeys(EntryList::iterator entry);
+
+  /// Remove entry from all indexes
+  void removeKeys(EntryList::iterator entry);
+
+  /// Add entry to an index
+  static void addKey(Index& index, unsigned long key, EntryList::iterator entry);
+
+  /// Remove entry from an index
+  static void removeKey(Index& index, unsigned long key, EntryList::iterator entry);
+
+  EntryList myEntries;
+  EventMap myEvents;
+  Index mySequences;
+  Index mySubSequences;
+  Index myTags;
+  unsigned long myNextSerial;
+};
+
+} // namespace LicqIcq
+
+#endif
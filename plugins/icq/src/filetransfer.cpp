@@ -242,7 +242,11 @@ bool CFileTransferManager::StartFileTransferServer()
   }
 
   // Add the server to the sock manager
-  sockman.AddSocket(&ftServer);
+  if (!sockman.AddSocket(&ftServer))
+  {
+    ftServer.CloseConnection();
+    return false;
+  }
   sockman.DropSocket(&ftServer);
 
   return true;
@@ -414,7 +418,11 @@ bool CFileTransferManager::SendFileHandshake()
 
   m_nState = FT_STATE_WAITxFORxSERVERxINIT;
 
-  sockman.AddSocket(&mySock);
+  if (!sockman.AddSocket(&mySock))
+  {
+    mySock.CloseConnection();
+    return false;
+  }
   sockman.DropSocket(&mySock);
 
   return true;
@@ -431,7 +439,11 @@ void CFileTransferManager::AcceptReverseConnection(Licq::TCPSocket* s)
   }
 
   mySock.TransferConnectionFrom(*s);
-  sockman.AddSocket(&mySock);
+  if (!sockman.AddSocket(&mySock))
+  {
+    mySock.CloseConnection();
+    return;
+  }
   sockman.DropSocket(&mySock);
 
   m_nState = FT_STATE_WAITxFORxCLIENTxINIT;
@@ -1200,11 +1212,15 @@ void* LicqIcq::FileTransferManager_tep(void* arg)
           {
             if (ftman->ftServer.RecvConnection(ftman->mySock))
             {
-              ftman->sockman.AddSocket(&ftman->mySock);
-              ftman->sockman.DropSocket(&ftman->mySock);
-
-              ftman->m_nState = FT_STATE_HANDSHAKE;
-              gLog.info(tr("File Transfer: Received connection."));
+              if (ftman->sockman.AddSocket(&ftman->mySock))
+              {
+                ftman->sockman.DropSocket(&ftman->mySock);
+
+                ftman->m_nState = FT_STATE_HANDSHAKE;
+                gLog.info(tr("File Transfer: Received connection."));
+              }
+              else
+                ftman->mySock.CloseConnection();
             }
             else
             {
@@ -1306,7 +1306,7 @@ Licq::Event* IcqProtocol::icqSendThroughServer(pthread_t caller, unsigned long e
   e->myCommand = eventCommandFromPacket(p);
   e->m_NoAck = true;
 
-  result = SendExpectEvent(e, &ProcessRunningEvent_Server_tep);
+  result = queueExpectEvent_Server(e);
   return result;
 }
 
@@ -1445,7 +1445,12 @@ void IcqProtocol::logon(const Licq::UserId& ownerId, unsigned logonStatus)
       gLog.error(tr("Unable to allocate TCP port for local server (No ports available)!"));
       return;
     }
-    gSocketManager.AddSocket(s);
+    if (!gSocketManager.AddSocket(s))
+    {
+      delete s;
+      m_nTCPSocketDesc = -1;
+      return;
+    }
     {
       OwnerWriteGuard o(ownerId);
       o->SetIntIp(s->getLocalIpInt());
@@ -1537,22 +1542,18 @@ void IcqProtocol::icqLogoff()
   m_bLoggingOn = false;
 
   gLog.info(tr("Logging off."));
-  Licq::Event* cancelledEvent = NULL;
 
   if (nSD != -1)
   {
     CPU_Logoff p;
-    cancelledEvent = new Licq::Event(nSD, &p, Licq::Event::ConnectServer);
-    cancelledEvent->m_pPacket = NULL;
-    cancelledEvent->m_bCancelled = true;
     SendEvent(nSD, p, true);
     gSocketManager.CloseSocket(nSD);
   }
 
-  postLogoff(nSD, cancelledEvent);
+  postLogoff(nSD);
 }
 
-void IcqProtocol::postLogoff(int nSD, Licq::Event* cancelledEvent)
+void IcqProtocol::postLogoff(int nSD)
 {
   if (m_xBARTService)
   {
@@ -1565,62 +1566,40 @@ void IcqProtocol::postLogoff(int nSD, Licq::Event* cancelledEvent)
     }
   }
   pthread_mutex_lock(&mutex_runningevents);
-  pthread_mutex_lock(&mutex_sendqueue_server);
   pthread_mutex_lock(&mutex_extendedevents);
   pthread_mutex_lock(&mutex_cancelthread);
   pthread_mutex_lock(&mutex_reverseconnect);
   std::list<Licq::Event*>::iterator iter;
 
   // Cancel all events
-  // Necessary since the end is always being modified
-  unsigned long i = m_lxSendQueue_Server.size();
-  for (iter = m_lxSendQueue_Server.begin(); i > 0; i--)
-  {
-    Licq::Event* e = *iter;
-    gLog.info(tr("Event #%hu is still on the server queue!"), e->Sequence());
-    iter = m_lxSendQueue_Server.erase(iter);
-    Licq::Event* cancelled = new Licq::Event(e);
-    cancelled->m_bCancelled = true;
-    m_lxSendQueue_Server.push_back(cancelled);
-  }
+  mySendQueue.clear();
+  myRateLimiter.clear();
 
-  iter = m_lxRunningEvents.begin();
-  while (iter != m_lxRunningEvents.end())
+  std::list<Licq::Event*> events = m_lxRunningEvents.events();
+  for (iter = events.begin(); iter != events.end(); ++iter)
   {
     CSrvPacketTcp* srvPacket = dynamic_cast<CSrvPacketTcp*>((*iter)->m_pPacket);
     if ((*iter)->m_nSocketDesc == nSD || (srvPacket != NULL && srvPacket->icqChannel() == ICQ_CHNxNEW))
     {
       Licq::Event* e = *iter;
       gLog.info(tr("Event #%hu is still on the running queue!"), e->Sequence());
-      iter = m_lxRunningEvents.erase(iter);
+      m_lxRunningEvents.remove(e);
       if (e->thread_running && !pthread_equal(e->thread_send, pthread_self()))
       {
         pthread_cancel(e->thread_send);
         e->thread_running = false;
       }
-      std::list<Licq::Event*>::iterator i;
-      for (i = m_lxExtendedEvents.begin(); i != m_lxExtendedEvents.end(); ++i)
-      {
-        if (*i == e)
-        {
-          m_lxExtendedEvents.erase(i);
-          break;
-        }
-      }
+      m_lxExtendedEvents.remove(e);
       CancelEvent(e);
     }
-    else
-      ++iter;
   }
   assert(m_lxExtendedEvents.empty());
 
   // Queue should be empty, might not be due to peer-to-peer events
-  for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
+  events = m_lxRunningEvents.events();
+  for (iter = events.begin(); iter != events.end(); ++iter)
     gLog.info(tr("Event #%hu is still on queue!\n"), (*iter)->Sequence());
 
-  if (cancelledEvent != NULL)
-    m_lxSendQueue_Server.push_back(cancelledEvent);
-
   std::list<CReverseConnectToUserData *>::iterator rciter;
   for (rciter = m_lReverseConnect.begin(); rciter != m_lReverseConnect.end();
                                            ++rciter)
@@ -1632,7 +1611,6 @@ void IcqProtocol::postLogoff(int nSD, Licq::Event* cancelledEvent)
   pthread_mutex_unlock(&mutex_reverseconnect);    
   pthread_mutex_unlock(&mutex_cancelthread);
   pthread_mutex_unlock(&mutex_extendedevents);
-  pthread_mutex_unlock(&mutex_sendqueue_server);
   pthread_mutex_unlock(&mutex_runningevents);
 
   // All extended event are a pointer that are also in the running events.
@@ -1753,9 +1731,16 @@ int IcqProtocol::ConnectToServer(const string& server, unsigned short port)
         o->SetIntIp(s->getLocalIpInt());
     }
 
-    gSocketManager.AddSocket(s);
-    nSocket = m_nTCPSrvSocketDesc = s->Descriptor();
-    gSocketManager.DropSocket(s);
+    if (gSocketManager.AddSocket(s))
+    {
+      nSocket = m_nTCPSrvSocketDesc = s->Descriptor();
+      gSocketManager.DropSocket(s);
+    }
+    else
+    {
+      delete s;
+      nSocket = -1;
+    }
   }
 
   pthread_mutex_unlock(&connect_mutex);
@@ -2000,7 +1985,18 @@ void IcqProtocol::ProcessServiceFam(Buffer& packet, unsigned short nSubtype)
     case ICQ_SNACxSUB_RATE_INFO:
     {
       gLog.info(tr("Server sent us rate information."));
-      CSrvPacketTcp *p = new CPU_RateAck();
+      CSrvPacketTcp* p;
+      if (myRateLimiter.parseRateInfo(packet))
+      {
+        p = new CPU_RateAck(myRateLimiter.classIds());
+      }
+      else
+      {
+        gLog.warning(tr("Invalid rate information from server, "
+            "sending without rate limiting."));
+        myRateLimiter.clear();
+        p = new CPU_RateAck();
+      }
       SendEvent_Server(p);
 
       gLog.info(tr("Setting ICQ Instant Messaging Mode."));
@@ -2076,8 +2072,19 @@ void IcqProtocol::ProcessServiceFam(Buffer& packet, unsigned short nSubtype)
 
   case ICQ_SNACxSUB_RATE_WARNING:
   {
+    // Server sends its view of the levels, use them to correct our own
+    unsigned short code, classId;
+    if (!myRateLimiter.parseRateChange(packet, code, classId))
+      break;
+
     // TODO: Inform the user:
     // we are sending fast, if we keep it up we will be kicked off
+    if (code == 2)
+      gLog.warning(tr("Rate warning from server for class %hu (level %lu)."),
+          classId, myRateLimiter.level(classId));
+    else if (code == 3)
+      gLog.warning(tr("Rate limit reached for class %hu (level %lu)."),
+          classId, myRateLimiter.level(classId));
     break;
   }
 
@@ -4838,7 +4845,7 @@ void IcqProtocol::ProcessAuthFam(Buffer& packet, unsigned short nSubtype)
         m_eStatus = STATUS_OFFLINE_MANUAL;
         m_bLoggingOn = false; 
         gSocketManager.CloseSocket(nSD);
-        postLogoff(nSD, NULL);
+        postLogoff(nSD);
         icqRegister(passwd);
       }
       else
@@ -4897,7 +4904,7 @@ void IcqProtocol::ProcessAuthFam(Buffer& packet, unsigned short nSubtype)
       m_eStatus = STATUS_OFFLINE_MANUAL;
       m_bLoggingOn = false; 
       gSocketManager.CloseSocket(nSD);
-      postLogoff(nSD, NULL);
+      postLogoff(nSD);
       if (added)
         logon(ownerId, Licq::User::OnlineStatus);
       break;
@@ -5105,7 +5112,7 @@ bool IcqProtocol::ProcessCloseChannel(Buffer& packet)
   else {
     m_nTCPSrvSocketDesc = -1;
     gSocketManager.CloseSocket(nSD);
-    postLogoff(nSD, NULL);
+    postLogoff(nSD);
   }
 
   if (packet.getDataSize() == 0) {
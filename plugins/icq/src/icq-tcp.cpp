@@ -1028,7 +1028,14 @@ int IcqProtocol::connectToUser(const Licq::UserId& userId, int channel)
   }
 
   // Add the new socket to the socket manager
-  gSocketManager.AddSocket(s);
+  if (!gSocketManager.AddSocket(s))
+  {
+    UserWriteGuard u(userId);
+    if (u.isLocked())
+      u->clearSocketDesc(s);
+    delete s;
+    return -1;
+  }
   gSocketManager.DropSocket(s);
 
   // Alert the select thread that there is a new socket
@@ -1192,7 +1199,14 @@ int IcqProtocol::reverseConnectToUser(const Licq::UserId& userId, unsigned long
     }
 
     // Add the new socket to the socket manager, alert the thread
-    gSocketManager.AddSocket(s);
+    if (!gSocketManager.AddSocket(s))
+    {
+      UserWriteGuard u(userId);
+      if (u.isLocked())
+        u->clearSocketDesc(s);
+      delete s;
+      return -1;
+    }
     gSocketManager.DropSocket(s);
     myNewSocketPipe.putChar('S');
   }
@@ -52,6 +52,7 @@
 #include "packet-tcp.h"
 #include "protocolsignal.h"
 #include "socket.h"
+#include "socketmonitor.h"
 #include "user.h"
 
 using namespace LicqIcq;
@@ -134,7 +135,6 @@ void IcqProtocol::initialize()
   // Start up our threads
   pthread_mutex_init(&mutex_runningevents, NULL);
   pthread_mutex_init(&mutex_extendedevents, NULL);
-  pthread_mutex_init(&mutex_sendqueue_server, NULL);
   pthread_mutex_init(&mutex_modifyserverusers, NULL);
   pthread_mutex_init(&mutex_cancelthread, NULL);
   pthread_cond_init(&cond_serverack, NULL);
@@ -143,7 +143,13 @@ void IcqProtocol::initialize()
 
 bool IcqProtocol::start()
 {
-  MonitorSockets_func();
+  if (!mySendQueue.start())
+    return false;
+
+  {
+    SocketMonitor monitor;
+    monitor.run();
+  }
 
   // Cancel the ping thread
   pthread_cancel(thread_ping);
@@ -160,6 +166,8 @@ bool IcqProtocol::start()
   if (m_nTCPSocketDesc != -1)
     gSocketManager.CloseSocket(m_nTCPSocketDesc);
 
+  mySendQueue.stop();
+
   return true;
 }
 
@@ -501,19 +509,9 @@ void IcqProtocol::SendEvent_Server(CPacket *packet, const Licq::ProtocolSignal*
   else
     e = new Licq::Event(ps->callerThread(), ps->eventId(), m_nTCPSrvSocketDesc, packet, Licq::Event::ConnectServer);
   e->myCommand = eventCommandFromPacket(packet);
-
-  pthread_mutex_lock(&mutex_sendqueue_server);
-  m_lxSendQueue_Server.push_back(e);
-  pthread_mutex_unlock(&mutex_sendqueue_server);
-
   e->m_NoAck = true;
-  int nResult = pthread_create(&e->thread_send, NULL, &ProcessRunningEvent_Server_tep, e);
-  if (nResult != 0)
-  {
-    gLog.error(tr("Unable to start server event thread (#%hu): %s."),
-        e->m_nSequence, strerror(nResult));
-    e->m_eResult = Licq::Event::ResultError;
-  }
+
+  mySendQueue.push(e, true);
 #else
   SendEvent(m_nTCPSrvSocketDesc, *packet, true);
 #endif
@@ -540,25 +538,7 @@ Licq::Event* IcqProtocol::SendExpectEvent_Server(const Licq::ProtocolSignal* ps,
 
   if (bExtendedEvent) PushExtendedEvent(e);
 
-  Licq::Event *result = SendExpectEvent(e, &ProcessRunningEvent_Server_tep);
-
-  // if an error occured, remove the event from the extended queue as well
-  if (result == NULL && bExtendedEvent)
-  {
-    pthread_mutex_lock(&mutex_extendedevents);
-    std::list<Licq::Event*>::iterator i;
-    for (i = m_lxExtendedEvents.begin(); i != m_lxExtendedEvents.end(); ++i)
-    {
-      if (*i == e)
-      {
-        m_lxExtendedEvents.erase(i);
-        break;
-      }
-    }
-    pthread_mutex_unlock(&mutex_extendedevents);
-  }
-
-  return result;
+  return queueExpectEvent_Server(e);
 }
 
 Licq::Event* IcqProtocol::SendExpectEvent_Client(const Licq::ProtocolSignal* ps, const User* pUser,
@@ -591,20 +571,12 @@ Licq::Event* IcqProtocol::SendExpectEvent(Licq::Event* e, void *(*fcn)(void *))
   // don't release the mutex until thread is running so that cancelling the
   // event cancels the thread as well
   pthread_mutex_lock(&mutex_runningevents);
-  m_lxRunningEvents.push_back(e);
+  m_lxRunningEvents.push(e);
 
   assert(e);
 
-  if (fcn == ProcessRunningEvent_Server_tep)
-  {
-    pthread_mutex_lock(&mutex_sendqueue_server);
-    m_lxSendQueue_Server.push_back(e);
-    pthread_mutex_unlock(&mutex_sendqueue_server); 
-  }
-
   int nResult = pthread_create(&e->thread_send, NULL, fcn, e);
-  if (fcn != ProcessRunningEvent_Server_tep)
-    e->thread_running = true;
+  e->thread_running = true;
   pthread_mutex_unlock(&mutex_runningevents);
 
   if (nResult != 0)
@@ -612,25 +584,6 @@ Licq::Event* IcqProtocol::SendExpectEvent(Licq::Event* e, void *(*fcn)(void *))
     gLog.error(tr("Unable to start event thread (#%hu): %s."),
         e->m_nSequence, strerror(nResult));
     DoneEvent(e, Licq::Event::ResultError);
-    if (e->m_nSocketDesc == m_nTCPSrvSocketDesc)
-    {
-      pthread_mutex_lock(&mutex_sendqueue_server);
-      list<Licq::Event*>::iterator iter;
-      for (iter = m_lxSendQueue_Server.begin();
-           iter != m_lxSendQueue_Server.end(); ++iter)
-      {
-        if (e == *iter)
-        {
-          m_lxSendQueue_Server.erase(iter);
-
-          Licq::Event* cancelled = new Licq::Event(e);
-          cancelled->m_bCancelled = true;
-          m_lxSendQueue_Server.push_back(cancelled);
-          break;
-        }
-      }
-      pthread_mutex_unlock(&mutex_sendqueue_server);
-    }
     ProcessDoneEvent(e);
     return NULL;
   }
@@ -638,6 +591,20 @@ Licq::Event* IcqProtocol::SendExpectEvent(Licq::Event* e, void *(*fcn)(void *))
   return (e);
 }
 
+Licq::Event* IcqProtocol::queueExpectEvent_Server(Licq::Event* e)
+{
+  assert(e);
+
+  // Hold running events mutex so the event can't be cancelled before it has
+  // been queued
+  pthread_mutex_lock(&mutex_runningevents);
+  m_lxRunningEvents.push(e);
+  mySendQueue.push(e, false);
+  pthread_mutex_unlock(&mutex_runningevents);
+
+  return e;
+}
+
 
 //---SendEvent-----------------------------------------------------------------
 /*! \brief Sends an event without expecting a reply
@@ -679,15 +646,7 @@ void IcqProtocol::FailEvents(int sd, int err)
   {
     e = NULL;
     pthread_mutex_lock(&mutex_runningevents);
-    list<Licq::Event*>::iterator iter;
-    for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-    {
-      if ((*iter)->m_nSocketDesc == sd)
-      {
-        e = *iter;
-        break;
-      }
-    }
+    e = m_lxRunningEvents.findBySocket(sd);
     pthread_mutex_unlock(&mutex_runningevents);
     if (e != NULL && DoneEvent(e, Licq::Event::ResultError) != NULL)
     {
@@ -713,18 +672,8 @@ void IcqProtocol::FailEvents(int sd, int err)
  */
 bool IcqProtocol::hasServerEvent(unsigned long _nSubSequence) const
 {
-  bool hasEvent = false;
   pthread_mutex_lock(&mutex_runningevents);
-  list<Licq::Event*>::const_iterator iter;
-  for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-  {
-    if ((*iter)->CompareSubSequence(_nSubSequence))
-    {
-      hasEvent = true;
-      break;
-    }
-  }
-
+  bool hasEvent = (m_lxRunningEvents.findBySubSequence(_nSubSequence) != NULL);
   pthread_mutex_unlock(&mutex_runningevents);
   return hasEvent;
 }
@@ -740,25 +689,9 @@ bool IcqProtocol::hasServerEvent(unsigned long _nSubSequence) const
 Licq::Event* IcqProtocol::DoneServerEvent(unsigned long _nSubSeq, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_runningevents);
-  Licq::Event* e = NULL;
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-  {
-    if ((*iter)->CompareSubSequence(_nSubSeq) )
-    {
-      e = *iter;
-      m_lxRunningEvents.erase(iter);
-      // Check if we should cancel a processing thread
-      if (e->thread_running && !pthread_equal(e->thread_send, pthread_self()))
-      {
-        pthread_mutex_lock(&mutex_cancelthread);
-        pthread_cancel(e->thread_send);
-        pthread_mutex_unlock(&mutex_cancelthread);
-        e->thread_running = false;
-      }
-      break;
-    }
-  }
+  Licq::Event* e = m_lxRunningEvents.findBySubSequence(_nSubSeq);
+  if (e != NULL)
+    removeRunningEvent(e);
   pthread_mutex_unlock(&mutex_runningevents);
 
   // If we didn't find the event, it must have already been removed, we are too late
@@ -778,39 +711,7 @@ Licq::Event* IcqProtocol::DoneServerEvent(unsigned long _nSubSeq, Licq::Event::R
 Licq::Event* IcqProtocol::DoneEvent(Licq::Event* e, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_runningevents);
-  list<Licq::Event*>::iterator iter;
-  bool bFound = false;
-  for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-  {
-    if (e == *iter)
-    {
-      bFound = true;
-      m_lxRunningEvents.erase(iter);
-      // Check if we should cancel a processing thread
-      if (e->thread_running && !pthread_equal(e->thread_send, pthread_self()))
-      {
-        pthread_mutex_lock(&mutex_cancelthread);
-        pthread_cancel(e->thread_send);
-        pthread_mutex_unlock(&mutex_cancelthread);
-        e->thread_running = false;
-      }
-      break;
-    }
-  }
-
-#if 0
-  if (m_lxRunningEvents.size()) {
-    gLog.info(tr("doneevents: for: %p pending:"), e);
-    for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-    {
-      gLog.info(tr("%p Command: %d SubCommand: %d Sequence: %hu SubSequence: %d: Uin: %lu"), *iter,
-                (*iter)->Command(), (*iter)->SubCommand(), (*iter)->Sequence(), (*iter)->SubSequence(),
-                (*iter)->Uin());
-    }
-  }
-#endif
-
-  //bool bFound = (iter == m_lxRunningEvents.end());
+  bool bFound = removeRunningEvent(e);
   pthread_mutex_unlock(&mutex_runningevents);
 
   // If we didn't find the event, it must have already been removed, we are too late
@@ -826,7 +727,7 @@ Licq::Event* IcqProtocol::DoneEvent(Licq::Event* e, Licq::Event::ResultType _eRe
     Licq::Event* e2 = new Licq::Event(e);
     e2->m_bCancelled = true;
     e2->m_xPacket = e->m_xPacket;
-    m_lxRunningEvents.push_back(e2);
+    m_lxRunningEvents.push(e2);
     pthread_mutex_unlock(&mutex_runningevents);
   }
   else
@@ -850,25 +751,9 @@ Licq::Event* IcqProtocol::DoneEvent(Licq::Event* e, Licq::Event::ResultType _eRe
 Licq::Event* IcqProtocol::DoneEvent(int _nSD, unsigned short _nSequence, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_runningevents);
-  Licq::Event* e = NULL;
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-  {
-    if ((*iter)->CompareEvent(_nSD, _nSequence) )
-    {
-      e = *iter;
-      m_lxRunningEvents.erase(iter);
-      // Check if we should cancel a processing thread
-      if (e->thread_running && !pthread_equal(e->thread_send, pthread_self()))
-      {
-        pthread_mutex_lock(&mutex_cancelthread);
-        pthread_cancel(e->thread_send);
-        pthread_mutex_unlock(&mutex_cancelthread);
-        e->thread_running = false;
-      }
-      break;
-    }
-  }
+  Licq::Event* e = m_lxRunningEvents.find(_nSD, _nSequence);
+  if (e != NULL)
+    removeRunningEvent(e);
   pthread_mutex_unlock(&mutex_runningevents);
 
   // If we didn't find the event, it must have already been removed, we are too late
@@ -882,25 +767,9 @@ Licq::Event* IcqProtocol::DoneEvent(int _nSD, unsigned short _nSequence, Licq::E
 Licq::Event* IcqProtocol::DoneEvent(unsigned long tag, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_runningevents);
-  Licq::Event* e = NULL;
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxRunningEvents.begin(); iter != m_lxRunningEvents.end(); ++iter)
-  {
-    if ((*iter)->Equals(tag))
-    {
-      e = *iter;
-      m_lxRunningEvents.erase(iter);
-      // Check if we should cancel a processing thread
-      if (e->thread_running && !pthread_equal(e->thread_send, pthread_self()))
-      {
-        pthread_mutex_lock(&mutex_cancelthread);
-        pthread_cancel(e->thread_send);
-        pthread_mutex_unlock(&mutex_cancelthread);
-        e->thread_running = false;
-      }
-      break;
-    }
-  }
+  Licq::Event* e = m_lxRunningEvents.findByTag(tag);
+  if (e != NULL)
+    removeRunningEvent(e);
   pthread_mutex_unlock(&mutex_runningevents);
 
   // If we didn't find the event, it must have already been removed, we are too late
@@ -911,6 +780,25 @@ Licq::Event* IcqProtocol::DoneEvent(unsigned long tag, Licq::Event::ResultType _
   return(e);
 }
 
+bool IcqProtocol::removeRunningEvent(Licq::Event* e)
+{
+  if (!m_lxRunningEvents.remove(e))
+    return false;
+
+  // Make sure the server send queue doesn't have it either
+  if (e->m_eConnect == Licq::Event::ConnectServer)
+    mySendQueue.remove(e);
+  // Check if we should cancel a processing thread
+  if (e->thread_running && !pthread_equal(e->thread_send, pthread_self()))
+  {
+    pthread_mutex_lock(&mutex_cancelthread);
+    pthread_cancel(e->thread_send);
+    pthread_mutex_unlock(&mutex_cancelthread);
+    e->thread_running = false;
+  }
+  return true;
+}
+
 
 /*------------------------------------------------------------------------------
  * ProcessDoneEvent
@@ -1061,17 +949,9 @@ void IcqProtocol::ProcessDoneEvent(Licq::Event* e)
 Licq::Event* IcqProtocol::DoneExtendedServerEvent(const unsigned short _nSubSequence, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_extendedevents);
-  Licq::Event* e = NULL;
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxExtendedEvents.begin(); iter != m_lxExtendedEvents.end(); ++iter)
-  {
-    if ((*iter)->m_nSubSequence == _nSubSequence)
-    {
-      e = *iter;
-      m_lxExtendedEvents.erase(iter);
-      break;
-    }
-  }
+  Licq::Event* e = m_lxExtendedEvents.findBySubSequence(_nSubSequence);
+  if (e != NULL)
+    m_lxExtendedEvents.remove(e);
   pthread_mutex_unlock(&mutex_extendedevents);
   if (e != NULL) e->m_eResult = _eResult;
   return(e);
@@ -1081,17 +961,9 @@ Licq::Event* IcqProtocol::DoneExtendedServerEvent(const unsigned short _nSubSequ
 Licq::Event* IcqProtocol::DoneExtendedEvent(Licq::Event* e, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_extendedevents);
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxExtendedEvents.begin(); iter != m_lxExtendedEvents.end(); ++iter)
-  {
-    if (e == (*iter))
-    {
-      m_lxExtendedEvents.erase(iter);
-      break;
-    }
-  }
+  bool found = m_lxExtendedEvents.remove(e);
   pthread_mutex_unlock(&mutex_extendedevents);
-  if (iter == m_lxExtendedEvents.end()) return NULL;
+  if (!found) return NULL;
   e->m_eResult = _eResult;
 #if 0
   // If the event was cancelled we still want to wait internally for the reply
@@ -1102,7 +974,7 @@ Licq::Event* IcqProtocol::DoneExtendedEvent(Licq::Event* e, Licq::Event::ResultT
     e2->m_bCancelled = true;
     e2->m_xPacket = e->m_xPacket;
     e->m_xPacket = NULL;
-    m_lxExtendedEvents.push_back(e2);
+    m_lxExtendedEvents.push(e2);
     pthread_mutex_unlock(&mutex_extendedevents);
   }
 #endif
@@ -1112,17 +984,9 @@ Licq::Event* IcqProtocol::DoneExtendedEvent(Licq::Event* e, Licq::Event::ResultT
 Licq::Event* IcqProtocol::DoneExtendedEvent(unsigned long tag, Licq::Event::ResultType _eResult)
 {
   pthread_mutex_lock(&mutex_extendedevents);
-  Licq::Event* e = NULL;
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxExtendedEvents.begin(); iter != m_lxExtendedEvents.end(); ++iter)
-  {
-    if ((*iter)->Equals(tag))
-    {
-      e = *iter;
-      m_lxExtendedEvents.erase(iter);
-      break;
-    }
-  }
+  Licq::Event* e = m_lxExtendedEvents.findByTag(tag);
+  if (e != NULL)
+    m_lxExtendedEvents.remove(e);
   pthread_mutex_unlock(&mutex_extendedevents);
   if (e != NULL) e->m_eResult = _eResult;
   return(e);
@@ -1132,7 +996,15 @@ void IcqProtocol::PushEvent(Licq::Event* e)
 {
   assert(e != NULL);
   pthread_mutex_lock(&mutex_runningevents);
-  m_lxRunningEvents.push_back(e);
+  m_lxRunningEvents.push(e);
+  pthread_mutex_unlock(&mutex_runningevents);
+}
+
+void IcqProtocol::attachEventPacket(Licq::Event* e, Licq::Packet* p)
+{
+  pthread_mutex_lock(&mutex_runningevents);
+  e->AttachPacket(p);
+  m_lxRunningEvents.update(e);
   pthread_mutex_unlock(&mutex_runningevents);
 }
 
@@ -1145,7 +1017,7 @@ void IcqProtocol::PushExtendedEvent(Licq::Event* e)
 {
   assert(e != NULL);
   pthread_mutex_lock(&mutex_extendedevents);
-  m_lxExtendedEvents.push_back(e);
+  m_lxExtendedEvents.push(e);
 #if 0
   gLog.info(tr("%p pushing Command: %d SubCommand: %d Sequence: %hu SubSequence: %d: Uin: %lu"), e,
             e->Command(), e->SubCommand(), e->Sequence(), e->SubSequence(), e->Uin());
@@ -1156,24 +1028,7 @@ void IcqProtocol::PushExtendedEvent(Licq::Event* e)
 //-----CICQDaemon::CancelEvent---------------------------------------------------------
 void IcqProtocol::CancelEvent(unsigned long t)
 {
-  Licq::Event* eSrv = NULL;
-  pthread_mutex_lock(&mutex_sendqueue_server);
-  list<Licq::Event*>::iterator iter;
-  for (iter = m_lxSendQueue_Server.begin();
-       iter != m_lxSendQueue_Server.end(); ++iter)
-  {
-    if ((*iter)->Equals(t))
-    {
-      eSrv = *iter;
-      m_lxSendQueue_Server.erase(iter);
-
-      Licq::Event* cancelled = new Licq::Event(eSrv);
-      cancelled->m_bCancelled = true;
-      m_lxSendQueue_Server.push_back(cancelled);
-      break;
-    }
-  }
-  pthread_mutex_unlock(&mutex_sendqueue_server);
+  Licq::Event* eSrv = mySendQueue.remove(t);
 
   Licq::Event* eRun = DoneEvent(t, Licq::Event::ResultCancelled);
   Licq::Event* eExt = DoneExtendedEvent(t, Licq::Event::ResultCancelled);
@@ -35,6 +35,9 @@
 #include <licq/userid.h>
 
 #include "buffer.h"
+#include "eventlist.h"
+#include "ratelimiter.h"
+#include "sendqueue.h"
 
 namespace Licq
 {
@@ -90,9 +93,7 @@ typedef std::map<int, std::string> GroupNameMap;
 
 void* Ping_tep(void* p);
 void* UpdateUsers_tep(void* p);
-void* MonitorSockets_func();
 void *ProcessRunningEvent_Client_tep(void *p);
-void *ProcessRunningEvent_Server_tep(void *p);
 void *ReverseConnectToUser_tep(void *p);
 
 struct PluginList
@@ -230,7 +231,7 @@ public:
   void icqRequestMetaInfo(const Licq::UserId& userId, const Licq::ProtocolSignal* ps = NULL);
   unsigned long setStatus(unsigned newStatus);
   void icqLogoff();
-  void postLogoff(int nSD, Licq::Event* cancelledEvent);
+  void postLogoff(int nSD);
   void icqRelogon();
   void icqAddUser(const Licq::UserId& userId, bool _bAuthReq = false);
   void icqAddUserServer(const Licq::UserId& userId, bool _bAuthReq, unsigned short groupId = 0);
@@ -282,6 +283,15 @@ public:
   Licq::Event* DoneExtendedEvent(Licq::Event*, Licq::Event::ResultType);
   Licq::Event* DoneExtendedEvent(unsigned long tag, Licq::Event::ResultType _eResult);
 
+  /**
+   * Remove an event from the running events and stop its send thread
+   * Caller must hold mutex_runningevents.
+   *
+   * @param e Event to remove
+   * @return True if event was in the running events
+   */
+  bool removeRunningEvent(Licq::Event* e);
+
   bool processPluginMessage(Licq::Buffer& packet, User* user, int channel,
      bool bIsAck, unsigned long nMsgID1,
      unsigned long nMsgID2, unsigned short nSequence,
@@ -336,6 +346,16 @@ public:
   void PushEvent(Licq::Event*);
   void PushExtendedEvent(Licq::Event*);
 
+  /**
+   * Attach a packet to an event that may be in the running events
+   * Running events are indexed by sequence so they must be updated when the
+   * packet is attached.
+   *
+   * @param e Event to attach packet to
+   * @param p Packet to attach
+   */
+  void attachEventPacket(Licq::Event* e, Licq::Packet* p);
+
   bool UseServerContactList() const;
 
   EDaemonStatus Status() const                  { return m_eStatus; }
@@ -392,6 +412,14 @@ private:
       const User* user, CPacketTcp* packet, Licq::UserEvent* ue);
 
   Licq::Event* SendExpectEvent(Licq::Event*, void *(*fcn)(void *));
+
+  /**
+   * Add an event to the running events and queue it for the server
+   *
+   * @param e Event to send
+   * @return The event
+   */
+  Licq::Event* queueExpectEvent_Server(Licq::Event* e);
   unsigned eventCommandFromPacket(Licq::Packet* p);
 
   void AckTCP(CPacketTcp &, int);
@@ -500,12 +528,12 @@ private:
 
   ContactUserList receivedUserList;
 
-  std::list<Licq::Event*> m_lxRunningEvents;
+  EventList m_lxRunningEvents;
   mutable pthread_mutex_t mutex_runningevents;
-  std::list<Licq::Event*> m_lxExtendedEvents;
+  EventList m_lxExtendedEvents;
   pthread_mutex_t mutex_extendedevents;
-  std::list<Licq::Event*> m_lxSendQueue_Server;
-  pthread_mutex_t mutex_sendqueue_server;
+  ServerSendQueue mySendQueue;
+  RateLimiter myRateLimiter;
   std::map <unsigned long, std::string> m_lszModifyServerUsers;
   pthread_mutex_t mutex_modifyserverusers;
   pthread_mutex_t mutex_cancelthread;
@@ -519,13 +547,13 @@ private:
 
   friend void *Ping_tep(void *p);
   friend void *UpdateUsers_tep(void *p);
-  friend void *MonitorSockets_func();
   friend void *ProcessRunningEvent_Client_tep(void *p);
-  friend void *ProcessRunningEvent_Server_tep(void *p);
   friend void* ReverseConnectToUser_tep(void* v);
   friend class COscarService;
   friend class ChatManager;
   friend class FileTransferManager;
+  friend class ServerSendQueue;
+  friend class SocketMonitor;
 };
 
 extern IcqProtocol gIcqProtocol;
@@ -77,7 +77,8 @@ void IcqProtocolPlugin::processPipe()
   switch (c)
   {
     case PipeSignal:
-      gIcqProtocol.processSignal(popSignal().get());
+      while (boost::shared_ptr<const Licq::ProtocolSignal> s = popSignal())
+        gIcqProtocol.processSignal(s.get());
       break;
     case PipeShutdown:
       gIcqProtocol.shutdown();
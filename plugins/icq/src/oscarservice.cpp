@@ -174,7 +174,7 @@ bool COscarService::SendBARTFam(Licq::Event* e)
         gLog.info(tr("Requesting buddy icon for %s (#%hu/#%d)..."),
             u->getAlias().c_str(), p->Sequence(), p->SubSequence());
       }
-      e->AttachPacket(p);
+      gIcqProtocol.attachEventPacket(e, p);
       return (SendPacket(p));
     }
     
@@ -466,8 +466,13 @@ bool COscarService::Initialize()
     ChangeStatus(STATUS_UNINITIALIZED);
     return false;
   }
+  if (!gSocketManager.AddSocket(s))
+  {
+    delete s;
+    ChangeStatus(STATUS_UNINITIALIZED);
+    return false;
+  }
   mySocketDesc = s->Descriptor();
-  gSocketManager.AddSocket(s);
   gSocketManager.DropSocket(s);
   // Alert the select thread that there is a new socket
   gIcqProtocol.myNewSocketPipe.putChar('S');
@@ -808,6 +808,17 @@ CPU_RateAck::CPU_RateAck(unsigned short nService)
   buffer->PackUnsignedShortBE(0x0005);
 }
 
+CPU_RateAck::CPU_RateAck(const std::vector<unsigned short>& classes)
+  : CPU_CommonFamily(ICQ_SNACxFAM_SERVICE, ICQ_SNACxSND_RATE_ACK)
+{
+  m_nSize += classes.size() * 2;
+
+  InitBuffer();
+
+  for (size_t i = 0; i < classes.size(); ++i)
+    buffer->PackUnsignedShortBE(classes[i]);
+}
+
 //-----UINSettings-----------------------------------------------------------
 CPU_CapabilitySettings::CPU_CapabilitySettings()
   : CPU_CommonFamily(ICQ_SNACxFAM_LOCATION, ICQ_SNACxLOC_SETxUSERxINFO)
@@ -26,6 +26,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <licq/userid.h>
 #include <licq/packet.h>
@@ -318,6 +319,13 @@ class CPU_RateAck : public CPU_CommonFamily
 {
 public:
   CPU_RateAck(unsigned short nService = 0);
+
+  /**
+   * Acknowledge rate classes received from server
+   *
+   * @param classes Ids of rate classes to acknowledge
+   */
+  CPU_RateAck(const std::vector<unsigned short>& classes);
 };
 
 //-----GenericUinList------------------------------------------------------------
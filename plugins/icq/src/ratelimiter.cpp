@@ -0,0 +1,212 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "ratelimiter.h"
+
+#include <climits>
+#include <ctime>
+
+#include <licq/buffer.h>
+#include <licq/thread/mutexlocker.h>
+
+using namespace LicqIcq;
+using Licq::MutexLocker;
+using std::vector;
+
+// Size of a rate class in the packet: id, 8 levels/times and current state
+static const size_t RateClassSize = 2 + 8*4 + 1;
+
+RateLimiter::RateLimiter()
+{
+  // Empty
+}
+
+void RateLimiter::clear()
+{
+  MutexLocker locker(myMutex);
+  myClasses.clear();
+  mySnacClasses.clear();
+}
+
+long long RateLimiter::getMonotonicClock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+unsigned short RateLimiter::unpackClass(Licq::Buffer& packet, RateClass& rateClass)
+{
+  unsigned short id = packet.unpackUInt16BE();
+  rateClass.windowSize = packet.unpackUInt32BE();
+  rateClass.clearLevel = packet.unpackUInt32BE();
+  rateClass.alertLevel = packet.unpackUInt32BE();
+  rateClass.limitLevel = packet.unpackUInt32BE();
+  rateClass.disconnectLevel = packet.unpackUInt32BE();
+  rateClass.currentLevel = packet.unpackUInt32BE();
+  rateClass.maxLevel = packet.unpackUInt32BE();
+
+  // Server sends time since last SNAC in this class
+  rateClass.lastTime = getMonotonicClock() - packet.unpackUInt32BE();
+
+  packet.unpackUInt8(); // current state
+
+  if (rateClass.windowSize == 0)
+    rateClass.windowSize = 1;
+  return id;
+}
+
+bool RateLimiter::parseRateInfo(Licq::Buffer& packet)
+{
+  if (packet.remainingDataToRead() < 2)
+    return false;
+
+  ClassMap classes;
+  unsigned short numClasses = packet.unpackUInt16BE();
+  for (unsigned short i = 0; i < numClasses; ++i)
+  {
+    if (packet.remainingDataToRead() < RateClassSize)
+      return false;
+    RateClass rateClass;
+    unsigned short id = unpackClass(packet, rateClass);
+    classes[id] = rateClass;
+  }
+
+  // Each class is followed by the list of SNACs belonging to it
+  SnacMap snacClasses;
+  while (packet.remainingDataToRead() >= 4)
+  {
+    unsigned short id = packet.unpackUInt16BE();
+    unsigned short numSnacs = packet.unpackUInt16BE();
+    if (packet.remainingDataToRead() < numSnacs * 4u)
+      return false;
+    for (unsigned short i = 0; i < numSnacs; ++i)
+    {
+      unsigned long snac = packet.unpackUInt32BE();
+      snacClasses[snac] = id;
+    }
+  }
+
+  MutexLocker locker(myMutex);
+  myClasses.swap(classes);
+  mySnacClasses.swap(snacClasses);
+  return true;
+}
+
+bool RateLimiter::parseRateChange(Licq::Buffer& packet, unsigned short& code,
+    unsigned short& classId)
+{
+  if (packet.remainingDataToRead() < 2 + RateClassSize)
+    return false;
+
+  code = packet.unpackUInt16BE();
+  RateClass rateClass;
+  classId = unpackClass(packet, rateClass);
+
+  MutexLocker locker(myMutex);
+  myClasses[classId] = rateClass;
+  return true;
+}
+
+vector<unsigned short> RateLimiter::classIds() const
+{
+  MutexLocker locker(myMutex);
+  vector<unsigned short> ret;
+  for (ClassMap::const_iterator i = myClasses.begin(); i != myClasses.end(); ++i)
+    ret.push_back(i->first);
+  return ret;
+}
+
+unsigned long RateLimiter::levelAt(const RateClass& rateClass, long long now)
+{
+  long long elapsed = now - rateClass.lastTime;
+  if (elapsed < 0)
+    elapsed = 0;
+
+  long long level = (static_cast<long long>(rateClass.windowSize - 1) *
+      rateClass.currentLevel + elapsed) / rateClass.windowSize;
+  if (level > static_cast<long long>(rateClass.maxLevel))
+    level = rateClass.maxLevel;
+  return level;
+}
+
+unsigned long RateLimiter::targetLevel(const RateClass& rateClass)
+{
+  // Keep a small margin above alert level as our clock isn't the server's
+  if (rateClass.clearLevel > rateClass.alertLevel)
+    return rateClass.alertLevel + (rateClass.clearLevel - rateClass.alertLevel) / 8;
+  return rateClass.alertLevel;
+}
+
+unsigned short RateLimiter::classId(unsigned long snac) const
+{
+  MutexLocker locker(myMutex);
+  SnacMap::const_iterator i = mySnacClasses.find(snac);
+  return (i == mySnacClasses.end() ? 0 : i->second);
+}
+
+int RateLimiter::delay(unsigned long snac) const
+{
+  MutexLocker locker(myMutex);
+
+  SnacMap::const_iterator s = mySnacClasses.find(snac);
+  if (s == mySnacClasses.end())
+    return 0;
+  ClassMap::const_iterator c = myClasses.find(s->second);
+  if (c == myClasses.end())
+    return 0;
+  const RateClass& rateClass = c->second;
+
+  long long now = getMonotonicClock();
+  unsigned long target = targetLevel(rateClass);
+  if (levelAt(rateClass, now) >= target)
+    return 0;
+
+  // Solve level formula for the time needed since last SNAC to reach target
+  long long needed = static_cast<long long>(rateClass.windowSize) * target -
+      static_cast<long long>(rateClass.windowSize - 1) * rateClass.currentLevel;
+  long long wait = needed - (now - rateClass.lastTime);
+  if (wait <= 0)
+    return 0;
+  return (wait > INT_MAX ? INT_MAX : static_cast<int>(wait));
+}
+
+void RateLimiter::sent(unsigned long snac)
+{
+  MutexLocker locker(myMutex);
+
+  SnacMap::const_iterator s = mySnacClasses.find(snac);
+  if (s == mySnacClasses.end())
+    return;
+  ClassMap::iterator c = myClasses.find(s->second);
+  if (c == myClasses.end())
+    return;
+
+  long long now = getMonotonicClock();
+  c->second.currentLevel = levelAt(c->second, now);
+  c->second.lastTime = now;
+}
+
+unsigned long RateLimiter::level(unsigned short classId) const
+{
+  MutexLocker locker(myMutex);
+
+  ClassMap::const_iterator c = myClasses.find(classId);
+  return (c == myClasses.end() ? 0 : c->second.currentLevel);
+}
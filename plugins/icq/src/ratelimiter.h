@@ -0,0 +1,157 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQICQ_RATELIMITER_H
+#define LICQICQ_RATELIMITER_H
+
+#include <boost/noncopyable.hpp>
+#include <map>
+#include <vector>
+
+#include <licq/thread/mutex.h>
+
+namespace Licq
+{
+class Buffer;
+}
+
+namespace LicqIcq
+{
+
+/**
+ * Client side of the OSCAR rate limiting
+ *
+ * The server assigns each SNAC to a rate class and keeps a moving average of
+ * the time between SNACs sent in each class:
+ *
+ *   level = ((window - 1) * level + time since last SNAC) / window
+ *
+ * If the level drops below the alert level we get a warning, below the limit
+ * level SNACs are dropped and below the disconnect level we get logged off.
+ *
+ * This class tracks the same levels locally so the send queue can hold back
+ * SNACs just long enough to keep each class above the alert level.
+ *
+ * All functions are thread safe.
+ */
+class RateLimiter : private boost::noncopyable
+{
+public:
+  RateLimiter();
+
+  /**
+   * Forget all rate classes
+   * Should be called when the server connection is closed.
+   */
+  void clear();
+
+  /**
+   * Parse rate information from server (SNAC 0x01,0x07)
+   *
+   * @param packet Buffer positioned at start of SNAC data
+   * @return True if rate information was parsed successfully
+   */
+  bool parseRateInfo(Licq::Buffer& packet);
+
+  /**
+   * Parse rate change notification from server (SNAC 0x01,0x0A)
+   *
+   * @param packet Buffer positioned at start of SNAC data
+   * @param code Message code from server (1 = changed, 2 = warning,
+   *             3 = limit, 4 = clear)
+   * @param classId Rate class the message is for
+   * @return True if packet was parsed successfully
+   */
+  bool parseRateChange(Licq::Buffer& packet, unsigned short& code,
+      unsigned short& classId);
+
+  /**
+   * Get all known rate classes
+   *
+   * @return Ids of rate classes received from server
+   */
+  std::vector<unsigned short> classIds() const;
+
+  /**
+   * Get time to wait before a SNAC can be sent
+   *
+   * @param snac Family and subtype of SNAC to send
+   * @return Milliseconds to wait, zero if SNAC may be sent now
+   */
+  int delay(unsigned long snac) const;
+
+  /**
+   * Register that a SNAC has been sent
+   *
+   * @param snac Family and subtype of SNAC that was sent
+   */
+  void sent(unsigned long snac);
+
+  /**
+   * Get current level of a rate class
+   *
+   * @param classId Id of rate class
+   * @return Level after last SNAC sent or zero if class is unknown
+   */
+  unsigned long level(unsigned short classId) const;
+
+  /**
+   * Get id of rate class a SNAC belongs to
+   *
+   * @param snac Family and subtype of SNAC
+   * @return Id of rate class or zero if SNAC isn't limited
+   */
+  unsigned short classId(unsigned long snac) const;
+
+private:
+  struct RateClass
+  {
+    unsigned long windowSize;
+    unsigned long clearLevel;
+    unsigned long alertLevel;
+    unsigned long limitLevel;
+    unsigned long disconnectLevel;
+    unsigned long currentLevel;
+    unsigned long maxLevel;
+    long long lastTime;
+  };
+
+  typedef std::map<unsigned short, RateClass> ClassMap;
+  typedef std::map<unsigned long, unsigned short> SnacMap;
+
+  /// Get monotonic clock in milliseconds
+  static long long getMonotonicClock();
+
+  /// Read rate class parameters from a packet, returns class id
+  static unsigned short unpackClass(Licq::Buffer& packet, RateClass& rateClass);
+
+  /// Calculate level for a class if a SNAC is sent at the given time
+  static unsigned long levelAt(const RateClass& rateClass, long long now);
+
+  /// Get level to stay above for a class
+  static unsigned long targetLevel(const RateClass& rateClass);
+
+  mutable Licq::Mutex myMutex;
+  ClassMap myClasses;
+  SnacMap mySnacClasses;
+};
+
+} // namespace LicqIcq
+
+#endif
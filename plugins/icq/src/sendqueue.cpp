@@ -0,0 +1,425 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sendqueue.h"
+
+#include <cstring>
+#include <ctime>
+
+#include <licq/buffer.h>
+#include <licq/logging/log.h>
+#include <licq/socket.h>
+#include <licq/socketmanager.h>
+#include <licq/thread/mutexlocker.h>
+
+#include "defines.h"
+#include "gettext.h"
+#include "icq.h"
+#include "packet-srv.h"
+
+using namespace LicqIcq;
+using Licq::MutexLocker;
+using Licq::gLog;
+using std::string;
+
+ServerSendQueue::ServerSendQueue()
+  : myNextSequence(0),
+    myWakeupPending(false),
+    myIsStalled(false),
+    myIsRateLimited(false),
+    myIsRunning(false)
+{
+  // Empty
+}
+
+ServerSendQueue::~ServerSendQueue()
+{
+  stop();
+}
+
+bool ServerSendQueue::start()
+{
+  if (myIsRunning)
+    return true;
+
+  int result = pthread_create(&myThread, NULL, &sender_tep, this);
+  if (result != 0)
+  {
+    gLog.error(tr("Unable to start server send thread: %s."), strerror(result));
+    return false;
+  }
+  myIsRunning = true;
+  return true;
+}
+
+void ServerSendQueue::stop()
+{
+  if (!myIsRunning)
+    return;
+
+  myWakeupPipe.putChar('X');
+  pthread_join(myThread, NULL);
+  myIsRunning = false;
+
+  clear();
+}
+
+void* ServerSendQueue::sender_tep(void* p)
+{
+  ServerSendQueue* q = static_cast<ServerSendQueue*>(p);
+
+  q->myMainLoop.addRawFile(q->myWakeupPipe.getReadFd(), q);
+  q->myMainLoop.run();
+  q->myMainLoop.removeCallback(q);
+
+  return NULL;
+}
+
+void ServerSendQueue::push(Licq::Event* event, bool owned)
+{
+  Entry entry;
+  entry.event = event;
+  entry.owned = owned;
+
+  // Logon packets start a new sequence so they don't wait for their turn
+  CSrvPacketTcp* srvPacket = dynamic_cast<CSrvPacketTcp*>(event->m_pPacket);
+  entry.logon = (srvPacket != NULL && srvPacket->icqChannel() == ICQ_CHNxNEW);
+
+  MutexLocker locker(myMutex);
+  if (entry.logon)
+    myLogonQueue.push_back(entry);
+  else
+    myQueue.insert(EntryMap::value_type(event->Sequence(), entry));
+
+  wakeup();
+}
+
+void ServerSendQueue::wakeup()
+{
+  // Only write to pipe if sender hasn't been notified already
+  if (myWakeupPending)
+    return;
+  myWakeupPending = true;
+  myWakeupPipe.putChar('W');
+}
+
+bool ServerSendQueue::remove(const Licq::Event* event)
+{
+  MutexLocker locker(myMutex);
+
+  for (EntryList::iterator i = myLogonQueue.begin(); i != myLogonQueue.end(); ++i)
+  {
+    if (i->event == event)
+    {
+      myLogonQueue.erase(i);
+      return true;
+    }
+  }
+
+  std::pair<EntryMap::iterator, EntryMap::iterator> range =
+      myQueue.equal_range(event->Sequence());
+  for (EntryMap::iterator i = range.first; i != range.second; ++i)
+  {
+    if (i->second.event == event)
+    {
+      // Keep the entry so the sequence is skipped instead of waited for
+      i->second.event = NULL;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+Licq::Event* ServerSendQueue::remove(unsigned long eventTag)
+{
+  MutexLocker locker(myMutex);
+
+  for (EntryList::iterator i = myLogonQueue.begin(); i != myLogonQueue.end(); ++i)
+  {
+    if (i->event->EventId() == eventTag)
+    {
+      Licq::Event* e = i->event;
+      myLogonQueue.erase(i);
+      return e;
+    }
+  }
+
+  for (EntryMap::iterator i = myQueue.begin(); i != myQueue.end(); ++i)
+  {
+    if (i->second.event != NULL && i->second.event->EventId() == eventTag)
+    {
+      Licq::Event* e = i->second.event;
+      i->second.event = NULL;
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+void ServerSendQueue::clear()
+{
+  MutexLocker locker(myMutex);
+
+  for (EntryList::iterator i = myLogonQueue.begin(); i != myLogonQueue.end(); ++i)
+  {
+    gLog.info(tr("Event #%hu is still on the server queue!"), i->event->Sequence());
+    if (i->owned)
+      delete i->event;
+  }
+  myLogonQueue.clear();
+
+  for (EntryMap::iterator i = myQueue.begin(); i != myQueue.end(); ++i)
+  {
+    if (i->second.event == NULL)
+      continue;
+    gLog.info(tr("Event #%hu is still on the server queue!"), i->first);
+    if (i->second.owned)
+      delete i->second.event;
+  }
+  myQueue.clear();
+}
+
+bool ServerSendQueue::popNext(Entry& entry, int& delay)
+{
+  delay = 0;
+  if (!myLogonQueue.empty())
+  {
+    entry = myLogonQueue.front();
+    myLogonQueue.pop_front();
+    myNextSequence = entry.event->Sequence() + 1;
+    return true;
+  }
+
+  while (true)
+  {
+    EntryMap::iterator i = myQueue.find(myNextSequence);
+    if (i == myQueue.end())
+      return false;
+
+    // Removed events leave an empty entry, just skip past them
+    if (i->second.event == NULL)
+    {
+      myQueue.erase(i);
+      ++myNextSequence;
+      continue;
+    }
+
+    // Leave event in queue if its rate class needs to recover first
+    delay = gIcqProtocol.myRateLimiter.delay(i->second.event->SNAC());
+    if (delay > 0)
+      return false;
+
+    entry = i->second;
+    myQueue.erase(i);
+    ++myNextSequence;
+    return true;
+  }
+}
+
+void ServerSendQueue::processQueue()
+{
+  while (true)
+  {
+    Entry entry;
+    Licq::Buffer* buffer;
+    int socket;
+    unsigned short sequence;
+    unsigned long snac;
+    bool noAck;
+    {
+      MutexLocker locker(myMutex);
+      int delay;
+      if (!popNext(entry, delay))
+      {
+        if (delay > 0)
+        {
+          // Next event is ready but must wait for its rate class
+          if (myIsStalled)
+          {
+            myIsStalled = false;
+            myMainLoop.removeTimeout(TimeoutStall);
+          }
+          if (!myIsRateLimited)
+          {
+            myIsRateLimited = true;
+            myMainLoop.addTimeout(delay, this, TimeoutRate, true);
+          }
+          return;
+        }
+
+        // Wait a while for missing sequence before giving up on it
+        if (!myQueue.empty() && !myIsStalled)
+        {
+          myIsStalled = true;
+          myMainLoop.addTimeout(StallTimeout, this, TimeoutStall);
+        }
+        else if (myQueue.empty() && myIsStalled)
+        {
+          myIsStalled = false;
+          myMainLoop.removeTimeout(TimeoutStall);
+        }
+        return;
+      }
+
+      // Get everything needed from the event while holding the mutex as
+      // anyone removing the event will wait for us to release it
+      buffer = entry.event->m_pPacket->Finalize(NULL);
+      socket = entry.event->m_nSocketDesc;
+      sequence = entry.event->Sequence();
+      snac = entry.event->SNAC();
+      noAck = entry.event->m_NoAck;
+    }
+
+    if (myIsStalled)
+    {
+      myIsStalled = false;
+      myMainLoop.removeTimeout(TimeoutStall);
+    }
+
+    sendEvent(entry, buffer, socket, sequence, noAck);
+    gIcqProtocol.myRateLimiter.sent(snac);
+  }
+}
+
+void ServerSendQueue::sendEvent(const Entry& entry, Licq::Buffer* buffer,
+    int socket, unsigned short sequence, bool noAck)
+{
+  if (socket == -1)
+  {
+    if (!entry.logon)
+    {
+      gLog.info(tr("Not connected to server, failing event."));
+      delete buffer;
+      finishEvent(entry, Licq::Event::ResultError);
+      return;
+    }
+
+    // Connect to the server if we are logging on
+    gLog.info(tr("Connecting to login server."));
+    socket = gIcqProtocol.ConnectToLoginServer();
+    if (socket == -1)
+    {
+      gLog.info(tr("Connecting to login server failed, failing event."));
+      // we need to initialize the logon time for the next retry
+      gIcqProtocol.m_tLogonTime = time(NULL);
+      gIcqProtocol.m_eStatus = STATUS_OFFLINE_FORCED;
+      gIcqProtocol.m_bLoggingOn = false;
+      delete buffer;
+      finishEvent(entry, Licq::Event::ResultError);
+      return;
+    }
+
+    if (entry.owned)
+      entry.event->m_nSocketDesc = socket;
+  }
+
+  Licq::INetSocket* s = gSocketManager.FetchSocket(socket);
+  if (s == NULL)
+  {
+    gLog.warning(tr("Socket not connected or invalid (#%hu)."), sequence);
+    delete buffer;
+    finishEvent(entry, Licq::Event::ResultError);
+    return;
+  }
+
+  bool sent = s->send(*buffer);
+  delete buffer;
+  string errorStr;
+  if (!sent)
+    errorStr = s->errorStr();
+
+  // We don't close the socket as it should be closed by the server thread
+  gSocketManager.DropSocket(s);
+
+  if (!sent)
+  {
+    gLog.warning(tr("Error sending event (#%hu): %s."),
+        sequence, errorStr.c_str());
+    finishEvent(entry, Licq::Event::ResultError);
+  }
+  else if (noAck)
+  {
+    // Sent successfully and we won't get an answer from the server
+    finishEvent(entry, Licq::Event::ResultAcked);
+  }
+  else if (entry.owned)
+  {
+    // Nobody will be waiting for an ack for this one
+    delete entry.event;
+  }
+}
+
+void ServerSendQueue::finishEvent(const Entry& entry, Licq::Event::ResultType result)
+{
+  Licq::Event* e = entry.event;
+  if (gIcqProtocol.DoneEvent(e, result) != NULL)
+  {
+    gIcqProtocol.DoneExtendedEvent(e, result);
+    gIcqProtocol.ProcessDoneEvent(e);
+  }
+  else if (entry.owned)
+  {
+    delete e;
+  }
+}
+
+void ServerSendQueue::rawFileEvent(int /* fd */, int /* revents */)
+{
+  char ch = myWakeupPipe.getChar();
+  if (ch == 'X')
+  {
+    myMainLoop.quit();
+    return;
+  }
+
+  {
+    MutexLocker locker(myMutex);
+    myWakeupPending = false;
+  }
+  processQueue();
+}
+
+void ServerSendQueue::timeoutEvent(int id)
+{
+  if (id == TimeoutRate)
+  {
+    myIsRateLimited = false;
+    processQueue();
+    return;
+  }
+
+  {
+    MutexLocker locker(myMutex);
+    myIsStalled = false;
+    if (myQueue.empty() || myQueue.count(myNextSequence) > 0)
+      return;
+
+    // Next sequence never showed up, continue with the closest one after it
+    EntryMap::iterator i = myQueue.lower_bound(myNextSequence);
+    if (i == myQueue.end())
+      i = myQueue.begin();
+    gLog.warning(tr("Server event #%hu was never queued, skipping to #%hu."),
+        myNextSequence, i->first);
+    myNextSequence = i->first;
+  }
+
+  processQueue();
+}
@@ -0,0 +1,183 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQICQ_SENDQUEUE_H
+#define LICQICQ_SENDQUEUE_H
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <pthread.h>
+
+#include <licq/event.h>
+#include <licq/mainloop.h>
+#include <licq/pipe.h>
+#include <licq/thread/mutex.h>
+
+namespace Licq
+{
+class Buffer;
+}
+
+namespace LicqIcq
+{
+
+/**
+ * Outgoing queue for the server connection
+ *
+ * OSCAR requires FLAPs to be sent in sequence order. Events are kept sorted
+ * by sequence and a single sender thread, running its own MainLoop, sends
+ * each event as soon as the next expected sequence is available.
+ *
+ * Events can be removed from the queue until the sender has picked them up.
+ * A removed event leaves a gap which is skipped so later events are not held
+ * back. If an expected sequence never shows up (e.g. the packet was dropped
+ * before being queued) the gap is skipped after a timeout.
+ *
+ * Sending is paced by the rate limiter so the server rate classes are never
+ * exceeded. As FLAPs must be sent in order, an event that has to wait for
+ * its rate class also holds back the events after it.
+ */
+class ServerSendQueue : private Licq::MainLoopCallback, private boost::noncopyable
+{
+public:
+  ServerSendQueue();
+  ~ServerSendQueue();
+
+  /**
+   * Start the sender thread
+   *
+   * @return True if thread was started
+   */
+  bool start();
+
+  /**
+   * Stop the sender thread and wait for it to finish
+   * Any events still in the queue are dropped.
+   */
+  void stop();
+
+  /**
+   * Add an event to the queue
+   *
+   * @param event Event to send
+   * @param owned True if queue should delete event after sending, false if
+   *              event is also in the running events list
+   */
+  void push(Licq::Event* event, bool owned);
+
+  /**
+   * Remove an event from the queue
+   * If the sender thread is preparing the event, this call will wait until
+   * the sender is done with it.
+   *
+   * @param event Event to remove
+   * @return True if the event was still in the queue
+   */
+  bool remove(const Licq::Event* event);
+
+  /**
+   * Remove an event from the queue
+   *
+   * @param eventTag Tag of event to remove
+   * @return Event removed from queue or NULL if not found, caller takes
+   *         ownership of event if it was owned by the queue
+   */
+  Licq::Event* remove(unsigned long eventTag);
+
+  /**
+   * Remove all events from the queue
+   * Events owned by the queue are deleted.
+   */
+  void clear();
+
+private:
+  static const int StallTimeout = 5000;
+
+  enum TimeoutIds
+  {
+    TimeoutStall = 1,
+    TimeoutRate = 2
+  };
+
+  struct Entry
+  {
+    Licq::Event* event;
+    bool owned;
+    bool logon;
+  };
+  typedef std::multimap<unsigned short, Entry> EntryMap;
+  typedef std::list<Entry> EntryList;
+
+  /// Thread entry point
+  static void* sender_tep(void* p);
+
+  /// Wake up sender thread
+  void wakeup();
+
+  /**
+   * Get next event to send, queue mutex must be held
+   *
+   * @param entry Set to next entry if one is ready
+   * @param delay Set to time to wait if next event is held back by rate
+   *              limiting, otherwise zero
+   * @return True if an entry was returned
+   */
+  bool popNext(Entry& entry, int& delay);
+
+  /// Send all events that are ready
+  void processQueue();
+
+  /**
+   * Send a single event
+   * Events not owned by the queue must not be accessed here as they may be
+   * acked or cancelled at any time.
+   *
+   * @param entry Queue entry for event
+   * @param buffer Finalized packet data, will be deleted
+   * @param socket Socket to send on or -1 if not connected
+   * @param sequence Sequence of event
+   * @param noAck True if event is done when packet has been sent
+   */
+  void sendEvent(const Entry& entry, Licq::Buffer* buffer, int socket,
+      unsigned short sequence, bool noAck);
+
+  /// Finish an event that will not get an ack from the server
+  void finishEvent(const Entry& entry, Licq::Event::ResultType result);
+
+  // From Licq::MainLoopCallback
+  void rawFileEvent(int fd, int revents);
+  void timeoutEvent(int id);
+
+  Licq::MainLoop myMainLoop;
+  Licq::Pipe myWakeupPipe;
+  Licq::Mutex myMutex;
+  EntryMap myQueue;
+  EntryList myLogonQueue;
+  unsigned short myNextSequence;
+  bool myWakeupPending;
+  bool myIsStalled;
+  bool myIsRateLimited;
+  bool myIsRunning;
+  pthread_t myThread;
+};
+
+} // namespace LicqIcq
+
+#endif
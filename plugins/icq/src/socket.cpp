@@ -20,6 +20,7 @@
 #include "socket.h"
 
 #include <cerrno>
+#include <cstring>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -30,11 +31,13 @@
 #include "gettext.h"
 
 using namespace LicqIcq;
-using Licq::Buffer;
 using Licq::gLog;
 
 SrvSocket::SrvSocket(const Licq::UserId& userId)
-  : Licq::INetSocket(SOCK_STREAM, "SRV", userId)
+  : Licq::INetSocket(SOCK_STREAM, "SRV", userId),
+    myRecvBuffer(RecvBufferSize),
+    myRecvStart(0),
+    myRecvEnd(0)
 {
   // Empty
 }
@@ -44,76 +47,68 @@ SrvSocket::~SrvSocket()
   // Empty
 }
 
-/*-----SrvSocket::ReceivePacket------------------------------------------------
- * Receive data on the socket.  Checks the buffer to see if it is empty, if
- * so, then it will create it using either the size read in from the socket
- * (the first two bytes available) or the given size.
- *---------------------------------------------------------------------------*/
-bool SrvSocket::receiveFlap(Licq::Buffer& buf)
+bool SrvSocket::receiveFlaps(std::list<Buffer>& packets)
 {
-  if (!buf.Empty())
+  // Move any partial packet to the beginning to make room for more data
+  if (myRecvStart > 0)
   {
-    gLog.error(tr("Internal error: %s: Called with full buffer (%lu bytes)."),
-        __func__, buf.getDataSize());
-    return true;
+    memmove(&myRecvBuffer[0], &myRecvBuffer[myRecvStart], myRecvEnd - myRecvStart);
+    myRecvEnd -= myRecvStart;
+    myRecvStart = 0;
   }
 
-  int nBytesReceived = 0;
-  errno = 0;
-
-  // Check if the buffer is empty
-  char *buffer = new char[6];
-  int nSixBytes = 0;
-  while (nSixBytes != 6)
+  ssize_t bytesReceived = recv(myDescriptor, &myRecvBuffer[myRecvEnd],
+      myRecvBuffer.size() - myRecvEnd, MSG_DONTWAIT);
+  if (bytesReceived == 0)
   {
-    nBytesReceived = read(myDescriptor, buffer + nSixBytes, 6 - nSixBytes);
-    if (nBytesReceived <= 0)
-    {
-      if (nBytesReceived == 0)
-        gLog.warning(tr("server socket was closed!!!\n"));
-      else
-      {
-        myErrorType = ErrorErrno;
-        gLog.warning(tr("Error during receiving from server socket:\n%s"),
-            errorStr().c_str());
-      }
-      delete[] buffer;
-      return false;
-    }
-    nSixBytes += nBytesReceived;
+    gLog.warning(tr("server socket was closed!!!\n"));
+    return false;
   }
-
-  // now we start to verify the FLAP header
-  if (buffer[0] != 0x2a)
+  if (bytesReceived < 0)
   {
-    gLog.warning(tr("Server send bad packet start code: %02x %02x %02x %02x %02x %02x"),
-        buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5]);
+    // Nothing to read right now, wait for next time
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return true;
+
     myErrorType = ErrorErrno;
-    delete[] buffer;
+    gLog.warning(tr("Error during receiving from server socket:\n%s"),
+        errorStr().c_str());
     return false;
   }
+  myRecvEnd += bytesReceived;
 
-  // DAW maybe verify sequence number ?
-
-  unsigned short nLen = ((unsigned char)buffer[5]) + (((unsigned char)buffer[4]) << 8);
-
-  // push the 6 bytes at the beginning of the packet again..
-  buf.Create(nLen + 6);
-  buf.packRaw(buffer, 6);
-  delete[] buffer;
-
-  while (!buf.Full())
+  // Split out all complete packets
+  while (myRecvEnd - myRecvStart >= FlapHeaderSize)
   {
-    ssize_t bytesReceived = read(myDescriptor, buf.getDataPosWrite(), buf.remainingDataToWrite());
-    if (bytesReceived == 0 || (bytesReceived < 0 && errno != EINTR))
+    const unsigned char* header =
+        reinterpret_cast<const unsigned char*>(&myRecvBuffer[myRecvStart]);
+
+    // now we start to verify the FLAP header
+    if (header[0] != 0x2a)
     {
+      gLog.warning(tr("Server send bad packet start code: %02x %02x %02x %02x %02x %02x"),
+          header[0], header[1], header[2], header[3], header[4], header[5]);
       myErrorType = ErrorErrno;
       return false;
     }
-    buf.incDataPosWrite(bytesReceived);
+
+    // DAW maybe verify sequence number ?
+
+    size_t length = FlapHeaderSize + ((header[4] << 8) | header[5]);
+    if (myRecvEnd - myRecvStart < length)
+      break;
+
+    packets.push_back(Buffer());
+    Buffer& buf = packets.back();
+    buf.Create(length);
+    buf.packRaw(header, length);
+    myRecvStart += length;
+
+    DumpPacket(&buf, true);
   }
 
-  DumpPacket(&buf, true);
+  if (myRecvStart == myRecvEnd)
+    myRecvStart = myRecvEnd = 0;
 
   return true;
 }
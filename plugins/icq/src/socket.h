@@ -20,21 +20,50 @@
 #ifndef LICQICQ_SOCKET_H
 #define LICQICQ_SOCKET_H
 
+#include <list>
+#include <vector>
+
 #include <licq/socket.h>
 
 #include <licq/buffer.h>
 
+#include "buffer.h"
+
 namespace LicqIcq
 {
 
+/**
+ * Socket for OSCAR server connections
+ *
+ * Received data is kept in a buffer in the socket so every read can get as
+ * much data as is available, regardless of where FLAPs begin and end.
+ */
 class SrvSocket : public Licq::INetSocket
 {
 public:
   SrvSocket(const Licq::UserId& userId);
   virtual ~SrvSocket();
 
-  /// Receive a FLAP packet
-  bool receiveFlap(Licq::Buffer& buf);
+  /**
+   * Receive FLAP packets
+   * Reads the data available on the socket, without blocking, and returns
+   * all complete FLAPs. Any partial FLAP is kept until the rest of it has
+   * been received.
+   *
+   * @param packets List to add received packets to, including FLAP headers
+   * @return False if socket was closed or on error
+   */
+  bool receiveFlaps(std::list<Buffer>& packets);
+
+private:
+  static const size_t FlapHeaderSize = 6;
+
+  // Large enough to always hold at least one FLAP of max size
+  static const size_t RecvBufferSize = 128 * 1024;
+
+  std::vector<char> myRecvBuffer;
+  size_t myRecvStart;
+  size_t myRecvEnd;
 };
 
 
@@ -0,0 +1,330 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "socketmonitor.h"
+
+#include <ctime>
+#include <list>
+#include <unistd.h>
+
+#include <licq/logging/log.h>
+#include <licq/plugin/pluginmanager.h>
+#include <licq/pluginsignal.h>
+
+#include "buffer.h"
+#include "defines.h"
+#include "gettext.h"
+#include "icq.h"
+#include "icqprotocolplugin.h"
+#include "oscarservice.h"
+#include "socket.h"
+#include "user.h"
+
+#define MAX_CONNECTS  256
+#define DEBUG_THREADS(x)
+//#define DEBUG_THREADS(x) gLog.info(x)
+
+using namespace LicqIcq;
+using Licq::gLog;
+
+SocketMonitor::SocketMonitor()
+  : myChangeCount(0)
+{
+  // Empty
+}
+
+void SocketMonitor::run()
+{
+  myMainLoop.addRawFile(gIcqProtocol.myNewSocketPipe.getReadFd(), this);
+  myMainLoop.addRawFile(gIcqProtocolPlugin->getReadPipe(), this);
+  syncSockets();
+
+  myMainLoop.run();
+
+  myMainLoop.removeCallback(this);
+  mySockets.clear();
+}
+
+void SocketMonitor::syncSockets()
+{
+  unsigned long changeCount = gSocketManager.changeCount();
+  if (changeCount == myChangeCount)
+    return;
+  myChangeCount = changeCount;
+
+  Licq::SocketSet::SerialMap sockets = gSocketManager.socketSerials();
+
+  // Remove sockets that are gone or have had their descriptor reused
+  Licq::SocketSet::SerialMap::iterator i = mySockets.begin();
+  while (i != mySockets.end())
+  {
+    Licq::SocketSet::SerialMap::const_iterator n = sockets.find(i->first);
+    if (n != sockets.end() && n->second == i->second)
+    {
+      ++i;
+      continue;
+    }
+    myMainLoop.removeRawFile(i->first);
+    mySockets.erase(i++);
+  }
+
+  for (i = sockets.begin(); i != sockets.end(); ++i)
+  {
+    if (mySockets.count(i->first) > 0)
+      continue;
+    myMainLoop.addRawFile(i->first, this);
+    mySockets.insert(*i);
+  }
+}
+
+void SocketMonitor::rawFileEvent(int fd, int /* revents */)
+{
+  if (fd == gIcqProtocol.myNewSocketPipe.getReadFd())
+  {
+    char buf = gIcqProtocol.myNewSocketPipe.getChar();
+    if (buf == 'S')
+    {
+      DEBUG_THREADS("[SocketMonitor] Reloading socket info.\n");
+    }
+    else if (buf == 'X')
+    {
+      DEBUG_THREADS("[SocketMonitor] Exiting.\n");
+      myMainLoop.quit();
+      return;
+    }
+  }
+  else if (fd == gIcqProtocolPlugin->getReadPipe())
+    gIcqProtocolPlugin->processPipe();
+  else
+    processSocket(fd);
+
+  syncSockets();
+}
+
+void SocketMonitor::processSocket(int fd)
+{
+  Licq::INetSocket* s = gSocketManager.FetchSocket(fd);
+  if (s != NULL && s->userId().isValid() &&
+      s->userId() == gIcqProtocol.ownerId() &&
+      gIcqProtocol.m_nTCPSrvSocketDesc == -1)
+  {
+    /* This is the server socket and it is about to be destoryed
+       so ignore this message (it's probably a disconnection anyway) */
+    gSocketManager.DropSocket(s);
+    return;
+  }
+
+  int serviceSocket = -1;
+  if (gIcqProtocol.m_xBARTService)
+    serviceSocket = gIcqProtocol.m_xBARTService->GetSocketDesc();
+
+  if (fd == gIcqProtocol.m_nTCPSrvSocketDesc)
+    processServerSocket(s, fd);
+  else if (fd == serviceSocket)
+    processServiceSocket(s, fd);
+  else if (fd == gIcqProtocol.m_nTCPSocketDesc)
+    processListenSocket(s, fd);
+  else
+    processDirectSocket(s, fd);
+}
+
+void SocketMonitor::processServerSocket(Licq::INetSocket* s, int fd)
+{
+  DEBUG_THREADS("[SocketMonitor] Data on TCP server socket.\n");
+  SrvSocket* srvTCP = dynamic_cast<SrvSocket*>(s);
+  if (srvTCP == NULL)
+  {
+    gLog.warning(tr("Invalid server socket in set."));
+    gSocketManager.DropSocket(s);
+    close(fd);
+    return;
+  }
+
+  // DAW FIXME error handling when socket is closed..
+  std::list<Buffer> packets;
+  if (srvTCP->receiveFlaps(packets))
+  {
+    gSocketManager.DropSocket(srvTCP);
+    std::list<Buffer>::iterator iter;
+    for (iter = packets.begin(); iter != packets.end(); ++iter)
+    {
+      // Stop if one of the packets made us drop the connection
+      if (gIcqProtocol.m_nTCPSrvSocketDesc != fd)
+        break;
+      if (!gIcqProtocol.ProcessSrvPacket(*iter))
+      {} // gIcqProtocol.icqRelogon();
+    }
+  }
+  else {
+    // probably server closed socket, try to relogon after a while
+    // if ping-thread is running already
+    int nSD = gIcqProtocol.m_nTCPSrvSocketDesc;
+    gIcqProtocol.m_nTCPSrvSocketDesc = -1;
+    gLog.info(tr("Dropping server connection."));
+    gSocketManager.DropSocket(srvTCP);
+    gSocketManager.CloseSocket(nSD);
+    // we need to initialize the logon time for the next retry
+    gIcqProtocol.m_tLogonTime = time(NULL);
+    gIcqProtocol.m_eStatus = STATUS_OFFLINE_FORCED;
+    gIcqProtocol.m_bLoggingOn = false;
+    gIcqProtocol.postLogoff(nSD);
+  }
+}
+
+void SocketMonitor::processServiceSocket(Licq::INetSocket* s, int fd)
+{
+  DEBUG_THREADS("[SocketMonitor] Data on BART service socket.\n");
+  COscarService *svc = gIcqProtocol.m_xBARTService;
+  SrvSocket* sock_svc = dynamic_cast<SrvSocket*>(s);
+  if (sock_svc == NULL)
+  {
+    gLog.warning(tr("Invalid BART service socket in set."));
+    gSocketManager.DropSocket(s);
+    close(fd);
+    return;
+  }
+  std::list<Buffer> packets;
+  if (sock_svc->receiveFlaps(packets))
+  {
+    gSocketManager.DropSocket(sock_svc);
+    std::list<Buffer>::iterator iter;
+    for (iter = packets.begin(); iter != packets.end(); ++iter)
+    {
+      if (!svc->ProcessPacket(*iter))
+      {
+        gLog.warning(tr("Can't process packet for service 0x%02X."), svc->GetFam());
+        svc->ResetSocket();
+        svc->ChangeStatus(STATUS_UNINITIALIZED);
+        gSocketManager.CloseSocket(fd);
+        break;
+      }
+    }
+  }
+  else
+  {
+    gLog.warning(tr("Can't receive packet for service 0x%02X."), svc->GetFam());
+    svc->ResetSocket();
+    svc->ChangeStatus(STATUS_UNINITIALIZED);
+    gSocketManager.DropSocket(sock_svc);
+    gSocketManager.CloseSocket(fd);
+  }
+}
+
+void SocketMonitor::processListenSocket(Licq::INetSocket* s, int fd)
+{
+  DEBUG_THREADS("[SocketMonitor] Data on listening TCP socket.\n");
+  Licq::TCPSocket* tcp = dynamic_cast<Licq::TCPSocket*>(s);
+  if (tcp == NULL)
+  {
+    gLog.warning(tr("Invalid server TCP socket in set."));
+    gSocketManager.DropSocket(s);
+    close(fd);
+    return;
+  }
+
+  DcSocket* newSocket = new DcSocket();
+  bool ok = tcp->RecvConnection(*newSocket);
+  gSocketManager.DropSocket(tcp);
+
+  // Make sure we can handle another socket before accepting it
+  if (!ok || gSocketManager.Num() > MAX_CONNECTS)
+  {
+    // Too many sockets, drop this one
+    gLog.warning(tr("Too many connected sockets, rejecting connection from %s."),
+        newSocket->getRemoteIpString().c_str());
+    delete newSocket;
+  }
+  else if (!gSocketManager.AddSocket(newSocket))
+    delete newSocket;
+  else
+    gSocketManager.DropSocket(newSocket);
+}
+
+void SocketMonitor::processDirectSocket(Licq::INetSocket* s, int fd)
+{
+  DEBUG_THREADS("[SocketMonitor] Data on TCP user socket.\n");
+
+  DcSocket* tcp = dynamic_cast<DcSocket*>(s);
+
+  // If tcp is NULL then the socket is no longer in the set, hence it
+  // must have been closed by us and we can ignore it.
+  if (tcp == NULL)
+  {
+    gSocketManager.DropSocket(s);
+    return;
+  }
+
+  // SSL may have decrypted more data than the packet we read, keep reading
+  // until it's all been processed
+  bool pending;
+  do
+  {
+    if (!tcp->RecvPacket())
+    {
+      int err = tcp->Error();
+      if (err == 0)
+        gLog.info(tr("Connection to %s was closed."), tcp->userId().toString().c_str());
+      else
+        gLog.info(tr("Connection to %s lost: %s."),
+            tcp->userId().toString().c_str(), tcp->errorStr().c_str());
+      if (tcp->userId().isValid())
+      {
+        Licq::UserWriteGuard u(tcp->userId());
+        if (u.isLocked() && u->Secure())
+        {
+          u->clearSocketDesc(tcp);
+          u->SetSecure(false);
+          Licq::gPluginManager.pushPluginSignal(new Licq::PluginSignal(
+              Licq::PluginSignal::SignalUser,
+              Licq::PluginSignal::UserSecurity, u->id(), 0));
+        }
+      }
+      gSocketManager.DropSocket(tcp);
+      gSocketManager.CloseSocket(fd);
+      gIcqProtocol.FailEvents(fd, err);
+      return;
+    }
+
+    // Save the bytes pending status of the socket
+    pending = tcp->SSL_Pending();
+    bool r = true;
+
+    // Process the packet if the buffer is full
+    if (tcp->RecvBufferFull())
+    {
+      if (tcp->userId().protocolId() != ICQ_PPID)
+        r = gIcqProtocol.ProcessTcpHandshake(tcp);
+      else
+        r = gIcqProtocol.ProcessTcpPacket(tcp);
+      tcp->ClearRecvBuffer();
+    }
+
+    // Kill the socket if there was a problem
+    if (!r)
+    {
+      gLog.info(tr("Closing connection to %s."), tcp->userId().toString().c_str());
+      gSocketManager.DropSocket(tcp);
+      gSocketManager.CloseSocket(fd);
+      gIcqProtocol.FailEvents(fd, 0);
+      return;
+    }
+  } while (pending);
+
+  gSocketManager.DropSocket(tcp);
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQICQ_SOCKETMONITOR_H
+#define LICQICQ_SOCKETMONITOR_H
+
+#include <boost/noncopyable.hpp>
+
+#include <licq/mainloop.h>
+#include <licq/socketmanager.h>
+
+namespace LicqIcq
+{
+
+/**
+ * Waits for activity on all sockets in the socket manager and processes
+ * incoming packets
+ *
+ * Sockets are added to and removed from the socket manager by other threads
+ * so the registered descriptors are synced with the socket manager after
+ * each event. Threads adding sockets must wake the monitor by writing 'S' to
+ * the new socket pipe.
+ */
+class SocketMonitor : private Licq::MainLoopCallback, private boost::noncopyable
+{
+public:
+  SocketMonitor();
+
+  /**
+   * Monitor sockets until 'X' is written to the new socket pipe
+   */
+  void run();
+
+private:
+  /// Update monitored descriptors if the socket manager has changed
+  void syncSockets();
+
+  /// Handle activity on a socket from the socket manager
+  void processSocket(int fd);
+
+  /// Read from the OSCAR server connection
+  void processServerSocket(Licq::INetSocket* s, int fd);
+
+  /// Read from the BART service connection
+  void processServiceSocket(Licq::INetSocket* s, int fd);
+
+  /// Accept a direct connection on the listening socket
+  void processListenSocket(Licq::INetSocket* s, int fd);
+
+  /// Read from a direct connection
+  void processDirectSocket(Licq::INetSocket* s, int fd);
+
+  // From Licq::MainLoopCallback
+  void rawFileEvent(int fd, int revents);
+
+  Licq::MainLoop myMainLoop;
+  Licq::SocketSet::SerialMap mySockets;
+  unsigned long myChangeCount;
+};
+
+} // namespace LicqIcq
+
+#endif
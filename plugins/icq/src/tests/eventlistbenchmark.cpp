@@ -0,0 +1,170 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Measures ack lookups in EventList with 10 to 100000 events waiting for a
+ * reply, compared to scanning a list of events like the plugin used to do.
+ *
+ * Not built by default, use "make eventlistbenchmark" in the build directory.
+ */
+
+#include "../eventlist.h"
+
+#include <cstdio>
+#include <ctime>
+#include <list>
+#include <vector>
+
+#include <licq/event.h>
+
+using LicqIcq::EventList;
+
+// Dummy implementations of the Licq::Event functions used by EventList, the
+// real ones are part of the daemon
+Licq::Event::Event(int socket, Licq::Packet* /* p */, ConnectType connect,
+    const UserId& userId, Licq::UserEvent* /* e */)
+{
+  m_eConnect = connect;
+  m_nSequence = 0;
+  m_nSubSequence = 0;
+  m_nSocketDesc = socket;
+  myUserId = userId;
+  m_pPacket = NULL;
+  m_nEventId = 0;
+}
+
+Licq::Event::~Event()
+{
+  // Empty
+}
+
+bool Licq::Event::CompareEvent(int sockfd, unsigned short sequence) const
+{
+  return m_nSocketDesc == sockfd && m_nSequence == sequence;
+}
+
+unsigned long Licq::Event::EventId() const
+{
+  return m_nEventId;
+}
+
+namespace
+{
+
+const int Socket = 5;
+const int NumLookups = 2000;
+
+class BenchmarkEvent : public Licq::Event
+{
+public:
+  BenchmarkEvent(unsigned long id)
+    : Event(Socket, NULL, ConnectServer)
+  {
+    m_nSequence = id & 0xffff;
+    m_nSubSequence = id & 0xffff;
+    m_nEventId = id;
+  }
+
+  bool matches(int socket, unsigned short sequence) const
+  { return CompareEvent(socket, sequence); }
+};
+
+double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Replies don't arrive in the order events were sent, pick events spread
+// over the whole list
+BenchmarkEvent* pick(std::vector<BenchmarkEvent*>& events, int i)
+{
+  return events[(i * 7919ul) % events.size()];
+}
+
+/**
+ * Ack an event and send a new one, keeping a steady number of events waiting
+ */
+double benchmarkEventList(std::vector<BenchmarkEvent*>& events)
+{
+  EventList list;
+  for (size_t i = 0; i < events.size(); ++i)
+    list.push(events[i]);
+
+  double start = now();
+  for (int i = 0; i < NumLookups; ++i)
+  {
+    // With more than 65536 events waiting, sequences are no longer unique
+    Licq::Event* e = list.find(Socket, pick(events, i)->Sequence());
+    if (e == NULL)
+      return -1;
+    list.remove(e);
+    list.push(e);
+  }
+  return now() - start;
+}
+
+double benchmarkScan(std::vector<BenchmarkEvent*>& events)
+{
+  std::list<BenchmarkEvent*> list(events.begin(), events.end());
+
+  double start = now();
+  for (int i = 0; i < NumLookups; ++i)
+  {
+    unsigned short sequence = pick(events, i)->Sequence();
+    std::list<BenchmarkEvent*>::iterator iter;
+    for (iter = list.begin(); iter != list.end(); ++iter)
+      if ((*iter)->matches(Socket, sequence))
+        break;
+    if (iter == list.end())
+      return -1;
+    BenchmarkEvent* e = *iter;
+    list.erase(iter);
+    list.push_back(e);
+  }
+  return now() - start;
+}
+
+} // namespace
+
+int main()
+{
+  for (unsigned long numEvents = 10; numEvents <= 100000; numEvents *= 10)
+  {
+    std::vector<BenchmarkEvent*> events;
+    for (unsigned long i = 0; i < numEvents; ++i)
+      events.push_back(new BenchmarkEvent(i + 1));
+
+    double indexMs = benchmarkEventList(events);
+    double scanMs = benchmarkScan(events);
+    if (indexMs < 0 || scanMs < 0)
+    {
+      fprintf(stderr, "Event not found\n");
+      return 1;
+    }
+
+    printf("%6lu events waiting: %.3f us/ack indexed, %.3f us/ack scanned\n",
+        numEvents, indexMs * 1000 / NumLookups, scanMs * 1000 / NumLookups);
+
+    for (size_t i = 0; i < events.size(); ++i)
+      delete events[i];
+  }
+  return 0;
+}
@@ -71,7 +71,8 @@ void Plugin::rawFileEvent(int fd, int /*revents*/)
   switch (ch)
   {
     case PipeSignal:
-      processSignal(popSignal().get());
+      while (boost::shared_ptr<const Licq::ProtocolSignal> signal = popSignal())
+        processSignal(signal.get());
       break;
     case PipeShutdown:
       doLogoff();
@@ -367,7 +367,8 @@ void CMSN::rawFileEvent(int fd, int /*revents*/)
   {
     case PipeSignal:
     {
-      ProcessSignal(popSignal().get());
+      while (boost::shared_ptr<const Licq::ProtocolSignal> s = popSignal())
+        ProcessSignal(s.get());
       break;
     }
 
@@ -273,6 +273,10 @@ int OsdPlugin::run()
   int nPipe = getReadPipe();
   setSignalMask(Licq::PluginSignal::SignalUser |
       Licq::PluginSignal::SignalLogon | Licq::PluginSignal::SignalLogoff);
+  subscribeSubSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserStatus);
+  subscribeSubSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserEvents);
     bool Exit=false; // exit plugin?
     char buf[16];
 
@@ -300,8 +304,9 @@ int OsdPlugin::run()
 	{
       case PipeSignal:
       {
-        // read the actual signal from the daemon
-        ProcessSignal(popSignal().get());
+        // read the actual signals from the daemon
+        while (boost::shared_ptr<const Licq::PluginSignal> s = popSignal())
+          ProcessSignal(s.get());
         break;
       }
 
@@ -311,7 +316,8 @@ int OsdPlugin::run()
       case PipeEvent:
       {
         gLog.warning("Event received - should not happen in this plugin");
-        popEvent();
+        while (popEvent())
+          ;
         break;
       }
 	    // shutdown command from daemon
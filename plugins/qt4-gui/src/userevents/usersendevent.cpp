@@ -235,17 +235,39 @@ UserSendEvent::UserSendEvent(int type, const Licq::UserId& userId, QWidget* pare
     if (u.isLocked() && (historyCount > 0 || historyTime > 0))
     {
       // Show recent messages in the history
+      // Only read the tail of the history. The time limit is checked by walking
+      // back to the first older message, as history isn't strictly in time
+      // order, so keep reading more until such a message has been read.
+      unsigned short nNewMessages = u->NewMessages();
+      time_t timeLimit = time(NULL) - historyTime;
       Licq::HistoryList lHistoryList;
-      if (u->GetHistory(lHistoryList))
+      size_t historySize = u->historySize();
+      size_t loadCount = historyCount + nNewMessages + 1;
+      bool historyLoaded;
+      while (true)
+      {
+        historyLoaded = u->getHistoryLast(lHistoryList, loadCount);
+        if (!historyLoaded || loadCount >= historySize)
+          break;
+
+        bool foundOlder = false;
+        Licq::HistoryList::iterator iter = lHistoryList.begin();
+        for (size_t i = historyCount + nNewMessages; i < lHistoryList.size() && !foundOlder; i++, iter++)
+          foundOlder = ((*iter)->Time() < timeLimit);
+        if (foundOlder)
+          break;
+
+        Licq::User::ClearHistory(lHistoryList);
+        loadCount *= 2;
+      }
+      if (historyLoaded)
       {
         // Rewind to the starting point. This will be the first message shown in the dialog.
         // Make sure we don't show the new messages waiting.
-        unsigned short nNewMessages = u->NewMessages();
         Licq::HistoryList::iterator lHistoryIter = lHistoryList.end();
         for (int i = 0; i < historyCount + nNewMessages && lHistoryIter != lHistoryList.begin(); i++)
           lHistoryIter--;
 
-        time_t timeLimit = time(NULL) - historyTime;
         while (lHistoryIter != lHistoryList.begin())
         {
           lHistoryIter--;
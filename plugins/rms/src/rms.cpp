@@ -23,12 +23,14 @@
 #include <boost/foreach.hpp>
 #include <cctype>
 #include <climits>
+#include <cstdarg>
 #include <cstdio>
 #include <cstring>
 #include <sstream>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 #include <cerrno>
 
 #include <licq/buffer.h>
@@ -47,6 +49,7 @@
 #include <licq/plugin/pluginmanager.h>
 #include <licq/pluginsignal.h>
 #include <licq/protocolmanager.h>
+#include <licq/thread/mutexlocker.h>
 #include <licq/translator.h>
 #include <licq/userevents.h>
 
@@ -90,6 +93,7 @@ const unsigned short CODE_SECURExSTAT = 228;
 const unsigned short CODE_NOTIFYxON = 229;
 const unsigned short CODE_NOTIFYxOFF = 230;
 const unsigned short CODE_HISTORYxEND = 231;
+const unsigned short CODE_SIGNALxSTATS = 232;
 const unsigned short CODE_VIEWxUNKNOWN = 299;
 // 300 - further action required
 const unsigned short CODE_ENTERxUIN = 300;
@@ -170,6 +174,8 @@ static struct Command commands[] =
     "Send an sms { <uin> }." },
   { "NOTIFY", &CRMSClient::Process_NOTIFY,
     "Notify events" },
+  { "SIGNALS", &CRMSClient::Process_SIGNALS,
+    "Show number of waiting and merged user update signals." },
 };
 
 static const unsigned short NUM_COMMANDS = sizeof(commands)/sizeof(*commands);
@@ -240,6 +246,9 @@ int CLicqRMS::run()
 {
   setSignalMask(Licq::PluginSignal::SignalAll);
 
+  // Only current user data is sent to clients so waiting updates can be merged
+  setSignalCoalescing(true);
+
   Licq::IniFile conf(myConfigFile);
   if (conf.loadFile())
   {
@@ -363,18 +372,16 @@ void CLicqRMS::ProcessPipe()
   switch (buf)
   {
     case PipeSignal:
-      if (m_bEnabled)
-        ProcessSignal(popSignal().get());
-      else
-        popSignal();
+      while (boost::shared_ptr<const Licq::PluginSignal> s = popSignal())
+        if (m_bEnabled)
+          ProcessSignal(s.get());
       break;
 
     case PipeEvent:
       // An event is pending (should never happen)
-      if (m_bEnabled)
-        ProcessEvent(popEvent().get());
-      else
-        popEvent();
+      while (boost::shared_ptr<const Licq::Event> e = popEvent())
+        if (m_bEnabled)
+          ProcessEvent(e.get());
       break;
 
     case PipeShutdown:
@@ -416,18 +423,18 @@ void CLicqRMS::ProcessLog()
       if (packetInBitmask(client->myLogLevelsBitmask)
           && !message->packet.empty())
       {
-        ::fprintf(client->fs, "%d %s [%s] %s: %s\n%s\n",
-                  CODE_LOG, time.c_str(), level,
-                  message->sender.c_str(), message->text.c_str(),
-                  packetToString(message).c_str());
+        client->print("%d %s [%s] %s: %s\n%s\n",
+                      CODE_LOG, time.c_str(), level,
+                      message->sender.c_str(), message->text.c_str(),
+                      packetToString(message).c_str());
       }
       else
       {
-        ::fprintf(client->fs, "%d %s [%s] %s: %s\n",
-                  CODE_LOG, time.c_str(), level,
-                  message->sender.c_str(), message->text.c_str());
+        client->print("%d %s [%s] %s: %s\n",
+                      CODE_LOG, time.c_str(), level,
+                      message->sender.c_str(), message->text.c_str());
       }
-      ::fflush(client->fs);
+      client->flush();
     }
   }
 }
@@ -451,8 +458,8 @@ void CLicqRMS::ProcessSignal(const Licq::PluginSignal* s)
         {
           if ((*iter)->m_bNotify)
           {
-            fprintf((*iter)->fs, "%d %s\n", CODE_NOTIFYxSTATUS, u->usprintf("%u %P %-20a %3m %s").c_str());
-            fflush((*iter)->fs);
+            (*iter)->print("%d %s\n", CODE_NOTIFYxSTATUS, u->usprintf("%u %P %-20a %3m %s").c_str());
+            (*iter)->flush();
           }
         }
         }
@@ -468,8 +475,8 @@ void CLicqRMS::ProcessSignal(const Licq::PluginSignal* s)
         {
           if ((*iter)->m_bNotify)
           {
-            fprintf((*iter)->fs, "%d %s\n", CODE_NOTIFYxMESSAGE, u->usprintf("%u %P %3m").c_str());
-            fflush((*iter)->fs);
+            (*iter)->print("%d %s\n", CODE_NOTIFYxMESSAGE, u->usprintf("%u %P %3m").c_str());
+            (*iter)->flush();
           }
         }
       }
@@ -503,6 +510,13 @@ void CLicqRMS::socketEvent(Licq::INetSocket* inetSocket, int /* revents */)
   }
 }
 
+bool RMSSocket::sendText(const std::string& text)
+{
+  Licq::MutexLocker locker(mySendMutex);
+  return queueSend(text.data(), text.size());
+}
+
+
 /*---------------------------------------------------------------------------
  * CRMSClient::constructor
  *-------------------------------------------------------------------------*/
@@ -510,13 +524,13 @@ CRMSClient::CRMSClient(Licq::TCPSocket* sin)
   : myLogLevelsBitmask(0)
 {
   sin->RecvConnection(sock);
+  sock.setSendQueueLimit(MAX_CLIENT_QUEUE);
   licqRMS->myMainLoop.addSocket(&sock, this);
 
   gLog.info("Client connected from %s", sock.getRemoteIpString().c_str());
-  fs = fdopen(sock.Descriptor(), "r+");
-  fprintf(fs, "Licq Remote Management Server v" PLUGIN_VERSION_STRING "\n"
+  print("Licq Remote Management Server v" PLUGIN_VERSION_STRING "\n"
       "%d Enter your UIN:\n", CODE_ENTERxUIN);
-  fflush(fs);
+  flush();
 
   m_szCheckId = 0;
   m_nState = STATE_UIN;
@@ -537,6 +551,41 @@ CRMSClient::~CRMSClient()
     free(m_szCheckId);
 }
 
+void CRMSClient::print(const char* format, ...)
+{
+  char buf[MAX_TEXT_LENGTH];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+
+  if (len < 0)
+    return;
+  if (static_cast<size_t>(len) < sizeof(buf))
+  {
+    myOutput.append(buf, len);
+    return;
+  }
+
+  // Too long for the stack buffer, format again with enough room
+  std::vector<char> bigBuf(len + 1);
+  va_start(args, format);
+  vsnprintf(&bigBuf[0], bigBuf.size(), format, args);
+  va_end(args);
+  myOutput.append(&bigBuf[0], len);
+}
+
+int CRMSClient::flush()
+{
+  if (myOutput.empty())
+    return 0;
+
+  // A client that doesn't read its output only gets what fits in the queue
+  bool sent = sock.sendText(myOutput);
+  myOutput.clear();
+  return sent ? 0 : EOF;
+}
+
 void CRMSClient::socketEvent(Licq::INetSocket* /*inetSocket*/, int /*revents*/)
 {
   if (Activity() == -1)
@@ -632,8 +681,8 @@ bool CRMSClient::ProcessEvent(const Licq::Event* e)
       szr = "cancelled";
       break;
   }
-  fprintf(fs, "%d [%ld] Event %s.\n", nCode, tag, szr);
-  fflush(fs);
+  print("%d [%ld] Event %s.\n", nCode, tag, szr);
+  flush();
 
   return true;
 }
@@ -690,8 +739,8 @@ int CRMSClient::StateMachine()
     case STATE_UIN:
     {
       myLoginUser = data_line;
-      fprintf(fs, "%d Enter your password:\n", CODE_ENTERxPASSWORD);
-      fflush(fs);
+      print("%d Enter your password:\n", CODE_ENTERxPASSWORD);
+      flush();
       m_nState = STATE_PASSWORD;
       break;
     }
@@ -720,15 +769,15 @@ int CRMSClient::StateMachine()
       {
         gLog.info("Client failed validation from %s",
             sock.getRemoteIpString().c_str());
-        fprintf(fs, "%d Invalid ID/Password.\n", CODE_INVALID);
-        fflush(fs);
+        print("%d Invalid ID/Password.\n", CODE_INVALID);
+        flush();
         return -1;
       }
       gLog.info("Client validated from %s",
           sock.getRemoteIpString().c_str());
-      fprintf(fs, "%d Hello %s.  Type HELP for assistance.\n", CODE_HELLO,
+      print("%d Hello %s.  Type HELP for assistance.\n", CODE_HELLO,
          name.c_str());
-      fflush(fs);
+      flush();
       m_nState = STATE_COMMAND;
       break;
     }
@@ -807,9 +856,9 @@ int CRMSClient::ProcessCommand()
       return  (this->*(commands[i].fcn))();
   }
 
-  fprintf(fs, "%d Invalid command.  Type HELP for assistance.\n",
+  print("%d Invalid command.  Type HELP for assistance.\n",
      CODE_INVALIDxCOMMAND);
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -826,24 +875,24 @@ int CRMSClient::Process_INFO()
   Licq::UserReadGuard u(myUserId);
   if (!u.isLocked())
   {
-    fprintf(fs, "%d No such user.\n", CODE_INVALIDxUSER);
-    return fflush(fs);
+    print("%d No such user.\n", CODE_INVALIDxUSER);
+    return flush();
   }
 
-  fprintf(fs, "%d %s Alias: %s\n", CODE_USERxINFO, u->accountId().c_str(),
+  print("%d %s Alias: %s\n", CODE_USERxINFO, u->accountId().c_str(),
       u->getAlias().c_str());
-  fprintf(fs, "%d %s Status: %s\n", CODE_USERxINFO, u->accountId().c_str(),
+  print("%d %s Status: %s\n", CODE_USERxINFO, u->accountId().c_str(),
       u->statusString().c_str());
-  fprintf(fs, "%d %s First Name: %s\n", CODE_USERxINFO, u->accountId().c_str(),
+  print("%d %s First Name: %s\n", CODE_USERxINFO, u->accountId().c_str(),
     u->getFirstName().c_str());
-  fprintf(fs, "%d %s Last Name: %s\n", CODE_USERxINFO, u->accountId().c_str(),
+  print("%d %s Last Name: %s\n", CODE_USERxINFO, u->accountId().c_str(),
     u->getLastName().c_str());
-  fprintf(fs, "%d %s Email 1: %s\n", CODE_USERxINFO, u->accountId().c_str(),
+  print("%d %s Email 1: %s\n", CODE_USERxINFO, u->accountId().c_str(),
     u->getUserInfoString("Email1").c_str());
-  fprintf(fs, "%d %s Email 2: %s\n", CODE_USERxINFO, u->accountId().c_str(),
+  print("%d %s Email 2: %s\n", CODE_USERxINFO, u->accountId().c_str(),
     u->getUserInfoString("Email2").c_str());
 
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -866,11 +915,11 @@ int CRMSClient::Process_STATUS()
     {
       Licq::ProtocolPlugin::Ptr protocol = Licq::gPluginManager.getProtocolPlugin(owner->protocolId());
       Licq::OwnerReadGuard o(owner);
-      fprintf(fs, "%d %s %s %s\n", CODE_STATUS, o->accountId().c_str(),
+      print("%d %s %s %s\n", CODE_STATUS, o->accountId().c_str(),
           protocol->name().c_str(), o->statusString().c_str());
     }
-    fprintf(fs, "%d\n", CODE_STATUSxDONE);
-    return fflush(fs);
+    print("%d\n", CODE_STATUSxDONE);
+    return flush();
   }
 
   // Set status
@@ -903,8 +952,8 @@ int CRMSClient::Process_STATUS()
   BOOST_FOREACH(const Licq::UserId& ownerId, owners)
     changeStatus(ownerId, status);
 
-  fprintf(fs, "%d Done setting status\n", CODE_STATUSxDONE);
-  return fflush(fs);
+  print("%d Done setting status\n", CODE_STATUSxDONE);
+  return flush();
 }
 
 int CRMSClient::changeStatus(const Licq::UserId& ownerId, const string& strStatus)
@@ -912,15 +961,15 @@ int CRMSClient::changeStatus(const Licq::UserId& ownerId, const string& strStatu
   unsigned status;
   if (!Licq::User::stringToStatus(strStatus, status))
   {
-    fprintf(fs, "%d Invalid status.\n", CODE_INVALIDxSTATUS);
+    print("%d Invalid status.\n", CODE_INVALIDxSTATUS);
     return -1;
   }
   if (status == Licq::User::OfflineStatus)
   {
-    fprintf(fs, "%d [0] Logging off %s.\n", CODE_COMMANDxSTART, strStatus.c_str());
-    fflush(fs);
+    print("%d [0] Logging off %s.\n", CODE_COMMANDxSTART, strStatus.c_str());
+    flush();
     gProtocolManager.setStatus(ownerId, Licq::User::OfflineStatus);
-    fprintf(fs, "%d [0] Event done.\n", CODE_STATUSxDONE);
+    print("%d [0] Event done.\n", CODE_STATUSxDONE);
     return 0;
   }
   else
@@ -930,16 +979,16 @@ int CRMSClient::changeStatus(const Licq::UserId& ownerId, const string& strStatu
       Licq::OwnerReadGuard o(ownerId);
       if (!o.isLocked())
       {
-        fprintf(fs, "%d Invalid protocol.\n", CODE_INVALIDxUSER);
+        print("%d Invalid protocol.\n", CODE_INVALIDxUSER);
         return -1;
       }
       b = !o->isOnline();
     }
     unsigned long tag = gProtocolManager.setStatus(ownerId, status);
     if (b)
-      fprintf(fs, "%d [%ld] Logging on to %s.\n", CODE_COMMANDxSTART, tag, strStatus.c_str());
+      print("%d [%ld] Logging on to %s.\n", CODE_COMMANDxSTART, tag, strStatus.c_str());
     else
-      fprintf(fs, "%d [%ld] Setting status for %s.\n", CODE_COMMANDxSTART, tag, strStatus.c_str());
+      print("%d [%ld] Setting status for %s.\n", CODE_COMMANDxSTART, tag, strStatus.c_str());
     tags.push_back(tag);
   }
   return 0;
@@ -950,8 +999,8 @@ int CRMSClient::changeStatus(const Licq::UserId& ownerId, const string& strStatu
  *-------------------------------------------------------------------------*/
 int CRMSClient::Process_QUIT()
 {
-  fprintf(fs, "%d Sayonara.\n", CODE_QUIT);
-  fflush(fs);
+  print("%d Sayonara.\n", CODE_QUIT);
+  flush();
   if (strtoul(data_arg, (char**)NULL, 10) > 0)
     licqRMS->myMainLoop.quit();
   return -1;
@@ -975,9 +1024,9 @@ int CRMSClient::Process_HELP()
 {
   for (unsigned short i = 0; i < NUM_COMMANDS; i++)
   {
-    fprintf(fs, "%d %s: %s\n", CODE_HELP, commands[i].name, commands[i].help);
+    print("%d %s: %s\n", CODE_HELP, commands[i].name, commands[i].help);
   }
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -997,18 +1046,18 @@ int CRMSClient::Process_HELP()
  *-------------------------------------------------------------------------*/
 int CRMSClient::Process_GROUPS()
 {
-  fprintf(fs, "%d 000 All Users\n", CODE_LISTxGROUP);
+  print("%d 000 All Users\n", CODE_LISTxGROUP);
   int i = 1;
   Licq::GroupListGuard groupList;
   BOOST_FOREACH(const Licq::Group* group, **groupList)
   {
     Licq::GroupReadGuard pGroup(group);
-    fprintf(fs, "%d %03d %s\n", CODE_LISTxGROUP, i, pGroup->name().c_str());
+    print("%d %03d %s\n", CODE_LISTxGROUP, i, pGroup->name().c_str());
     ++i;
   }
-  fprintf(fs, "%d\n", CODE_LISTxDONE);
+  print("%d\n", CODE_LISTxDONE);
 
-  return fflush(fs);
+  return flush();
 }
 
 int CRMSClient::Process_HISTORY()
@@ -1016,8 +1065,8 @@ int CRMSClient::Process_HISTORY()
   char* s = strtok(data_arg, " ");
   if (s == NULL)
   {
-    fprintf(fs, "%d Invalid User.\n", CODE_INVALIDxUSER);
-    return fflush(fs);
+    print("%d Invalid User.\n", CODE_INVALIDxUSER);
+    return flush();
   }
   ParseUser(s);
 
@@ -1039,13 +1088,13 @@ int CRMSClient::Process_HISTORY()
     Licq::UserReadGuard u(myUserId);
     if (!u.isLocked())
     {
-      fprintf(fs, "%d Invalid User (%s).\n", CODE_INVALIDxUSER, myUserId.toString().c_str());
-      return fflush(fs);
+      print("%d Invalid User (%s).\n", CODE_INVALIDxUSER, myUserId.toString().c_str());
+      return flush();
     }
     if (!u->GetHistory(history))
     {
-      fprintf(fs, "%d Cannot load history file.\n", CODE_EVENTxERROR);
-      return fflush(fs);
+      print("%d Cannot load history file.\n", CODE_EVENTxERROR);
+      return flush();
     }
 
     if (u->isUser())
@@ -1072,8 +1121,8 @@ int CRMSClient::Process_HISTORY()
 
     printUserEvent(*it, ((*it)->isReceiver() ? userAlias : ownerAlias));
   }
-  fprintf(fs, "%d End.\n", CODE_HISTORYxEND);
-  return fflush(fs);
+  print("%d End.\n", CODE_HISTORYxEND);
+  return flush();
 }
 
 
@@ -1139,12 +1188,12 @@ int CRMSClient::Process_LIST()
     if (pUser->isInGroup(nGroup) &&
         ((!pUser->isOnline() && n&2) || (pUser->isOnline() && n&1)))
     {
-      fprintf(fs, "%d %s\n", CODE_LISTxUSER, pUser->usprintf(format).c_str());
+      print("%d %s\n", CODE_LISTxUSER, pUser->usprintf(format).c_str());
     }
   }
-  fprintf(fs, "%d\n", CODE_LISTxDONE);
+  print("%d\n", CODE_LISTxDONE);
 
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1166,7 +1215,7 @@ int CRMSClient::Process_LIST()
  *-------------------------------------------------------------------------*/
 int CRMSClient::Process_MESSAGE()
 {
-  fprintf(fs, "%d Enter message, terminate with a . on a line by itself:\n",
+  print("%d Enter message, terminate with a . on a line by itself:\n",
      CODE_ENTERxTEXT);
 
   ParseUser(data_arg);
@@ -1174,7 +1223,7 @@ int CRMSClient::Process_MESSAGE()
   myText.clear();
 
   m_nState = STATE_ENTERxMESSAGE;
-  return fflush(fs);
+  return flush();
 }
 
 int CRMSClient::Process_MESSAGE_text()
@@ -1184,13 +1233,13 @@ int CRMSClient::Process_MESSAGE_text()
   unsigned long tag = gProtocolManager.sendMessage(myUserId,
       Licq::gTranslator.toUtf8(myText));
 
-  fprintf(fs, "%d [%ld] Sending message to %s.\n", CODE_COMMANDxSTART,
+  print("%d [%ld] Sending message to %s.\n", CODE_COMMANDxSTART,
       tag, myUserId.toString().c_str());
 
   tags.push_back(tag);
   m_nState = STATE_COMMAND;
 
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1220,7 +1269,7 @@ int CRMSClient::Process_URL()
   myText.clear();
 
   m_nState = STATE_ENTERxURL;
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1228,13 +1277,13 @@ int CRMSClient::Process_URL_url()
 {
   myLine = data_line;
 
-  fprintf(fs, "%d Enter description, terminate with a . on a line by itself:\n",
+  print("%d Enter description, terminate with a . on a line by itself:\n",
      CODE_ENTERxTEXT);
 
   myText.clear();
 
   m_nState = STATE_ENTERxURLxDESCRIPTION;
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1243,13 +1292,13 @@ int CRMSClient::Process_URL_text()
   unsigned long tag = gProtocolManager.sendUrl(myUserId, myLine,
       Licq::gTranslator.toUtf8(myText));
 
-  fprintf(fs, "%d [%ld] Sending URL to %s.\n", CODE_COMMANDxSTART,
+  print("%d [%ld] Sending URL to %s.\n", CODE_COMMANDxSTART,
       tag, myUserId.toString().c_str());
 
   tags.push_back(tag);
   m_nState = STATE_COMMAND;
 
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1277,15 +1326,15 @@ int CRMSClient::Process_SMS()
 
   if (!myUserId.isValid())
   {
-    fprintf(fs, "%d Invalid UIN.\n", CODE_INVALIDxUSER);
-    return fflush(fs);
+    print("%d Invalid UIN.\n", CODE_INVALIDxUSER);
+    return flush();
   }
-  fprintf(fs, "%d Enter NUMBER:\n", CODE_ENTERxLINE);
+  print("%d Enter NUMBER:\n", CODE_ENTERxLINE);
 
   myText.clear();
 
   m_nState = STATE_ENTERxSMSxNUMBER;
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1293,13 +1342,13 @@ int CRMSClient::Process_SMS_number()
 {
   myLine = data_line;
 
-  fprintf(fs, "%d Enter message, terminate with a . on a line by itself:\n",
+  print("%d Enter message, terminate with a . on a line by itself:\n",
      CODE_ENTERxTEXT);
 
   myText.clear();
 
   m_nState = STATE_ENTERxSMSxMESSAGE;
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1308,18 +1357,18 @@ int CRMSClient::Process_SMS_message()
   Licq::IcqProtocol::Ptr icq = plugin_internal_cast<Licq::IcqProtocol>(
       Licq::gPluginManager.getProtocolInstance(myUserId.ownerId()));
   if (!icq)
-    return fflush(fs);
+    return flush();
 
   unsigned long tag = icq->icqSendSms(
       myUserId, myLine, Licq::gTranslator.toUtf8(myText));
 
-  fprintf(fs, "%d [%lu] Sending SMS to %s (%s).\n", CODE_COMMANDxSTART,
+  print("%d [%lu] Sending SMS to %s (%s).\n", CODE_COMMANDxSTART,
      tag, myUserId.accountId().c_str(), myLine.c_str());
 
   tags.push_back(tag);
   m_nState = STATE_COMMAND;
 
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1349,18 +1398,18 @@ int CRMSClient::Process_AR()
 
     if (!myUserId.isValid())
     {
-      fprintf(fs, "%d Invalid User.\n", CODE_INVALIDxUSER);
-      return fflush(fs);
+      print("%d Invalid User.\n", CODE_INVALIDxUSER);
+      return flush();
     }
   }
 
-  fprintf(fs, "%d Enter %sauto response, terminate with a . on a line by itself:\n",
+  print("%d Enter %sauto response, terminate with a . on a line by itself:\n",
      CODE_ENTERxTEXT, myUserId.isValid() ? "custom " : "");
 
   myText.clear();
 
   m_nState = STATE_ENTERxAUTOxRESPONSE;
-  return fflush(fs);
+  return flush();
 }
 
 int CRMSClient::Process_AR_text()
@@ -1384,9 +1433,9 @@ int CRMSClient::Process_AR_text()
       u->setCustomAutoResponse(textUtf8);
   }
 
-  fprintf(fs, "%d Auto response saved.\n", CODE_RESULTxSUCCESS);
+  print("%d Auto response saved.\n", CODE_RESULTxSUCCESS);
   m_nState = STATE_COMMAND;
-  return fflush(fs);
+  return flush();
 }
 
 
@@ -1407,9 +1456,9 @@ int CRMSClient::Process_LOG()
 
   licqRMS->setupLogSink();
 
-  fprintf(fs, "%d Log type set to %d.\n", CODE_LOGxTYPE, lt);
+  print("%d Log type set to %d.\n", CODE_LOGxTYPE, lt);
 
-  return fflush(fs);
+  return flush();
 }
 
 /*---------------------------------------------------------------------------
@@ -1427,11 +1476,28 @@ int CRMSClient::Process_NOTIFY()
   m_bNotify = !m_bNotify;
 
   if (m_bNotify)
-    fprintf(fs, "%d Notify set ON.\n", CODE_NOTIFYxON);
+    print("%d Notify set ON.\n", CODE_NOTIFYxON);
   else
-    fprintf(fs, "%d Notify set OFF.\n", CODE_NOTIFYxOFF);
+    print("%d Notify set OFF.\n", CODE_NOTIFYxOFF);
+
+  return flush();
+}
 
-  return fflush(fs);
+/*---------------------------------------------------------------------------
+ * CRMSClient::Process_SIGNALS
+ *
+ * Command:
+ *   SIGNALS
+ *
+ * Response:
+ *   CODE_SIGNALxSTATS <waiting> <merged>
+ *-------------------------------------------------------------------------*/
+int CRMSClient::Process_SIGNALS()
+{
+  print("%d %lu %lu\n", CODE_SIGNALxSTATS,
+      static_cast<unsigned long>(licqRMS->signalQueueLength()),
+      licqRMS->mergedSignalCount());
+  return flush();
 }
 
 /*---------------------------------------------------------------------------
@@ -1467,29 +1533,29 @@ int CRMSClient::Process_VIEW()
 
     if (!myUserId.isValid())
     {
-      fprintf(fs, "%d No new messages.\n", CODE_VIEWxNONE);
-      return fflush(fs);
+      print("%d No new messages.\n", CODE_VIEWxNONE);
+      return flush();
     }
   }
 
   Licq::UserWriteGuard u(myUserId);
   if (!u.isLocked())
   {
-    fprintf(fs, "%d No such user.\n", CODE_INVALIDxUSER);
-    return fflush(fs);
+    print("%d No such user.\n", CODE_INVALIDxUSER);
+    return flush();
   }
 
   Licq::UserEvent* e = u->EventPop();
   printUserEvent(e, u->getAlias());
 
-  return fflush(fs);
+  return flush();
 }
 
 void CRMSClient::printUserEvent(const Licq::UserEvent* e, const string& alias)
 {
   if (e == NULL)
   {
-    fprintf(fs, "%d Invalid event\n", CODE_EVENTxERROR);
+    print("%d Invalid event\n", CODE_EVENTxERROR);
     return;
   }
 
@@ -1521,19 +1587,19 @@ void CRMSClient::printUserEvent(const Licq::UserEvent* e, const string& alias)
   eventHeader << "\n";
 
   // Write out the event header
-  fputs(eventHeader.str().c_str(), fs);
+  myOutput += eventHeader.str();
 
   // Timestamp
   char szTime[25];
   time_t nMessageTime = e->Time();
   struct tm* pTM = localtime(&nMessageTime);
   strftime(szTime, 25, "%Y-%m-%d %H:%M:%S", pTM);
-  fprintf(fs, "%d Sent At %s\n", CODE_VIEWxTIME, szTime);
+  print("%d Sent At %s\n", CODE_VIEWxTIME, szTime);
 
   // Message
-  fprintf(fs, "%d Message Start\n", CODE_VIEWxTEXTxSTART);
-  fputs(e->textLoc().c_str(), fs);
-  fprintf(fs, "\n%d Message Complete\n", CODE_VIEWxTEXTxEND);
+  print("%d Message Start\n", CODE_VIEWxTEXTxSTART);
+  myOutput += e->textLoc();
+  print("\n%d Message Complete\n", CODE_VIEWxTEXTxEND);
 }
 
 /*---------------------------------------------------------------------------
@@ -1551,18 +1617,18 @@ int CRMSClient::Process_ADDUSER()
 
   if (!myUserId.isValid())
   {
-    fprintf(fs, "%d Invalid UIN.\n", CODE_INVALIDxUSER);
+    print("%d Invalid UIN.\n", CODE_INVALIDxUSER);
   }
   else if (gUserManager.addUser(myUserId) != 0)
   {
-    fprintf(fs, "%d User added\n", CODE_ADDUSERxDONE);
+    print("%d User added\n", CODE_ADDUSERxDONE);
   }
   else
   {
-    fprintf(fs, "%d User not added\n", CODE_ADDUSERxERROR);
+    print("%d User not added\n", CODE_ADDUSERxERROR);
   }
 
-  return fflush(fs);
+  return flush();
 }
 
 /*---------------------------------------------------------------------------
@@ -1581,14 +1647,14 @@ int CRMSClient::Process_REMUSER()
   if (myUserId.isValid() && gUserManager.userExists(myUserId))
   {
     gUserManager.removeUser(myUserId);
-    fprintf(fs, "%d User removed\n", CODE_REMUSERxDONE);
+    print("%d User removed\n", CODE_REMUSERxDONE);
   }
   else
   {
-    fprintf(fs, "%d Invalid UIN.\n", CODE_INVALIDxUSER);
+    print("%d Invalid UIN.\n", CODE_INVALIDxUSER);
   }
 
-  return fflush(fs);
+  return flush();
 }
 
 /*---------------------------------------------------------------------------
@@ -1604,29 +1670,29 @@ int CRMSClient::Process_SECURE()
 {
   if (!Licq::gDaemon.haveCryptoSupport())
   {
-    fprintf(fs, "%d Licq secure channel not compiled. Please recompile with OpenSSL.\n", CODE_SECURExNOTCOMPILED);
-    return fflush(fs);
+    print("%d Licq secure channel not compiled. Please recompile with OpenSSL.\n", CODE_SECURExNOTCOMPILED);
+    return flush();
   }
 
   ParseUser(data_arg);
 
   if (!myUserId.isValid())
   {
-    fprintf(fs, "%d Invalid UIN.\n", CODE_INVALIDxUSER);
-    return fflush(fs);
+    print("%d Invalid UIN.\n", CODE_INVALIDxUSER);
+    return flush();
   }
   while (*data_arg != '\0' && *data_arg != ' ') data_arg++;
   NEXT_WORD(data_arg);
 
   if (strncasecmp(data_arg, "open", 4) == 0)
   {
-    fprintf(fs, "%d Opening secure connection.\n", CODE_SECURExOPEN);
+    print("%d Opening secure connection.\n", CODE_SECURExOPEN);
     gProtocolManager.secureChannelOpen(myUserId);
   }
   else
   if (strncasecmp(data_arg, "close", 5) == 0)
   {
-    fprintf(fs, "%d Closing secure connection.\n", CODE_SECURExCLOSE);
+    print("%d Closing secure connection.\n", CODE_SECURExCLOSE);
     gProtocolManager.secureChannelClose(myUserId);
   }
   else
@@ -1635,11 +1701,11 @@ int CRMSClient::Process_SECURE()
     if (u.isLocked())
     {
       if (u->Secure() == 0)
-        fprintf(fs, "%d Status: secure connection is closed.\n", CODE_SECURExSTAT);
+        print("%d Status: secure connection is closed.\n", CODE_SECURExSTAT);
       if (u->Secure() == 1)
-        fprintf(fs, "%d Status: secure connection is open.\n", CODE_SECURExSTAT);
+        print("%d Status: secure connection is open.\n", CODE_SECURExSTAT);
     }
   }
 
-  return fflush(fs);
+  return flush();
 }
@@ -36,6 +36,7 @@ class UserEvent;
 
 const unsigned short MAX_LINE_LENGTH = 1024 * 1;
 const unsigned short MAX_TEXT_LENGTH = 1024 * 8;
+const size_t MAX_CLIENT_QUEUE = 1024 * 1024;
 
 typedef std::list<class CRMSClient*> ClientList;
 typedef std::list<unsigned long> TagList;
@@ -89,6 +90,18 @@ friend class CRMSClient;
 };
 
 
+/**
+ * Socket for RMS clients
+ * Sends text with the send queue, without logging it as a packet since
+ * clients may be following the log.
+ */
+class RMSSocket : public Licq::TCPSocket
+{
+public:
+  bool sendText(const std::string& text);
+};
+
+
 class CRMSClient : public Licq::MainLoopCallback
 {
 public:
@@ -115,13 +128,24 @@ public:
   int Process_REMUSER();
   int Process_SECURE();
   int Process_NOTIFY();
+  int Process_SIGNALS();
 
 protected:
   // From Licq::MainLoopCallback
   void socketEvent(Licq::INetSocket* inetSocket, int revents);
 
-  Licq::TCPSocket sock;
-  FILE *fs;
+  /// Add text to output, sent to client by flush()
+  void print(const char* format, ...) LICQ_FORMAT(2, 3);
+
+  /**
+   * Send output to client without blocking
+   *
+   * @return 0 on success, EOF if socket failed or client isn't reading
+   */
+  int flush();
+
+  RMSSocket sock;
+  std::string myOutput;
   TagList tags;
   unsigned short m_nState;
   char data_line[MAX_LINE_LENGTH + 1];
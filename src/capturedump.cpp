@@ -0,0 +1,108 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Please refer to the COPYRIGHT file distributed with this source
+ * distribution for the names of the individual contributors.
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * licq-capturedump prints packet capture files written by Licq in the same
+ * form as packets in the log.
+ *
+ * Usage: licq-capturedump [-r|-s] file...
+ *   -r  Only print received packets
+ *   -s  Only print sent packets
+ */
+
+#include <boost/shared_ptr.hpp>
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+
+#include "logging/packetcapturesink.h"
+#include "logging/streamlogsink.h"
+
+using LicqDaemon::PacketCaptureReader;
+using LicqDaemon::PacketCaptureSink;
+using LicqDaemon::StreamLogSink;
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "Usage: %s [-r|-s] file...\n"
+      "  -r  Only print received packets\n"
+      "  -s  Only print sent packets\n", name);
+}
+
+int main(int argc, char** argv)
+{
+  PacketCaptureSink::Direction only = PacketCaptureSink::DirectionUnknown;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "rs")) != -1)
+  {
+    switch (opt)
+    {
+      case 'r':
+        only = PacketCaptureSink::DirectionReceived;
+        break;
+      case 's':
+        only = PacketCaptureSink::DirectionSent;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  StreamLogSink sink(std::cout);
+  sink.setUseColors(false);
+  sink.setAllLogLevels(true);
+  sink.setLogPackets(true);
+
+  int ret = 0;
+  for (int i = optind; i < argc; ++i)
+  {
+    PacketCaptureReader reader;
+    if (!reader.open(argv[i]))
+    {
+      fprintf(stderr, "%s: %s is not a Licq packet capture file\n",
+          argv[0], argv[i]);
+      ret = 1;
+      continue;
+    }
+
+    PacketCaptureSink::Direction direction;
+    for (;;)
+    {
+      boost::shared_ptr<Licq::LogSink::Message> message(
+          new Licq::LogSink::Message());
+      if (!reader.read(*message, direction))
+        break;
+      if (only == PacketCaptureSink::DirectionUnknown || direction == only)
+        sink.log(message);
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,548 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "contactdatabase.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <licq/logging/log.h>
+#include <licq/thread/mutexlocker.h>
+
+#include "../gettext.h"
+
+using namespace LicqDaemon;
+using Licq::MutexLocker;
+using Licq::gLog;
+using std::list;
+using std::string;
+using std::vector;
+
+static const char DatabaseMagic[8] = { 'L', 'i', 'c', 'q', 'C', 'D', 'b', '\0' };
+static const char JournalMagic[8] = { 'L', 'i', 'c', 'q', 'C', 'J', 'n', '\0' };
+static const uint32_t DatabaseVersion = 1;
+
+/**
+ * Compare a key in the database file with a string
+ *
+ * @return Less than, equal to or greater than zero like memcmp
+ */
+static int compareKey(const char* key, size_t keyLength, const string& other)
+{
+  int r = memcmp(key, other.data(), std::min(keyLength, other.size()));
+  if (r != 0)
+    return r;
+  if (keyLength == other.size())
+    return 0;
+  return (keyLength < other.size() ? -1 : 1);
+}
+
+ContactDatabase::ContactDatabase(const string& filename)
+  : myFilename(filename),
+    myJournalFilename(filename + ".journal"),
+    myMap(NULL),
+    myMapSize(0),
+    myIndex(NULL),
+    myCount(0),
+    myJournalFd(-1),
+    myJournalSize(0)
+{
+  // Empty
+}
+
+ContactDatabase::~ContactDatabase()
+{
+  // Leave a clean database so next startup doesn't need to replay anything
+  if (myJournalFd != -1 && myJournalSize > sizeof(JournalHeader))
+    compact();
+
+  unmapDatabase();
+  if (myJournalFd != -1)
+    close(myJournalFd);
+}
+
+bool ContactDatabase::exists(const string& filename)
+{
+  struct stat st;
+  return stat(filename.c_str(), &st) == 0;
+}
+
+bool ContactDatabase::open()
+{
+  MutexLocker locker(myMutex);
+
+  if (!exists(myFilename))
+  {
+    // Write an empty database so the file exists from now on
+    if (!writeDatabase())
+      return false;
+  }
+  else if (!mapDatabase())
+    return false;
+
+  return openJournal();
+}
+
+uint32_t ContactDatabase::checksum(const string& key, const string& data)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < key.size(); ++i)
+    hash = (hash ^ static_cast<unsigned char>(key[i])) * 16777619U;
+  for (size_t i = 0; i < data.size(); ++i)
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619U;
+  return hash;
+}
+
+bool ContactDatabase::mapDatabase()
+{
+  int fd = ::open(myFilename.c_str(), O_RDONLY);
+  if (fd == -1)
+  {
+    gLog.error(tr("Unable to open contact database (%s): %s."),
+        myFilename.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  FileHeader header;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(header)) ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, DatabaseMagic, sizeof(DatabaseMagic)) != 0 ||
+      header.size != static_cast<uint64_t>(st.st_size) ||
+      sizeof(header) + static_cast<uint64_t>(header.count) * sizeof(IndexEntry) > header.size)
+  {
+    gLog.error(tr("Contact database (%s) is damaged."), myFilename.c_str());
+    close(fd);
+    return false;
+  }
+  if (header.version != DatabaseVersion)
+  {
+    gLog.error(tr("Contact database (%s) has unsupported version %u."),
+        myFilename.c_str(), header.version);
+    close(fd);
+    return false;
+  }
+
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    gLog.error(tr("Unable to map contact database (%s): %s."),
+        myFilename.c_str(), strerror(errno));
+    return false;
+  }
+
+  const IndexEntry* index = reinterpret_cast<const IndexEntry*>(
+      static_cast<const char*>(map) + sizeof(header));
+  for (uint32_t i = 0; i < header.count; ++i)
+  {
+    if (static_cast<uint64_t>(index[i].keyOffset) + index[i].keyLength > header.size ||
+        static_cast<uint64_t>(index[i].dataOffset) + index[i].dataLength > header.size)
+    {
+      gLog.error(tr("Contact database (%s) is damaged."), myFilename.c_str());
+      munmap(map, st.st_size);
+      return false;
+    }
+  }
+
+  myMap = static_cast<const char*>(map);
+  myMapSize = st.st_size;
+  myIndex = index;
+  myCount = header.count;
+  return true;
+}
+
+void ContactDatabase::unmapDatabase()
+{
+  if (myMap != NULL)
+    munmap(const_cast<char*>(myMap), myMapSize);
+  myMap = NULL;
+  myMapSize = 0;
+  myIndex = NULL;
+  myCount = 0;
+}
+
+bool ContactDatabase::openJournal()
+{
+  int fd = ::open(myJournalFilename.c_str(), O_RDWR | O_CREAT | O_APPEND, 00600);
+  if (fd == -1)
+  {
+    gLog.error(tr("Unable to open contact database journal (%s): %s."),
+        myJournalFilename.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  vector<char> buffer(st.st_size);
+  JournalHeader header;
+  size_t valid = 0;
+  if (st.st_size > 0 &&
+      pread(fd, &buffer[0], st.st_size, 0) == st.st_size &&
+      buffer.size() >= sizeof(header))
+  {
+    memcpy(&header, &buffer[0], sizeof(header));
+    if (memcmp(header.magic, JournalMagic, sizeof(JournalMagic)) == 0 &&
+        header.version == DatabaseVersion)
+      valid = sizeof(header);
+  }
+
+  if (valid == 0)
+  {
+    if (st.st_size > 0)
+      gLog.warning(tr("Ignoring damaged contact database journal (%s)."),
+          myJournalFilename.c_str());
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JournalMagic, sizeof(JournalMagic));
+    header.version = DatabaseVersion;
+    if (ftruncate(fd, 0) != 0 || write(fd, &header, sizeof(header)) != sizeof(header))
+    {
+      gLog.error(tr("Unable to write contact database journal (%s): %s."),
+          myJournalFilename.c_str(), strerror(errno));
+      close(fd);
+      return false;
+    }
+    myJournalFd = fd;
+    myJournalSize = sizeof(header);
+    return true;
+  }
+
+  // Replay records, stop at any record that wasn't completely written
+  while (valid + sizeof(JournalRecord) <= buffer.size())
+  {
+    JournalRecord record;
+    memcpy(&record, &buffer[valid], sizeof(record));
+    size_t end = valid + sizeof(record) + record.keyLength + record.dataLength;
+    if (end > buffer.size() || end < valid ||
+        (record.type != RecordPut && record.type != RecordRemove))
+      break;
+
+    const char* p = &buffer[valid + sizeof(record)];
+    string key(p, record.keyLength);
+    string data(p + record.keyLength, record.dataLength);
+    if (checksum(key, data) != record.checksum)
+      break;
+
+    Change& change = myChanges[key];
+    change.removed = (record.type == RecordRemove);
+    change.data.swap(data);
+    valid = end;
+  }
+
+  if (valid < buffer.size())
+  {
+    gLog.warning(tr("Dropping incomplete record at end of contact database journal (%s)."),
+        myJournalFilename.c_str());
+    if (ftruncate(fd, valid) != 0)
+    {
+      close(fd);
+      return false;
+    }
+  }
+
+  myJournalFd = fd;
+  myJournalSize = valid;
+  return true;
+}
+
+bool ContactDatabase::appendJournal(JournalRecordType type, const string& key,
+    const string& data)
+{
+  if (myJournalFd == -1)
+    return false;
+
+  JournalRecord record;
+  record.type = type;
+  record.keyLength = key.size();
+  record.dataLength = data.size();
+  record.checksum = checksum(key, data);
+
+  // Write record with a single call so it isn't mixed with anything else
+  string buffer(reinterpret_cast<const char*>(&record), sizeof(record));
+  buffer += key;
+  buffer += data;
+  if (write(myJournalFd, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size()))
+  {
+    gLog.error(tr("Unable to write contact database journal (%s): %s."),
+        myJournalFilename.c_str(), strerror(errno));
+    // Remove anything partially written so the journal can still be replayed
+    if (ftruncate(myJournalFd, myJournalSize) != 0)
+      gLog.error(tr("Unable to truncate contact database journal (%s): %s."),
+          myJournalFilename.c_str(), strerror(errno));
+    return false;
+  }
+  myJournalSize += buffer.size();
+  return true;
+}
+
+const ContactDatabase::IndexEntry* ContactDatabase::findEntry(const string& key) const
+{
+  uint32_t low = 0;
+  uint32_t high = myCount;
+  while (low < high)
+  {
+    uint32_t mid = low + (high - low) / 2;
+    const IndexEntry& entry = myIndex[mid];
+    int r = compareKey(myMap + entry.keyOffset, entry.keyLength, key);
+    if (r == 0)
+      return &entry;
+    if (r < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return NULL;
+}
+
+bool ContactDatabase::get(const string& accountId, string& data) const
+{
+  MutexLocker locker(myMutex);
+
+  ChangeMap::const_iterator i = myChanges.find(accountId);
+  if (i != myChanges.end())
+  {
+    if (i->second.removed)
+      return false;
+    data = i->second.data;
+    return true;
+  }
+
+  const IndexEntry* entry = findEntry(accountId);
+  if (entry == NULL)
+    return false;
+  data.assign(myMap + entry->dataOffset, entry->dataLength);
+  return true;
+}
+
+bool ContactDatabase::put(const string& accountId, const string& data)
+{
+  MutexLocker locker(myMutex);
+
+  if (!appendJournal(RecordPut, accountId, data))
+    return false;
+
+  Change& change = myChanges[accountId];
+  change.removed = false;
+  change.data = data;
+
+  compactIfNeeded();
+  return true;
+}
+
+bool ContactDatabase::remove(const string& accountId)
+{
+  MutexLocker locker(myMutex);
+
+  if (!appendJournal(RecordRemove, accountId, string()))
+    return false;
+
+  Change& change = myChanges[accountId];
+  change.removed = true;
+  change.data.clear();
+
+  compactIfNeeded();
+  return true;
+}
+
+void ContactDatabase::getAccountIds(list<string>& accountIds) const
+{
+  MutexLocker locker(myMutex);
+
+  for (uint32_t i = 0; i < myCount; ++i)
+  {
+    string key(myMap + myIndex[i].keyOffset, myIndex[i].keyLength);
+    if (myChanges.count(key) == 0)
+      accountIds.push_back(key);
+  }
+  for (ChangeMap::const_iterator i = myChanges.begin(); i != myChanges.end(); ++i)
+    if (!i->second.removed)
+      accountIds.push_back(i->first);
+}
+
+void ContactDatabase::compactIfNeeded()
+{
+  if (myJournalSize < MinCompactSize || myJournalSize < myMapSize / 2)
+    return;
+
+  writeDatabase();
+}
+
+bool ContactDatabase::compact()
+{
+  MutexLocker locker(myMutex);
+  return writeDatabase();
+}
+
+namespace
+{
+
+/// Contact to write when compacting database
+struct CompactItem
+{
+  const char* key;
+  size_t keyLength;
+  const char* data;
+  size_t dataLength;
+};
+
+} // namespace
+
+bool ContactDatabase::writeDatabase()
+{
+  // Merge database file and changes, both are sorted by account id
+  vector<CompactItem> items;
+  items.reserve(myCount + myChanges.size());
+
+  uint32_t i = 0;
+  ChangeMap::const_iterator c = myChanges.begin();
+  while (i < myCount || c != myChanges.end())
+  {
+    int r;
+    if (i >= myCount)
+      r = 1;
+    else if (c == myChanges.end())
+      r = -1;
+    else
+      r = compareKey(myMap + myIndex[i].keyOffset, myIndex[i].keyLength, c->first);
+
+    if (r < 0)
+    {
+      CompactItem item = { myMap + myIndex[i].keyOffset, myIndex[i].keyLength,
+          myMap + myIndex[i].dataOffset, myIndex[i].dataLength };
+      items.push_back(item);
+      ++i;
+      continue;
+    }
+
+    // Changed contact replaces the one in database file
+    if (r == 0)
+      ++i;
+    if (!c->second.removed)
+    {
+      CompactItem item = { c->first.data(), c->first.size(),
+          c->second.data.data(), c->second.data.size() };
+      items.push_back(item);
+    }
+    ++c;
+  }
+
+  FileHeader header;
+  memcpy(header.magic, DatabaseMagic, sizeof(DatabaseMagic));
+  header.version = DatabaseVersion;
+  header.count = items.size();
+  uint64_t size = sizeof(header) + items.size() * sizeof(IndexEntry);
+  for (vector<CompactItem>::const_iterator item = items.begin(); item != items.end(); ++item)
+    size += item->keyLength + item->dataLength;
+  if (size > 0xFFFFFFFFULL)
+  {
+    gLog.error(tr("Contact database (%s) is too large."), myFilename.c_str());
+    return false;
+  }
+  header.size = size;
+
+  string buffer;
+  buffer.reserve(size);
+  buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint32_t offset = sizeof(header) + items.size() * sizeof(IndexEntry);
+  for (vector<CompactItem>::const_iterator item = items.begin(); item != items.end(); ++item)
+  {
+    IndexEntry entry;
+    entry.keyOffset = offset;
+    entry.keyLength = item->keyLength;
+    entry.dataOffset = offset + item->keyLength;
+    entry.dataLength = item->dataLength;
+    offset += item->keyLength + item->dataLength;
+    buffer.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  }
+  for (vector<CompactItem>::const_iterator item = items.begin(); item != items.end(); ++item)
+  {
+    buffer.append(item->key, item->keyLength);
+    buffer.append(item->data, item->dataLength);
+  }
+
+  // Write new file and replace old one so database is never half written
+  vector<char> tempName(myFilename.begin(), myFilename.end());
+  const char* suffix = ".XXXXXX";
+  tempName.insert(tempName.end(), suffix, suffix + strlen(suffix) + 1);
+  int fd = mkstemp(&tempName[0]);
+  if (fd == -1)
+  {
+    gLog.error(tr("Unable to write contact database (%s): %s."),
+        myFilename.c_str(), strerror(errno));
+    return false;
+  }
+  bool written = (write(fd, buffer.data(), buffer.size()) ==
+      static_cast<ssize_t>(buffer.size()) && fdatasync(fd) == 0);
+  if (close(fd) != 0)
+    written = false;
+  if (!written || rename(&tempName[0], myFilename.c_str()) != 0)
+  {
+    gLog.error(tr("Unable to write contact database (%s): %s."),
+        myFilename.c_str(), strerror(errno));
+    unlink(&tempName[0]);
+    return false;
+  }
+
+  // Changes are in the database now, an old journal replayed on top of it
+  // would only repeat them
+  unmapDatabase();
+  myChanges.clear();
+  bool mapped = mapDatabase();
+  if (myJournalFd != -1 && myJournalSize > sizeof(JournalHeader))
+  {
+    if (ftruncate(myJournalFd, sizeof(JournalHeader)) == 0)
+      myJournalSize = sizeof(JournalHeader);
+    else
+      gLog.error(tr("Unable to truncate contact database journal (%s): %s."),
+          myJournalFilename.c_str(), strerror(errno));
+  }
+  return mapped;
+}
+
+bool ContactDatabase::destroy()
+{
+  MutexLocker locker(myMutex);
+
+  unmapDatabase();
+  myChanges.clear();
+  if (myJournalFd != -1)
+    close(myJournalFd);
+  myJournalFd = -1;
+  myJournalSize = 0;
+
+  bool ok = true;
+  if (unlink(myFilename.c_str()) != 0 && errno != ENOENT)
+    ok = false;
+  if (unlink(myJournalFilename.c_str()) != 0 && errno != ENOENT)
+    ok = false;
+  return ok;
+}
@@ -0,0 +1,221 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef LICQDAEMON_CONTACTLIST_CONTACTDATABASE_H
+#define LICQDAEMON_CONTACTLIST_CONTACTDATABASE_H
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <licq/thread/mutex.h>
+
+namespace LicqDaemon
+{
+
+/**
+ * Storage for the configuration of all contacts of an owner
+ *
+ * Normally each contact has its own configuration file, which makes loading
+ * a large contact list slow. A contact database keeps the configuration of
+ * all contacts in a single file with an index sorted by account id. The file
+ * is mapped into memory when opened so getting a contact is a binary search.
+ *
+ * Changes are appended to a journal next to the database file and replayed
+ * when the database is opened. Once the journal has grown large enough, the
+ * database is compacted, that is rewritten with all changes included, and
+ * the journal is cleared.
+ *
+ * Files are in native byte order as they are never moved between machines.
+ *
+ * All functions are thread safe.
+ */
+class ContactDatabase : private boost::noncopyable
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param filename Database file, journal has the same name with
+   *                 ".journal" appended
+   */
+  explicit ContactDatabase(const std::string& filename);
+
+  /**
+   * Destructor
+   * Database is compacted first if there is anything in the journal.
+   */
+  ~ContactDatabase();
+
+  /**
+   * Check if a database exists
+   *
+   * @param filename Database file
+   * @return True if database file exists
+   */
+  static bool exists(const std::string& filename);
+
+  /**
+   * Open database and replay journal
+   * Database is created if it doesn't exist.
+   *
+   * @return True if database could be opened
+   */
+  bool open();
+
+  /// Get database filename
+  const std::string& filename() const { return myFilename; }
+
+  /**
+   * Get configuration for a contact
+   *
+   * @param accountId Account id of contact
+   * @param data Set to raw configuration of contact
+   * @return True if contact exists
+   */
+  bool get(const std::string& accountId, std::string& data) const;
+
+  /**
+   * Add or replace configuration for a contact
+   *
+   * @param accountId Account id of contact
+   * @param data Raw configuration of contact
+   * @return True if change was written to journal
+   */
+  bool put(const std::string& accountId, const std::string& data);
+
+  /**
+   * Remove a contact
+   *
+   * @param accountId Account id of contact
+   * @return True if change was written to journal
+   */
+  bool remove(const std::string& accountId);
+
+  /**
+   * Get all contacts in database
+   *
+   * @param accountIds List to add account ids to
+   */
+  void getAccountIds(std::list<std::string>& accountIds) const;
+
+  /**
+   * Rewrite database with all changes and clear journal
+   *
+   * @return True if database was written
+   */
+  bool compact();
+
+  /**
+   * Close and delete database and journal files
+   *
+   * @return True if files were removed
+   */
+  bool destroy();
+
+private:
+  // Don't compact until journal is at least this large
+  static const size_t MinCompactSize = 1024 * 1024;
+
+  struct FileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t size;
+  };
+
+  struct IndexEntry
+  {
+    uint32_t keyOffset;
+    uint32_t keyLength;
+    uint32_t dataOffset;
+    uint32_t dataLength;
+  };
+
+  struct JournalHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+  };
+
+  struct JournalRecord
+  {
+    uint32_t type;
+    uint32_t keyLength;
+    uint32_t dataLength;
+    uint32_t checksum;
+  };
+
+  enum JournalRecordType
+  {
+    RecordPut = 1,
+    RecordRemove = 2
+  };
+
+  /// A change that is in the journal but not in the database file
+  struct Change
+  {
+    bool removed;
+    std::string data;
+  };
+  typedef std::map<std::string, Change> ChangeMap;
+
+  /// Checksum for journal records
+  static uint32_t checksum(const std::string& key, const std::string& data);
+
+  /// Map database file, file must exist
+  bool mapDatabase();
+
+  /// Unmap database file
+  void unmapDatabase();
+
+  /// Open journal and read changes from it
+  bool openJournal();
+
+  /// Append a record to journal
+  bool appendJournal(JournalRecordType type, const std::string& key,
+      const std::string& data);
+
+  /// Find a contact in database file
+  const IndexEntry* findEntry(const std::string& key) const;
+
+  /// Compact if journal is large compared to the database
+  void compactIfNeeded();
+
+  /// Write database file with all changes, mutex must be locked
+  bool writeDatabase();
+
+  std::string myFilename;
+  std::string myJournalFilename;
+  mutable Licq::Mutex myMutex;
+  const char* myMap;
+  size_t myMapSize;
+  const IndexEntry* myIndex;
+  uint32_t myCount;
+  int myJournalFd;
+  size_t myJournalSize;
+  ChangeMap myChanges;
+};
+
+} // namespace LicqDaemon
+
+#endif
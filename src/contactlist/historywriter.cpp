@@ -0,0 +1,329 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "historywriter.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include <licq/logging/log.h>
+#include <licq/thread/mutexlocker.h>
+
+#include "../gettext.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+using namespace LicqDaemon;
+using Licq::MutexLocker;
+using Licq::gLog;
+using std::map;
+using std::string;
+using std::vector;
+
+// Declare global HistoryWriter (internal for daemon)
+LicqDaemon::HistoryWriter LicqDaemon::gHistoryWriter;
+
+static char LineBreak[] = "\n";
+
+HistoryWriter::HistoryWriter()
+  : myQueuedSerial(0),
+    myWrittenSerial(0),
+    myDurability(DurabilityNone),
+    myIsRunning(false),
+    myStopRequested(false)
+{
+  // Empty
+}
+
+HistoryWriter::~HistoryWriter()
+{
+  shutdown();
+}
+
+bool HistoryWriter::start(Durability durability)
+{
+  MutexLocker locker(myMutex);
+  myDurability = durability;
+  if (myIsRunning)
+    return true;
+
+  myStopRequested = false;
+  int error = pthread_create(&myThread, NULL, writer_tep, this);
+  if (error != 0)
+  {
+    gLog.error(tr("Unable to start history writer thread: %s."), strerror(error));
+    return false;
+  }
+  myIsRunning = true;
+  return true;
+}
+
+void HistoryWriter::shutdown()
+{
+  {
+    MutexLocker locker(myMutex);
+    if (!myIsRunning || myStopRequested)
+      return;
+    myStopRequested = true;
+    myQueueCond.signal();
+  }
+
+  pthread_join(myThread, NULL);
+
+  MutexLocker fileLocker(myFileMutex);
+  closeAllFiles();
+}
+
+HistoryWriter::Durability HistoryWriter::durability() const
+{
+  MutexLocker locker(myMutex);
+  return myDurability;
+}
+
+void HistoryWriter::append(const string& filename, const string& data)
+{
+  PendingList batch(1);
+  batch.front().filename = filename;
+  batch.front().data = data;
+
+  MutexLocker locker(myMutex);
+  if (!myIsRunning)
+  {
+    // No writer thread, write it ourselves
+    Durability durability = myDurability;
+    locker.unlock();
+
+    MutexLocker fileLocker(myFileMutex);
+    writeBatch(batch, durability);
+    closeFile(filename);
+    return;
+  }
+
+  myLastSerials[filename] = ++myQueuedSerial;
+  myQueue.splice(myQueue.end(), batch);
+  myQueueCond.signal();
+}
+
+void HistoryWriter::flush(const string& filename)
+{
+  MutexLocker locker(myMutex);
+  map<string, unsigned long>::const_iterator i = myLastSerials.find(filename);
+  if (i == myLastSerials.end())
+    return;
+
+  unsigned long serial = i->second;
+  while (myIsRunning && myWrittenSerial < serial)
+    myDoneCond.wait(myMutex);
+}
+
+void HistoryWriter::flush()
+{
+  MutexLocker locker(myMutex);
+  unsigned long serial = myQueuedSerial;
+  while (myIsRunning && myWrittenSerial < serial)
+    myDoneCond.wait(myMutex);
+}
+
+void* HistoryWriter::writer_tep(void* arg)
+{
+  static_cast<HistoryWriter*>(arg)->run();
+  return NULL;
+}
+
+void HistoryWriter::run()
+{
+  MutexLocker locker(myMutex);
+  while (true)
+  {
+    while (myQueue.empty() && !myStopRequested)
+      myQueueCond.wait(myMutex);
+
+    if (myQueue.empty())
+    {
+      // Stop requested and everything written, later appends are written
+      // directly by caller
+      myIsRunning = false;
+      myDoneCond.broadcast();
+      break;
+    }
+
+    // Take everything queued so far as one batch
+    PendingList batch;
+    batch.swap(myQueue);
+    unsigned long serial = myQueuedSerial;
+    Durability durability = myDurability;
+    locker.unlock();
+
+    {
+      MutexLocker fileLocker(myFileMutex);
+      writeBatch(batch, durability);
+    }
+
+    locker.relock();
+    myWrittenSerial = serial;
+
+    // Files with nothing more queued no longer need to be tracked
+    map<string, unsigned long>::iterator i = myLastSerials.begin();
+    while (i != myLastSerials.end())
+    {
+      if (i->second <= myWrittenSerial)
+        myLastSerials.erase(i++);
+      else
+        ++i;
+    }
+    myDoneCond.broadcast();
+  }
+}
+
+void HistoryWriter::writeBatch(const PendingList& batch, Durability durability)
+{
+  // Group appends per file, keeping the order for each file
+  map<string, vector<const string*> > files;
+  for (PendingList::const_iterator i = batch.begin(); i != batch.end(); ++i)
+    files[i->filename].push_back(&i->data);
+
+  for (map<string, vector<const string*> >::const_iterator i = files.begin();
+      i != files.end(); ++i)
+  {
+    const string& filename = i->first;
+    const vector<const string*>& data = i->second;
+
+    int fd = openFile(filename);
+    if (fd == -1)
+      continue;
+
+    bool ok = true;
+    if (durability == DurabilityEvent)
+    {
+      for (size_t j = 0; ok && j < data.size(); ++j)
+      {
+        struct iovec iov[2];
+        iov[0].iov_base = const_cast<char*>(data[j]->data());
+        iov[0].iov_len = data[j]->size();
+        iov[1].iov_base = LineBreak;
+        iov[1].iov_len = 1;
+        ok = writeData(fd, iov, 2) && fdatasync(fd) == 0;
+      }
+    }
+    else
+    {
+      vector<struct iovec> iov(data.size() * 2);
+      for (size_t j = 0; j < data.size(); ++j)
+      {
+        iov[j*2].iov_base = const_cast<char*>(data[j]->data());
+        iov[j*2].iov_len = data[j]->size();
+        iov[j*2+1].iov_base = LineBreak;
+        iov[j*2+1].iov_len = 1;
+      }
+      ok = writeData(fd, &iov[0], iov.size());
+      if (ok && durability == DurabilityBatch)
+        ok = (fdatasync(fd) == 0);
+    }
+
+    if (!ok)
+    {
+      gLog.error(tr("Unable to write history file (%s): %s."),
+          filename.c_str(), strerror(errno));
+      // Reopen file on next write in case it has been replaced
+      closeFile(filename);
+    }
+  }
+}
+
+bool HistoryWriter::writeData(int fd, struct iovec* iov, size_t count)
+{
+  while (count > 0)
+  {
+    ssize_t written = writev(fd, iov, (count > IOV_MAX ? IOV_MAX : count));
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    // Skip past what was written, a short write may end mid buffer
+    size_t left = written;
+    while (count > 0 && left >= iov->iov_len)
+    {
+      left -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (left > 0)
+    {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+int HistoryWriter::openFile(const string& filename)
+{
+  FileMap::iterator i = myOpenFiles.find(filename);
+  if (i != myOpenFiles.end())
+  {
+    // Move to front of LRU list
+    myLruFiles.splice(myLruFiles.begin(), myLruFiles, i->second.lru);
+    return i->second.fd;
+  }
+
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 00600);
+  if (fd == -1)
+  {
+    gLog.error(tr("Unable to open history file (%s): %s."),
+        filename.c_str(), strerror(errno));
+    return -1;
+  }
+
+  if (myOpenFiles.size() >= MaxOpenFiles)
+    closeFile(string(myLruFiles.back()));
+
+  myLruFiles.push_front(filename);
+  OpenFile& file(myOpenFiles[filename]);
+  file.fd = fd;
+  file.lru = myLruFiles.begin();
+  return fd;
+}
+
+void HistoryWriter::closeFile(const string& filename)
+{
+  FileMap::iterator i = myOpenFiles.find(filename);
+  if (i == myOpenFiles.end())
+    return;
+
+  close(i->second.fd);
+  myLruFiles.erase(i->second.lru);
+  myOpenFiles.erase(i);
+}
+
+void HistoryWriter::closeAllFiles()
+{
+  for (FileMap::iterator i = myOpenFiles.begin(); i != myOpenFiles.end(); ++i)
+    close(i->second.fd);
+  myOpenFiles.clear();
+  myLruFiles.clear();
+}
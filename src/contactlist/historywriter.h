@@ -0,0 +1,176 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_CONTACTLIST_HISTORYWRITER_H
+#define LICQDAEMON_CONTACTLIST_HISTORYWRITER_H
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <sys/uio.h>
+
+#include <licq/thread/condition.h>
+#include <licq/thread/mutex.h>
+
+namespace LicqDaemon
+{
+
+/**
+ * Background writer for history files
+ *
+ * Appending to history is done from protocol threads while holding the user
+ * lock. To keep that cheap, appends are only queued here and a writer thread
+ * writes them in batches. Each batch is written with a single writev per file
+ * and descriptors for recently used files are kept open.
+ *
+ * Anyone reading or overwriting a history file must call flush() for the
+ * file first so all queued appends have been written. Files are opened with
+ * O_APPEND so cached descriptors stay valid if a file is truncated.
+ *
+ * If the writer thread isn't running, appends are written directly.
+ */
+class HistoryWriter : private boost::noncopyable
+{
+public:
+  enum Durability
+  {
+    DurabilityNone = 0,         // Leave it to the OS when data reaches disk
+    DurabilityBatch = 1,        // Sync each file after writing a batch
+    DurabilityEvent = 2         // Sync each file after every event
+  };
+
+  HistoryWriter();
+  ~HistoryWriter();
+
+  /**
+   * Start the writer thread
+   *
+   * @param durability When to sync written data to disk
+   * @return True if thread was started
+   */
+  bool start(Durability durability = DurabilityNone);
+
+  /**
+   * Write everything that is queued and stop the writer thread
+   * Any later appends will be written directly.
+   */
+  void shutdown();
+
+  /// Get current durability setting
+  Durability durability() const;
+
+  /**
+   * Queue data to be appended to a history file
+   * A line break is added after the data.
+   *
+   * @param filename History file to append to
+   * @param data Data to append
+   */
+  void append(const std::string& filename, const std::string& data);
+
+  /**
+   * Wait until everything queued for a file has been written
+   *
+   * @param filename History file to wait for
+   */
+  void flush(const std::string& filename);
+
+  /**
+   * Wait until everything queued has been written
+   */
+  void flush();
+
+private:
+  // Maximum number of history files to keep open
+  static const size_t MaxOpenFiles = 32;
+
+  struct Pending
+  {
+    std::string filename;
+    std::string data;
+  };
+  typedef std::list<Pending> PendingList;
+
+  struct OpenFile
+  {
+    int fd;
+    std::list<std::string>::iterator lru;
+  };
+  typedef std::map<std::string, OpenFile> FileMap;
+
+  /// Thread entry point
+  static void* writer_tep(void* arg);
+
+  /// Main loop for writer thread
+  void run();
+
+  /**
+   * Write a batch of appends
+   * Appends for the same file are written together, in queued order.
+   *
+   * @param batch Appends to write
+   * @param durability When to sync written data
+   */
+  void writeBatch(const PendingList& batch, Durability durability);
+
+  /**
+   * Write data to a file
+   *
+   * @param fd Descriptor to write to
+   * @param iov Data to write, will be modified
+   * @param count Number of entries in iov
+   * @return True if all data was written
+   */
+  static bool writeData(int fd, struct iovec* iov, size_t count);
+
+  /// Get descriptor for a file, opening it if needed
+  int openFile(const std::string& filename);
+
+  /// Close cached descriptor for a file
+  void closeFile(const std::string& filename);
+
+  /// Close all cached descriptors
+  void closeAllFiles();
+
+  // Protected by myMutex
+  mutable Licq::Mutex myMutex;
+  Licq::Condition myQueueCond;
+  Licq::Condition myDoneCond;
+  PendingList myQueue;
+  std::map<std::string, unsigned long> myLastSerials;
+  unsigned long myQueuedSerial;
+  unsigned long myWrittenSerial;
+  Durability myDurability;
+  bool myIsRunning;
+  bool myStopRequested;
+  pthread_t myThread;
+
+  // Protected by myFileMutex, held while writing
+  Licq::Mutex myFileMutex;
+  FileMap myOpenFiles;
+  std::list<std::string> myLruFiles;
+};
+
+extern HistoryWriter gHistoryWriter;
+
+} // namespace LicqDaemon
+
+#endif
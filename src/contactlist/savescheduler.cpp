@@ -0,0 +1,228 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "savescheduler.h"
+
+#include <boost/foreach.hpp>
+#include <cstring>
+#include <ctime>
+
+#include <licq/contactlist/owner.h>
+#include <licq/contactlist/user.h>
+#include <licq/logging/log.h>
+#include <licq/thread/mutexlocker.h>
+
+#include "../gettext.h"
+
+using namespace LicqDaemon;
+using Licq::MutexLocker;
+using Licq::OwnerWriteGuard;
+using Licq::UserId;
+using Licq::UserWriteGuard;
+using Licq::gLog;
+using std::list;
+
+// Declare global SaveScheduler (internal for daemon)
+LicqDaemon::SaveScheduler LicqDaemon::gSaveScheduler;
+
+SaveScheduler::SaveScheduler()
+  : myDelay(0),
+    myIsRunning(false),
+    myStopRequested(false)
+{
+  // Empty
+}
+
+SaveScheduler::~SaveScheduler()
+{
+  // Users are gone by now so just stop the thread
+  MutexLocker locker(myMutex);
+  if (!myIsRunning || myStopRequested)
+    return;
+  myStopRequested = true;
+  myQueueCond.signal();
+  locker.unlock();
+  pthread_join(myThread, NULL);
+}
+
+bool SaveScheduler::start(unsigned delay)
+{
+  MutexLocker locker(myMutex);
+  myDelay = delay;
+  if (myIsRunning)
+    return true;
+
+  myStopRequested = false;
+  int error = pthread_create(&myThread, NULL, saver_tep, this);
+  if (error != 0)
+  {
+    gLog.error(tr("Unable to start contact save thread: %s."), strerror(error));
+    return false;
+  }
+  myIsRunning = true;
+  return true;
+}
+
+void SaveScheduler::shutdown()
+{
+  {
+    MutexLocker locker(myMutex);
+    if (!myIsRunning || myStopRequested)
+      return;
+    myStopRequested = true;
+    myQueueCond.signal();
+  }
+
+  pthread_join(myThread, NULL);
+
+  // Thread is gone, write what's left ourselves
+  flush();
+}
+
+bool SaveScheduler::schedule(const UserId& userId, unsigned groups)
+{
+  MutexLocker locker(myMutex);
+  if (!myIsRunning || myStopRequested)
+    return false;
+
+  PendingMap::iterator i = myPending.find(userId);
+  if (i != myPending.end())
+  {
+    // Already scheduled, just add to what will be saved
+    i->second.groups |= groups;
+    return true;
+  }
+
+  Pending pending = { groups, now() + myDelay };
+  myPending[userId] = pending;
+
+  QueueEntry entry = { userId, pending.due };
+  bool wasEmpty = myQueue.empty();
+  myQueue.push_back(entry);
+
+  // If queue wasn't empty the thread is already waiting for an earlier user
+  if (wasEmpty)
+    myQueueCond.signal();
+  return true;
+}
+
+unsigned SaveScheduler::take(const UserId& userId)
+{
+  MutexLocker locker(myMutex);
+  PendingMap::iterator i = myPending.find(userId);
+  if (i == myPending.end())
+    return 0;
+
+  // Entry in queue is left and will be skipped when it's due
+  unsigned groups = i->second.groups;
+  myPending.erase(i);
+  return groups;
+}
+
+void SaveScheduler::flush()
+{
+  list<UserId> users;
+  {
+    MutexLocker locker(myMutex);
+    for (PendingMap::const_iterator i = myPending.begin(); i != myPending.end(); ++i)
+      users.push_back(i->first);
+  }
+
+  BOOST_FOREACH(const UserId& userId, users)
+    saveUser(userId);
+}
+
+long long SaveScheduler::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void* SaveScheduler::saver_tep(void* arg)
+{
+  static_cast<SaveScheduler*>(arg)->run();
+  return NULL;
+}
+
+void SaveScheduler::run()
+{
+  MutexLocker locker(myMutex);
+  while (true)
+  {
+    while (myQueue.empty() && !myStopRequested)
+      myQueueCond.wait(myMutex);
+
+    if (myStopRequested)
+      break;
+
+    long long time = now();
+    if (myQueue.front().due > time)
+    {
+      myQueueCond.wait(myMutex, myQueue.front().due - time);
+      continue;
+    }
+
+    // Users are queued in order so all that are due are at the front
+    list<UserId> users;
+    while (!myQueue.empty() && myQueue.front().due <= time)
+    {
+      const QueueEntry& entry = myQueue.front();
+      PendingMap::const_iterator i = myPending.find(entry.userId);
+      // Skip users that have been saved since and may have been marked again
+      if (i != myPending.end() && i->second.due == entry.due)
+        users.push_back(entry.userId);
+      myQueue.pop_front();
+    }
+    locker.unlock();
+
+    BOOST_FOREACH(const UserId& userId, users)
+      saveUser(userId);
+
+    locker.relock();
+  }
+
+  // Stop requested, caller will save whatever is left
+  myIsRunning = false;
+}
+
+void SaveScheduler::saveUser(const UserId& userId)
+{
+  // Saving will take pending changes from the schedule
+  if (userId.isOwner())
+  {
+    OwnerWriteGuard o(userId);
+    if (o.isLocked())
+    {
+      o->saveNow(0);
+      return;
+    }
+  }
+  else
+  {
+    UserWriteGuard u(userId);
+    if (u.isLocked())
+    {
+      u->saveNow(0);
+      return;
+    }
+  }
+
+  // User has been removed, nothing to save
+  take(userId);
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef LICQDAEMON_CONTACTLIST_SAVESCHEDULER_H
+#define LICQDAEMON_CONTACTLIST_SAVESCHEDULER_H
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <pthread.h>
+
+#include <licq/thread/condition.h>
+#include <licq/thread/mutex.h>
+#include <licq/userid.h>
+
+namespace LicqDaemon
+{
+
+/**
+ * Delayed writing of user and owner configuration
+ *
+ * Protocols often update several parts of a user at once, for example one
+ * save for each type of user info received, and each save used to rewrite
+ * the entire file. Instead, User::save() only records which parts have
+ * changed here. A writer thread saves each user once its delay has passed,
+ * so all changes made in that time end up in a single write.
+ *
+ * The delay starts when a user is first marked as changed and isn't
+ * extended by later changes, so data is never held back for longer than the
+ * delay.
+ *
+ * If the writer thread isn't running, nothing is scheduled and users are
+ * saved directly.
+ */
+class SaveScheduler : private boost::noncopyable
+{
+public:
+  SaveScheduler();
+  ~SaveScheduler();
+
+  /**
+   * Start the writer thread
+   *
+   * @param delay Time in milliseconds to collect changes before writing
+   * @return True if thread was started
+   */
+  bool start(unsigned delay);
+
+  /**
+   * Stop the writer thread and save all pending users
+   * Any later saves will be written directly.
+   */
+  void shutdown();
+
+  /**
+   * Mark parts of a user as changed
+   * Caller must hold the user lock.
+   *
+   * @param userId User to save
+   * @param groups Parts of user to save (User::SaveGroups)
+   * @return True if save was scheduled, false if caller must save directly
+   */
+  bool schedule(const Licq::UserId& userId, unsigned groups);
+
+  /**
+   * Remove a user from the schedule
+   * Used when saving a user so pending changes are written as well.
+   * Caller must hold the user lock.
+   *
+   * @param userId User that is being saved
+   * @return Parts of user that were scheduled for saving
+   */
+  unsigned take(const Licq::UserId& userId);
+
+  /**
+   * Save all pending users now
+   * Must not be called while holding any user lock.
+   */
+  void flush();
+
+private:
+  struct Pending
+  {
+    unsigned groups;
+    long long due;
+  };
+  typedef std::map<Licq::UserId, Pending> PendingMap;
+
+  struct QueueEntry
+  {
+    Licq::UserId userId;
+    long long due;
+  };
+
+  /// Get monotonic clock in milliseconds
+  static long long now();
+
+  /// Thread entry point
+  static void* saver_tep(void* arg);
+
+  /// Main loop for writer thread
+  void run();
+
+  /**
+   * Save a user
+   * Fetches and locks the user so the scheduler mutex must not be held.
+   *
+   * @param userId User or owner to save
+   */
+  void saveUser(const Licq::UserId& userId);
+
+  mutable Licq::Mutex myMutex;
+  Licq::Condition myQueueCond;
+  PendingMap myPending;
+  // Users in the order they were marked, may have stale entries for users
+  // that have already been saved
+  std::list<QueueEntry> myQueue;
+  unsigned myDelay;
+  pthread_t myThread;
+  bool myIsRunning;
+  bool myStopRequested;
+};
+
+extern SaveScheduler gSaveScheduler;
+
+} // namespace LicqDaemon
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "../contactdatabase.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <licq/inifile.h>
+
+using LicqDaemon::ContactDatabase;
+using Licq::IniFile;
+using std::string;
+using std::vector;
+
+namespace LicqTest {
+
+static const int NumContacts = 8000;
+
+/**
+ * Measures loading the configuration of all contacts of an owner at
+ * startup, from separate files and from a contact database.
+ */
+class ContactDatabaseBenchmark : public ::testing::Test
+{
+public:
+  string myDir;
+  vector<string> myAccountIds;
+  string myConfig;
+  double myMs;
+
+  void SetUp()
+  {
+    char dir[] = "/tmp/licqcontactdbbench.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    myDir = dir;
+
+    // Typical contact with user info and Licq settings
+    std::ostringstream config;
+    config << "[user]\nAlias=Some Contact\nKeepAliasOnUpdate=0\nTimezone=-100\n"
+        << "Authorization=0\nFirstName=Some\nLastName=Contact\n"
+        << "Email1=contact@example.com\nEmail2=\nEmail0=\nCity=Stockholm\n"
+        << "State=\nPhoneNumber=\nFaxNumber=\nAddress=\nCellularNumber=\n"
+        << "Zipcode=\nCountry=0\nGMTOffset=0\nAge=65535\nGender=0\n"
+        << "Homepage=\nBirthYear=0\nBirthMonth=0\nBirthDay=0\n"
+        << "Language0=0\nLanguage1=0\nLanguage2=0\nPicturePresent=0\n"
+        << "OnVisibleList=0\nOnInvisibleList=0\nOnIgnoreList=0\n"
+        << "OnlineNotify=0\nNewUser=0\nIp=0.0.0.0\nIntIp=0.0.0.0\nPort=0\n"
+        << "NewMessages=0\nLastOnline=1364000000\nLastSent=0\nLastRecv=0\n"
+        << "LastCheckedAR=0\nRegisteredTime=0\nAutoAccept=0\n"
+        << "StatusToUser=65535\nCustomAutoRsp=\nSendIntIp=0\nUserEncoding=\n"
+        << "AwaitingAuth=0\nUseGPG=0\nGPGKey=\nSendServer=0\n"
+        << "Groups.User=1\n";
+    myConfig = config.str();
+
+    for (int i = 0; i < NumContacts; ++i)
+    {
+      std::ostringstream ss;
+      ss << (100000000 + i * 7);
+      myAccountIds.push_back(ss.str());
+    }
+  }
+
+  void TearDown()
+  {
+    for (int i = 0; i < NumContacts; ++i)
+      unlink(userFile(i).c_str());
+    unlink((myDir + "/contacts.db").c_str());
+    unlink((myDir + "/contacts.db.journal").c_str());
+    rmdir(myDir.c_str());
+  }
+
+  string userFile(int i) const
+  {
+    return myDir + "/" + myAccountIds[i] + ".conf";
+  }
+
+  static void readContact(IniFile& conf)
+  {
+    conf.setSection("user");
+    string alias;
+    unsigned lastOnline;
+    bool notify;
+    conf.get("Alias", alias);
+    conf.get("LastOnline", lastOnline);
+    conf.get("OnlineNotify", notify);
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void start()
+  {
+    myMs = now();
+  }
+
+  void report(const char* what)
+  {
+    double elapsed = now() - myMs;
+    printf("[   BENCH  ] %s: %d contacts in %.1f ms (%.3f us/contact)\n",
+        what, NumContacts, elapsed, elapsed * 1000 / NumContacts);
+  }
+};
+
+TEST_F(ContactDatabaseBenchmark, startup)
+{
+  for (int i = 0; i < NumContacts; ++i)
+  {
+    IniFile conf(userFile(i));
+    conf.loadRawConfiguration(myConfig);
+    ASSERT_TRUE(conf.writeFile());
+  }
+
+  start();
+  for (int i = 0; i < NumContacts; ++i)
+  {
+    IniFile conf(userFile(i));
+    ASSERT_TRUE(conf.loadFile());
+    readContact(conf);
+  }
+  report("load separate files");
+
+  // Convert to database as the daemon does on first start with it enabled
+  start();
+  {
+    ContactDatabase db(myDir + "/contacts.db");
+    ASSERT_TRUE(db.open());
+    for (int i = 0; i < NumContacts; ++i)
+    {
+      IniFile conf(userFile(i));
+      ASSERT_TRUE(conf.loadFile());
+      ASSERT_TRUE(db.put(myAccountIds[i], conf.getRawConfiguration()));
+    }
+    ASSERT_TRUE(db.compact());
+  }
+  report("convert to database");
+
+  start();
+  {
+    ContactDatabase db(myDir + "/contacts.db");
+    ASSERT_TRUE(db.open());
+    for (int i = 0; i < NumContacts; ++i)
+    {
+      string data;
+      ASSERT_TRUE(db.get(myAccountIds[i], data));
+      IniFile conf;
+      conf.loadRawConfiguration(data);
+      readContact(conf);
+    }
+  }
+  report("load database");
+
+  // Saves go to the journal, one save for each contact
+  start();
+  {
+    ContactDatabase db(myDir + "/contacts.db");
+    ASSERT_TRUE(db.open());
+    for (int i = 0; i < NumContacts; ++i)
+      ASSERT_TRUE(db.put(myAccountIds[i], myConfig));
+  }
+  report("save to database and close");
+}
+
+} // namespace LicqTest
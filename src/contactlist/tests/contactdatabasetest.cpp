@@ -0,0 +1,203 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "../contactdatabase.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <list>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using LicqDaemon::ContactDatabase;
+using std::list;
+using std::string;
+
+namespace LicqTest {
+
+class ContactDatabaseFixture : public ::testing::Test
+{
+public:
+  string myDir;
+  string myFile;
+
+  void SetUp()
+  {
+    char dir[] = "/tmp/licqcontactdbtest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    myDir = dir;
+    myFile = myDir + "/owner.ICQ.db";
+  }
+
+  void TearDown()
+  {
+    unlink(myFile.c_str());
+    unlink((myFile + ".journal").c_str());
+    rmdir(myDir.c_str());
+  }
+
+  off_t fileSize(const string& filename) const
+  {
+    struct stat st;
+    return (stat(filename.c_str(), &st) == 0 ? st.st_size : -1);
+  }
+};
+
+TEST_F(ContactDatabaseFixture, createEmpty)
+{
+  EXPECT_FALSE(ContactDatabase::exists(myFile));
+  {
+    ContactDatabase db(myFile);
+    ASSERT_TRUE(db.open());
+    string data;
+    EXPECT_FALSE(db.get("1234", data));
+  }
+  EXPECT_TRUE(ContactDatabase::exists(myFile));
+}
+
+TEST_F(ContactDatabaseFixture, putGetRemove)
+{
+  ContactDatabase db(myFile);
+  ASSERT_TRUE(db.open());
+
+  EXPECT_TRUE(db.put("1234", "[user]\nAlias=First\n"));
+  EXPECT_TRUE(db.put("5678", "[user]\nAlias=Second\n"));
+  EXPECT_TRUE(db.put("1234", "[user]\nAlias=Changed\n"));
+
+  string data;
+  EXPECT_TRUE(db.get("1234", data));
+  EXPECT_EQ("[user]\nAlias=Changed\n", data);
+  EXPECT_TRUE(db.get("5678", data));
+  EXPECT_EQ("[user]\nAlias=Second\n", data);
+
+  EXPECT_TRUE(db.remove("5678"));
+  EXPECT_FALSE(db.get("5678", data));
+
+  list<string> accountIds;
+  db.getAccountIds(accountIds);
+  ASSERT_EQ(1u, accountIds.size());
+  EXPECT_EQ("1234", accountIds.front());
+}
+
+TEST_F(ContactDatabaseFixture, journalIsReplayed)
+{
+  ContactDatabase db(myFile);
+  ASSERT_TRUE(db.open());
+  ASSERT_TRUE(db.put("a", "1"));
+  ASSERT_TRUE(db.compact());
+  ASSERT_TRUE(db.put("b", "2"));
+  ASSERT_TRUE(db.remove("a"));
+
+  // Open again without closing first, as after a crash
+  ContactDatabase db2(myFile);
+  ASSERT_TRUE(db2.open());
+  string data;
+  EXPECT_FALSE(db2.get("a", data));
+  EXPECT_TRUE(db2.get("b", data));
+  EXPECT_EQ("2", data);
+}
+
+TEST_F(ContactDatabaseFixture, compactClearsJournal)
+{
+  ContactDatabase db(myFile);
+  ASSERT_TRUE(db.open());
+  off_t emptyJournal = fileSize(myFile + ".journal");
+
+  for (int i = 0; i < 100; ++i)
+  {
+    char key[16];
+    snprintf(key, sizeof(key), "user%03d", i);
+    ASSERT_TRUE(db.put(key, string("data for ") + key));
+  }
+  EXPECT_GT(fileSize(myFile + ".journal"), emptyJournal);
+
+  ASSERT_TRUE(db.compact());
+  EXPECT_EQ(emptyJournal, fileSize(myFile + ".journal"));
+
+  string data;
+  EXPECT_TRUE(db.get("user000", data));
+  EXPECT_EQ("data for user000", data);
+  EXPECT_TRUE(db.get("user099", data));
+  EXPECT_EQ("data for user099", data);
+  EXPECT_FALSE(db.get("user100", data));
+
+  // Changes after compaction are merged in order
+  ASSERT_TRUE(db.put("user050", "changed"));
+  ASSERT_TRUE(db.put("aaa", "first"));
+  ASSERT_TRUE(db.remove("user001"));
+  ASSERT_TRUE(db.compact());
+
+  EXPECT_TRUE(db.get("user050", data));
+  EXPECT_EQ("changed", data);
+  EXPECT_TRUE(db.get("aaa", data));
+  EXPECT_EQ("first", data);
+  EXPECT_FALSE(db.get("user001", data));
+
+  list<string> accountIds;
+  db.getAccountIds(accountIds);
+  EXPECT_EQ(100u, accountIds.size());
+  EXPECT_EQ("aaa", accountIds.front());
+}
+
+TEST_F(ContactDatabaseFixture, incompleteJournalRecordIsDropped)
+{
+  ContactDatabase db(myFile);
+  ASSERT_TRUE(db.open());
+  ASSERT_TRUE(db.put("a", "1"));
+  ASSERT_TRUE(db.put("b", "2"));
+
+  // Cut last record as if write was interrupted
+  string journal = myFile + ".journal";
+  ASSERT_EQ(0, truncate(journal.c_str(), fileSize(journal) - 1));
+
+  ContactDatabase db2(myFile);
+  ASSERT_TRUE(db2.open());
+  string data;
+  EXPECT_TRUE(db2.get("a", data));
+  EXPECT_EQ("1", data);
+  EXPECT_FALSE(db2.get("b", data));
+
+  // Journal can still be appended to
+  EXPECT_TRUE(db2.put("c", "3"));
+}
+
+TEST_F(ContactDatabaseFixture, damagedDatabaseIsRejected)
+{
+  int fd = open(myFile.c_str(), O_WRONLY | O_CREAT, 0600);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(9, write(fd, "not a db\n", 9));
+  close(fd);
+
+  ContactDatabase db(myFile);
+  EXPECT_FALSE(db.open());
+}
+
+TEST_F(ContactDatabaseFixture, destroy)
+{
+  ContactDatabase db(myFile);
+  ASSERT_TRUE(db.open());
+  ASSERT_TRUE(db.put("a", "1"));
+  EXPECT_TRUE(db.destroy());
+  EXPECT_FALSE(ContactDatabase::exists(myFile));
+  EXPECT_FALSE(ContactDatabase::exists(myFile + ".journal"));
+}
+
+} // namespace LicqTest
@@ -0,0 +1,142 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../historywriter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using LicqDaemon::HistoryWriter;
+using std::string;
+
+namespace LicqTest {
+
+class HistoryWriterFixture
+  : public ::testing::TestWithParam<HistoryWriter::Durability>
+{
+public:
+  string myDir;
+
+  void SetUp()
+  {
+    char dir[] = "/tmp/licqhistorytest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    myDir = dir;
+  }
+
+  void TearDown()
+  {
+    for (int i = 0; i < 40; ++i)
+      unlink(filename(i).c_str());
+    rmdir(myDir.c_str());
+  }
+
+  string filename(int i) const
+  {
+    std::ostringstream ss;
+    ss << myDir << "/" << i << ".history";
+    return ss.str();
+  }
+
+  static string readFile(const string& filename)
+  {
+    std::ifstream f(filename.c_str());
+    std::ostringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+  }
+};
+
+TEST_P(HistoryWriterFixture, directWriteWhenNotStarted)
+{
+  HistoryWriter writer;
+  writer.append(filename(0), "first");
+  writer.append(filename(0), "second");
+  EXPECT_EQ("first\nsecond\n", readFile(filename(0)));
+}
+
+TEST_P(HistoryWriterFixture, flushWritesQueuedData)
+{
+  HistoryWriter writer;
+  ASSERT_TRUE(writer.start(GetParam()));
+  EXPECT_EQ(GetParam(), writer.durability());
+
+  string expected;
+  for (int i = 0; i < 1000; ++i)
+  {
+    std::ostringstream ss;
+    ss << "[ R | 0001 | 0001 | 0000 | " << i << " ]\n:message " << i << "\n";
+    writer.append(filename(0), ss.str());
+    expected += ss.str() + "\n";
+  }
+  writer.flush(filename(0));
+  EXPECT_EQ(expected, readFile(filename(0)));
+
+  writer.shutdown();
+}
+
+TEST_P(HistoryWriterFixture, orderKeptPerFileWithMoreFilesThanCached)
+{
+  HistoryWriter writer;
+  ASSERT_TRUE(writer.start(GetParam()));
+
+  // Use more files than descriptors that are kept open
+  for (int round = 0; round < 3; ++round)
+    for (int i = 0; i < 40; ++i)
+    {
+      std::ostringstream ss;
+      ss << i << "-" << round;
+      writer.append(filename(i), ss.str());
+    }
+  writer.flush();
+
+  for (int i = 0; i < 40; ++i)
+  {
+    std::ostringstream ss;
+    ss << i << "-0\n" << i << "-1\n" << i << "-2\n";
+    EXPECT_EQ(ss.str(), readFile(filename(i)));
+  }
+
+  writer.shutdown();
+}
+
+TEST_P(HistoryWriterFixture, shutdownWritesEverything)
+{
+  HistoryWriter writer;
+  ASSERT_TRUE(writer.start(GetParam()));
+  for (int i = 0; i < 100; ++i)
+    writer.append(filename(1), "x");
+  writer.shutdown();
+  EXPECT_EQ(200u, readFile(filename(1)).size());
+
+  // Writer is stopped, appends go directly to the file
+  writer.append(filename(1), "y");
+  EXPECT_EQ(202u, readFile(filename(1)).size());
+}
+
+INSTANTIATE_TEST_CASE_P(Durability, HistoryWriterFixture,
+    ::testing::Values(HistoryWriter::DurabilityNone,
+        HistoryWriter::DurabilityBatch, HistoryWriter::DurabilityEvent));
+
+} // namespace LicqTest
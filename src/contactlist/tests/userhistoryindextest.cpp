@@ -0,0 +1,321 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../userhistoryindex.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using LicqDaemon::UserHistory;
+using std::string;
+using std::vector;
+
+namespace LicqTest {
+
+// Index is only visible to UserHistory and its subclasses
+class IndexedUserHistory : public UserHistory
+{
+public:
+  typedef UserHistory::Index Index;
+};
+
+typedef IndexedUserHistory::Index Index;
+
+class UserHistoryIndexFixture : public ::testing::Test
+{
+public:
+  string myDir;
+  string myFile;
+
+  void SetUp()
+  {
+    char dir[] = "/tmp/licqhistoryindextest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    myDir = dir;
+    myFile = myDir + "/test.history";
+  }
+
+  void TearDown()
+  {
+    unlink(myFile.c_str());
+    unlink((myFile + ".idx").c_str());
+    rmdir(myDir.c_str());
+  }
+
+  static string entry(time_t time, const string& message)
+  {
+    std::ostringstream ss;
+    ss << "[ R | 0001 | 0001 | 0000 | " << time << " ]\n:" << message << "\n\n";
+    return ss.str();
+  }
+
+  void writeFile(const string& data, bool append = false)
+  {
+    std::ofstream f(myFile.c_str(),
+        append ? std::ios::out | std::ios::app : std::ios::out | std::ios::trunc);
+    f << data;
+  }
+
+  bool indexFileExists() const
+  {
+    return access((myFile + ".idx").c_str(), F_OK) == 0;
+  }
+
+  static string ranges(const Index& index, time_t from, time_t to)
+  {
+    vector<Index::Range> ranges;
+    index.findTime(from, to, ranges);
+    std::ostringstream ss;
+    for (size_t i = 0; i < ranges.size(); ++i)
+      ss << ranges[i].first << "-" << ranges[i].second << ",";
+    return ss.str();
+  }
+};
+
+TEST_F(UserHistoryIndexFixture, parseHeader)
+{
+  Index::EntryHeader header;
+  string line = "[ S | 0001 | 0002 | 0004 | 1234567890 ]";
+  ASSERT_TRUE(Index::parseHeader(line.data(), line.data() + line.size(), header));
+  EXPECT_EQ('S', header.direction);
+  EXPECT_EQ(1, header.subCommand);
+  EXPECT_EQ(2, header.command);
+  EXPECT_EQ(4u, header.flags);
+  EXPECT_EQ(1234567890, header.time);
+
+  // Trailing data, e.g. line break, is ignored
+  line = "[ R | 0012 | 0000 | 0000 | 5 ]\n";
+  ASSERT_TRUE(Index::parseHeader(line.data(), line.data() + line.size(), header));
+  EXPECT_EQ('R', header.direction);
+  EXPECT_EQ(12, header.subCommand);
+  EXPECT_EQ(5, header.time);
+
+  const char* const invalid[] = {
+    "",
+    "[ X | 0001 | 0001 | 0000 | 100 ]",
+    "[ R | 0001 | 0001 | 0000 ]",
+    "[ R | 0001 | 0001 | 0000 | abc ]",
+    "[ R | 0001 | 0001 | 0000 | 100",
+    "[R | 0001 | 0001 | 0000 | 100 ]",
+    "[ R | 0001 | 0001 | | 100 ]",
+    ":[ R | 0001 | 0001 | 0000 | 100 ]",
+  };
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i)
+    EXPECT_FALSE(Index::parseHeader(invalid[i], invalid[i] + strlen(invalid[i]), header))
+        << invalid[i];
+
+  // Header must be within the given range
+  line = "[ R | 0001 | 0001 | 0000 | 100 ]";
+  EXPECT_FALSE(Index::parseHeader(line.data(), line.data() + line.size() - 1, header));
+}
+
+TEST_F(UserHistoryIndexFixture, openMissingFile)
+{
+  Index index;
+  EXPECT_TRUE(index.open(myFile));
+  EXPECT_EQ(0u, index.size());
+  EXPECT_TRUE(index.isSorted());
+  EXPECT_FALSE(indexFileExists());
+}
+
+TEST_F(UserHistoryIndexFixture, openCreatesIndex)
+{
+  string first = entry(100, "first");
+  writeFile(first + entry(200, "second") + entry(300, "third"));
+
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  EXPECT_TRUE(indexFileExists());
+  ASSERT_EQ(3u, index.size());
+  EXPECT_EQ(0u, index[0].offset);
+  EXPECT_EQ(100, index[0].time);
+  EXPECT_EQ(first.size(), index[1].offset);
+  EXPECT_EQ(200, index[1].time);
+  EXPECT_EQ(300, index[2].time);
+  EXPECT_TRUE(index.isSorted());
+
+  // Existing index file is used
+  Index index2;
+  ASSERT_TRUE(index2.open(myFile));
+  ASSERT_EQ(3u, index2.size());
+  EXPECT_EQ(first.size(), index2[1].offset);
+  EXPECT_EQ(300, index2[2].time);
+}
+
+TEST_F(UserHistoryIndexFixture, indexUpdatedAfterAppend)
+{
+  writeFile(entry(100, "first") + entry(200, "second"));
+  {
+    Index index;
+    ASSERT_TRUE(index.open(myFile));
+    EXPECT_EQ(2u, index.size());
+  }
+
+  string before = entry(100, "first") + entry(200, "second");
+  writeFile(entry(300, "third"), true);
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  ASSERT_EQ(3u, index.size());
+  EXPECT_EQ(before.size(), index[2].offset);
+  EXPECT_EQ(300, index[2].time);
+}
+
+TEST_F(UserHistoryIndexFixture, incompleteLastEntryNotIndexed)
+{
+  writeFile(entry(100, "first") + "[ R | 0001 | 0001 | 0000 | 200 ]");
+  {
+    Index index;
+    ASSERT_TRUE(index.open(myFile));
+    EXPECT_EQ(1u, index.size());
+  }
+
+  // Rest of the entry is picked up once it's been written
+  writeFile("\n:second\n\n", true);
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  ASSERT_EQ(2u, index.size());
+  EXPECT_EQ(200, index[1].time);
+}
+
+TEST_F(UserHistoryIndexFixture, indexRebuiltAfterTruncate)
+{
+  writeFile(entry(100, "first") + entry(200, "second") + entry(300, "third"));
+  {
+    Index index;
+    ASSERT_TRUE(index.open(myFile));
+    EXPECT_EQ(3u, index.size());
+  }
+
+  writeFile(entry(400, "new"));
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  ASSERT_EQ(1u, index.size());
+  EXPECT_EQ(0u, index[0].offset);
+  EXPECT_EQ(400, index[0].time);
+}
+
+TEST_F(UserHistoryIndexFixture, indexRebuiltAfterRewrite)
+{
+  // Same size as the indexed file but entries at other offsets
+  writeFile(entry(100, "aaaa") + entry(200, "bbbb"));
+  {
+    Index index;
+    ASSERT_TRUE(index.open(myFile));
+    EXPECT_EQ(2u, index.size());
+  }
+
+  writeFile(entry(300, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"));
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  ASSERT_EQ(1u, index.size());
+  EXPECT_EQ(300, index[0].time);
+}
+
+TEST_F(UserHistoryIndexFixture, invalidHeadersNotIndexed)
+{
+  writeFile(
+      "[ R | 0001 | 0001 | 0000 | 100 ]\n:valid\n\n"
+      "[ X | 0001 | 0001 | 0000 | 200 ]\n:bad direction\n\n"
+      "[ R | 0001 | 0001 | 0000 ]\n:missing field\n\n"
+      "[ R | 0001 | 0001 | 0000 | abc ]\n:bad time\n\n"
+      "[ R | 0001 | 0001 | 0000 | 300\n:unterminated\n\n"
+      "[R | 0001 | 0001 | 0000 | 400 ]\n:bad spacing\n\n"
+      ":[ R | 0001 | 0001 | 0000 | 500 ]\n\n"
+      "[ S | 0001 | 0002 | 0004 | 600 ]\n:sent\n\n");
+
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  ASSERT_EQ(2u, index.size());
+  EXPECT_EQ(100, index[0].time);
+  EXPECT_EQ(600, index[1].time);
+
+}
+
+TEST_F(UserHistoryIndexFixture, bounds)
+{
+  writeFile(entry(100, "a") + entry(200, "b") + entry(200, "c") + entry(300, "d"));
+
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  EXPECT_EQ(0u, index.lowerBound(50));
+  EXPECT_EQ(1u, index.lowerBound(200));
+  EXPECT_EQ(3u, index.upperBound(200));
+  EXPECT_EQ(4u, index.lowerBound(301));
+  EXPECT_EQ(4u, index.upperBound(300));
+}
+
+TEST_F(UserHistoryIndexFixture, findTimeSorted)
+{
+  writeFile(entry(100, "a") + entry(200, "b") + entry(300, "c") + entry(400, "d"));
+
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  EXPECT_TRUE(index.isSorted());
+  EXPECT_EQ("1-3,", ranges(index, 200, 300));
+  EXPECT_EQ("3-4,", ranges(index, 350, 1000));
+  EXPECT_EQ("0-4,", ranges(index, 0, 1000));
+  EXPECT_EQ("", ranges(index, 500, 1000));
+  EXPECT_EQ("", ranges(index, 210, 290));
+}
+
+TEST_F(UserHistoryIndexFixture, findTimeUnsorted)
+{
+  // Offline messages are appended with the time they were sent
+  writeFile(entry(100, "a") + entry(400, "b") + entry(150, "offline") +
+      entry(160, "offline2") + entry(500, "c") + entry(300, "server"));
+
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  EXPECT_FALSE(index.isSorted());
+  EXPECT_EQ("1-4,5-6,", ranges(index, 140, 450));
+  EXPECT_EQ("4-5,", ranges(index, 450, 1000));
+  EXPECT_EQ("0-1,", ranges(index, 0, 120));
+  EXPECT_EQ("0-6,", ranges(index, 0, 1000));
+
+  // Sortedness is also detected when index is read from file
+  Index index2;
+  ASSERT_TRUE(index2.open(myFile));
+  EXPECT_FALSE(index2.isSorted());
+  EXPECT_EQ("1-4,5-6,", ranges(index2, 140, 450));
+}
+
+TEST_F(UserHistoryIndexFixture, unsortedAfterAppend)
+{
+  writeFile(entry(100, "a") + entry(200, "b"));
+  {
+    Index index;
+    ASSERT_TRUE(index.open(myFile));
+    EXPECT_TRUE(index.isSorted());
+  }
+
+  writeFile(entry(150, "offline"), true);
+  Index index;
+  ASSERT_TRUE(index.open(myFile));
+  EXPECT_FALSE(index.isSorted());
+  EXPECT_EQ("1-3,", ranges(index, 150, 200));
+}
+
+} // namespace LicqTest
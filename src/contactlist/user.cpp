@@ -34,6 +34,9 @@
 #include <unistd.h>
 
 #include "gettext.h"
+#include "contactdatabase.h"
+#include "savescheduler.h"
+#include "usermanager.h"
 #include <licq/logging/log.h>
 #include <licq/inifile.h>
 #include <licq/contactlist/usermanager.h>
@@ -51,6 +54,7 @@ using std::string;
 using std::stringstream;
 using std::vector;
 using LicqDaemon::UserHistory;
+using LicqDaemon::gSaveScheduler;
 using namespace Licq;
 
 
@@ -61,6 +65,8 @@ pthread_mutex_t Licq::User::mutex_nNumUserEvents = PTHREAD_MUTEX_INITIALIZER;
 User::Private::Private(User* user, const UserId& id)
   : myUser(user),
     myId(id),
+    myDatabase(NULL),
+    myHasImportedFile(false),
     myHistory(myId)
 {
   // Empty
@@ -104,15 +110,34 @@ User::User(const UserId& id, bool temporary)
   d->myHistory.setFile(gDaemon.baseDir() + filename + ".history");
   myPictureFileName = gDaemon.baseDir() + filename + ".picture";
 
+  // Contacts may be kept in a database instead of separate files
+  if (!myId.isOwner())
+    d->myDatabase = LicqDaemon::gUserManager.contactDatabase(myId.ownerId());
+
   if (m_bNotInList)
   {
     d->setDefaults();
     return;
   }
 
-
+  string rawConf;
+  if (d->myDatabase != NULL && d->myDatabase->get(myId.accountId(), rawConf))
+  {
+    d->myConf.loadRawConfiguration(rawConf);
+    d->myConf.setSection("user");
+  }
+  else if (d->myDatabase != NULL)
+  {
+    // Not in database yet, move configuration from separate file if it exists
+    if (d->myConf.loadFile() &&
+        d->myDatabase->put(myId.accountId(), d->myConf.getRawConfiguration()))
+      d->myHasImportedFile = true;
+    d->myConf.setSection("user");
+    if (!d->myHasImportedFile)
+      d->setDefaults();
+  }
   // Make sure we have a file so load won't fail
-  if (!d->myConf.loadFile())
+  else if (!d->myConf.loadFile())
   {
     d->myConf.setSection("user");
     if (!d->myConf.writeFile())
@@ -277,7 +302,7 @@ void User::Private::loadLicqInfo()
   if (nNewMessages > 0)
   {
     Licq::HistoryList hist;
-    if (myUser->GetHistory(hist))
+    if (myUser->getHistoryLast(hist, nNewMessages))
     {
       Licq::HistoryList::iterator it;
       if (hist.size() < nNewMessages)
@@ -322,7 +347,25 @@ User::~User()
 
 void User::Private::removeFiles()
 {
-  remove(myConf.filename().c_str());
+  // Drop any scheduled save so the file isn't written again
+  gSaveScheduler.take(myUser->id());
+  if (myDatabase != NULL)
+    myDatabase->remove(myId.accountId());
+  else
+    remove(myConf.filename().c_str());
+}
+
+void User::Private::removeImportedFile()
+{
+  if (!myHasImportedFile)
+    return;
+
+  string filename = myConf.filename();
+  if (filename[0] != '/')
+    filename = gDaemon.baseDir() + filename;
+  if (unlink(filename.c_str()) != 0 && errno != ENOENT)
+    gLog.warning(tr("Unable to remove %s: %s"), filename.c_str(), strerror(errno));
+  myHasImportedFile = false;
 }
 
 void User::Private::Init()
@@ -444,7 +487,7 @@ void User::Private::setPermanent()
   addToContactList();
 
   // Create file so save will have something to write in
-  if (!myConf.loadFile())
+  if (myDatabase == NULL && !myConf.loadFile())
   {
     myConf.setSection("user");
     if (!myConf.writeFile())
@@ -719,6 +762,30 @@ int User::GetHistory(Licq::HistoryList& history) const
   return d->myHistory.load(history, userEncoding());
 }
 
+size_t User::historySize() const
+{
+  LICQ_D_CONST();
+  return d->myHistory.count();
+}
+
+bool User::getHistoryLast(Licq::HistoryList& history, size_t count) const
+{
+  LICQ_D_CONST();
+  return d->myHistory.loadLast(history, userEncoding(), count);
+}
+
+bool User::getHistoryRange(Licq::HistoryList& history, size_t first, size_t count) const
+{
+  LICQ_D_CONST();
+  return d->myHistory.loadRange(history, userEncoding(), first, count);
+}
+
+bool User::getHistoryTime(Licq::HistoryList& history, time_t from, time_t to) const
+{
+  LICQ_D_CONST();
+  return d->myHistory.loadTime(history, userEncoding(), from, to);
+}
+
 void Licq::User::ClearHistory(HistoryList& h)
 {
   UserHistory::clear(h);
@@ -1328,9 +1395,23 @@ void User::save(unsigned group)
   if (!EnableSave())
     return;
 
+  // Let the scheduler combine changes into a single write
+  if (gSaveScheduler.schedule(myId, group))
+    return;
+
+  saveNow(group);
+}
+
+void User::saveNow(unsigned group)
+{
+  group |= gSaveScheduler.take(myId);
+  if (group == 0 || !EnableSave())
+    return;
+
   LICQ_D();
 
-  if (!d->myConf.loadFile())
+  // Configuration in database is only changed from here so no need to reload
+  if (d->myDatabase == NULL && !d->myConf.loadFile())
   {
     gLog.error(tr("Error opening '%s' for reading. See log for details."),
         d->myConf.filename().c_str());
@@ -1350,7 +1431,13 @@ void User::save(unsigned group)
   if (group & SavePictureInfo)
     savePictureInfo();
 
-  if (!d->myConf.writeFile())
+  if (d->myDatabase != NULL)
+  {
+    if (!d->myDatabase->put(myId.accountId(), d->myConf.getRawConfiguration()))
+      gLog.error(tr("Error writing %s to contact database. See log for details."),
+          myId.toString().c_str());
+  }
+  else if (!d->myConf.writeFile())
     gLog.error(tr("Error opening '%s' for writing. See log for details."),
         d->myConf.filename().c_str());
 }
@@ -29,6 +29,11 @@
 
 #include "userhistory.h"
 
+namespace LicqDaemon
+{
+class ContactDatabase;
+}
+
 namespace Licq
 {
 typedef std::map<std::string, boost::any> PropertyMap;
@@ -53,6 +58,15 @@ public:
   void loadPictureInfo();
   void loadUserInfo();
 
+  /// Check if configuration was moved to database from a separate file
+  bool hasImportedFile() const { return myHasImportedFile; }
+
+  /**
+   * Remove separate configuration file after it has been moved to database
+   * Caller must make sure the database has been written first.
+   */
+  void removeImportedFile();
+
 private:
   /**
    * Initialize all user object. Contains common code for all constructors
@@ -62,6 +76,8 @@ private:
   User* const myUser;
   const UserId myId;
   IniFile myConf;
+  LicqDaemon::ContactDatabase* myDatabase;
+  bool myHasImportedFile;
   LicqDaemon::UserHistory myHistory;
 
   // myUserInfo holds user information like email, address, homepage etc...
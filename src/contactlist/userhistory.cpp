@@ -22,7 +22,6 @@
 #include "userhistory.h"
 
 #include <boost/foreach.hpp>
-#include <boost/regex.hpp>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
@@ -31,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #include <licq/logging/log.h>
 #include <licq/translator.h>
@@ -38,6 +38,8 @@
 #include <licq/userid.h>
 
 #include "../gettext.h"
+#include "historywriter.h"
+#include "userhistoryindex.h"
 
 #define MAX_HISTORY_MSG_SIZE 8192
 
@@ -45,8 +47,10 @@ using Licq::UserId;
 using Licq::gLog;
 using Licq::gTranslator;
 using LicqDaemon::UserHistory;
+using LicqDaemon::gHistoryWriter;
 using std::list;
 using std::string;
+using std::vector;
 
 UserHistory::UserHistory(const Licq::UserId& userId)
   : myUserId(userId)
@@ -84,6 +88,7 @@ bool UserHistory::load(Licq::HistoryList& lHistory, const string& userEncoding)
 {
   if (myFilename.empty())
     return false;
+  gHistoryWriter.flush(myFilename);
 
   FILE* f = fopen(myFilename.c_str(), "r");
   if (f == NULL)
@@ -100,9 +105,93 @@ bool UserHistory::load(Licq::HistoryList& lHistory, const string& userEncoding)
     }
   }
 
-  // Expression to match message headers
-  boost::regex headRegex("\\[ ([SR]) \\| (\\d+) \\| (\\d+) \\| (\\d+) \\| (\\d+) \\].*");
+  parse(f, lHistory, userEncoding);
 
+  // Close the file
+  fclose(f);
+  return true;
+}
+
+size_t UserHistory::count() const
+{
+  if (myFilename.empty())
+    return 0;
+  gHistoryWriter.flush(myFilename);
+
+  Index index;
+  if (!index.open(myFilename))
+    return 0;
+  return index.size();
+}
+
+bool UserHistory::loadLast(Licq::HistoryList& history,
+    const string& userEncoding, size_t count) const
+{
+  if (myFilename.empty())
+    return false;
+
+  gHistoryWriter.flush(myFilename);
+  Index index;
+  if (!index.open(myFilename))
+    return false;
+  size_t first = (index.size() > count ? index.size() - count : 0);
+  parseRange(index, history, userEncoding, first, index.size());
+  return true;
+}
+
+bool UserHistory::loadRange(Licq::HistoryList& history,
+    const string& userEncoding, size_t first, size_t count) const
+{
+  if (myFilename.empty())
+    return false;
+
+  gHistoryWriter.flush(myFilename);
+  Index index;
+  if (!index.open(myFilename))
+    return false;
+  if (first > index.size())
+    first = index.size();
+  size_t end = (index.size() - first > count ? first + count : index.size());
+  parseRange(index, history, userEncoding, first, end);
+  return true;
+}
+
+bool UserHistory::loadTime(Licq::HistoryList& history,
+    const string& userEncoding, time_t from, time_t to) const
+{
+  if (myFilename.empty())
+    return false;
+
+  gHistoryWriter.flush(myFilename);
+  Index index;
+  if (!index.open(myFilename))
+    return false;
+  vector<Index::Range> ranges;
+  index.findTime(from, to, ranges);
+  BOOST_FOREACH(const Index::Range& range, ranges)
+    parseRange(index, history, userEncoding, range.first, range.second);
+  return true;
+}
+
+void UserHistory::parseRange(const Index& index, Licq::HistoryList& history,
+    const string& userEncoding, size_t first, size_t end) const
+{
+  if (first >= end)
+    return;
+
+  size_t startOffset = index[first].offset;
+  size_t endOffset = (end < index.size() ? index[end].offset : index.dataSize());
+  FILE* f = fmemopen(const_cast<char*>(index.data() + startOffset),
+      endOffset - startOffset, "r");
+  if (f == NULL)
+    return;
+  parse(f, history, userEncoding);
+  fclose(f);
+}
+
+void UserHistory::parse(FILE* f, Licq::HistoryList& lHistory,
+    const string& userEncoding) const
+{
   // Now read in a line at a time
   char sz[4096], *szResult;
   szResult = fgets(sz, sizeof(sz), f);
@@ -113,19 +202,19 @@ bool UserHistory::load(Licq::HistoryList& lHistory, const string& userEncoding)
     if (szResult == NULL) break;
 
     // Validate header line and extract fields
-    boost::cmatch headMatch;
-    if (!boost::regex_match(sz, headMatch, headRegex))
+    Index::EntryHeader header;
+    if (!Index::parseHeader(sz, sz + strlen(sz), header))
     {
       // No match, ignore it and move on
       szResult = fgets(sz, sizeof(sz), f);
       continue;
     }
 
-    char cDir = *headMatch[1].first;
-    int nSubCommand = atoi(headMatch[2].first);
-    int nCommand = atoi(headMatch[3].first);
-    unsigned long nFlags = atol(headMatch[4].first) << 16;
-    time_t tTime = (time_t)atol(headMatch[5].first);
+    char cDir = header.direction;
+    int nSubCommand = header.subCommand;
+    int nCommand = header.command;
+    unsigned long nFlags = header.flags << 16;
+    time_t tTime = header.time;
 
     // nCommand == Licq::UserEvent::CommandDirect => FlagDirect (already present in flags)
     // nCommand == Licq::UserEvent::CommandSent => FlagSender (present in cDir)
@@ -372,10 +461,6 @@ bool UserHistory::load(Licq::HistoryList& lHistory, const string& userEncoding)
     }
     if (szResult == NULL) break;
   }
-
-  // Close the file
-  fclose(f);
-  return true;
 }
 
 void UserHistory::write(const string& buf, bool append)
@@ -383,7 +468,16 @@ void UserHistory::write(const string& buf, bool append)
   if (myFilename.empty() || buf.empty())
     return;
 
-  int fd = open(myFilename.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 00600);
+  if (append)
+  {
+    gHistoryWriter.append(myFilename, buf);
+    return;
+  }
+
+  // Make sure no queued append ends up after the new contents
+  gHistoryWriter.flush(myFilename);
+
+  int fd = open(myFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 00600);
   if (fd == -1)
   {
     gLog.error(tr("Unable to open history file (%s): %s."),
@@ -391,9 +485,10 @@ void UserHistory::write(const string& buf, bool append)
     return;
   }
   ::write(fd, buf.c_str(), buf.size());
-  if (append)
-    ::write(fd, "\n", 1);
   close(fd);
+
+  // Index doesn't match a rewritten history
+  unlink((myFilename + ".idx").c_str());
 }
 
 void UserHistory::clear(Licq::HistoryList& hist)
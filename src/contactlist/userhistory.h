@@ -20,6 +20,8 @@
 #ifndef LICQDAEMON_CONTACTLIST_USERHISTORY_H
 #define LICQDAEMON_CONTACTLIST_USERHISTORY_H
 
+#include <cstdio>
+#include <ctime>
 #include <string>
 
 #include <licq/contactlist/user.h> // HistoryList
@@ -27,6 +29,16 @@
 namespace LicqDaemon
 {
 
+/**
+ * History file for a user
+ *
+ * The history file is a text file with events appended to it. To avoid
+ * parsing the whole file when only part of the history is needed, a sidecar
+ * index (history filename + ".idx") holds the offset and timestamp of each
+ * event. The index is created on first use and brought up to date with any
+ * events appended since, so it never has to be maintained by writers.
+ * History and index are read using mmap.
+ */
 class UserHistory
 {
 public:
@@ -52,6 +64,53 @@ public:
    */
   bool load(Licq::HistoryList& history, const std::string& userEncoding) const;
 
+  /**
+   * Get number of events in history
+   * Entries that don't produce an event (e.g. cancelled file transfers) are
+   * also counted.
+   *
+   * @return Number of entries in history file
+   */
+  size_t count() const;
+
+  /**
+   * Read the last events from history
+   *
+   * @param history List to put history entries in
+   * @param userEncoding Default encoding to use if unknown
+   * @param count Number of entries to read
+   * @return True if history was read
+   */
+  bool loadLast(Licq::HistoryList& history, const std::string& userEncoding,
+      size_t count) const;
+
+  /**
+   * Read a range of events from history
+   *
+   * @param history List to put history entries in
+   * @param userEncoding Default encoding to use if unknown
+   * @param first Index of first entry to read, zero is the oldest
+   * @param count Number of entries to read
+   * @return True if history was read
+   */
+  bool loadRange(Licq::HistoryList& history, const std::string& userEncoding,
+      size_t first, size_t count) const;
+
+  /**
+   * Read events from a time window
+   * Events are returned in file order. History is normally in time order but
+   * offline messages are added with the time they were sent so if timestamps
+   * go backwards all entries are checked instead of doing a binary search.
+   *
+   * @param history List to put history entries in
+   * @param userEncoding Default encoding to use if unknown
+   * @param from Start of time window
+   * @param to End of time window (inclusive)
+   * @return True if history was read
+   */
+  bool loadTime(Licq::HistoryList& history, const std::string& userEncoding,
+      time_t from, time_t to) const;
+
   /**
    * Frees up memory used by a history list
    *
@@ -61,6 +120,7 @@ public:
 
   /**
    * Write to the history file, creating it if necessary
+   * Appends are queued to the history writer, overwriting is done directly.
    *
    * @param buf String with data to write
    * @param append True to append data or false to overwrite file
@@ -73,6 +133,29 @@ public:
   const std::string& filename() const { return myFilename; }
 
 protected:
+  class Index;
+
+  /**
+   * Parse history entries from a file
+   *
+   * @param f File positioned at start of an entry
+   * @param history List to put history entries in
+   * @param userEncoding Default encoding to use if unknown
+   */
+  void parse(FILE* f, Licq::HistoryList& history, const std::string& userEncoding) const;
+
+  /**
+   * Parse a range of indexed entries
+   *
+   * @param index Index to read entries from
+   * @param history List to put history entries in
+   * @param userEncoding Default encoding to use if unknown
+   * @param first Index of first entry to read
+   * @param end Index after last entry to read
+   */
+  void parseRange(const Index& index, Licq::HistoryList& history,
+      const std::string& userEncoding, size_t first, size_t end) const;
+
   Licq::UserId myUserId;
   std::string myFilename;
 };
@@ -0,0 +1,313 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "userhistoryindex.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <licq/logging/log.h>
+
+#include "../gettext.h"
+
+using Licq::gLog;
+using LicqDaemon::UserHistory;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+bool skipString(const char*& p, const char* end, const char* str)
+{
+  size_t len = strlen(str);
+  if (static_cast<size_t>(end - p) < len || memcmp(p, str, len) != 0)
+    return false;
+  p += len;
+  return true;
+}
+
+bool parseNumber(const char*& p, const char* end, unsigned long& value)
+{
+  if (p == end || *p < '0' || *p > '9')
+    return false;
+  value = 0;
+  while (p != end && *p >= '0' && *p <= '9')
+    value = value * 10 + (*p++ - '0');
+  return true;
+}
+
+} // namespace
+
+static const char IndexMagic[8] = { 'L', 'i', 'c', 'q', 'H', 'I', 'd', '1' };
+
+UserHistory::Index::Index()
+  : myData(NULL),
+    myDataSize(0),
+    myIndexMap(NULL),
+    myIndexMapSize(0),
+    myEntries(NULL),
+    mySize(0),
+    myIsSorted(true)
+{
+  // Empty
+}
+
+UserHistory::Index::~Index()
+{
+  if (myData != NULL)
+    munmap(const_cast<char*>(myData), myDataSize);
+  if (myIndexMap != NULL)
+    munmap(myIndexMap, myIndexMapSize);
+}
+
+bool UserHistory::Index::open(const string& filename)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+  {
+    if (errno == ENOENT)
+      return true;
+    gLog.warning(tr("Unable to open history file (%s): %s."),
+        filename.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  if (st.st_size > 0)
+  {
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      gLog.warning(tr("Unable to map history file (%s): %s."),
+          filename.c_str(), strerror(errno));
+      close(fd);
+      return false;
+    }
+    myData = static_cast<const char*>(data);
+    myDataSize = st.st_size;
+  }
+  close(fd);
+
+  if (!openIndex(filename + ".idx", st.st_ino))
+  {
+    myMemoryEntries.clear();
+    scan(0, myMemoryEntries);
+    myEntries = (myMemoryEntries.empty() ? NULL : &myMemoryEntries[0]);
+    mySize = myMemoryEntries.size();
+  }
+
+  for (size_t i = 1; i < mySize && myIsSorted; ++i)
+    if (myEntries[i].time < myEntries[i-1].time)
+      myIsSorted = false;
+  return true;
+}
+
+size_t UserHistory::Index::lowerBound(time_t t) const
+{
+  return std::lower_bound(myEntries, myEntries + mySize,
+      static_cast<int64_t>(t), &compareTime) - myEntries;
+}
+
+size_t UserHistory::Index::upperBound(time_t t) const
+{
+  return std::upper_bound(myEntries, myEntries + mySize,
+      static_cast<int64_t>(t), &compareTimeUpper) - myEntries;
+}
+
+void UserHistory::Index::findTime(time_t from, time_t to,
+    vector<Range>& ranges) const
+{
+  if (myIsSorted)
+  {
+    size_t first = lowerBound(from);
+    size_t end = upperBound(to);
+    if (first < end)
+      ranges.push_back(Range(first, end));
+    return;
+  }
+
+  // Timestamps go backwards somewhere so check every entry
+  size_t i = 0;
+  while (i < mySize)
+  {
+    if (myEntries[i].time < from || myEntries[i].time > to)
+    {
+      ++i;
+      continue;
+    }
+    size_t first = i;
+    while (i < mySize && myEntries[i].time >= from && myEntries[i].time <= to)
+      ++i;
+    ranges.push_back(Range(first, i));
+  }
+}
+
+size_t UserHistory::Index::scan(size_t from, vector<Entry>& entries) const
+{
+  size_t pos = from;
+  while (pos < myDataSize)
+  {
+    const char* line = myData + pos;
+    const char* nl = static_cast<const char*>(memchr(line, '\n', myDataSize - pos));
+    if (nl == NULL)
+      // Last line is still being written
+      break;
+
+    EntryHeader header;
+    if (*line == '[' && parseHeader(line, nl, header))
+    {
+      Entry entry;
+      entry.offset = pos;
+      entry.time = header.time;
+      entries.push_back(entry);
+    }
+    pos = nl - myData + 1;
+  }
+  return pos;
+}
+
+bool UserHistory::Index::openIndex(const string& filename, ino_t inode)
+{
+  int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 00600);
+  if (fd == -1)
+    return false;
+  // Lock index while updating it so other readers don't add the same entries
+  if (flock(fd, LOCK_EX) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  struct stat st;
+  Header header;
+  size_t numEntries = 0;
+  bool valid = false;
+  if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(header)) &&
+      (st.st_size - sizeof(header)) % sizeof(Entry) == 0 &&
+      pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      memcmp(header.magic, IndexMagic, sizeof(IndexMagic)) == 0 &&
+      header.dataInode == static_cast<uint64_t>(inode) &&
+      header.dataSize <= myDataSize &&
+      (header.dataSize == 0 || myData[header.dataSize - 1] == '\n'))
+  {
+    // Sanity check last entry in case history was rewritten without index
+    numEntries = (st.st_size - sizeof(header)) / sizeof(Entry);
+    Entry last;
+    valid = (numEntries == 0 ||
+        (pread(fd, &last, sizeof(last), sizeof(header) + (numEntries-1) * sizeof(last)) == sizeof(last) &&
+        last.offset < header.dataSize && myData[last.offset] == '['));
+  }
+
+  vector<Entry> newEntries;
+  if (!valid)
+  {
+    memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+    header.dataInode = inode;
+    header.dataSize = scan(0, newEntries);
+
+    // Replace file instead of truncating it as other readers may have it mapped
+    int newFd = rebuildIndex(filename, header, newEntries);
+    close(fd);
+    if (newFd == -1)
+      return false;
+    fd = newFd;
+    numEntries = newEntries.size();
+  }
+  else if (header.dataSize < myDataSize)
+  {
+    header.dataSize = scan(header.dataSize, newEntries);
+    size_t size = newEntries.size() * sizeof(Entry);
+    // Write entries before header so an interrupted update is detected
+    if ((size > 0 && pwrite(fd, &newEntries[0], size,
+        sizeof(header) + numEntries * sizeof(Entry)) != static_cast<ssize_t>(size)) ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+      close(fd);
+      return false;
+    }
+    numEntries += newEntries.size();
+  }
+
+  myIndexMapSize = sizeof(header) + numEntries * sizeof(Entry);
+  void* map = mmap(NULL, myIndexMapSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  myIndexMap = map;
+  myEntries = reinterpret_cast<const Entry*>(static_cast<char*>(map) + sizeof(header));
+  mySize = numEntries;
+  return true;
+}
+
+int UserHistory::Index::rebuildIndex(const string& filename,
+    const Header& header, const vector<Entry>& entries) const
+{
+  vector<char> tempName(filename.begin(), filename.end());
+  const char* suffix = ".XXXXXX";
+  tempName.insert(tempName.end(), suffix, suffix + strlen(suffix) + 1);
+  int fd = mkstemp(&tempName[0]);
+  if (fd == -1)
+    return -1;
+
+  size_t size = entries.size() * sizeof(Entry);
+  if (::write(fd, &header, sizeof(header)) != sizeof(header) ||
+      (size > 0 && ::write(fd, &entries[0], size) != static_cast<ssize_t>(size)) ||
+      rename(&tempName[0], filename.c_str()) != 0)
+  {
+    gLog.warning(tr("Unable to write history index (%s): %s."),
+        filename.c_str(), strerror(errno));
+    close(fd);
+    unlink(&tempName[0]);
+    return -1;
+  }
+  return fd;
+}
+
+bool UserHistory::Index::parseHeader(const char* p, const char* end,
+    EntryHeader& header)
+{
+  unsigned long subCommand, command, flags, time;
+  if (!skipString(p, end, "[ ") || p == end || (*p != 'S' && *p != 'R'))
+    return false;
+  header.direction = *p++;
+  if (!skipString(p, end, " | ") || !parseNumber(p, end, subCommand) ||
+      !skipString(p, end, " | ") || !parseNumber(p, end, command) ||
+      !skipString(p, end, " | ") || !parseNumber(p, end, flags) ||
+      !skipString(p, end, " | ") || !parseNumber(p, end, time) ||
+      !skipString(p, end, " ]"))
+    return false;
+  header.subCommand = subCommand;
+  header.command = command;
+  header.flags = flags;
+  header.time = time;
+  return true;
+}
@@ -0,0 +1,166 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_CONTACTLIST_USERHISTORYINDEX_H
+#define LICQDAEMON_CONTACTLIST_USERHISTORYINDEX_H
+
+#include "userhistory.h"
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace LicqDaemon
+{
+
+/**
+ * Index of entries in a history file
+ *
+ * Index file contains a header followed by an entry for each event in the
+ * history file. The index is only a cache, if it cannot be used it is
+ * rebuilt and if it cannot be written the history is indexed in memory.
+ *
+ * Entries are in file order. This is normally also time order but offline
+ * and server messages are appended with the time they were sent so the
+ * timestamps may go backwards.
+ */
+class UserHistory::Index : private boost::noncopyable
+{
+public:
+  struct Entry
+  {
+    uint64_t offset;
+    int64_t time;
+  };
+
+  /// Parsed header line of a history entry
+  struct EntryHeader
+  {
+    char direction;
+    int subCommand;
+    int command;
+    unsigned long flags;
+    time_t time;
+  };
+
+  /// Range of entries, first and end index
+  typedef std::pair<size_t, size_t> Range;
+
+  /**
+   * Parse an entry header
+   * Header lines have the format "[ R | 0001 | 0001 | 0000 | 1234567890 ]"
+   *
+   * @param p Start of line
+   * @param end End of line
+   * @param header Header to fill in
+   * @return True if line is a valid header
+   */
+  static bool parseHeader(const char* p, const char* end, EntryHeader& header);
+
+  Index();
+  ~Index();
+
+  /**
+   * Open history file and bring index up to date
+   *
+   * @param filename History file
+   * @return True if history file could be read or doesn't exist
+   */
+  bool open(const std::string& filename);
+
+  /// Number of entries in history
+  size_t size() const { return mySize; }
+
+  /// Get an entry
+  const Entry& operator[](size_t i) const { return myEntries[i]; }
+
+  /// True if no entry has an earlier time than the entry before it
+  bool isSorted() const { return myIsSorted; }
+
+  /// Find first entry with time not earlier than t, requires sorted entries
+  size_t lowerBound(time_t t) const;
+
+  /// Find first entry with time later than t, requires sorted entries
+  size_t upperBound(time_t t) const;
+
+  /**
+   * Find entries in a time window
+   * Uses binary search if entries are sorted, otherwise all are checked.
+   *
+   * @param from Start of time window
+   * @param to End of time window (inclusive)
+   * @param ranges List to add ranges of consecutive matching entries to
+   */
+  void findTime(time_t from, time_t to, std::vector<Range>& ranges) const;
+
+  /// Contents of history file
+  const char* data() const { return myData; }
+
+  /// Size of history file
+  size_t dataSize() const { return myDataSize; }
+
+private:
+  struct Header
+  {
+    char magic[8];
+    uint64_t dataSize;
+    uint64_t dataInode;
+  };
+
+  static bool compareTime(const Entry& e, int64_t t) { return e.time < t; }
+  static bool compareTimeUpper(int64_t t, const Entry& e) { return t < e.time; }
+
+  /**
+   * Index entries in history file
+   *
+   * @param from Offset to start at, must be start of a line
+   * @param entries List to add entries to
+   * @return Offset after last complete line
+   */
+  size_t scan(size_t from, std::vector<Entry>& entries) const;
+
+  /**
+   * Open, update and map index file
+   *
+   * @param filename Index file
+   * @param inode Inode of history file
+   * @return True if index file is up to date and mapped
+   */
+  bool openIndex(const std::string& filename, ino_t inode);
+
+  /// Write a new index file and replace the old one
+  int rebuildIndex(const std::string& filename, const Header& header,
+      const std::vector<Entry>& entries) const;
+
+  const char* myData;
+  size_t myDataSize;
+  void* myIndexMap;
+  size_t myIndexMapSize;
+  const Entry* myEntries;
+  size_t mySize;
+  bool myIsSorted;
+  std::vector<Entry> myMemoryEntries;
+};
+
+} // namespace LicqDaemon
+
+#endif
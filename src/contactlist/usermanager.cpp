@@ -20,7 +20,13 @@
 #include "usermanager.h"
 
 #include <boost/foreach.hpp>
+#include <cerrno>
 #include <cstdio> // sprintf
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <licq/contactlist/owner.h>
 #include <licq/contactlist/user.h>
@@ -28,16 +34,20 @@
 #include <licq/logging/log.h>
 #include <licq/pluginsignal.h>
 #include <licq/protocolsignal.h>
+#include <licq/thread/mutexlocker.h>
 
 #include "../daemon.h"
 #include "../gettext.h"
 #include "../plugin/pluginmanager.h"
 #include "../protocolmanager.h"
+#include "contactdatabase.h"
 #include "group.h"
+#include "savescheduler.h"
 #include "user.h"
 
 using std::list;
 using std::string;
+using std::vector;
 using Licq::GroupListGuard;
 using Licq::GroupReadGuard;
 using Licq::GroupWriteGuard;
@@ -63,6 +73,8 @@ Licq::UserManager& Licq::gUserManager(LicqDaemon::gUserManager);
 
 
 UserManager::UserManager()
+  : myUseContactDatabase(false),
+    myUserLoadThreads(0)
 {
   // Set up the basic all users and new users group
   myGroupListMutex.setName("grouplist");
@@ -92,6 +104,8 @@ void UserManager::shutdown()
   for (o_iter = myOwners.begin(); o_iter != myOwners.end(); ++o_iter)
     delete o_iter->second;
   myOwners.clear();
+
+  closeContactDatabases(0);
 }
 
 void UserManager::addOwner(const UserId& userId)
@@ -231,6 +245,8 @@ bool UserManager::Load()
 
   licqConf.setSection("network");
   licqConf.get("DefaultUserEncoding", myDefaultEncoding, "");
+  licqConf.get("ContactDatabase", myUseContactDatabase, false);
+  licqConf.get("UserLoadThreads", myUserLoadThreads, 0);
 
   licqConf.writeFile();
   gDaemon.releaseLicqConf();
@@ -238,21 +254,31 @@ bool UserManager::Load()
   return true;
 }
 
+/// Get monotonic clock in milliseconds, used for load timings
+static long long getMonotonicClock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
 void UserManager::loadUserList(const UserId& ownerId)
 {
+  long long startTime = getMonotonicClock();
+
   // Load users from users.conf
   Licq::IniFile usersConf("users.conf");
   usersConf.loadFile();
 
   string ppidStr = Licq::protocolId_toString(ownerId.protocolId());
 
-  myUserListMutex.lockWrite();
-
   usersConf.setSection(ownerId.accountId() + "." + ppidStr);
   int numUsers;
   usersConf.get("NumUsers", numUsers);
   gLog.info(tr("Loading %i users for %s"), numUsers, ownerId.toString().c_str());
 
+  vector<UserId> userIds;
+  userIds.reserve(numUsers > 0 ? numUsers : 0);
   for (int i = 1; i <= numUsers; ++i)
   {
     char key[20];
@@ -264,12 +290,220 @@ void UserManager::loadUserList(const UserId& ownerId)
       gLog.warning(tr("Skipping user %i, invalid key"), i);
       continue;
     }
-    UserId userId(ownerId, accountId);
-    User* u = createUser(userId);
+    userIds.push_back(UserId(ownerId, accountId));
+  }
+
+  openContactDatabase(ownerId);
+  long long listTime = getMonotonicClock();
+
+  // Each thread takes every n:th user so slow files are spread out
+  vector<User*> users(userIds.size(), static_cast<User*>(NULL));
+  unsigned numThreads = userLoadThreads(userIds.size());
+  vector<UserLoadJob> jobs(numThreads);
+  vector<pthread_t> threads;
+  threads.reserve(numThreads);
+  for (unsigned i = 0; i < numThreads; ++i)
+  {
+    jobs[i].manager = this;
+    jobs[i].userIds = &userIds;
+    jobs[i].users = &users;
+    jobs[i].first = i;
+    jobs[i].step = numThreads;
+  }
+  for (unsigned i = 1; i < numThreads; ++i)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, loadUsers_tep, &jobs[i]) != 0)
+    {
+      // Load the remaining parts ourselves
+      gLog.warning(tr("Failed to start thread for loading users: %s"),
+          strerror(errno));
+      for (unsigned j = i; j < numThreads; ++j)
+        loadUsers(jobs[j]);
+      break;
+    }
+    threads.push_back(thread);
+  }
+  loadUsers(jobs[0]);
+  BOOST_FOREACH(pthread_t thread, threads)
+    pthread_join(thread, NULL);
+  long long loadTime = getMonotonicClock();
+
+  myUserListMutex.lockWrite();
+  for (size_t i = 0; i < users.size(); ++i)
+  {
+    User* u = users[i];
+    std::pair<UserMap::iterator, bool> ret =
+        myUsers.insert(std::make_pair(userIds[i], u));
+    if (!ret.second)
+    {
+      // Duplicate entry in users.conf or user was added while loading
+      delete u;
+      continue;
+    }
     u->myPrivate->addToContactList();
-    myUsers[userId] = u;
   }
+
+  importUserFiles(ownerId);
   myUserListMutex.unlockWrite();
+  long long mergeTime = getMonotonicClock();
+
+  gLog.info(tr("Loaded %i users for %s in %lld ms (list %lld ms, "
+      "users %lld ms with %u threads, merge %lld ms)"),
+      static_cast<int>(users.size()), ownerId.toString().c_str(),
+      mergeTime - startTime, listTime - startTime, loadTime - listTime,
+      numThreads, mergeTime - loadTime);
+}
+
+unsigned UserManager::userLoadThreads(size_t numUsers) const
+{
+  // Not worth starting threads for a short list
+  static const size_t MinUsersPerThread = 50;
+  static const unsigned MaxThreads = 16;
+
+  unsigned numThreads = myUserLoadThreads;
+  if (numThreads == 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    numThreads = (cpus > 0 ? cpus : 1);
+  }
+  if (numThreads > MaxThreads)
+    numThreads = MaxThreads;
+  if (numThreads > numUsers / MinUsersPerThread)
+    numThreads = numUsers / MinUsersPerThread;
+  return (numThreads > 0 ? numThreads : 1);
+}
+
+void UserManager::loadUsers(const UserLoadJob& job)
+{
+  for (size_t i = job.first; i < job.userIds->size(); i += job.step)
+    (*job.users)[i] = createUser((*job.userIds)[i]);
+}
+
+void* UserManager::loadUsers_tep(void* arg)
+{
+  UserLoadJob* job = static_cast<UserLoadJob*>(arg);
+  job->manager->loadUsers(*job);
+  return NULL;
+}
+
+string UserManager::contactDatabaseFile(const UserId& ownerId)
+{
+  return gDaemon.baseDir() + "users/" +
+      Licq::IniFile::sanitizeName(ownerId.accountId()) + "." +
+      Licq::protocolId_toString(ownerId.protocolId()) + ".db";
+}
+
+void UserManager::openContactDatabase(const UserId& ownerId)
+{
+  string filename = contactDatabaseFile(ownerId);
+  if (!myUseContactDatabase)
+  {
+    // Database has been disabled, go back to separate files
+    if (ContactDatabase::exists(filename))
+      exportContactDatabase(ownerId);
+    return;
+  }
+
+  Licq::MutexLocker locker(myContactDatabaseMutex);
+  if (myContactDatabases.count(ownerId) > 0)
+    return;
+
+  ContactDatabase* db = new ContactDatabase(filename);
+  if (!db->open())
+  {
+    gLog.error(tr("Unable to open contact database for %s, using separate files."),
+        ownerId.toString().c_str());
+    delete db;
+    return;
+  }
+  myContactDatabases[ownerId] = db;
+}
+
+void UserManager::importUserFiles(const UserId& ownerId)
+{
+  ContactDatabase* db = contactDatabase(ownerId);
+  if (db == NULL)
+    return;
+
+  list<User*> imported;
+  for (UserMap::const_iterator i = myUsers.begin(); i != myUsers.end(); ++i)
+    if (i->first.ownerId() == ownerId && i->second->myPrivate->hasImportedFile())
+      imported.push_back(i->second);
+  if (imported.empty())
+    return;
+
+  // Make sure all users are in the database file before removing old files
+  if (!db->compact())
+    return;
+
+  BOOST_FOREACH(User* u, imported)
+    u->myPrivate->removeImportedFile();
+  gLog.info(tr("Moved %i users for %s to contact database"),
+      static_cast<int>(imported.size()), ownerId.toString().c_str());
+}
+
+void UserManager::exportContactDatabase(const UserId& ownerId)
+{
+  ContactDatabase db(contactDatabaseFile(ownerId));
+  if (!db.open())
+    return;
+
+  // Same directory as used by User
+  string dirname = "users/" + Licq::IniFile::sanitizeName(ownerId.accountId()) +
+      "." + Licq::protocolId_toString(ownerId.protocolId());
+  string path = gDaemon.baseDir() + dirname;
+  if (mkdir(path.c_str(), 0700) < 0 && errno != EEXIST)
+    gLog.error(tr("Failed to create directory %s: %s"), path.c_str(), strerror(errno));
+
+  list<string> accountIds;
+  db.getAccountIds(accountIds);
+  bool written = true;
+  BOOST_FOREACH(const string& accountId, accountIds)
+  {
+    string data;
+    db.get(accountId, data);
+    Licq::IniFile conf(dirname + "/" + Licq::IniFile::sanitizeName(accountId) + ".conf");
+    conf.loadRawConfiguration(data);
+    if (!conf.writeFile())
+      written = false;
+  }
+
+  if (!written)
+  {
+    gLog.error(tr("Unable to move users for %s from contact database, keeping database."),
+        ownerId.toString().c_str());
+    return;
+  }
+
+  db.destroy();
+  gLog.info(tr("Moved %i users for %s from contact database to separate files"),
+      static_cast<int>(accountIds.size()), ownerId.toString().c_str());
+}
+
+ContactDatabase* UserManager::contactDatabase(const UserId& ownerId)
+{
+  Licq::MutexLocker locker(myContactDatabaseMutex);
+  ContactDatabaseMap::const_iterator i = myContactDatabases.find(ownerId);
+  return (i == myContactDatabases.end() ? NULL : i->second);
+}
+
+void UserManager::closeContactDatabases(unsigned long protocolId)
+{
+  Licq::MutexLocker locker(myContactDatabaseMutex);
+  ContactDatabaseMap::iterator i = myContactDatabases.begin();
+  while (i != myContactDatabases.end())
+  {
+    if (protocolId != 0 && i->first.protocolId() != protocolId)
+    {
+      ++i;
+      continue;
+    }
+
+    // Closing database writes any changes in journal to database file
+    delete i->second;
+    myContactDatabases.erase(i++);
+  }
 }
 
 void UserManager::loadProtocol(unsigned long protocolId)
@@ -304,6 +538,9 @@ void UserManager::loadProtocol(unsigned long protocolId)
 
 void UserManager::unloadProtocol(unsigned long protocolId)
 {
+  // Write any scheduled changes while the users still exist
+  gSaveScheduler.flush();
+
   // Delete all user objects using this protocol
   myUserListMutex.lockWrite();
   for (UserMap::iterator i = myUsers.begin(); i != myUsers.end(); )
@@ -322,6 +559,8 @@ void UserManager::unloadProtocol(unsigned long protocolId)
   }
   myUserListMutex.unlockWrite();
 
+  closeContactDatabases(protocolId);
+
   // Delete owner object for this protocol
   myOwnerListMutex.lockWrite();
   for (OwnerMap::iterator i = myOwners.begin(); i != myOwners.end(); )
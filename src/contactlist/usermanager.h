@@ -24,13 +24,16 @@
 
 #include <map>
 #include <set>
+#include <vector>
 
+#include <licq/thread/mutex.h>
 #include <licq/thread/readwritemutex.h>
 #include <licq/userid.h>
 
 
 namespace LicqDaemon
 {
+class ContactDatabase;
 class Group;
 
 typedef std::map<Licq::UserId, Licq::User*> UserMap;
@@ -142,6 +145,15 @@ public:
    */
   Licq::Owner* fetchOwner(const Licq::UserId& userId, bool writeLock = false);
 
+  /**
+   * Get contact database for an owner
+   *
+   * @param ownerId Owner of contacts
+   * @return Database to store contacts in or NULL if contacts are stored in
+   *         separate files
+   */
+  ContactDatabase* contactDatabase(const Licq::UserId& ownerId);
+
   // From Licq::UserManager
   void addOwner(const Licq::UserId& userId);
   bool removeOwner(const Licq::UserId& userId);
@@ -173,10 +185,42 @@ private:
   /**
    * Load user list from configuration file
    *
+   * Users are constructed by a pool of threads as reading their files is
+   * independent of each other, the list is only locked to add them once all
+   * have been loaded.
+   *
    * @param ownerId Owner to load users for
    */
   void loadUserList(const Licq::UserId& ownerId);
 
+  /// Part of the users for a thread to load
+  struct UserLoadJob
+  {
+    UserManager* manager;
+    const std::vector<Licq::UserId>* userIds;
+    std::vector<Licq::User*>* users;
+    size_t first;
+    size_t step;
+  };
+
+  /**
+   * Create users for a load job
+   *
+   * @param job Job to run
+   */
+  void loadUsers(const UserLoadJob& job);
+
+  /// Thread entry point for loading users
+  static void* loadUsers_tep(void* arg);
+
+  /**
+   * Get number of threads to load users with
+   *
+   * @param numUsers Number of users to load
+   * @return Number of threads including the calling thread
+   */
+  unsigned userLoadThreads(size_t numUsers) const;
+
   void saveOwnerList();
 
   /**
@@ -189,6 +233,45 @@ private:
 
   void SaveGroups();
 
+  /**
+   * Get contact database file for an owner
+   *
+   * @param ownerId Owner of contacts
+   * @return Absolute path of database file
+   */
+  static std::string contactDatabaseFile(const Licq::UserId& ownerId);
+
+  /**
+   * Open contact database for an owner if enabled
+   * If database is disabled but exists, contacts are moved back to separate
+   * files instead.
+   *
+   * @param ownerId Owner to open database for
+   */
+  void openContactDatabase(const Licq::UserId& ownerId);
+
+  /**
+   * Move contacts that were loaded from separate files into database
+   * Note: This function assumes that the user list is already locked.
+   *
+   * @param ownerId Owner of contacts
+   */
+  void importUserFiles(const Licq::UserId& ownerId);
+
+  /**
+   * Write contacts in a database to separate files and remove database
+   *
+   * @param ownerId Owner of contacts
+   */
+  void exportContactDatabase(const Licq::UserId& ownerId);
+
+  /**
+   * Close contact databases
+   *
+   * @param protocolId Protocol to close databases for, zero for all
+   */
+  void closeContactDatabases(unsigned long protocolId);
+
   /**
    * Create a user object, either Licq::User or protocol subclass
    *
@@ -216,6 +299,12 @@ private:
   std::set<Licq::UserId> myConfiguredOwners;
   bool m_bAllowSave;
   std::string myDefaultEncoding;
+
+  typedef std::map<Licq::UserId, ContactDatabase*> ContactDatabaseMap;
+  Licq::Mutex myContactDatabaseMutex;
+  ContactDatabaseMap myContactDatabases;
+  bool myUseContactDatabase;
+  unsigned myUserLoadThreads;
 };
 
 extern UserManager gUserManager;
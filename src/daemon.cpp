@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <list>
 #include <map>
 #include <sys/stat.h> // chmod
 
@@ -45,12 +46,17 @@
 #include <licq/translator.h>
 #include <licq/userevents.h>
 
+#include "contactlist/historywriter.h"
+#include "contactlist/savescheduler.h"
 #include "contactlist/usermanager.h"
+#include "eventratelimiter.h"
 #include "gettext.h"
 #include "gpghelper.h"
 #include "filter.h"
 #include "licq.h"
 #include "logging/filelogsink.h"
+#include "logging/logservice.h"
+#include "logging/packetcapturesink.h"
 #include "plugin/pluginmanager.h"
 
 using namespace LicqDaemon;
@@ -128,6 +134,33 @@ void Daemon::initialize()
   if (myRejectFile == "none")
     myRejectFile = "";
 
+  // Binary packet capture, replaces hex dumps in the error log
+  // Size is in KiB, types use the same bitmask as ErrorTypes
+  string captureFile;
+  unsigned captureSize, captureFiles, captureTypes;
+  licqConf.get("PacketCapture", captureFile, "none");
+  licqConf.get("PacketCaptureSize", captureSize, 16384); // KiB
+  licqConf.get("PacketCaptureFiles", captureFiles, 4);
+  licqConf.get("PacketCaptureTypes", captureTypes, 0x10 | 0x2);
+  bool capturePackets = false;
+  if (!captureFile.empty() && captureFile != "none")
+  {
+    captureFile = baseDir() + captureFile;
+    boost::shared_ptr<PacketCaptureSink> captureSink(
+        new PacketCaptureSink(captureFile, captureSize * 1024, captureFiles));
+    captureSink->setLogLevelsFromBitmask(
+        Licq::LogUtils::convertOldBitmaskToNew(captureTypes));
+    captureSink->setLogPackets(true);
+    if (captureSink->isOpen())
+    {
+      Licq::gLogService.registerLogSink(captureSink);
+      capturePackets = true;
+    }
+    else
+      gLog.error(tr("Unable to open %s as packet capture:\n%s"),
+                 captureFile.c_str(), strerror(errno));
+  }
+
   // Error log file
   licqConf.get("Errors", myErrorFile, "log.errors");
   licqConf.get("ErrorTypes", myErrorTypes, 0x4 | 0x2); // error and unknown
@@ -137,7 +170,7 @@ void Daemon::initialize()
     boost::shared_ptr<FileLogSink> logSink(new FileLogSink(errorFile));
     logSink->setLogLevelsFromBitmask(
         Licq::LogUtils::convertOldBitmaskToNew(myErrorTypes));
-    logSink->setLogPackets(true);
+    logSink->setLogPackets(!capturePackets);
     if (logSink->isOpen())
       Licq::gLogService.registerLogSink(logSink);
     else
@@ -145,17 +178,70 @@ void Daemon::initialize()
                  errorFile.c_str(), strerror(errno));
   }
 
+  // Number of log messages to queue for a writer thread, 0 to log directly
+  unsigned logQueueSize;
+  bool logQueueBlock;
+  licqConf.get("LogQueueSize", logQueueSize, 0);
+  licqConf.get("LogQueueBlock", logQueueBlock, false);
+
   // Misc
   licqConf.get("Terminal", myTerminal, "xterm -T Licq -e ");
   licqConf.get("SendTypingNotification", mySendTypingNotification, true);
   licqConf.get("IgnoreTypes", myIgnoreTypes, 0);
 
+  // History durability: 0 = no sync, 1 = sync each batch, 2 = sync each event
+  unsigned historySync;
+  licqConf.get("HistorySync", historySync, 0);
+  if (historySync > HistoryWriter::DurabilityEvent)
+    historySync = HistoryWriter::DurabilityEvent;
+
+  // Time in milliseconds to collect contact changes before writing them
+  unsigned contactSaveDelay;
+  licqConf.get("ContactSaveDelay", contactSaveDelay, 2000);
+
   unsigned long color;
   licqConf.get("ForegroundColor", color, 0x00000000);
   Licq::Color::setDefaultForeground(color);
   licqConf.get("BackgroundColor", color, 0x00FFFFFF);
   Licq::Color::setDefaultBackground(color);
 
+  // Admission limits for incoming events
+  licqConf.setSection("ratelimit");
+  EventRateLimiter::Budget budget;
+  licqConf.get("GlobalRate", budget.rate, 120);
+  licqConf.get("GlobalBurst", budget.burst, 60);
+  gEventRateLimiter.setGlobalBudget(budget);
+
+  licqConf.get("InListRate", budget.rate, 0);
+  licqConf.get("InListBurst", budget.burst, 0);
+  gEventRateLimiter.setSenderBudget(0, true, budget);
+  licqConf.get("NotInListRate", budget.rate, 20);
+  licqConf.get("NotInListBurst", budget.burst, 10);
+  gEventRateLimiter.setSenderBudget(0, false, budget);
+
+  // Sender limits for a single protocol are prefixed with protocol name
+  // (e.g. "ICQ.NotInListRate")
+  std::list<string> keys;
+  licqConf.getKeyList(keys);
+  BOOST_FOREACH(const string& key, keys)
+  {
+    string::size_type dot = key.find('.');
+    if (dot == string::npos)
+      continue;
+    string name = key.substr(dot + 1);
+    if (name != "InListRate" && name != "NotInListRate")
+      continue;
+    unsigned long protocolId = Licq::protocolId_fromString(key.substr(0, dot));
+    if (protocolId == 0)
+      continue;
+
+    bool inList = (name == "InListRate");
+    licqConf.get(key, budget.rate);
+    licqConf.get(key.substr(0, key.size() - 4) + "Burst", budget.burst,
+        inList ? 0 : 10);
+    gEventRateLimiter.setSenderBudget(protocolId, inList, budget);
+  }
+
   releaseLicqConf();
 
   // Initialize the random number generator
@@ -163,6 +249,20 @@ void Daemon::initialize()
 
   // start GPG helper
   LicqDaemon::gGpgHelper.Start();
+
+  // Write log messages in the background if enabled
+  LogDistributor::OverflowPolicy logPolicy = (logQueueBlock ?
+      LogDistributor::OverflowBlock : LogDistributor::OverflowDrop);
+  if (logQueueSize > 0 &&
+      !gLogService.startAsyncLogging(logQueueSize, logPolicy))
+    gLog.error(tr("Unable to start log writer thread: %s."), strerror(errno));
+
+  // Start writing history in the background
+  gHistoryWriter.start(static_cast<HistoryWriter::Durability>(historySync));
+
+  // Write contact changes in the background unless disabled
+  if (contactSaveDelay > 0)
+    gSaveScheduler.start(contactSaveDelay);
 }
 
 const char* Daemon::Version() const
@@ -318,6 +418,36 @@ Licq::Proxy* Licq::Daemon::createProxy()
 
 bool Daemon::addUserEvent(Licq::User* u, Licq::UserEvent* e)
 {
+  // Requests from unknown users are delivered to the owner
+  UserId senderId = u->id();
+  bool inList = !u->NotInList();
+  if (!u->isUser())
+  {
+    if (e->eventType() == Licq::UserEvent::TypeAuthRequest)
+    {
+      senderId = dynamic_cast<Licq::EventAuthRequest*>(e)->userId();
+      inList = false;
+    }
+    else if (e->eventType() == Licq::UserEvent::TypeAdded)
+    {
+      senderId = dynamic_cast<Licq::EventAdded*>(e)->userId();
+      inList = false;
+    }
+  }
+
+  // Drop events from senders that are over their budget before doing any
+  // other work with them
+  bool sheddingStarted;
+  if (!gEventRateLimiter.admit(senderId, inList,
+      EventRateLimiter::getMonotonicClock(), sheddingStarted))
+  {
+    if (sheddingStarted)
+      gLog.warning(tr("Too many events from users not in list, dropping events"));
+    Licq::gStatistics.increase(Licq::Statistics::EventsDroppedCounter);
+    delete e;
+    return false;
+  }
+
   int filteraction = gFilterManager.filterEvent(u, e);
   if (filteraction == Licq::FilterRule::ActionIgnore)
   {
@@ -0,0 +1,187 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "eventratelimiter.h"
+
+#include <ctime>
+
+#include <licq/thread/mutexlocker.h>
+#include <licq/userid.h>
+
+using namespace LicqDaemon;
+using Licq::MutexLocker;
+
+// Declare global EventRateLimiter (internal for daemon)
+LicqDaemon::EventRateLimiter LicqDaemon::gEventRateLimiter;
+
+EventRateLimiter::EventRateLimiter()
+  : myIsShedding(false)
+{
+  // Contacts in list are not limited unless configured
+  Budget inList = { 0, 0 };
+  myBudgets[true][0] = inList;
+
+  // Allow a short conversation from strangers but not a flood
+  Budget notInList = { 20, 10 };
+  myBudgets[false][0] = notInList;
+
+  Budget global = { 120, 60 };
+  myGlobalBudget = global;
+
+  myGlobalBucket.key = 0;
+  myGlobalBucket.lastTime = 0;
+  myGlobalBucket.tokens = myGlobalBudget.burst * TokenScale;
+
+  for (size_t i = 0; i < NumSlots; ++i)
+  {
+    mySlots[i].key = 0;
+    mySlots[i].lastTime = 0;
+    mySlots[i].tokens = 0;
+  }
+}
+
+void EventRateLimiter::setSenderBudget(unsigned long protocolId, bool inList,
+    const Budget& budget)
+{
+  MutexLocker locker(myMutex);
+  myBudgets[inList][protocolId] = budget;
+}
+
+void EventRateLimiter::setGlobalBudget(const Budget& budget)
+{
+  MutexLocker locker(myMutex);
+  myGlobalBudget = budget;
+  myGlobalBucket.tokens = (budget.burst > 0 ? budget.burst : 1) * TokenScale;
+}
+
+long long EventRateLimiter::getMonotonicClock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t EventRateLimiter::hashUserId(const Licq::UserId& userId)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  unsigned long protocolId = userId.protocolId();
+  for (size_t i = 0; i < sizeof(protocolId); ++i)
+  {
+    hash ^= (protocolId >> (i * 8)) & 0xFF;
+    hash *= 1099511628211ULL;
+  }
+  const std::string& accountId = userId.accountId();
+  for (size_t i = 0; i < accountId.size(); ++i)
+  {
+    hash ^= static_cast<unsigned char>(accountId[i]);
+    hash *= 1099511628211ULL;
+  }
+
+  // Zero marks an unused slot
+  return hash | 1;
+}
+
+void EventRateLimiter::refill(Bucket& bucket, const Budget& budget, long long now)
+{
+  unsigned max = (budget.burst > 0 ? budget.burst : 1) * TokenScale;
+  long long elapsed = now - bucket.lastTime;
+  if (elapsed <= 0)
+    return;
+
+  long long added = elapsed * budget.rate * TokenScale / 60000;
+  if (bucket.tokens + added >= max)
+  {
+    bucket.tokens = max;
+    bucket.lastTime = now;
+  }
+  else if (added > 0)
+  {
+    // Only count time that gave tokens so slow rates still refill
+    bucket.tokens += added;
+    bucket.lastTime += added * 60000 / (static_cast<long long>(budget.rate) * TokenScale);
+  }
+}
+
+bool EventRateLimiter::take(Bucket& bucket, const Budget& budget, long long now)
+{
+  refill(bucket, budget, now);
+  if (bucket.tokens < TokenScale)
+    return false;
+  bucket.tokens -= TokenScale;
+  return true;
+}
+
+bool EventRateLimiter::isFull(const Bucket& bucket, const Budget& budget, long long now)
+{
+  unsigned max = (budget.burst > 0 ? budget.burst : 1) * TokenScale;
+  long long elapsed = now - bucket.lastTime;
+  if (elapsed < 0)
+    elapsed = 0;
+  return bucket.tokens + elapsed * budget.rate * TokenScale / 60000 >= max;
+}
+
+const EventRateLimiter::Budget& EventRateLimiter::senderBudget(
+    unsigned long protocolId, bool inList) const
+{
+  const BudgetMap& budgets = myBudgets[inList];
+  BudgetMap::const_iterator i = budgets.find(protocolId);
+  if (i == budgets.end())
+    i = budgets.find(0);
+  return i->second;
+}
+
+bool EventRateLimiter::admit(const Licq::UserId& userId, bool inList,
+    long long now, bool& sheddingStarted)
+{
+  sheddingStarted = false;
+  MutexLocker locker(myMutex);
+
+  const Budget& budget = senderBudget(userId.protocolId(), inList);
+  if (budget.rate > 0)
+  {
+    uint64_t key = hashUserId(userId);
+    Bucket& bucket = mySlots[key % NumSlots];
+    if (bucket.key != key)
+    {
+      // Take over slot unless it's still in use by another sender
+      if (bucket.key == 0 || isFull(bucket, budget, now))
+      {
+        bucket.key = key;
+        bucket.lastTime = now;
+        bucket.tokens = (budget.burst > 0 ? budget.burst : 1) * TokenScale;
+      }
+    }
+    if (!take(bucket, budget, now))
+      return false;
+  }
+
+  if (!inList && myGlobalBudget.rate > 0)
+  {
+    if (!take(myGlobalBucket, myGlobalBudget, now))
+    {
+      sheddingStarted = !myIsShedding;
+      myIsShedding = true;
+      return false;
+    }
+    myIsShedding = false;
+  }
+
+  return true;
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_EVENTRATELIMITER_H
+#define LICQDAEMON_EVENTRATELIMITER_H
+
+#include <boost/noncopyable.hpp>
+#include <map>
+#include <stdint.h>
+
+#include <licq/thread/mutex.h>
+
+namespace Licq
+{
+class UserId;
+}
+
+namespace LicqDaemon
+{
+
+/**
+ * Admission control for incoming user events
+ *
+ * Each sender has a token bucket that is refilled at a fixed rate and each
+ * event takes one token. Events from senders with an empty bucket are
+ * dropped. Senders not in the contact list also share a global bucket so a
+ * flood from many different accounts is limited as well, contacts in the
+ * list are never held back by strangers.
+ *
+ * Buckets are kept in a fixed size table indexed by a hash of the user id so
+ * checking an event never allocates memory. Senders that hash to the same
+ * slot while the bucket is in use will share it.
+ *
+ * All functions are thread safe.
+ */
+class EventRateLimiter : private boost::noncopyable
+{
+public:
+  /// Budget for a token bucket
+  struct Budget
+  {
+    /// Events allowed per minute, zero for no limit
+    unsigned rate;
+
+    /// Number of events that may arrive at once
+    unsigned burst;
+  };
+
+  EventRateLimiter();
+
+  /**
+   * Set budget for each sender
+   *
+   * @param protocolId Protocol to set budget for or zero for default
+   * @param inList True to set budget for contacts in list, false for senders
+   *               not in list
+   * @param budget New budget
+   */
+  void setSenderBudget(unsigned long protocolId, bool inList, const Budget& budget);
+
+  /**
+   * Set budget for all senders not in list together
+   *
+   * @param budget New budget
+   */
+  void setGlobalBudget(const Budget& budget);
+
+  /**
+   * Check if an event may be accepted
+   *
+   * @param userId Sender of event
+   * @param inList True if sender is in contact list
+   * @param now Current monotonic time in milliseconds
+   * @param sheddingStarted Set to true if this is the first event dropped
+   *                        by the global limit since it last admitted an
+   *                        event
+   * @return True if event should be accepted
+   */
+  bool admit(const Licq::UserId& userId, bool inList, long long now,
+      bool& sheddingStarted);
+
+  /// Get monotonic clock in milliseconds
+  static long long getMonotonicClock();
+
+private:
+  static const size_t NumSlots = 4096;
+
+  // Tokens are stored in thousandths so slow rates work
+  static const unsigned TokenScale = 1000;
+
+  struct Bucket
+  {
+    uint64_t key;
+    long long lastTime;
+    unsigned tokens;
+  };
+
+  typedef std::map<unsigned long, Budget> BudgetMap;
+
+  /// Hash a user id for use in the bucket table
+  static uint64_t hashUserId(const Licq::UserId& userId);
+
+  /// Refill a bucket
+  static void refill(Bucket& bucket, const Budget& budget, long long now);
+
+  /// Take a token from a bucket, returns false if bucket is empty
+  static bool take(Bucket& bucket, const Budget& budget, long long now);
+
+  /// Check if a bucket has refilled completely
+  static bool isFull(const Bucket& bucket, const Budget& budget, long long now);
+
+  /// Get sender budget for a protocol
+  const Budget& senderBudget(unsigned long protocolId, bool inList) const;
+
+  Licq::Mutex myMutex;
+  BudgetMap myBudgets[2];
+  Budget myGlobalBudget;
+  Bucket myGlobalBucket;
+  bool myIsShedding;
+  Bucket mySlots[NumSlots];
+};
+
+extern EventRateLimiter gEventRateLimiter;
+
+} // namespace LicqDaemon
+
+#endif
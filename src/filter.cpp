@@ -19,18 +19,22 @@
 
 #include "filter.h"
 
+#include <map>
+
 #include <licq/contactlist/user.h>
 #include <licq/inifile.h>
 #include <licq/thread/mutexlocker.h>
 #include <licq/userevents.h>
 
 #include <boost/foreach.hpp>
-#include <boost/regex.hpp>
+
+#include "filterexpression.h"
 
 using namespace LicqDaemon;
 using Licq::FilterRule;
 using Licq::FilterRules;
 using Licq::UserEvent;
+using std::map;
 using std::string;
 
 // Declare global FilterManager (internal for daemon)
@@ -86,7 +90,9 @@ void FilterManager::initialize()
   if(!conf.loadFile())
   {
     // Failed to read configuration, setup defaults
+    Licq::MutexLocker lock(myDataMutex);
     getDefaultRules(myRules);
+    compileRules();
     saveRules(0);
     return;
   }
@@ -115,6 +121,9 @@ void FilterManager::initialize()
 
     myRules.push_back(rule);
   }
+
+  Licq::MutexLocker lock(myDataMutex);
+  compileRules();
 }
 
 void FilterManager::getRules(FilterRules& rules)
@@ -129,10 +138,40 @@ void FilterManager::setRules(const FilterRules& newRules)
   Licq::MutexLocker lock(myDataMutex);
   int oldCount = myRules.size();
   myRules = newRules;
+  compileRules();
 
   saveRules(oldCount);
 }
 
+void FilterManager::compileRules()
+{
+  // Reuse expressions that haven't changed
+  map<string, boost::shared_ptr<const FilterExpression> > oldExpressions;
+  if (myCompiledRules)
+  {
+    BOOST_FOREACH(const CompiledRule& rule, *myCompiledRules)
+      oldExpressions[rule.rule.expression] = rule.expression;
+  }
+
+  boost::shared_ptr<CompiledRules> rules(new CompiledRules);
+  rules->reserve(myRules.size());
+  BOOST_FOREACH(const FilterRule& rule, myRules)
+  {
+    if (!rule.isEnabled)
+      continue;
+
+    CompiledRule compiled;
+    compiled.rule = rule;
+    boost::shared_ptr<const FilterExpression>& expression =
+        oldExpressions[rule.expression];
+    if (!expression)
+      expression.reset(new FilterExpression(rule.expression));
+    compiled.expression = expression;
+    rules->push_back(compiled);
+  }
+  myCompiledRules = rules;
+}
+
 void FilterManager::saveRules(int oldCount)
 {
   Licq::IniFile conf("filter.conf");
@@ -181,56 +220,57 @@ void FilterManager::saveRules(int oldCount)
 int FilterManager::filterEvent(const Licq::User* user, const Licq::UserEvent* event)
 {
   // Get message and user id
+  static const string NoMessage;
   Licq::UserId userId = user->id();
-  string msg;
+  const string* msg = &NoMessage;
 
   switch (event->eventType())
   {
     case UserEvent::TypeMessage:
-      msg = (dynamic_cast<const Licq::EventMsg*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventMsg*>(event))->message();
       break;
     case UserEvent::TypeFile:
-      msg = (dynamic_cast<const Licq::EventFile*>(event))->fileDescription();
+      msg = &(dynamic_cast<const Licq::EventFile*>(event))->fileDescription();
       break;
     case UserEvent::TypeUrl:
-      msg = (dynamic_cast<const Licq::EventUrl*>(event))->urlDescription();
+      msg = &(dynamic_cast<const Licq::EventUrl*>(event))->urlDescription();
       break;
     case UserEvent::TypeChat:
-      msg = (dynamic_cast<const Licq::EventChat*>(event))->reason();
+      msg = &(dynamic_cast<const Licq::EventChat*>(event))->reason();
       break;
     case UserEvent::TypeAdded:
       // No message
       userId = (dynamic_cast<const Licq::EventAdded*>(event))->userId();
       break;
     case UserEvent::TypeAuthRequest:
-      msg = (dynamic_cast<const Licq::EventAuthRequest*>(event))->reason();
+      msg = &(dynamic_cast<const Licq::EventAuthRequest*>(event))->reason();
       userId = (dynamic_cast<const Licq::EventAuthRequest*>(event))->userId();
       break;
     case UserEvent::TypeAuthGranted:
-      msg = (dynamic_cast<const Licq::EventAuthGranted*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventAuthGranted*>(event))->message();
       userId = (dynamic_cast<const Licq::EventAuthGranted*>(event))->userId();
       break;
     case UserEvent::TypeAuthRefused:
-      msg = (dynamic_cast<const Licq::EventAuthRefused*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventAuthRefused*>(event))->message();
       userId = (dynamic_cast<const Licq::EventAuthRefused*>(event))->userId();
       break;
     case UserEvent::TypeWebPanel:
-      msg = (dynamic_cast<const Licq::EventWebPanel*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventWebPanel*>(event))->message();
       break;
     case UserEvent::TypeEmailPager:
-      msg = (dynamic_cast<const Licq::EventEmailPager*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventEmailPager*>(event))->message();
       break;
     case UserEvent::TypeContactList:
       // No message
       break;
     case UserEvent::TypeSms:
-      msg = (dynamic_cast<const Licq::EventSms*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventSms*>(event))->message();
       break;
     case UserEvent::TypeMsgServer:
-      msg = (dynamic_cast<const Licq::EventServerMessage*>(event))->message();
+      msg = &(dynamic_cast<const Licq::EventServerMessage*>(event))->message();
       break;
     case UserEvent::TypeEmailAlert:
-      msg = (dynamic_cast<const Licq::EventEmailAlert*>(event))->subject();
+      msg = &(dynamic_cast<const Licq::EventEmailAlert*>(event))->subject();
       break;
   }
 
@@ -260,11 +300,18 @@ int FilterManager::filterEvent(const Licq::User* user, const Licq::UserEvent* ev
   if (userInList)
     return FilterRule::ActionAccept;
 
-  Licq::MutexLocker lock(myDataMutex);
-  BOOST_FOREACH(const FilterRule& rule, myRules)
+  // Only hold the mutex while taking a reference to the current rules
+  boost::shared_ptr<const CompiledRules> rules;
   {
-    if (!rule.isEnabled)
-      continue;
+    Licq::MutexLocker lock(myDataMutex);
+    rules = myCompiledRules;
+  }
+  if (!rules)
+    return FilterRule::ActionAccept;
+
+  BOOST_FOREACH(const CompiledRule& compiled, *rules)
+  {
+    const FilterRule& rule = compiled.rule;
 
     if (rule.protocolId != 0 && rule.protocolId != userId.protocolId())
       continue;
@@ -272,20 +319,9 @@ int FilterManager::filterEvent(const Licq::User* user, const Licq::UserEvent* ev
     if ((rule.eventMask & (1<<event->eventType())) == 0)
       continue;
 
-    if (!rule.expression.empty())
-    {
-      try
-      {
-        boost::regex re(rule.expression, boost::regex::nosubs);
-        if (!boost::regex_match(msg, re))
-          continue;
-      }
-      catch (boost::regex_error& e)
-      {
-        // Expression is invalid so ignore this rule
-        continue;
-      }
-    }
+    // Invalid expressions never match so the rule is ignored
+    if (!compiled.expression->match(*msg))
+      continue;
 
     // This rule matches, return result
     return rule.action;
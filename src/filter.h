@@ -22,6 +22,9 @@
 
 #include <licq/filter.h>
 
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
 #include <licq/thread/mutex.h>
 
 namespace Licq
@@ -32,6 +35,7 @@ class UserEvent;
 
 namespace LicqDaemon
 {
+class FilterExpression;
 
 class FilterManager : public Licq::FilterManager
 {
@@ -59,6 +63,13 @@ public:
   void getDefaultRules(Licq::FilterRules& rules);
 
 private:
+  struct CompiledRule
+  {
+    Licq::FilterRule rule;
+    boost::shared_ptr<const FilterExpression> expression;
+  };
+  typedef std::vector<CompiledRule> CompiledRules;
+
   /**
    * Save the current set of rules to file
    *
@@ -66,8 +77,17 @@ private:
    */
   void saveRules(int oldCount);
 
+  /**
+   * Compile the current set of rules, myDataMutex must be held
+   * Expressions from the previous set are reused if unchanged.
+   */
+  void compileRules();
 
   Licq::FilterRules myRules;
+
+  // Compiled rules are never modified, a new set is made when rules change
+  // so filterEvent only needs the mutex to get the current set
+  boost::shared_ptr<const CompiledRules> myCompiledRules;
   Licq::Mutex myDataMutex;
 };
 
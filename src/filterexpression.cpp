@@ -0,0 +1,269 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "filterexpression.h"
+
+#include <cctype>
+#include <cstring>
+
+using LicqDaemon::FilterExpression;
+using std::string;
+
+FilterExpression::FilterExpression(const string& expression)
+  : myIsValid(true),
+    myMatchAll(expression.empty())
+{
+  if (myMatchAll)
+    return;
+
+  try
+  {
+    myRegex.assign(expression, boost::regex::nosubs);
+  }
+  catch (boost::regex_error& e)
+  {
+    // Expression is invalid so rule will never match
+    myIsValid = false;
+    return;
+  }
+
+  myLiteral = requiredLiteral(expression);
+}
+
+bool FilterExpression::match(const string& message) const
+{
+  if (!myIsValid)
+    return false;
+  if (myMatchAll)
+    return true;
+
+  // Cheap check first, most messages won't contain the literal
+  if (!myLiteral.empty() && memmem(message.data(), message.size(),
+      myLiteral.data(), myLiteral.size()) == NULL)
+    return false;
+
+  return boost::regex_match(message, myRegex);
+}
+
+/**
+ * Check if an escape sequence takes argument characters
+ *
+ * Escapes like \x41, \cI, \0101, \pL and \k<name> are followed by characters
+ * that are not matched literally and can't be parsed without knowing the
+ * exact syntax, so they disable the literal search.
+ *
+ * @param e Character following the backslash
+ * @return True if characters after e may belong to the escape
+ */
+static bool escapeHasArgument(char e)
+{
+  return isdigit(static_cast<unsigned char>(e)) ||
+      strchr("xcpPNkgu", e) != NULL;
+}
+
+/**
+ * Skip past a bracket expression
+ *
+ * @param expr Expression
+ * @param i Position of opening bracket, updated to position after the
+ *          closing bracket
+ * @return False if bracket couldn't be skipped safely
+ */
+static bool skipBracket(const string& expr, size_t& i)
+{
+  ++i;
+  if (i < expr.size() && expr[i] == '^')
+    ++i;
+  // A closing bracket first is part of the set
+  if (i < expr.size() && expr[i] == ']')
+    ++i;
+  while (i < expr.size() && expr[i] != ']')
+  {
+    if (expr[i] == '\\')
+    {
+      if (i + 1 < expr.size() && escapeHasArgument(expr[i+1]))
+        return false;
+      i += 2;
+    }
+    else if (expr[i] == '[' && i + 1 < expr.size() &&
+        (expr[i+1] == ':' || expr[i+1] == '=' || expr[i+1] == '.'))
+    {
+      // Character class like [:alpha:], skip to its end
+      size_t end = expr.find(string(1, expr[i+1]) + "]", i + 2);
+      if (end == string::npos)
+        return false;
+      i = end + 2;
+    }
+    else
+      ++i;
+  }
+  if (i >= expr.size())
+    return false;
+  ++i;
+  return true;
+}
+
+/**
+ * Skip past a group
+ *
+ * @param expr Expression
+ * @param i Position of opening parenthesis, updated to position after the
+ *          closing parenthesis
+ * @return False if group couldn't be skipped safely
+ */
+static bool skipGroup(const string& expr, size_t& i)
+{
+  // Options like (?i) may change how the rest of the expression matches
+  if (i + 1 < expr.size() && expr[i+1] == '?' &&
+      (i + 2 >= expr.size() || expr[i+2] != ':'))
+    return false;
+
+  int depth = 0;
+  while (i < expr.size())
+  {
+    char c = expr[i];
+    if (c == '\\')
+    {
+      if (i + 1 < expr.size() && (expr[i+1] == 'Q' || expr[i+1] == 'E' ||
+          escapeHasArgument(expr[i+1])))
+        return false;
+      i += 2;
+      continue;
+    }
+    if (c == '[')
+    {
+      if (!skipBracket(expr, i))
+        return false;
+      continue;
+    }
+    ++i;
+    if (c == '(')
+      ++depth;
+    else if (c == ')' && --depth == 0)
+      return true;
+  }
+  return false;
+}
+
+string FilterExpression::requiredLiteral(const string& expr)
+{
+  string best;
+  string run;
+  // True if last atom was a literal character at the end of run
+  bool lastIsLiteral = false;
+
+  size_t i = 0;
+  while (i < expr.size())
+  {
+    char c = expr[i];
+    bool isLiteral = false;
+    bool endRun = true;
+
+    switch (c)
+    {
+      case '\\':
+      {
+        if (i + 1 >= expr.size())
+          return string();
+        char e = expr[i+1];
+        if (e == 'Q' || e == 'E' || escapeHasArgument(e))
+          return string();
+        i += 2;
+        if (!isalnum(static_cast<unsigned char>(e)))
+        {
+          // Escaped special character
+          run += e;
+          isLiteral = true;
+          endRun = false;
+        }
+        break;
+      }
+
+      case '(':
+        if (!skipGroup(expr, i))
+          return string();
+        break;
+
+      case '[':
+        if (!skipBracket(expr, i))
+          return string();
+        break;
+
+      case '|':
+      case ')':
+        // Alternatives at top level, nothing is required
+        return string();
+
+      case '*':
+      case '?':
+      case '{':
+      {
+        // Previous atom is optional or repeated a variable number of times
+        if (c == '{')
+        {
+          size_t end = expr.find('}', i);
+          if (end == string::npos)
+            return string();
+          i = end + 1;
+        }
+        else
+          ++i;
+        if (lastIsLiteral)
+          run.erase(run.size() - 1);
+        // Skip lazy or possessive modifier
+        if (i < expr.size() && (expr[i] == '?' || expr[i] == '+'))
+          ++i;
+        break;
+      }
+
+      case '+':
+        // Previous atom is required but may be repeated
+        ++i;
+        if (i < expr.size() && (expr[i] == '?' || expr[i] == '+'))
+          ++i;
+        break;
+
+      case '.':
+      case '^':
+      case '$':
+        ++i;
+        break;
+
+      default:
+        run += c;
+        ++i;
+        isLiteral = true;
+        endRun = false;
+        break;
+    }
+
+    // A quantifier may follow so don't end the run until we know
+    if (endRun)
+    {
+      if (run.size() > best.size())
+        best = run;
+      run.clear();
+    }
+    lastIsLiteral = isLiteral;
+  }
+
+  if (run.size() > best.size())
+    best = run;
+  return best;
+}
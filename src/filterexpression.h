@@ -0,0 +1,91 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_FILTEREXPRESSION_H
+#define LICQDAEMON_FILTEREXPRESSION_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/regex.hpp>
+#include <string>
+
+namespace LicqDaemon
+{
+
+/**
+ * Compiled expression for a filter rule
+ *
+ * The regular expression is compiled once when the rule is set. To avoid
+ * running the regex for messages that cannot match, the longest literal
+ * string that must be part of any matching message is extracted from the
+ * expression and checked first.
+ *
+ * Objects are immutable after construction so they can be shared between
+ * threads without locking.
+ */
+class FilterExpression : private boost::noncopyable
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param expression Regular expression, empty matches everything
+   */
+  explicit FilterExpression(const std::string& expression);
+
+  /// Check if the expression could be compiled
+  bool isValid() const { return myIsValid; }
+
+  /**
+   * Get literal string required for a match
+   *
+   * @return Literal string that all matching messages contain, empty if
+   *         none could be determined
+   */
+  const std::string& literal() const { return myLiteral; }
+
+  /**
+   * Match a message against the expression
+   *
+   * @param message Message to test
+   * @return True if expression is valid and matches the entire message
+   */
+  bool match(const std::string& message) const;
+
+  /**
+   * Find the longest literal string required by an expression
+   *
+   * Only simple expressions are analyzed, for anything that isn't understood
+   * an empty string is returned so the message is always checked with the
+   * regex.
+   *
+   * @param expression Regular expression
+   * @return Literal string that must be in any match or empty if unknown
+   */
+  static std::string requiredLiteral(const std::string& expression);
+
+private:
+  bool myIsValid;
+  bool myMatchAll;
+  boost::regex myRegex;
+  std::string myLiteral;
+};
+
+} // namespace LicqDaemon
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <licq/inifile.h>
 
+#include <boost/unordered_map.hpp>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <cerrno>
@@ -35,6 +36,185 @@ using Licq::IniFile;
 using std::list;
 using std::string;
 
+class IniFile::Private
+{
+public:
+  typedef list<string>::iterator LineIter;
+  typedef boost::unordered_map<string, LineIter> KeyIndex;
+
+  struct Section
+  {
+    /// Header line or empty for the lines before the first section
+    string header;
+
+    /// All lines in section including comments and empty lines
+    list<string> lines;
+
+    /// Lines with parameters, only the first line is indexed for duplicates
+    KeyIndex keys;
+  };
+
+  typedef list<Section> SectionList;
+  typedef boost::unordered_map<string, Section*> SectionIndex;
+
+  Private();
+
+  /**
+   * Replace configuration with parsed data
+   *
+   * @param rawConfig Complete configuration as it appears in file
+   */
+  void parse(const string& rawConfig);
+
+  /**
+   * Get the configuration as it should appear in the file
+   */
+  string serialize() const;
+
+  /**
+   * Get section name from a header line
+   *
+   * @param header Header line
+   * @param name Set to section name
+   * @return False if header is malformed
+   */
+  static bool sectionName(const string& header, string& name);
+
+  /**
+   * Add a line to index of a section
+   *
+   * @param section Section that line belongs to
+   * @param line Line to index
+   */
+  static void indexLine(Section& section, LineIter line);
+
+  /**
+   * Add a section to index
+   *
+   * @param section Section to index, ignored if a section with the same name
+   *                is already indexed
+   */
+  void indexSection(Section& section);
+
+  // First section holds lines before any section header and is never removed
+  SectionList mySections;
+  SectionIndex mySectionIndex;
+  Section* mySection;
+};
+
+IniFile::Private::Private()
+  : mySections(1),
+    mySection(NULL)
+{
+  // Empty
+}
+
+bool IniFile::Private::sectionName(const string& header, string& name)
+{
+  string::size_type end = header.find(']');
+  if (end == string::npos)
+    return false;
+  name = header.substr(1, end - 1);
+  return true;
+}
+
+void IniFile::Private::indexLine(Section& section, LineIter line)
+{
+  const string& s = *line;
+  if (s.empty() || s[0] == '#' || s[0] == ';')
+    return;
+
+  string::size_type pos = s.find('=');
+  if (pos == string::npos)
+    return;
+
+  // Keep first occurrence if key is duplicated, that's the one get will find
+  section.keys.insert(KeyIndex::value_type(s.substr(0, pos), line));
+}
+
+void IniFile::Private::indexSection(Section& section)
+{
+  string name;
+  if (!sectionName(section.header, name) || name.empty())
+    return;
+  mySectionIndex.insert(SectionIndex::value_type(name, &section));
+}
+
+void IniFile::Private::parse(const string& rawConfig)
+{
+  mySections.clear();
+  mySectionIndex.clear();
+  mySection = NULL;
+  mySections.push_back(Section());
+  Section* section = &mySections.back();
+
+  string::size_type lineStart = 0;
+  while (lineStart < rawConfig.size())
+  {
+    // A missing newline at end of data is added when serializing
+    string::size_type lineEnd = rawConfig.find('\n', lineStart);
+    if (lineEnd == string::npos)
+      lineEnd = rawConfig.size();
+    string line(rawConfig, lineStart, lineEnd - lineStart);
+    lineStart = lineEnd + 1;
+
+    if (!line.empty() && line[0] == '[')
+    {
+      mySections.push_back(Section());
+      section = &mySections.back();
+      section->header = line;
+      indexSection(*section);
+      continue;
+    }
+
+    if (!line.empty() && line[0] != '#' && line[0] != ';')
+    {
+      // Old configuration files had spaces around equal sign, drop them
+      string::size_type pos = line.find('=');
+      if (pos != string::npos && pos > 0 && pos + 1 < line.size() &&
+          line[pos-1] == ' ' && line[pos+1] == ' ')
+        line.replace(pos-1, 3, "=");
+    }
+
+    section->lines.push_back(line);
+    indexLine(*section, --section->lines.end());
+  }
+
+  // TODO: Validate the config data so we can reject broken config files
+}
+
+string IniFile::Private::serialize() const
+{
+  // Get size first so data is only copied once
+  size_t size = 0;
+  SectionList::const_iterator s;
+  list<string>::const_iterator l;
+  for (s = mySections.begin(); s != mySections.end(); ++s)
+  {
+    if (s != mySections.begin())
+      size += s->header.size() + 1;
+    for (l = s->lines.begin(); l != s->lines.end(); ++l)
+      size += l->size() + 1;
+  }
+
+  string data;
+  data.reserve(size);
+  for (s = mySections.begin(); s != mySections.end(); ++s)
+  {
+    if (s != mySections.begin())
+    {
+      data += s->header;
+      data += '\n';
+    }
+    for (l = s->lines.begin(); l != s->lines.end(); ++l)
+    {
+      data += *l;
+      data += '\n';
+    }
+  }
+  return data;
+}
+
 string IniFile::sanitizeName(const string &s)
 {
   string r(s);
@@ -46,9 +226,7 @@ string IniFile::sanitizeName(const string &s)
 }
 
 IniFile::IniFile(const string& filename)
-  : myConfigData("\n"),
-    mySectionStart(string::npos),
-    mySectionEnd(string::npos),
+  : myPrivate(new Private),
     myIsModified(true),
     myLastTimestamp(0)
 {
@@ -58,7 +236,7 @@ IniFile::IniFile(const string& filename)
 
 IniFile::~IniFile()
 {
-  // Empty
+  delete myPrivate;
 }
 
 void IniFile::setFilename(const std::string& filename)
@@ -107,8 +285,7 @@ bool IniFile::loadFile()
   if (!myIsModified && myLastTimestamp != 0 && myLastTimestamp == st.st_mtime)
   {
     // File hasn't changed, no need to reread it
-    mySectionStart = string::npos;
-    mySectionEnd = string::npos;
+    myPrivate->mySection = NULL;
     close(fd);
     return true;
   }
@@ -142,54 +319,7 @@ bool IniFile::loadFile()
 
 void IniFile::loadRawConfiguration(const string& rawConfig)
 {
-  // Prepend buffer with an extra newline so setSection can assume every section starts with a newline
-  myConfigData = '\n' + rawConfig;
-
-  // Make sure data ends with a newline
-  if (myConfigData[myConfigData.size() - 1] != '\n')
-    myConfigData += '\n';
-
-  // Reset section pointers to mark that no section is selected
-  mySectionStart = string::npos;
-  mySectionEnd = string::npos;
-
-  // Old configuration files had spaces around equal sign, drop them
-
-  // First character is always a newline so first line starts on second character
-  string::size_type lineStart = 1;
-  while (true)
-  {
-    // Find next line
-    string::size_type lineEnd = myConfigData.find('\n', lineStart);
-    if (lineEnd == string::npos)
-      // Last character is always a new line so no next line means we're done
-      break;
-
-    // Ignore section headers and comments
-    if (myConfigData[lineStart] == '[' || myConfigData[lineStart] == '#' || myConfigData[lineStart] == ';')
-    {
-      lineStart = lineEnd + 1;
-      continue;
-    }
-
-    // Find equal sign between name and value
-    string::size_type pos = myConfigData.find('=', lineStart);
-
-    if (pos != string::npos && pos < lineEnd && pos < myConfigData.size() - 1)
-    {
-      // Equal sign found, check for spaces
-      if (myConfigData[pos-1] == ' ' && myConfigData[pos+1] == ' ')
-      {
-        // Spaces found, drop them
-        myConfigData.replace(pos-1, 3, "=");
-        lineEnd -= 2;
-      }
-    }
-
-    lineStart = lineEnd + 1;
-  }
-
-  // TODO: Validate the config data so we can reject broken config files
+  myPrivate->parse(rawConfig);
 
   // The raw configuration is most likely not in sync with the file
   myIsModified = true;
@@ -241,10 +371,11 @@ bool IniFile::writeFile(bool allowCreate)
     return false;
   }
 
-  // Write entire configuration but skip our initial newline
-  ssize_t numWritten = write(fd, myConfigData.c_str() + 1, myConfigData.size() - 1);
+  // Only generate file data when there is something to write
+  string data = myPrivate->serialize();
+  ssize_t numWritten = write(fd, data.data(), data.size());
 
-  if (numWritten != static_cast<ssize_t>(myConfigData.size() - 1))
+  if (numWritten != static_cast<ssize_t>(data.size()))
   {
     // Write failed, remove temp file
     gLog.error(tr("IniFile: I/O error, failed to write file.\nFile: %s\nError code: %i"),
@@ -275,12 +406,12 @@ bool IniFile::writeFile(bool allowCreate)
 
 string IniFile::getRawConfiguration() const
 {
-  // First character is our newline, the rest is the real config
-  return myConfigData.substr(1);
+  return myPrivate->serialize();
 }
 
 bool IniFile::setSection(const string& rawSection, bool allowAdd)
 {
+  LICQ_D();
   string section(rawSection);
 
   // Restrict characters allowed in section name
@@ -289,64 +420,36 @@ bool IniFile::setSection(const string& rawSection, bool allowAdd)
     section.erase(p, 1);
   if (section.empty())
   {
-    mySectionStart = string::npos;
-    mySectionEnd = string::npos;
+    d->mySection = NULL;
     return false;
   }
 
   // Find section
-  string::size_type pos = myConfigData.find("\n[" + section + "]");
-
-  if (pos != string::npos)
+  Private::SectionIndex::iterator i = d->mySectionIndex.find(section);
+  if (i != d->mySectionIndex.end())
   {
-    // Section found, find start of next line (probably first parameter)
-    pos = myConfigData.find('\n', pos + 1);
-    if (pos != string::npos)
-    {
-      // mySectionStart points to first character on first line after section header
-      mySectionStart = pos + 1;
-    }
-    else
-    {
-      // Line break missing after section, add it
-      myConfigData.append("\n");
-      mySectionStart = myConfigData.size();
-    }
-
-    // Find end of section (i.e. start of next section)
-    pos = myConfigData.find("\n[", mySectionStart-1);
-    if (pos == string::npos)
-      mySectionEnd = myConfigData.size();
-    else
-      mySectionEnd = pos + 1;
-
-    // Don't include empty lines between sections as part of this section
-    while (mySectionEnd > mySectionStart && myConfigData[mySectionEnd-2] == '\n')
-      --mySectionEnd;
-
-    // TODO: Don't include comments between sections as part of this section
-
-    // mySectionEnd points to first character of line after section end
-
+    d->mySection = i->second;
     return true;
   }
 
   if (!allowAdd)
   {
     // Section not found and not allowed to create, fail
-    mySectionStart = string::npos;
-    mySectionEnd = string::npos;
+    d->mySection = NULL;
     return false;
   }
 
   // Section not found, create it
-  if (myConfigData.size() > 1 &&
-      (myConfigData[myConfigData.size()-1] != '\n' || myConfigData[myConfigData.size()-2] != '\n'))
+  Private::Section& last = d->mySections.back();
+  if ((!last.lines.empty() && !last.lines.back().empty()) ||
+      (last.lines.empty() && !last.header.empty()))
     // Make sure we get an extra space between each section
-    myConfigData.append("\n");
-  myConfigData.append("[" + section + "]\n");
-  mySectionStart = myConfigData.size();
-  mySectionEnd = myConfigData.size();
+    last.lines.push_back(string());
+
+  d->mySections.push_back(Private::Section());
+  d->mySection = &d->mySections.back();
+  d->mySection->header = "[" + section + "]";
+  d->indexSection(*d->mySection);
 
   // We've added a section, mark data as changed
   myIsModified = true;
@@ -356,108 +459,101 @@ bool IniFile::setSection(const string& rawSection, bool allowAdd)
 
 void IniFile::removeSection(const string& section)
 {
+  LICQ_D();
+
   // Find section to remove
   if (!setSection(section, false))
     return;
 
-  // find section header (should be line before mySectionStart)
-  string::size_type pos = myConfigData.rfind("\n[", mySectionStart-2);
-  if (pos == string::npos)
-    // Shouldn't happen, just give up
-    return;
+  // Find position in list, it's never the first entry as that has no name
+  Private::SectionList::iterator i = ++d->mySections.begin();
+  while (&*i != d->mySection)
+    ++i;
 
-  // Also remove empty lines at end of section
-  while (mySectionEnd < myConfigData.size() && myConfigData[mySectionEnd] == '\n')
-    mySectionEnd++;
+  string name;
+  Private::sectionName(i->header, name);
+  d->mySectionIndex.erase(name);
+  i = d->mySections.erase(i);
 
-  myConfigData.erase(pos+1, mySectionEnd-pos-1);
+  // If section was duplicated the next one is now the one to find
+  for (; i != d->mySections.end(); ++i)
+  {
+    string otherName;
+    if (Private::sectionName(i->header, otherName) && otherName == name)
+    {
+      d->indexSection(*i);
+      break;
+    }
+  }
 
   // Data has changed
   myIsModified = true;
 
   // We no longer have a valid section selected
-  mySectionStart = string::npos;
-  mySectionEnd = string::npos;
+  d->mySection = NULL;
 }
 
 void IniFile::getSections(list<string>& ret, const string& prefix) const
 {
-  string needle = "\n[" + prefix;
-  string::size_type pos = 0;
-  while ((pos = myConfigData.find(needle, pos)) != string::npos)
+  LICQ_D_CONST();
+  Private::SectionList::const_iterator i;
+  for (i = ++d->mySections.begin(); i != d->mySections.end(); ++i)
   {
-    // Skip newline and left bracket
-    pos += 2;
-
-    // Find end of section name and make sure it ends on the same line
-    string::size_type secend = myConfigData.find(']', pos);
-    string::size_type nl = myConfigData.find('\n', pos);
-    if (secend == string::npos || nl == string::npos || nl < secend)
+    if (i->header.compare(1, prefix.size(), prefix) != 0)
       continue;
 
-    // Section name is valid, return it
-    ret.push_back(myConfigData.substr(pos, secend - pos));
+    // Only return sections where the name ends on the same line
+    string name;
+    if (Private::sectionName(i->header, name))
+      ret.push_back(name);
   }
 }
 
 void IniFile::getKeyList(list<string>& ret, const string& prefix) const
 {
-  if (mySectionStart == string::npos)
+  LICQ_D_CONST();
+  if (d->mySection == NULL)
     return;
 
-  string::size_type lineStart = mySectionStart;
-  string::size_type nextLine;
-  for (lineStart = mySectionStart; lineStart < mySectionEnd; lineStart = nextLine)
+  const list<string>& lines = d->mySection->lines;
+  for (list<string>::const_iterator i = lines.begin(); i != lines.end(); ++i)
   {
-    // Find start of next line
-    nextLine = myConfigData.find('\n', lineStart);
-    if (nextLine == string::npos)
-      nextLine = myConfigData.size();
-    else
-      nextLine += 1;
-
     // Ignore comments
-    if (myConfigData[lineStart] == '#' || myConfigData[lineStart] == ';')
+    if (i->empty() || (*i)[0] == '#' || (*i)[0] == ';')
       continue;
 
     // Check prefix
-    if (myConfigData.compare(lineStart, prefix.size(), prefix) != 0)
+    if (i->compare(0, prefix.size(), prefix) != 0)
       continue;
 
     // Check for delimiter
-    string::size_type equalPos = myConfigData.find('=', lineStart);
-    if (equalPos != string::npos && equalPos < nextLine)
-      // Delimiter found on same line, add key to list
-      ret.push_back(myConfigData.substr(lineStart, equalPos - lineStart));
+    string::size_type equalPos = i->find('=');
+    if (equalPos != string::npos)
+      ret.push_back(i->substr(0, equalPos));
   }
 }
 
 bool IniFile::get(const string& key, string& data, const string& defValue) const
 {
-  if (mySectionStart == string::npos)
+  LICQ_D_CONST();
+  if (d->mySection == NULL)
   {
     data = defValue;
     return false;
   }
 
   // Find parameter
-  string::size_type pos = myConfigData.find('\n' + key + '=', mySectionStart-1);
-  if (pos == string::npos || pos >= mySectionEnd)
+  Private::KeyIndex::const_iterator i = d->mySection->keys.find(key);
+  if (i == d->mySection->keys.end())
   {
-    // Parameter not found or not within this section
     data = defValue;
     return false;
   }
 
-  string::size_type start = pos + key.size() + 2;
-
-  // Find end of parameter value
-  pos = myConfigData.find('\n', start);
-  string::size_type len = (pos == string::npos ? string::npos : pos - start);
-  data = myConfigData.substr(start, len);
+  data = i->second->substr(key.size() + 1);
 
   // Convert special characters
-  pos = 0;
+  string::size_type pos = 0;
   while ( (pos = data.find_first_of('\\', pos)) != string::npos)
   {
     if (pos == data.size() - 1)
@@ -583,7 +679,8 @@ bool IniFile::getHex(const string& key, string& data, const string& defValue) co
 
 bool IniFile::set(const string& key, const string& data)
 {
-  if (mySectionStart == string::npos)
+  LICQ_D();
+  if (d->mySection == NULL)
     return false;
 
   // Restrict characters allowed in parameter name
@@ -611,26 +708,31 @@ bool IniFile::set(const string& key, const string& data)
     ++pos;
   }
 
-  pos = myConfigData.find('\n' + key + '=', mySectionStart-1);
-  if (pos != string::npos && pos < mySectionEnd)
+  Private::Section& section = *d->mySection;
+  Private::KeyIndex::iterator i = section.keys.find(key);
+  if (i != section.keys.end())
   {
     // Parameter already exists, replace value
-    string::size_type start = pos + key.size() + 2;
-    pos = myConfigData.find('\n', start);
-    string::size_type len = (pos == string::npos ? string::npos : pos - start);
-
-    if (safeData == myConfigData.substr(start, len))
+    string& line = *i->second;
+    if (line.compare(key.size() + 1, string::npos, safeData) == 0)
       // New data is same as old, no point in continuing
       return true;
 
-    myConfigData.replace(start, len, safeData);
-    mySectionEnd += safeData.size() - len;
+    line.replace(key.size() + 1, string::npos, safeData);
   }
   else
   {
-    // Parameter not found, add it at end of section
-    myConfigData.insert(mySectionEnd, key + '=' + safeData + '\n');
-    mySectionEnd += key.size() + safeData.size() + 2;
+    // Parameter not found, add it at end of section but before empty lines
+    Private::LineIter line = section.lines.end();
+    while (line != section.lines.begin())
+    {
+      Private::LineIter prev = line;
+      if (!(--prev)->empty())
+        break;
+      line = prev;
+    }
+    line = section.lines.insert(line, key + '=' + safeData);
+    section.keys.insert(Private::KeyIndex::value_type(key, line));
   }
 
   // Data has changed
@@ -695,18 +797,29 @@ bool IniFile::setHex(const string& key, const string& data)
 
 bool IniFile::unset(const std::string& key)
 {
-  if (mySectionStart == string::npos)
+  LICQ_D();
+  if (d->mySection == NULL)
     return false;
 
-  string::size_type start = myConfigData.find('\n' + key + '=', mySectionStart-1);
-  if (start == string::npos && start >= mySectionEnd)
+  Private::Section& section = *d->mySection;
+  Private::KeyIndex::iterator i = section.keys.find(key);
+  if (i == section.keys.end())
     // Parameter doesn't exist
     return false;
 
-  string::size_type end = myConfigData.find('\n', start+1);
-  string::size_type len = (end == string::npos ? string::npos : end - start);
-  myConfigData.erase(start, len);
-  mySectionEnd -= len;
+  Private::LineIter line = section.lines.erase(i->second);
+  section.keys.erase(i);
+
+  // If key was duplicated the next one is now the one to find
+  for (; line != section.lines.end(); ++line)
+  {
+    if (line->compare(0, key.size(), key) == 0 && line->size() > key.size() &&
+        (*line)[key.size()] == '=')
+    {
+      Private::indexLine(section, line);
+      break;
+    }
+  }
 
   // Data has changed
   myIsModified = true;
@@ -44,6 +44,8 @@
 #include <licq/utility.h>
 #include <licq/version.h>
 
+#include "contactlist/historywriter.h"
+#include "contactlist/savescheduler.h"
 #include "contactlist/usermanager.h"
 #include "daemon.h"
 #include "filter.h"
@@ -71,8 +73,10 @@ using LicqDaemon::gFifo;
 #endif
 using LicqDaemon::gFilterManager;
 using LicqDaemon::gLogService;
+using LicqDaemon::gHistoryWriter;
 using LicqDaemon::gOnEventManager;
 using LicqDaemon::gSarManager;
+using LicqDaemon::gSaveScheduler;
 using LicqDaemon::gPluginManager;
 using LicqDaemon::gStatistics;
 using LicqDaemon::gUserManager;
@@ -647,6 +651,9 @@ CLicq::~CLicq()
   gFifo.shutdown();
 #endif
 
+  // Deliver any queued log messages before the console log goes away
+  gLogService.stopAsyncLogging();
+
   gLogService.unregisterLogSink(myConsoleLog);
 }
 
@@ -763,8 +770,14 @@ int CLicq::Main()
 
   gDaemon.Shutdown();
 
+  // Write contact changes before users are removed
+  gSaveScheduler.shutdown();
+
   gUserManager.shutdown();
 
+  // Write any history still queued
+  gHistoryWriter.shutdown();
+
   // Flush statistics counters
   gStatistics.flush();
 
@@ -30,6 +30,8 @@ extern const unsigned int PacketBit = 0x1000;
 using namespace LicqDaemon;
 using Licq::MutexLocker;
 
+volatile unsigned long AdjustableLogSink::ourLevelGeneration = 0;
+
 AdjustableLogSink::AdjustableLogSink()
   : myLogLevels(0)
 {
@@ -52,33 +54,33 @@ void AdjustableLogSink::setLogLevel(Licq::Log::Level level, bool enable)
 {
   MutexLocker locker(myMutex);
   if (enable)
-    myLogLevels |= (1 << level);
+    setLevels(myLogLevels | (1 << level));
   else
-    myLogLevels &= ~(1 << level);
+    setLevels(myLogLevels & ~(1 << level));
 }
 
 void AdjustableLogSink::setLogPackets(bool enable)
 {
   MutexLocker locker(myMutex);
   if (enable)
-    myLogLevels |= PacketBit;
+    setLevels(myLogLevels | PacketBit);
   else
-    myLogLevels &= ~PacketBit;
+    setLevels(myLogLevels & ~PacketBit);
 }
 
 void AdjustableLogSink::setAllLogLevels(bool enable)
 {
   MutexLocker locker(myMutex);
   if (enable)
-    myLogLevels |= AllLevelsMask;
+    setLevels(myLogLevels | AllLevelsMask);
   else
-    myLogLevels &= ~AllLevelsMask;
+    setLevels(myLogLevels & ~AllLevelsMask);
 }
 
 void AdjustableLogSink::setLogLevelsFromBitmask(unsigned int levels)
 {
   MutexLocker locker(myMutex);
-  myLogLevels = levels & (AllLevelsMask | PacketBit);
+  setLevels(levels & (AllLevelsMask | PacketBit));
 }
 
 unsigned int AdjustableLogSink::getLogLevelsBitmask() const
@@ -86,3 +88,14 @@ unsigned int AdjustableLogSink::getLogLevelsBitmask() const
   MutexLocker locker(myMutex);
   return myLogLevels;
 }
+
+void AdjustableLogSink::setLevels(unsigned int levels)
+{
+  if (levels == myLogLevels)
+    return;
+  myLogLevels = levels;
+
+  // Bumped after the change so a cache built from the old levels is
+  // always detected
+  __sync_add_and_fetch(&ourLevelGeneration, 1);
+}
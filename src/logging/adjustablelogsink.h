@@ -45,11 +45,24 @@ public:
   void setLogLevelsFromBitmask(unsigned int levels);
   unsigned int getLogLevelsBitmask() const;
 
+  /**
+   * Get a number that changes each time the levels of any sink change
+   * Lets LogDistributor know when its cached levels must be checked again.
+   * Includes a memory barrier so reads made before it are done first.
+   */
+  static unsigned long levelGeneration()
+  { __sync_synchronize(); return ourLevelGeneration; }
+
 protected:
   mutable Licq::Mutex myMutex;
 
 private:
+  /// Set new levels, caller must hold myMutex
+  void setLevels(unsigned int levels);
+
   unsigned int myLogLevels;
+
+  static volatile unsigned long ourLevelGeneration;
 };
 
 } // namespace LicqDaemon
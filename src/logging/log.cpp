@@ -28,26 +28,33 @@ Stream::Stream(Log* log, Level level, const uint8_t* data, size_t size)
   : myLog(log),
     myLevel(level),
     myData(data),
-    mySize(size)
+    mySize(size),
+    myEnabled(log->isLogging(level)),
+    myStream(NULL)
 {
-  myStream = new std::ostringstream;
+  // Nothing written to a disabled stream is used so skip the allocation
+  if (myEnabled)
+    myStream = new std::ostringstream;
 }
 
 Licq::Log::Stream::Stream(const Stream& other)
+  : myStream(NULL)
 {
-  myStream = new std::ostringstream;
   *this = other;
 }
 
 Licq::Log::Stream::~Stream()
 {
-  const std::string msg = myStream->str();
-  if (!msg.empty())
+  if (myEnabled)
   {
-    if (myData != 0 && mySize != 0)
-      myLog->packet(myLevel, myData, mySize, msg);
-    else
-      myLog->log(myLevel, msg);
+    const std::string msg = myStream->str();
+    if (!msg.empty())
+    {
+      if (myData != 0 && mySize != 0)
+        myLog->packet(myLevel, myData, mySize, msg);
+      else
+        myLog->log(myLevel, msg);
+    }
   }
   delete myStream;
 }
@@ -60,11 +67,22 @@ Licq::Log::Stream& Licq::Log::Stream::operator=(const Stream& other)
     myLevel = other.myLevel;
     myData = other.myData;
     mySize = other.mySize;
+    myEnabled = other.myEnabled;
 
-    myStream->clear();
-    myStream->str(other.myStream->str());
-    myStream->copyfmt(*other.myStream);
-    myStream->seekp(other.myStream->tellp());
+    if (other.myStream == NULL)
+    {
+      delete myStream;
+      myStream = NULL;
+    }
+    else
+    {
+      if (myStream == NULL)
+        myStream = new std::ostringstream;
+      myStream->clear();
+      myStream->str(other.myStream->str());
+      myStream->copyfmt(*other.myStream);
+      myStream->seekp(other.myStream->tellp());
+    }
   }
 
   return *this;
@@ -72,6 +90,9 @@ Licq::Log::Stream& Licq::Log::Stream::operator=(const Stream& other)
 
 Licq::Log::Stream::operator std::ostream&()
 {
+  // Callers writing directly to a disabled stream still need a stream
+  if (myStream == NULL)
+    myStream = new std::ostringstream;
   return *myStream;
 }
 
@@ -88,13 +109,15 @@ static inline std::string vaToString(const char* format, va_list args)
 
 void Licq::Log::log(Level level, const char* format, va_list args)
 {
-  log(level, vaToString(format, args));
+  if (isLogging(level))
+    log(level, vaToString(format, args));
 }
 
 void Licq::Log::packet(Level level, const uint8_t* data,
                        size_t size, const char* format, va_list args)
 {
-  packet(level, data, size, vaToString(format, args));
+  if (isLogging(level))
+    packet(level, data, size, vaToString(format, args));
 }
 
 using Licq::LogSink;
@@ -107,6 +130,11 @@ Log::Log(const std::string& owner, LogSink& sink) :
   // Empty
 }
 
+bool Log::isLogging(Level level) const
+{
+  return mySink.isLogging(level);
+}
+
 void Log::log(Level level, const std::string& msg)
 {
   if (!mySink.isLogging(level))
@@ -18,14 +18,35 @@
  */
 
 #include "logdistributor.h"
+#include "adjustablelogsink.h"
 #include <licq/thread/mutexlocker.h>
 
 #include <boost/foreach.hpp>
+#include <cerrno>
+#include <sstream>
+#include <sys/time.h>
 
 using Licq::LogSink;
 using Licq::MutexLocker;
 using namespace LicqDaemon;
 
+LogDistributor::LogDistributor()
+  : myLevelCache(0),
+    myCacheGeneration(0),
+    myQueueHead(0),
+    myQueueCount(0),
+    myPolicy(OverflowDrop),
+    myIsRunning(false),
+    myStopRequested(false)
+{
+  // Empty
+}
+
+LogDistributor::~LogDistributor()
+{
+  stopAsync();
+}
+
 void LogDistributor::registerSink(LogSink::Ptr sink)
 {
   MutexLocker locker(myMutex);
@@ -33,42 +54,224 @@ void LogDistributor::registerSink(LogSink::Ptr sink)
     return;
 
   mySinks.push_back(sink);
+  myLevelCache = 0;
 }
 
 void LogDistributor::unregisterSink(LogSink::Ptr sink)
 {
   MutexLocker locker(myMutex);
   mySinks.remove(sink);
+  myLevelCache = 0;
 }
 
-bool LogDistributor::isLogging(Licq::Log::Level level) const
+bool LogDistributor::startAsync(size_t capacity, OverflowPolicy policy)
+{
+  MutexLocker locker(myQueueMutex);
+  if (myIsRunning)
+    return true;
+  if (capacity == 0)
+  {
+    errno = EINVAL;
+    return false;
+  }
+
+  myQueue.assign(capacity, Message::Ptr());
+  myQueueHead = 0;
+  myQueueCount = 0;
+  myPolicy = policy;
+  myStopRequested = false;
+  int error = pthread_create(&myThread, NULL, writer_tep, this);
+  if (error != 0)
+  {
+    // pthread_create returns the error instead of setting errno
+    errno = error;
+    return false;
+  }
+  myIsRunning = true;
+  return true;
+}
+
+void LogDistributor::stopAsync()
 {
-  MutexLocker locker(myMutex);
-  BOOST_FOREACH(LogSink::Ptr sink, mySinks)
   {
-    if (sink->isLogging(level))
-      return true;
+    MutexLocker locker(myQueueMutex);
+    if (!myIsRunning || myStopRequested)
+      return;
+    myStopRequested = true;
+    myNotEmptyCond.signal();
   }
-  return false;
+
+  pthread_join(myThread, NULL);
+}
+
+unsigned long LogDistributor::droppedMessages(const std::string& sender) const
+{
+  MutexLocker locker(myQueueMutex);
+  DropCounts::const_iterator iter = myDropped.find(sender);
+  return (iter != myDropped.end() ? iter->second : 0);
+}
+
+bool LogDistributor::isLogging(Licq::Log::Level level) const
+{
+  return cachedIsLogging(level);
 }
 
 bool LogDistributor::isLoggingPackets() const
 {
+  return cachedIsLogging(PacketsLevel);
+}
+
+bool LogDistributor::cachedIsLogging(int level) const
+{
+  unsigned int bit = 1 << level;
+  unsigned long cacheGeneration = myCacheGeneration;
+  __sync_synchronize();
+  unsigned int cache = myLevelCache;
+  if ((cache & (bit << CacheKnownShift)) != 0 &&
+      cacheGeneration == AdjustableLogSink::levelGeneration())
+    return (cache & bit) != 0;
+
   MutexLocker locker(myMutex);
+
+  // Read generation before asking sinks so changes made while asking will
+  // clear the cache next time
+  unsigned long generation = AdjustableLogSink::levelGeneration();
+  if (generation != myCacheGeneration)
+  {
+    // Readers that see the new generation must not see the old levels
+    myLevelCache = 0;
+    __sync_synchronize();
+    myCacheGeneration = generation;
+  }
+
+  bool logging = false;
   BOOST_FOREACH(LogSink::Ptr sink, mySinks)
   {
-    if (sink->isLoggingPackets())
-      return true;
+    if (level == PacketsLevel ? sink->isLoggingPackets() :
+        sink->isLogging(static_cast<Licq::Log::Level>(level)))
+    {
+      logging = true;
+      break;
+    }
   }
-  return false;
+
+  myLevelCache |= (bit << CacheKnownShift) | (logging ? bit : 0);
+  return logging;
 }
 
 void LogDistributor::log(Message::Ptr message)
 {
+  {
+    MutexLocker locker(myQueueMutex);
+
+    // A sink logging from the writer thread must not wait for itself
+    bool mayBlock = (myPolicy == OverflowBlock && myIsRunning &&
+        !pthread_equal(pthread_self(), myThread));
+    while (mayBlock && myIsRunning && myQueueCount == myQueue.size())
+      myNotFullCond.wait(myQueueMutex);
+
+    if (myIsRunning)
+    {
+      if (myQueueCount == myQueue.size())
+      {
+        ++myDropped[message->sender];
+        ++myUnreportedDrops[message->sender];
+        return;
+      }
+
+      myQueue[(myQueueHead + myQueueCount) % myQueue.size()] = message;
+      if (myQueueCount++ == 0)
+        myNotEmptyCond.signal();
+      return;
+    }
+  }
+
   MutexLocker locker(myMutex);
-  BOOST_FOREACH(LogSink::Ptr sink, mySinks)
+  deliver(mySinks, message);
+}
+
+void LogDistributor::deliver(const LogSinkList& sinks, Message::Ptr message)
+{
+  BOOST_FOREACH(LogSink::Ptr sink, sinks)
   {
     if (sink->isLogging(message->level))
       sink->log(message);
   }
 }
+
+void* LogDistributor::writer_tep(void* arg)
+{
+  static_cast<LogDistributor*>(arg)->run();
+  return NULL;
+}
+
+void LogDistributor::run()
+{
+  std::vector<Message::Ptr> batch;
+  DropCounts dropped;
+
+  MutexLocker locker(myQueueMutex);
+  while (true)
+  {
+    while (myQueueCount == 0 && !myStopRequested)
+      myNotEmptyCond.wait(myQueueMutex);
+
+    if (myQueueCount == 0 && myUnreportedDrops.empty())
+    {
+      // Stop requested and everything delivered, later messages are
+      // delivered directly by caller
+      myIsRunning = false;
+      myNotFullCond.broadcast();
+      break;
+    }
+
+    // Take everything queued so far as one batch
+    batch.reserve(myQueueCount);
+    for (; myQueueCount > 0; --myQueueCount)
+    {
+      batch.push_back(Message::Ptr());
+      batch.back().swap(myQueue[myQueueHead]);
+      myQueueHead = (myQueueHead + 1) % myQueue.size();
+    }
+    dropped.swap(myUnreportedDrops);
+    myNotFullCond.broadcast();
+    locker.unlock();
+
+    // Sinks are called without holding myMutex so threads checking
+    // isLogging() don't have to wait for sink I/O
+    LogSinkList sinks;
+    {
+      MutexLocker sinkLocker(myMutex);
+      sinks = mySinks;
+    }
+    BOOST_FOREACH(const Message::Ptr& message, batch)
+      deliver(sinks, message);
+    batch.clear();
+
+    BOOST_FOREACH(const DropCounts::value_type& drop, dropped)
+      deliver(sinks, droppedMessage(drop.first, drop.second));
+    dropped.clear();
+
+    locker.relock();
+  }
+}
+
+LogSink::Message::Ptr LogDistributor::droppedMessage(
+    const std::string& sender, unsigned long count)
+{
+  LogSink::Message* message = new LogSink::Message();
+
+  timeval tv;
+  ::gettimeofday(&tv, NULL);
+  message->time.sec = tv.tv_sec;
+  message->time.msec = tv.tv_usec / 1000;
+
+  std::ostringstream text;
+  text << count << " log messages from " << sender
+      << " dropped, log queue is full";
+  message->level = Licq::Log::Warning;
+  message->sender = "licq";
+  message->text = text.str();
+
+  return LogSink::Message::Ptr(message);
+}
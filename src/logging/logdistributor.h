@@ -21,19 +21,43 @@
 #define LICQDAEMON_LOGDISTRIBUTOR_H
 
 #include <licq/logging/logsink.h>
+#include <licq/thread/condition.h>
 #include <licq/thread/mutex.h>
 
 #include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <vector>
 
 namespace LicqDaemon
 {
 
 /**
  * Distributes log messages to all registered sinks.
+ *
+ * By default messages are passed to the sinks directly by the thread that
+ * logs them. After startAsync(), messages are instead put in a bounded queue
+ * and passed to the sinks by a writer thread so callers never wait for sink
+ * I/O. Messages are still delivered in the order they were logged.
+ *
+ * isLogging() and isLoggingPackets() are cached so checking a disabled level
+ * doesn't take any lock. The cache is cleared when sinks are registered or
+ * unregistered and when levels of any AdjustableLogSink change.
  */
 class LogDistributor : public Licq::LogSink
 {
 public:
+  /// What to do with new messages when the queue is full
+  enum OverflowPolicy
+  {
+    OverflowDrop,               // Drop the message and count it for sender
+    OverflowBlock,              // Wait until the writer thread makes room
+  };
+
+  LogDistributor();
+  ~LogDistributor();
+
   /**
    * Registers a sink that will receive a copy of future log messages.
    *
@@ -48,16 +72,86 @@ public:
    */
   void unregisterSink(LogSink::Ptr sink);
 
+  /**
+   * Start delivering messages from a writer thread
+   *
+   * @param capacity Maximum number of messages waiting for the writer
+   * @param policy What to do when the queue is full
+   * @return True if thread was started, otherwise errno is set
+   */
+  bool startAsync(size_t capacity, OverflowPolicy policy = OverflowDrop);
+
+  /**
+   * Deliver all queued messages and stop the writer thread
+   * Any later messages are delivered directly.
+   */
+  void stopAsync();
+
+  /**
+   * Get number of messages dropped because the queue was full
+   *
+   * @param sender Sender to get count for
+   * @return Number of dropped messages from sender
+   */
+  unsigned long droppedMessages(const std::string& sender) const;
+
   // From Licq::LogSink
   bool isLogging(Licq::Log::Level level) const;
   bool isLoggingPackets() const;
   void log(Message::Ptr message);
 
 private:
-  mutable Licq::Mutex myMutex;
+  typedef std::map<std::string, unsigned long> DropCounts;
+
+  /// Thread entry point
+  static void* writer_tep(void* arg);
+
+  /// Main loop for writer thread
+  void run();
 
   typedef std::list<LogSink::Ptr> LogSinkList;
+
+  /// Pass a message to all sinks that are interested in its level
+  static void deliver(const LogSinkList& sinks, Message::Ptr message);
+
+  /**
+   * Check cache for a level, updating it from sinks if needed
+   *
+   * @param level A Licq::Log::Level, or PacketsLevel for packets
+   * @return True if any sink logs the level
+   */
+  bool cachedIsLogging(int level) const;
+
+  /// Create a warning about messages dropped from a sender
+  static Message::Ptr droppedMessage(const std::string& sender,
+      unsigned long count);
+
+  mutable Licq::Mutex myMutex;
   LogSinkList mySinks;
+
+  // Each level has bit 1 << level, packets use level 0 which is unused by
+  // Licq::Log::Level. The same bits shifted up by CacheKnownShift are set
+  // for levels that have been checked. Written under myMutex but read
+  // without, the cache is cleared before a new generation is stored and
+  // readers check the generation before reading the cache.
+  static const int PacketsLevel = 0;
+  static const unsigned int CacheKnownShift = 16;
+  mutable volatile unsigned int myLevelCache;
+  mutable volatile unsigned long myCacheGeneration;
+
+  // Queue for writer thread, protected by myQueueMutex
+  mutable Licq::Mutex myQueueMutex;
+  Licq::Condition myNotEmptyCond;
+  Licq::Condition myNotFullCond;
+  std::vector<Message::Ptr> myQueue;
+  size_t myQueueHead;
+  size_t myQueueCount;
+  OverflowPolicy myPolicy;
+  DropCounts myDropped;
+  DropCounts myUnreportedDrops;
+  bool myIsRunning;
+  bool myStopRequested;
+  pthread_t myThread;
 };
 
 } // namespace LicqDaemon
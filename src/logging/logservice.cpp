@@ -54,6 +54,17 @@ void LogService::registerDefaultLogSink(Licq::AdjustableLogSink::Ptr logSink)
   registerLogSink(logSink);
 }
 
+bool LogService::startAsyncLogging(size_t capacity,
+    LogDistributor::OverflowPolicy policy)
+{
+  return myLogDistributor.startAsync(capacity, policy);
+}
+
+void LogService::stopAsyncLogging()
+{
+  myLogDistributor.stopAsync();
+}
+
 Log::Ptr LogService::createLog(const std::string& name)
 {
   return Log::Ptr(new Log(name, myLogDistributor));
@@ -39,6 +39,19 @@ public:
 
   void registerDefaultLogSink(Licq::AdjustableLogSink::Ptr logSink);
 
+  /**
+   * Deliver log messages to sinks from a writer thread
+   *
+   * @param capacity Maximum number of messages waiting to be delivered
+   * @param policy What to do with new messages when the queue is full
+   * @return True if writer thread was started, otherwise errno is set
+   */
+  bool startAsyncLogging(size_t capacity,
+      LogDistributor::OverflowPolicy policy);
+
+  /// Deliver queued log messages and go back to delivering directly
+  void stopAsyncLogging();
+
   // From Licq::LogService
   Licq::Log::Ptr createLog(const std::string& name);
   void createThreadLog(const std::string& name);
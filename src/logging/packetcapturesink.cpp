@@ -0,0 +1,318 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Please refer to the COPYRIGHT file distributed with this source
+ * distribution for the names of the individual contributors.
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "packetcapturesink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+#include <licq/thread/mutexlocker.h>
+
+using namespace LicqDaemon;
+using Licq::MutexLocker;
+
+// pcap file header values
+static const uint32_t PcapMagic = 0xa1b2c3d4;
+static const uint32_t PcapMagicSwapped = 0xd4c3b2a1;
+static const uint16_t PcapVersionMajor = 2;
+static const uint16_t PcapVersionMinor = 4;
+static const uint32_t PcapSnapLen = 262144;
+
+static const size_t PcapFileHeaderSize = 24;
+static const size_t PcapRecordHeaderSize = 16;
+static const size_t FrameHeaderSize = 8;
+
+static void appendHost16(std::string& buf, uint16_t value)
+{
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void appendHost32(std::string& buf, uint32_t value)
+{
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void appendNet16(std::string& buf, uint16_t value)
+{
+  buf += static_cast<char>(value >> 8);
+  buf += static_cast<char>(value & 0xff);
+}
+
+static uint16_t getNet16(const uint8_t* data)
+{
+  return (data[0] << 8) | data[1];
+}
+
+static uint32_t swap32(uint32_t value)
+{
+  return ((value & 0xff) << 24) | ((value & 0xff00) << 8) |
+      ((value >> 8) & 0xff00) | (value >> 24);
+}
+
+PacketCaptureSink::PacketCaptureSink(const std::string& filename,
+    size_t maxFileSize, unsigned maxFiles)
+  : myFilename(filename),
+    myMaxFileSize(maxFileSize),
+    myMaxFiles(maxFiles),
+    myFd(-1),
+    myFileSize(0)
+{
+  MutexLocker locker(myFileMutex);
+  myBuffer.reserve(BufferSize);
+
+  // Keep capture from previous run instead of appending to it
+  rotate();
+}
+
+PacketCaptureSink::~PacketCaptureSink()
+{
+  MutexLocker locker(myFileMutex);
+  writeBuffer();
+  if (myFd != -1)
+    ::close(myFd);
+}
+
+bool PacketCaptureSink::isOpen() const
+{
+  MutexLocker locker(myFileMutex);
+  return myFd != -1;
+}
+
+void PacketCaptureSink::flush()
+{
+  MutexLocker locker(myFileMutex);
+  writeBuffer();
+}
+
+PacketCaptureSink::Direction PacketCaptureSink::directionFromText(
+    const std::string& text)
+{
+  // Only look at the first line so addresses can't give a false match
+  const std::string firstLine = text.substr(0, text.find('\n'));
+  if (firstLine.find(" received") != std::string::npos)
+    return DirectionReceived;
+  if (firstLine.find(" sent") != std::string::npos)
+    return DirectionSent;
+  return DirectionUnknown;
+}
+
+void PacketCaptureSink::log(Message::Ptr message)
+{
+  if (message->packet.empty())
+    return;
+
+  const size_t senderSize = std::min<size_t>(message->sender.size(), 0xffff);
+  const size_t textSize = std::min<size_t>(message->text.size(), 0xffff);
+  const size_t origSize = FrameHeaderSize + senderSize + textSize +
+      message->packet.size();
+  const size_t inclSize = std::min<size_t>(origSize, PcapSnapLen);
+
+  MutexLocker locker(myFileMutex);
+  if (myFd == -1)
+    return;
+
+  appendHost32(myBuffer, message->time.sec);
+  appendHost32(myBuffer, message->time.msec * 1000);
+  appendHost32(myBuffer, inclSize);
+  appendHost32(myBuffer, origSize);
+
+  myBuffer += static_cast<char>(FormatVersion);
+  myBuffer += static_cast<char>(directionFromText(message->text));
+  myBuffer += static_cast<char>(message->level);
+  myBuffer += '\0';
+  appendNet16(myBuffer, senderSize);
+  appendNet16(myBuffer, textSize);
+  myBuffer.append(message->sender, 0, senderSize);
+  myBuffer.append(message->text, 0, textSize);
+
+  // Packets larger than the snap length are truncated like pcap does
+  const size_t packetSize = inclSize - (origSize - message->packet.size());
+  myBuffer.append(reinterpret_cast<const char*>(&message->packet[0]),
+      packetSize);
+
+  myFileSize += myBuffer.size();
+
+  // Don't keep anything in memory, the packet may be the one that crashes us
+  writeBuffer();
+
+  if (myFileSize >= myMaxFileSize)
+    rotate();
+}
+
+bool PacketCaptureSink::openFile()
+{
+  myFd = ::open(myFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (myFd == -1)
+    return false;
+
+  myBuffer.clear();
+  appendHost32(myBuffer, PcapMagic);
+  appendHost16(myBuffer, PcapVersionMajor);
+  appendHost16(myBuffer, PcapVersionMinor);
+  appendHost32(myBuffer, 0);            // Time zone, always UTC
+  appendHost32(myBuffer, 0);            // Timestamp accuracy
+  appendHost32(myBuffer, PcapSnapLen);
+  appendHost32(myBuffer, LinkType);
+  myFileSize = myBuffer.size();
+  writeBuffer();
+  return myFd != -1;
+}
+
+void PacketCaptureSink::rotate()
+{
+  if (myFd != -1)
+  {
+    writeBuffer();
+    ::close(myFd);
+    myFd = -1;
+  }
+
+  // file.N-1 -> file.N, ..., file -> file.1, oldest file is overwritten
+  for (unsigned i = myMaxFiles - 1; i > 0 && myMaxFiles > 0; --i)
+  {
+    std::ostringstream from;
+    from << myFilename;
+    if (i > 1)
+      from << '.' << (i - 1);
+    std::ostringstream to;
+    to << myFilename << '.' << i;
+    ::rename(from.str().c_str(), to.str().c_str());
+  }
+
+  openFile();
+}
+
+void PacketCaptureSink::writeBuffer()
+{
+  if (myFd == -1 || myBuffer.empty())
+  {
+    myBuffer.clear();
+    return;
+  }
+
+  const char* data = myBuffer.data();
+  size_t left = myBuffer.size();
+  while (left > 0)
+  {
+    ssize_t ret = ::write(myFd, data, left);
+    if (ret < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      // Stop capturing rather than writing a broken file
+      ::close(myFd);
+      myFd = -1;
+      break;
+    }
+    data += ret;
+    left -= ret;
+  }
+  myBuffer.clear();
+}
+
+
+PacketCaptureReader::PacketCaptureReader()
+  : myFile(NULL),
+    mySwapped(false)
+{
+  // Empty
+}
+
+PacketCaptureReader::~PacketCaptureReader()
+{
+  if (myFile != NULL)
+    fclose(myFile);
+}
+
+bool PacketCaptureReader::open(const std::string& filename)
+{
+  if (myFile != NULL)
+    fclose(myFile);
+
+  myFile = fopen(filename.c_str(), "rb");
+  if (myFile == NULL)
+    return false;
+
+  uint32_t header[PcapFileHeaderSize / 4];
+  if (fread(header, PcapFileHeaderSize, 1, myFile) != 1)
+    return false;
+
+  if (header[0] == PcapMagic)
+    mySwapped = false;
+  else if (header[0] == PcapMagicSwapped)
+    mySwapped = true;
+  else
+    return false;
+
+  return fileOrder(header[5]) == PacketCaptureSink::LinkType;
+}
+
+bool PacketCaptureReader::read(Licq::LogSink::Message& message,
+    PacketCaptureSink::Direction& direction)
+{
+  if (myFile == NULL)
+    return false;
+
+  uint32_t header[PcapRecordHeaderSize / 4];
+  if (fread(header, PcapRecordHeaderSize, 1, myFile) != 1)
+    return false;
+
+  const uint32_t inclSize = fileOrder(header[2]);
+  if (inclSize < FrameHeaderSize || inclSize > PcapSnapLen)
+    return false;
+
+  std::vector<uint8_t> data(inclSize);
+  if (fread(&data[0], inclSize, 1, myFile) != 1)
+    return false;
+
+  if (data[0] != PacketCaptureSink::FormatVersion)
+    return false;
+
+  const size_t senderSize = getNet16(&data[4]);
+  const size_t textSize = getNet16(&data[6]);
+  if (FrameHeaderSize + senderSize + textSize > inclSize)
+    return false;
+
+  direction = static_cast<PacketCaptureSink::Direction>(data[1]);
+  message.level = static_cast<Licq::Log::Level>(data[2]);
+  message.time.sec = fileOrder(header[0]);
+  message.time.msec = fileOrder(header[1]) / 1000;
+
+  std::vector<uint8_t>::iterator pos = data.begin() + FrameHeaderSize;
+  message.sender.assign(pos, pos + senderSize);
+  pos += senderSize;
+  message.text.assign(pos, pos + textSize);
+  pos += textSize;
+  message.packet.assign(pos, data.end());
+  return true;
+}
+
+uint32_t PacketCaptureReader::fileOrder(uint32_t value) const
+{
+  return mySwapped ? swap32(value) : value;
+}
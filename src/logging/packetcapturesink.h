@@ -0,0 +1,164 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Please refer to the COPYRIGHT file distributed with this source
+ * distribution for the names of the individual contributors.
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_PACKETCAPTURESINK_H
+#define LICQDAEMON_PACKETCAPTURESINK_H
+
+#include "adjustablelogsink.h"
+
+#include <boost/noncopyable.hpp>
+#include <cstdio>
+#include <string>
+
+namespace LicqDaemon
+{
+
+/**
+ * A log sink that writes logged packets to a binary capture file
+ *
+ * Only messages that carry packet data are written, other messages are
+ * ignored. Writing raw packets is much cheaper than the hex dumps written
+ * by StreamLogSink, licq-capturedump can print a capture file in the same
+ * form afterwards.
+ *
+ * The file is a pcap file (version 2.4, link type LINKTYPE_USER0) in host
+ * byte order. The data of each pcap record starts with a header, with
+ * multi byte fields in network byte order:
+ *   uint8_t   Format version, currently 1
+ *   uint8_t   Direction, a PacketCaptureSink::Direction
+ *   uint8_t   Log level of message
+ *   uint8_t   Reserved, always 0
+ *   uint16_t  Length of sender
+ *   uint16_t  Length of text
+ *   Sender of log message (the plugin or owner)
+ *   Text of log message (includes socket and addresses)
+ * followed by the packet data.
+ *
+ * Each record is written to the file as soon as it is logged, so the
+ * capture has every packet up to a crash, including one that caused it.
+ * When the file grows past its maximum size, it is renamed with suffix ".1"
+ * (older files get their number increased) and a new file is started.
+ */
+class PacketCaptureSink : public AdjustableLogSink
+{
+public:
+  enum Direction
+  {
+    DirectionUnknown = 0,
+    DirectionReceived = 1,
+    DirectionSent = 2
+  };
+
+  static const unsigned int LinkType = 147;     // LINKTYPE_USER0
+  static const unsigned int FormatVersion = 1;
+
+  /**
+   * Constructor, opens the capture file
+   *
+   * @param filename File to write, any existing file is rotated
+   * @param maxFileSize Size in bytes when file is rotated
+   * @param maxFiles Number of files to keep, including the current one
+   */
+  PacketCaptureSink(const std::string& filename,
+      size_t maxFileSize = 16*1024*1024, unsigned maxFiles = 4);
+
+  /// Destructor, closes file
+  ~PacketCaptureSink();
+
+  /// Check if capture file is open
+  bool isOpen() const;
+
+  /// Write any data not yet written to the file
+  void flush();
+
+  /**
+   * Get direction of a packet from the log text for it
+   *
+   * @param text Log text, as written by INetSocket::DumpPacket
+   * @return Direction of packet, DirectionUnknown if not found in text
+   */
+  static Direction directionFromText(const std::string& text);
+
+  // Licq::LogSink
+  void log(Message::Ptr message);
+
+private:
+  // Space to reserve for building a record
+  static const size_t BufferSize = 64*1024;
+
+  /// Open a new file and write the file header, caller must hold myFileMutex
+  bool openFile();
+
+  /// Close current file and start a new, caller must hold myFileMutex
+  void rotate();
+
+  /// Write buffer to file, caller must hold myFileMutex
+  void writeBuffer();
+
+  mutable Licq::Mutex myFileMutex;
+  const std::string myFilename;
+  const size_t myMaxFileSize;
+  const unsigned myMaxFiles;
+  int myFd;
+  size_t myFileSize;
+  std::string myBuffer;
+};
+
+/**
+ * Reads records from a file written by PacketCaptureSink
+ */
+class PacketCaptureReader : private boost::noncopyable
+{
+public:
+  PacketCaptureReader();
+  ~PacketCaptureReader();
+
+  /**
+   * Open a capture file
+   *
+   * @param filename File to read
+   * @return True if file was opened and has a valid header
+   */
+  bool open(const std::string& filename);
+
+  /**
+   * Read next record
+   *
+   * @param message Message to fill with level, sender, text, time and packet
+   * @param direction Set to direction of packet
+   * @return True if a record was read, false at end of file or if the next
+   *         record is broken
+   */
+  bool read(Licq::LogSink::Message& message,
+      PacketCaptureSink::Direction& direction);
+
+private:
+  /// Convert a value from file byte order
+  uint32_t fileOrder(uint32_t value) const;
+
+  FILE* myFile;
+  bool mySwapped;
+};
+
+} // namespace LicqDaemon
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../adjustablelogsink.h"
+#include "../log.h"
+#include "../logdistributor.h"
+
+#include <boost/shared_ptr.hpp>
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+
+using Licq::LogSink;
+using LicqDaemon::Log;
+using LicqDaemon::LogDistributor;
+
+namespace LicqTest {
+
+static const int NumThreads = 4;
+static const int NumMessages = 5000;
+
+// Messages between simulated disk stalls in the sink
+static const int StallInterval = 500;
+
+/**
+ * Sink that writes each message to a file, like the console and error log
+ * sinks do. Now and then a write stalls for a millisecond.
+ */
+class FileBenchmarkSink : public LogSink
+{
+public:
+  FileBenchmarkSink() : myFile(tmpfile()), myCount(0) { }
+  ~FileBenchmarkSink() { fclose(myFile); }
+
+  bool isLogging(Licq::Log::Level /*level*/) const { return true; }
+  bool isLoggingPackets() const { return false; }
+
+  void log(Message::Ptr message)
+  {
+    fprintf(myFile, "%lu.%03u [%s] %s\n", (unsigned long)message->time.sec,
+        message->time.msec, message->sender.c_str(), message->text.c_str());
+    fflush(myFile);
+    if (++myCount % StallInterval == 0)
+      usleep(1000);
+  }
+
+private:
+  FILE* myFile;
+  int myCount;
+};
+
+/**
+ * Measures the time protocol threads spend in log calls when several of
+ * them log packets as they arrive.
+ */
+class LogDistributorBenchmark : public ::testing::Test
+{
+public:
+  LogDistributor myDistributor;
+
+  void SetUp()
+  {
+    myDistributor.registerSink(LogSink::Ptr(new FileBenchmarkSink));
+  }
+
+  struct ThreadResult
+  {
+    LogDistributor* distributor;
+    double totalMs;
+    double maxMs;
+  };
+
+  static void* logThread(void* arg)
+  {
+    ThreadResult* result = static_cast<ThreadResult*>(arg);
+    Log log("protocol", *result->distributor);
+    result->totalMs = 0;
+    result->maxMs = 0;
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      // Wait for next packet
+      usleep(20);
+
+      double start = now();
+      log.info("Received packet %d from server", i);
+      double elapsed = now() - start;
+      result->totalMs += elapsed;
+      if (elapsed > result->maxMs)
+        result->maxMs = elapsed;
+    }
+    return NULL;
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void run(const char* what)
+  {
+    pthread_t threads[NumThreads];
+    ThreadResult results[NumThreads];
+    for (int i = 0; i < NumThreads; ++i)
+    {
+      results[i].distributor = &myDistributor;
+      pthread_create(&threads[i], NULL, logThread, &results[i]);
+    }
+    double totalMs = 0;
+    double maxMs = 0;
+    for (int i = 0; i < NumThreads; ++i)
+    {
+      pthread_join(threads[i], NULL);
+      totalMs += results[i].totalMs;
+      if (results[i].maxMs > maxMs)
+        maxMs = results[i].maxMs;
+    }
+    printf("[   BENCH  ] %s: %d threads, %d messages each, %.3f us/message "
+        "in log call (max %.1f us)\n", what, NumThreads, NumMessages,
+        totalMs * 1000 / (NumThreads * NumMessages), maxMs * 1000);
+  }
+};
+
+TEST_F(LogDistributorBenchmark, direct)
+{
+  run("direct");
+}
+
+TEST_F(LogDistributorBenchmark, asyncBlock)
+{
+  ASSERT_TRUE(myDistributor.startAsync(4096, LogDistributor::OverflowBlock));
+  run("async, block when full");
+  myDistributor.stopAsync();
+}
+
+TEST_F(LogDistributorBenchmark, asyncDrop)
+{
+  ASSERT_TRUE(myDistributor.startAsync(4096, LogDistributor::OverflowDrop));
+  run("async, drop when full");
+  myDistributor.stopAsync();
+  printf("[   BENCH  ] dropped %lu messages\n",
+      myDistributor.droppedMessages("protocol"));
+}
+
+/**
+ * Sink that only logs errors, like the console log by default.
+ */
+class ErrorBenchmarkSink : public LicqDaemon::AdjustableLogSink
+{
+public:
+  ErrorBenchmarkSink() { setLogLevel(Licq::Log::Error, true); }
+  void log(Message::Ptr /*message*/) { }
+};
+
+TEST(LogBenchmark, disabledLevel)
+{
+  const int numCalls = 1000000;
+  LogDistributor distributor;
+  distributor.registerSink(LogSink::Ptr(new ErrorBenchmarkSink));
+  distributor.registerSink(LogSink::Ptr(new ErrorBenchmarkSink));
+  Log log("protocol", distributor);
+
+  double start = LogDistributorBenchmark::now();
+  for (int i = 0; i < numCalls; ++i)
+    log.debug("Parsed %s field %d of packet", "status", i);
+  double printfMs = LogDistributorBenchmark::now() - start;
+
+  start = LogDistributorBenchmark::now();
+  for (int i = 0; i < numCalls; ++i)
+    log.debug() << "Parsed status field " << i << " of packet";
+  double streamMs = LogDistributorBenchmark::now() - start;
+
+  printf("[   BENCH  ] disabled level: %.3f us/call printf style, "
+      "%.3f us/call stream\n", printfMs * 1000 / numCalls,
+      streamMs * 1000 / numCalls);
+}
+
+} // namespace LicqTest
@@ -17,10 +17,17 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include "../adjustablelogsink.h"
 #include "../logdistributor.h"
 #include "mocklogsink.h"
 
+#include <cerrno>
 #include <gtest/gtest.h>
+#include <licq/thread/condition.h>
+#include <licq/thread/mutexlocker.h>
+#include <sstream>
+#include <string>
+#include <vector>
 
 using ::testing::_;
 using ::testing::Return;
@@ -28,6 +35,7 @@ using ::testing::StrictMock;
 
 using Licq::Log;
 using Licq::LogSink;
+using Licq::MutexLocker;
 using namespace LicqDaemon;
 
 namespace LicqTest {
@@ -146,4 +154,159 @@ TEST_F(LogDistributorFixture, logPacketWorks)
   EXPECT_TRUE(distributor.isLoggingPackets());
 }
 
+/**
+ * Sink that records messages. Delivery is held up while myGate is locked.
+ */
+class RecordingLogSink : public LogSink
+{
+public:
+  Licq::Mutex myGate;
+
+  bool isLogging(Log::Level /*level*/) const { return true; }
+  bool isLoggingPackets() const { return false; }
+
+  void log(Message::Ptr message)
+  {
+    {
+      MutexLocker locker(myMutex);
+      myTexts.push_back(message->sender + ": " + message->text);
+      myCond.broadcast();
+    }
+    MutexLocker gateLocker(myGate);
+  }
+
+  void waitForMessages(size_t count)
+  {
+    MutexLocker locker(myMutex);
+    while (myTexts.size() < count)
+      myCond.wait(myMutex);
+  }
+
+  std::vector<std::string> texts()
+  {
+    MutexLocker locker(myMutex);
+    return myTexts;
+  }
+
+private:
+  Licq::Mutex myMutex;
+  Licq::Condition myCond;
+  std::vector<std::string> myTexts;
+};
+
+static LogSink::Message::Ptr makeMessage(const std::string& sender, int i)
+{
+  LogSink::Message* message = new LogSink::Message();
+  message->level = Log::Info;
+  message->sender = sender;
+  std::ostringstream text;
+  text << "message " << i;
+  message->text = text.str();
+  return LogSink::Message::Ptr(message);
+}
+
+TEST(LogDistributor, asyncDeliversInOrder)
+{
+  boost::shared_ptr<RecordingLogSink> sink(new RecordingLogSink);
+  LogDistributor distributor;
+  distributor.registerSink(sink);
+
+  ASSERT_TRUE(distributor.startAsync(8, LogDistributor::OverflowBlock));
+  for (int i = 0; i < 100; ++i)
+    distributor.log(makeMessage("test", i));
+  distributor.stopAsync();
+
+  std::vector<std::string> texts = sink->texts();
+  ASSERT_EQ(100u, texts.size());
+  EXPECT_EQ("test: message 0", texts[0]);
+  EXPECT_EQ("test: message 99", texts[99]);
+  EXPECT_EQ(0u, distributor.droppedMessages("test"));
+
+  // Delivered directly after stop
+  distributor.log(makeMessage("test", 100));
+  EXPECT_EQ(101u, sink->texts().size());
+}
+
+TEST(LogDistributor, asyncNeedsCapacity)
+{
+  boost::shared_ptr<RecordingLogSink> sink(new RecordingLogSink);
+  LogDistributor distributor;
+  distributor.registerSink(sink);
+
+  errno = 0;
+  EXPECT_FALSE(distributor.startAsync(0));
+  EXPECT_EQ(EINVAL, errno);
+
+  // Still delivering directly
+  distributor.log(makeMessage("test", 0));
+  EXPECT_EQ(1u, sink->texts().size());
+}
+
+TEST(LogDistributor, asyncDropsWhenFull)
+{
+  boost::shared_ptr<RecordingLogSink> sink(new RecordingLogSink);
+  LogDistributor distributor;
+  distributor.registerSink(sink);
+
+  ASSERT_TRUE(distributor.startAsync(4, LogDistributor::OverflowDrop));
+
+  // Hold up the writer thread in the sink with an empty queue
+  sink->myGate.lock();
+  distributor.log(makeMessage("first", 0));
+  sink->waitForMessages(1);
+
+  for (int i = 1; i <= 4; ++i)
+    distributor.log(makeMessage("first", i));
+  for (int i = 0; i < 3; ++i)
+    distributor.log(makeMessage("second", i));
+  EXPECT_EQ(0u, distributor.droppedMessages("first"));
+  EXPECT_EQ(3u, distributor.droppedMessages("second"));
+
+  sink->myGate.unlock();
+  distributor.stopAsync();
+
+  std::vector<std::string> texts = sink->texts();
+  ASSERT_EQ(6u, texts.size());
+  EXPECT_EQ("first: message 4", texts[4]);
+  EXPECT_EQ("licq: 3 log messages from second dropped, log queue is full",
+      texts[5]);
+}
+
+class TestAdjustableLogSink : public AdjustableLogSink
+{
+public:
+  void log(Message::Ptr /*message*/) { }
+};
+
+TEST(LogDistributor, cachedLevelsFollowSinks)
+{
+  boost::shared_ptr<TestAdjustableLogSink> sink(new TestAdjustableLogSink);
+  LogDistributor distributor;
+  distributor.registerSink(sink);
+
+  EXPECT_FALSE(distributor.isLogging(Log::Info));
+  EXPECT_FALSE(distributor.isLogging(Log::Info));
+  EXPECT_FALSE(distributor.isLoggingPackets());
+
+  sink->setLogLevel(Log::Info, true);
+  EXPECT_TRUE(distributor.isLogging(Log::Info));
+  EXPECT_FALSE(distributor.isLogging(Log::Debug));
+  EXPECT_FALSE(distributor.isLoggingPackets());
+
+  sink->setLogPackets(true);
+  EXPECT_TRUE(distributor.isLoggingPackets());
+
+  sink->setLogLevelsFromBitmask(0);
+  EXPECT_FALSE(distributor.isLogging(Log::Info));
+  EXPECT_FALSE(distributor.isLoggingPackets());
+
+  boost::shared_ptr<TestAdjustableLogSink> sink2(new TestAdjustableLogSink);
+  sink2->setLogLevel(Log::Debug, true);
+  distributor.registerSink(sink2);
+  EXPECT_TRUE(distributor.isLogging(Log::Debug));
+
+  distributor.unregisterSink(sink2);
+  EXPECT_FALSE(distributor.isLogging(Log::Debug));
+}
+
 } // namespace LicqTest
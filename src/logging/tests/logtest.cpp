@@ -49,7 +49,7 @@ public:
                                   Field(&Licq::LogSink::Message::sender,
                                         "test")))));
     EXPECT_CALL(myLogSink, isLogging(GetParam()))
-        .WillOnce(Return(true));
+        .WillRepeatedly(Return(true));
   }
 
   void log(const std::string& msg)
@@ -178,7 +178,7 @@ TEST(Log, streamPacket)
 
   StrictMock<MockLogSink> logSink;
   EXPECT_CALL(logSink, isLogging(Licq::Log::Info))
-      .WillOnce(Return(true));
+      .WillRepeatedly(Return(true));
   EXPECT_CALL(logSink, isLoggingPackets())
       .WillOnce(Return(true));
   EXPECT_CALL(logSink, log(Pointee(Field(&Licq::LogSink::Message::packet,
@@ -193,7 +193,7 @@ TEST(Log, streamFormatting)
 {
   StrictMock<MockLogSink> logSink;
   EXPECT_CALL(logSink, isLogging(Licq::Log::Info))
-      .WillOnce(Return(true));
+      .WillRepeatedly(Return(true));
   EXPECT_CALL(logSink, log(Pointee(Field(&Licq::LogSink::Message::text,
                                          "255 = 0xff"))));
 
@@ -236,7 +236,7 @@ TEST(Log, streamCustomDataType)
 {
   StrictMock<MockLogSink> logSink;
   EXPECT_CALL(logSink, isLogging(Licq::Log::Error))
-      .WillOnce(Return(true));
+      .WillRepeatedly(Return(true));
   EXPECT_CALL(logSink, log(Pointee(Field(&Licq::LogSink::Message::text,
                                          "256 = 0x100"))));
 
@@ -245,4 +245,42 @@ TEST(Log, streamCustomDataType)
   log.log(Log::Error) << c << " = " << std::showbase << std::hex << c;
 }
 
+static int ourCustomFormatCount = 0;
+
+struct Counted
+{
+};
+
+static std::ostream& operator<<(std::ostream& os, const Counted& /*c*/)
+{
+  ++ourCustomFormatCount;
+  return os;
+}
+
+TEST(Log, disabledStreamIsNotFormatted)
+{
+  StrictMock<MockLogSink> logSink;
+  EXPECT_CALL(logSink, isLogging(Licq::Log::Debug))
+      .WillOnce(Return(false));
+
+  Log log("test", logSink);
+  ourCustomFormatCount = 0;
+  Counted c;
+  log.debug() << c << " = " << 123 << c;
+  EXPECT_EQ(0, ourCustomFormatCount);
+}
+
+TEST(Log, disabledStreamCanBeUsedAsOstream)
+{
+  StrictMock<MockLogSink> logSink;
+  EXPECT_CALL(logSink, isLogging(Licq::Log::Debug))
+      .WillOnce(Return(false));
+
+  Log log("test", logSink);
+  Licq::Log::Stream s(log.debug());
+  static_cast<std::ostream&>(s) << "dropped";
+  Licq::Log::Stream s2(s);
+  s2 << "also dropped";
+}
+
 } // namespace LicqTest
@@ -0,0 +1,115 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../filelogsink.h"
+#include "../packetcapturesink.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using LicqDaemon::FileLogSink;
+using LicqDaemon::PacketCaptureSink;
+using Licq::LogSink;
+using std::string;
+
+namespace LicqTest {
+
+static const int NumPackets = 20000;
+static const size_t PacketSize = 300;
+
+/**
+ * Measures logging packets as hex dumps in the error log compared to
+ * writing them to a packet capture.
+ */
+class PacketCaptureSinkBenchmark : public ::testing::Test
+{
+public:
+  string myDir;
+  LogSink::Message::Ptr myMessage;
+
+  void SetUp()
+  {
+    char dir[] = "/tmp/licqcapturebench.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    myDir = dir;
+
+    LogSink::Message* message = new LogSink::Message();
+    message->level = Licq::Log::Debug;
+    message->sender = "ICQ";
+    message->text = "Packet (ICQ, 300 bytes) received:\n"
+        "(192.168.0.2:40000 <- 64.12.24.50:5190)";
+    message->time.sec = time(NULL);
+    message->time.msec = 0;
+    for (size_t i = 0; i < PacketSize; ++i)
+      message->packet.push_back(i * 13);
+    myMessage.reset(message);
+  }
+
+  void TearDown()
+  {
+    unlink((myDir + "/log.errors").c_str());
+    unlink((myDir + "/capture").c_str());
+    rmdir(myDir.c_str());
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void run(const char* what, LicqDaemon::AdjustableLogSink& sink,
+      const string& file)
+  {
+    sink.setAllLogLevels(true);
+    sink.setLogPackets(true);
+
+    double start = now();
+    for (int i = 0; i < NumPackets; ++i)
+      sink.log(myMessage);
+    double elapsed = now() - start;
+
+    struct stat st;
+    stat(file.c_str(), &st);
+    printf("[   BENCH  ] %s: %d packets, %.3f us/packet, %ld bytes/packet\n",
+        what, NumPackets, elapsed * 1000 / NumPackets,
+        (long)st.st_size / NumPackets);
+  }
+};
+
+TEST_F(PacketCaptureSinkBenchmark, hexDump)
+{
+  string file = myDir + "/log.errors";
+  FileLogSink sink(file);
+  run("hex dump", sink, file);
+}
+
+TEST_F(PacketCaptureSinkBenchmark, capture)
+{
+  string file = myDir + "/capture";
+  PacketCaptureSink sink(file, 1024*1024*1024);
+  run("capture", sink, file);
+}
+
+} // namespace LicqTest
@@ -0,0 +1,200 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../packetcapturesink.h"
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace LicqDaemon;
+using Licq::Log;
+using Licq::LogSink;
+using std::string;
+
+namespace LicqTest {
+
+class PacketCaptureSinkFixture : public ::testing::Test
+{
+public:
+  string myDir;
+  string myFile;
+
+  void SetUp()
+  {
+    char dir[] = "/tmp/licqpacketcapture.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    myDir = dir;
+    myFile = myDir + "/capture";
+  }
+
+  void TearDown()
+  {
+    unlink(myFile.c_str());
+    for (int i = 1; i <= 3; ++i)
+      unlink(rotated(i).c_str());
+    rmdir(myDir.c_str());
+  }
+
+  string rotated(int i) const
+  {
+    return myFile + "." + char('0' + i);
+  }
+
+  static bool exists(const string& file)
+  {
+    struct stat st;
+    return stat(file.c_str(), &st) == 0;
+  }
+
+  static LogSink::Message::Ptr packet(const string& text, size_t size)
+  {
+    LogSink::Message* message = new LogSink::Message();
+    message->level = Log::Debug;
+    message->sender = "ICQ";
+    message->text = text;
+    message->time.sec = 1364000000;
+    message->time.msec = 123;
+    for (size_t i = 0; i < size; ++i)
+      message->packet.push_back(i & 0xff);
+    return LogSink::Message::Ptr(message);
+  }
+};
+
+TEST(PacketCaptureSink, directionFromText)
+{
+  EXPECT_EQ(PacketCaptureSink::DirectionSent,
+      PacketCaptureSink::directionFromText(
+          "Packet (ICQ, 10 bytes) sent:\n(1.2.3.4:5 -> 6.7.8.9:10)"));
+  EXPECT_EQ(PacketCaptureSink::DirectionReceived,
+      PacketCaptureSink::directionFromText(
+          "Packet (ICQ, 10 bytes) received:\n(1.2.3.4:5 <- 6.7.8.9:10)"));
+  EXPECT_EQ(PacketCaptureSink::DirectionUnknown,
+      PacketCaptureSink::directionFromText("Packet\nsent received"));
+}
+
+TEST_F(PacketCaptureSinkFixture, writeAndRead)
+{
+  LogSink::Message::Ptr sent = packet("Packet (1, 3 bytes) sent:\n(a -> b)", 3);
+  LogSink::Message::Ptr received =
+      packet("Packet (1, 300 bytes) received:", 300);
+  {
+    PacketCaptureSink sink(myFile);
+    ASSERT_TRUE(sink.isOpen());
+    sink.log(sent);
+    sink.log(packet("No packet here", 0));
+    sink.log(received);
+  }
+
+  PacketCaptureReader reader;
+  ASSERT_TRUE(reader.open(myFile));
+
+  LogSink::Message message;
+  PacketCaptureSink::Direction direction;
+  ASSERT_TRUE(reader.read(message, direction));
+  EXPECT_EQ(PacketCaptureSink::DirectionSent, direction);
+  EXPECT_EQ(Log::Debug, message.level);
+  EXPECT_EQ(sent->sender, message.sender);
+  EXPECT_EQ(sent->text, message.text);
+  EXPECT_EQ(sent->time.sec, message.time.sec);
+  EXPECT_EQ(sent->time.msec, message.time.msec);
+  EXPECT_EQ(sent->packet, message.packet);
+
+  ASSERT_TRUE(reader.read(message, direction));
+  EXPECT_EQ(PacketCaptureSink::DirectionReceived, direction);
+  EXPECT_EQ(received->text, message.text);
+  EXPECT_EQ(received->packet, message.packet);
+
+  EXPECT_FALSE(reader.read(message, direction));
+}
+
+TEST_F(PacketCaptureSinkFixture, flushWritesBufferedPackets)
+{
+  PacketCaptureSink sink(myFile);
+  sink.log(packet("Packet sent:", 10));
+  sink.log(packet("Packet sent:", 10));
+  sink.flush();
+
+  PacketCaptureReader reader;
+  ASSERT_TRUE(reader.open(myFile));
+  LogSink::Message message;
+  PacketCaptureSink::Direction direction;
+  EXPECT_TRUE(reader.read(message, direction));
+  EXPECT_TRUE(reader.read(message, direction));
+  EXPECT_FALSE(reader.read(message, direction));
+}
+
+TEST_F(PacketCaptureSinkFixture, packetsAreWrittenWhenLogged)
+{
+  // Nothing may be left in memory if Licq crashes or is killed
+  PacketCaptureSink sink(myFile);
+  sink.log(packet("Packet received:", 10));
+
+  PacketCaptureReader reader;
+  ASSERT_TRUE(reader.open(myFile));
+  LogSink::Message message;
+  PacketCaptureSink::Direction direction;
+  EXPECT_TRUE(reader.read(message, direction));
+  EXPECT_FALSE(reader.read(message, direction));
+
+  sink.log(packet("Packet sent:", 10));
+  PacketCaptureReader reader2;
+  ASSERT_TRUE(reader2.open(myFile));
+  EXPECT_TRUE(reader2.read(message, direction));
+  EXPECT_TRUE(reader2.read(message, direction));
+  EXPECT_EQ(PacketCaptureSink::DirectionSent, direction);
+}
+
+TEST_F(PacketCaptureSinkFixture, rotate)
+{
+  {
+    PacketCaptureSink sink(myFile, 1000, 3);
+    for (int i = 0; i < 10; ++i)
+      sink.log(packet("Packet received:", 400));
+  }
+  EXPECT_TRUE(exists(myFile));
+  EXPECT_TRUE(exists(rotated(1)));
+  EXPECT_TRUE(exists(rotated(2)));
+  EXPECT_FALSE(exists(rotated(3)));
+
+  // Each rotated file must be a complete capture
+  PacketCaptureReader reader;
+  ASSERT_TRUE(reader.open(rotated(1)));
+  LogSink::Message message;
+  PacketCaptureSink::Direction direction;
+  EXPECT_TRUE(reader.read(message, direction));
+  EXPECT_TRUE(reader.read(message, direction));
+  EXPECT_TRUE(reader.read(message, direction));
+  EXPECT_FALSE(reader.read(message, direction));
+}
+
+TEST_F(PacketCaptureSinkFixture, readerRejectsOtherFiles)
+{
+  FILE* f = fopen(myFile.c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fputs("Not a capture file, just some text that is long enough", f);
+  fclose(f);
+
+  PacketCaptureReader reader;
+  EXPECT_FALSE(reader.open(myFile));
+  EXPECT_FALSE(reader.open(myDir + "/missing"));
+}
+
+} // namespace LicqTest
@@ -21,7 +21,7 @@
 
 Licq::ThreadLog Licq::gLog;
 
-Licq::Log* Licq::ThreadLog::getLog()
+Licq::Log* Licq::ThreadLog::getLog() const
 {
   using LicqDaemon::gLogService;
 
@@ -17,14 +17,26 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include "config.h"
+
 #include <licq/mainloop.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cstring>
 #include <ctime>
+#include <functional>
 #include <map>
+#include <set>
 #include <unistd.h>
+#include <vector>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
+#include <licq/logging/log.h>
 #include <licq/socket.h>
 
 using namespace Licq;
@@ -61,6 +73,7 @@ public:
   struct File
   {
     int events;
+    int polledEvents;
     MainLoopCallback* callback;
     INetSocket* inetSocket;
   };
@@ -73,19 +86,98 @@ public:
     int timeout;
     MainLoopCallback* callback;
     bool once;
-    bool removed;
+    unsigned long serial;
   };
   typedef std::map<int, Timeout> TimeoutMap;
 
+  // Entry in timer heap, entries are not removed from the heap when a
+  // timeout is removed, instead serial is used to detect stale entries
+  struct TimerEntry
+  {
+    long long expires;
+    int id;
+    unsigned long serial;
+
+    // Timeouts expiring at the same time are taken in the order they were added
+    bool operator>(const TimerEntry& other) const
+    { return expires > other.expires || (expires == other.expires && serial > other.serial); }
+  };
+  typedef std::vector<TimerEntry> TimerHeap;
+
+  Private(Backend backend);
+  ~Private();
+
   static long long getMonotonicClock();
 
+  /// Start watching a file with the backend
+  bool registerFile(int fd, File& f);
+
+  /// Stop watching a file with the backend
+  void unregisterFile(int fd, File& f);
+
+  /// Poll for POLLOUT on sockets that have got data in their send queue
+  void updateSendQueues();
+
+  /// Flush send queue of a writable socket, stop POLLOUT once it is empty
+  bool flushSendQueue(int fd, File& f);
+
+  /// Change events polled for a file
+  void setPolledEvents(int fd, File& f, int events);
+
+  /// Add heap entry for a timeout
+  void pushTimer(int id, const Timeout& t);
+
+  /// Drop stale entries from top of heap and get next timeout
+  long long earliestTimeout();
+
+  /// Check if a heap entry still refers to an active timeout
+  bool isTimerValid(const TimerEntry& e) const;
+
+  Backend myBackend;
   bool myIsRunning;
   bool myFilesHasChanged;
-  bool myTimeoutsHasChanged;
   FileMap myFiles;
+
+  // Sockets that have told us they have queued data since last iteration
+  std::vector<int> myStartedSendQueues;
   TimeoutMap myTimeouts;
+  TimerHeap myTimerHeap;
+  unsigned long myNextTimerSerial;
+
+#ifdef HAVE_EPOLL
+  int myEpollFd;
+
+  // Files that epoll refuses (e.g. regular files), these are always ready
+  std::set<int> myUnpollableFiles;
+#endif
 };
 
+MainLoop::Private::Private(Backend backend)
+  : myBackend(backend),
+    myIsRunning(false),
+    myFilesHasChanged(true),
+    myNextTimerSerial(0)
+{
+#ifdef HAVE_EPOLL
+  myEpollFd = -1;
+  if (myBackend != BackendPoll)
+  {
+    myEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    myBackend = (myEpollFd == -1 ? BackendPoll : BackendEpoll);
+  }
+#else
+  myBackend = BackendPoll;
+#endif
+}
+
+MainLoop::Private::~Private()
+{
+#ifdef HAVE_EPOLL
+  if (myEpollFd != -1)
+    close(myEpollFd);
+#endif
+}
+
 long long MainLoop::Private::getMonotonicClock()
 {
   // Get monotonic time and convert to milliseconds
@@ -99,8 +191,161 @@ long long MainLoop::Private::getMonotonicClock()
   return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
 }
 
-MainLoop::MainLoop()
-  : myPrivate(new Private())
+#ifdef HAVE_EPOLL
+static uint32_t pollToEpoll(int events)
+{
+  uint32_t ret = 0;
+  if (events & POLLIN)
+    ret |= EPOLLIN;
+  if (events & POLLPRI)
+    ret |= EPOLLPRI;
+  if (events & POLLOUT)
+    ret |= EPOLLOUT;
+  return ret;
+}
+
+static int epollToPoll(uint32_t events)
+{
+  int ret = 0;
+  if (events & EPOLLIN)
+    ret |= POLLIN;
+  if (events & EPOLLPRI)
+    ret |= POLLPRI;
+  if (events & EPOLLOUT)
+    ret |= POLLOUT;
+  if (events & EPOLLERR)
+    ret |= POLLERR;
+  if (events & EPOLLHUP)
+    ret |= POLLHUP;
+  return ret;
+}
+#endif
+
+bool MainLoop::Private::registerFile(int fd, File& f)
+{
+  f.polledEvents = f.events;
+  if (f.inetSocket != NULL && f.inetSocket->sendQueueSize() > 0)
+    f.polledEvents |= POLLOUT;
+
+#ifdef HAVE_EPOLL
+  if (myBackend == BackendEpoll)
+  {
+    struct epoll_event ev;
+    ev.events = pollToEpoll(f.polledEvents);
+    ev.data.fd = fd;
+    if (epoll_ctl(myEpollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+      if (errno != EPERM)
+      {
+        gLog.error("Cannot monitor file descriptor %d: %s", fd, strerror(errno));
+        return false;
+      }
+
+      // poll() always reports regular files as ready so do the same
+      myUnpollableFiles.insert(fd);
+    }
+  }
+#endif
+
+  myFilesHasChanged = true;
+  return true;
+}
+
+void MainLoop::Private::unregisterFile(int fd, File& f)
+{
+  if (f.inetSocket != NULL)
+    f.inetSocket->setMainLoop(NULL);
+  myFilesHasChanged = true;
+
+#ifdef HAVE_EPOLL
+  if (myBackend == BackendEpoll && myUnpollableFiles.erase(fd) == 0)
+  {
+    // Will fail if file has already been closed, but then it's already gone
+    struct epoll_event ev;
+    epoll_ctl(myEpollFd, EPOLL_CTL_DEL, fd, &ev);
+  }
+#endif
+}
+
+void MainLoop::Private::setPolledEvents(int fd, File& f, int events)
+{
+  if (events == f.polledEvents)
+    return;
+  f.polledEvents = events;
+  myFilesHasChanged = true;
+
+#ifdef HAVE_EPOLL
+  if (myBackend == BackendEpoll && myUnpollableFiles.count(fd) == 0)
+  {
+    struct epoll_event ev;
+    ev.events = pollToEpoll(events);
+    ev.data.fd = fd;
+    epoll_ctl(myEpollFd, EPOLL_CTL_MOD, fd, &ev);
+  }
+#else
+  (void)fd;
+#endif
+}
+
+void MainLoop::Private::updateSendQueues()
+{
+  // Watch for sockets becoming writable while they have queued data
+  for (size_t i = 0; i < myStartedSendQueues.size(); ++i)
+  {
+    int fd = myStartedSendQueues[i];
+    FileMap::iterator iter = myFiles.find(fd);
+    if (iter != myFiles.end() && iter->second.inetSocket != NULL)
+      setPolledEvents(fd, iter->second, iter->second.events | POLLOUT);
+  }
+  myStartedSendQueues.clear();
+}
+
+bool MainLoop::Private::flushSendQueue(int fd, File& f)
+{
+  if (!f.inetSocket->flushSendQueue())
+    return false;
+  if (f.inetSocket->sendQueueSize() == 0)
+    setPolledEvents(fd, f, f.events);
+  return true;
+}
+
+void MainLoop::Private::pushTimer(int id, const Timeout& t)
+{
+  TimerEntry e;
+  e.expires = t.last + t.timeout;
+  e.id = id;
+  e.serial = t.serial;
+  myTimerHeap.push_back(e);
+  std::push_heap(myTimerHeap.begin(), myTimerHeap.end(), std::greater<TimerEntry>());
+}
+
+bool MainLoop::Private::isTimerValid(const TimerEntry& e) const
+{
+  TimeoutMap::const_iterator i = myTimeouts.find(e.id);
+  return (i != myTimeouts.end() && i->second.serial == e.serial);
+}
+
+long long MainLoop::Private::earliestTimeout()
+{
+  // If timeouts are added and removed a lot, stale entries may pile up
+  if (myTimerHeap.size() > 2 * myTimeouts.size() + 64)
+  {
+    myTimerHeap.clear();
+    for (TimeoutMap::const_iterator i = myTimeouts.begin(); i != myTimeouts.end(); ++i)
+      pushTimer(i->first, i->second);
+  }
+
+  while (!myTimerHeap.empty() && !isTimerValid(myTimerHeap.front()))
+  {
+    std::pop_heap(myTimerHeap.begin(), myTimerHeap.end(), std::greater<TimerEntry>());
+    myTimerHeap.pop_back();
+  }
+
+  return (myTimerHeap.empty() ? 0 : myTimerHeap.front().expires);
+}
+
+MainLoop::MainLoop(Backend backend)
+  : myPrivate(new Private(backend))
 {
   // Empty
 }
@@ -110,66 +355,43 @@ MainLoop::~MainLoop()
   delete myPrivate;
 }
 
+MainLoop::Backend MainLoop::backend() const
+{
+  LICQ_D_CONST();
+  return d->myBackend;
+}
+
 void MainLoop::run()
 {
   LICQ_D();
   d->myIsRunning = true;
   d->myFilesHasChanged = true;
-  d->myTimeoutsHasChanged = true;
-  struct pollfd* pfds = NULL;
-  Private::FileMap::size_type fdcount = 0;
-  long long earliest;
+  std::vector<struct pollfd> pfds;
+#ifdef HAVE_EPOLL
+  static const int MaxEpollEvents = 64;
+  struct epoll_event epollEvents[MaxEpollEvents];
+#endif
+  std::vector<std::pair<int, int> > ready;
+  std::vector<Private::TimerEntry> expired;
+
   while (d->myIsRunning)
   {
-    if (d->myFilesHasChanged)
-    {
-      // Reallocate pfd size if needed
-      Private::FileMap::size_type c = d->myFiles.size();
-      if (c != fdcount)
-      {
-        // Reallocate pfd
-        delete[] pfds;
-        if (c > 0)
-          pfds = new struct pollfd[c];
-        else
-          pfds = NULL;
-        fdcount = c;
-      }
-
-      if (fdcount > 0)
-      {
-        struct pollfd* p = pfds;
-        for (Private::FileMap::const_iterator i = d->myFiles.begin(); i != d->myFiles.end(); ++i, ++p)
-        {
-          p->fd = i->first;
-          p->events = i->second.events;
-        }
-      }
-
-      d->myFilesHasChanged = false;
-    }
+    if (!d->myStartedSendQueues.empty())
+      d->updateSendQueues();
 
-    if (d->myTimeoutsHasChanged)
+    if (d->myBackend == BackendPoll && d->myFilesHasChanged)
     {
-      earliest = 0;
-      for (Private::TimeoutMap::iterator i = d->myTimeouts.begin(); i != d->myTimeouts.end(); )
+      pfds.resize(d->myFiles.size());
+      std::vector<struct pollfd>::iterator p = pfds.begin();
+      for (Private::FileMap::const_iterator i = d->myFiles.begin(); i != d->myFiles.end(); ++i, ++p)
       {
-        if (i->second.removed)
-        {
-          // Actually erase timeouts marked for removal
-          d->myTimeouts.erase(i++);
-          continue;
-        }
-
-        // Find the earliest timeout
-        if (earliest == 0 || i->second.last + i->second.timeout < earliest)
-          earliest = i->second.last + i->second.timeout;
-
-        ++i;
+        p->fd = i->first;
+        p->events = i->second.polledEvents;
       }
-      d->myTimeoutsHasChanged = false;
     }
+    d->myFilesHasChanged = false;
 
+    long long earliest = d->earliestTimeout();
     int timeout; // Timeout in milliseconds
     if (earliest == 0)
     {
@@ -184,69 +406,122 @@ void MainLoop::run()
         timeout = 0;
     }
 
-    int pollret = poll(pfds, fdcount, timeout);
-
-    if (pollret < 0)
+    // Collect events first as callbacks may change the files
+    ready.clear();
+#ifdef HAVE_EPOLL
+    if (d->myBackend == BackendEpoll)
     {
-      assert(errno == EINTR);
-      continue;
-    }
+      if (!d->myUnpollableFiles.empty())
+        timeout = 0;
+
+      int count = epoll_wait(d->myEpollFd, epollEvents, MaxEpollEvents, timeout);
+      if (count < 0)
+      {
+        assert(errno == EINTR);
+        continue;
+      }
 
-    if (pollret > 0)
+      for (int i = 0; i < count; ++i)
+      {
+        // Copy fd first, epoll_event is packed on some architectures
+        int fd = epollEvents[i].data.fd;
+        ready.push_back(std::make_pair(fd, epollToPoll(epollEvents[i].events)));
+      }
+      for (std::set<int>::const_iterator i = d->myUnpollableFiles.begin();
+          i != d->myUnpollableFiles.end(); ++i)
+        ready.push_back(std::make_pair(*i, d->myFiles[*i].polledEvents & (POLLIN | POLLOUT)));
+    }
+    else
+#endif
     {
-      // Check for file events to handle
-      for (Private::FileMap::size_type i = 0; i < fdcount; ++i)
+      int pollret = poll(pfds.empty() ? NULL : &pfds[0], pfds.size(), timeout);
+      if (pollret < 0)
       {
-        int revents = pfds[i].revents;
-        if (revents == 0)
-          continue;
+        assert(errno == EINTR);
+        continue;
+      }
 
-        int fd = pfds[i].fd;
-        Private::FileMap::iterator iter(d->myFiles.find(fd));
-        if (iter == d->myFiles.end())
-          // Could happen if one callback removes other files
+      for (size_t i = 0; i < pfds.size() && pollret > 0; ++i)
+      {
+        if (pfds[i].revents == 0)
           continue;
-
-        Private::File& f(iter->second);
-        if (f.inetSocket != NULL)
-          f.callback->socketEvent(f.inetSocket, revents);
-        else
-          f.callback->rawFileEvent(fd, revents);
+        ready.push_back(std::make_pair(pfds[i].fd, static_cast<int>(pfds[i].revents)));
+        --pollret;
       }
     }
 
-    if (earliest > 0)
+    // Handle file events
+    for (size_t i = 0; i < ready.size(); ++i)
     {
-      long long now = Private::getMonotonicClock();
-      if (now >= earliest)
+      int fd = ready[i].first;
+      int revents = ready[i].second;
+      Private::FileMap::iterator iter(d->myFiles.find(fd));
+      if (iter == d->myFiles.end())
+        // Could happen if one callback removes other files
+        continue;
+
+      Private::File& f(iter->second);
+      if (f.inetSocket != NULL)
       {
-        // Check for expired timeouts
-        for (Private::TimeoutMap::iterator i = d->myTimeouts.begin(); i != d->myTimeouts.end(); ++i)
+        if (revents & POLLOUT)
         {
-          Private::Timeout& t(i->second);
-
-          if (t.removed)
-            continue;
+          // Write queued data before the callback can send anything more
+          if (!d->flushSendQueue(fd, f))
+            revents |= POLLERR;
+
+          if (!(f.events & POLLOUT))
+          {
+            // Only polled for the send queue, callback didn't ask for it
+            revents &= ~POLLOUT;
+            if (revents == 0)
+              continue;
+          }
+        }
+        f.callback->socketEvent(f.inetSocket, revents);
+      }
+      else
+        f.callback->rawFileEvent(fd, revents);
+    }
 
-          if (t.last + t.timeout > now)
-            // Not yet
-            continue;
+    if (earliest == 0)
+      continue;
 
-          if (t.once)
-            // Timeout isn't reoccuring, mark it for removal
-            t.removed = true;
-          else
-            // Timeout is reoccuring, update timestamp
-            t.last += t.timeout;
+    // Take out expired timeouts before calling any of them so that repeating
+    // timeouts are only triggered once per iteration
+    long long now = Private::getMonotonicClock();
+    expired.clear();
+    while (!d->myTimerHeap.empty() && d->myTimerHeap.front().expires <= now)
+    {
+      std::pop_heap(d->myTimerHeap.begin(), d->myTimerHeap.end(),
+          std::greater<Private::TimerEntry>());
+      expired.push_back(d->myTimerHeap.back());
+      d->myTimerHeap.pop_back();
+    }
 
-          d->myTimeoutsHasChanged = true;
-          t.callback->timeoutEvent(i->first);
-        }
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      // Check each entry right before using it as callbacks may remove timeouts
+      Private::TimeoutMap::iterator iter(d->myTimeouts.find(expired[i].id));
+      if (iter == d->myTimeouts.end() || iter->second.serial != expired[i].serial)
+        continue;
+
+      Private::Timeout& t(iter->second);
+      MainLoopCallback* callback = t.callback;
+      if (t.once)
+      {
+        // Timeout isn't reoccuring, remove it
+        d->myTimeouts.erase(iter);
       }
+      else
+      {
+        // Timeout is reoccuring, update timestamp
+        t.last += t.timeout;
+        d->pushTimer(iter->first, t);
+      }
+
+      callback->timeoutEvent(expired[i].id);
     }
   }
-
-  delete[] pfds;
 }
 
 void MainLoop::quit()
@@ -268,16 +543,19 @@ void MainLoop::addRawFile(int fd, MainLoopCallback* callback, int events)
   f.events = events;
   f.callback = callback;
   f.inetSocket = NULL;
-
-  d->myFilesHasChanged = true;
+  if (!d->registerFile(fd, f))
+    d->myFiles.erase(fd);
 }
 
 void MainLoop::removeRawFile(int fd)
 {
   LICQ_D();
 
-  d->myFiles.erase(fd);
-  d->myFilesHasChanged = true;
+  Private::FileMap::iterator iter = d->myFiles.find(fd);
+  if (iter == d->myFiles.end())
+    return;
+  d->unregisterFile(fd, iter->second);
+  d->myFiles.erase(iter);
 }
 
 void MainLoop::addSocket(INetSocket* inetSocket, MainLoopCallback* callback, int events)
@@ -294,8 +572,11 @@ void MainLoop::addSocket(INetSocket* inetSocket, MainLoopCallback* callback, int
   Private::File& f(d->myFiles[fd]);
   f.events = events;
   f.callback = callback;
-  f.inetSocket = inetSocket;;
-  d->myFilesHasChanged = true;
+  f.inetSocket = inetSocket;
+  if (d->registerFile(fd, f))
+    inetSocket->setMainLoop(this);
+  else
+    d->myFiles.erase(fd);
 }
 
 void MainLoop::removeSocket(INetSocket* inetSocket)
@@ -313,31 +594,29 @@ void MainLoop::addTimeout(int timeout, MainLoopCallback* callback, int id, bool
   // Don't allow a timeout of zero unless it's a oneshot
   assert(timeout > 0 || once);
 
-  // Allow reusing an entry if it has been marked for removal
-  Private::TimeoutMap::const_iterator iter(d->myTimeouts.find(id));
-  assert(iter == d->myTimeouts.end() || iter->second.removed);
+  assert(d->myTimeouts.count(id) == 0);
 
   Private::Timeout& t(d->myTimeouts[id]);
   t.last = Private::getMonotonicClock();
   t.timeout = timeout;
   t.callback = callback;
   t.once = once;
-  t.removed = false;
-  d->myTimeoutsHasChanged = true;
+  t.serial = d->myNextTimerSerial++;
+  d->pushTimer(id, t);
 }
 
 void MainLoop::removeTimeout(int id)
 {
   LICQ_D();
 
-  Private::TimeoutMap::iterator iter(d->myTimeouts.find(id));
-  if (iter == d->myTimeouts.end())
-    return;
+  // Entry in timer heap is left and will be skipped when it comes up
+  d->myTimeouts.erase(id);
+}
 
-  // Don't break main loop if it currently has an iterator in the list
-  // Just mark the entry as removed and let main loop remove it when it's safe
-  iter->second.removed = true;
-  d->myTimeoutsHasChanged = true;
+void MainLoop::sendQueueStarted(int fd)
+{
+  LICQ_D();
+  d->myStartedSendQueues.push_back(fd);
 }
 
 void MainLoop::removeCallback(const MainLoopCallback* callback, bool closeDelete)
@@ -349,6 +628,8 @@ void MainLoop::removeCallback(const MainLoopCallback* callback, bool closeDelete
   {
     if (i->second.callback == callback)
     {
+      // Unregister before closing so epoll doesn't lose track of it
+      d->unregisterFile(i->first, i->second);
       if (closeDelete)
       {
         if (i->second.inetSocket != NULL)
@@ -357,20 +638,18 @@ void MainLoop::removeCallback(const MainLoopCallback* callback, bool closeDelete
           close(i->first);
       }
       d->myFiles.erase(i++);
-      d->myFilesHasChanged = true;
     }
     else
       ++i;
   }
 
   // Find and remove all timeouts with this callback object
-  for (Private::TimeoutMap::iterator i = d->myTimeouts.begin(); i != d->myTimeouts.end(); ++i)
+  for (Private::TimeoutMap::iterator i = d->myTimeouts.begin(); i != d->myTimeouts.end(); )
   {
     if (i->second.callback == callback)
-    {
-      i->second.removed = true;
-      d->myTimeoutsHasChanged = true;
-    }
+      d->myTimeouts.erase(i++);
+    else
+      ++i;
   }
 }
 
@@ -0,0 +1,144 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2010-2011, 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_BATCHQUEUE_H
+#define LICQDAEMON_BATCHQUEUE_H
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+
+#include <licq/thread/mutex.h>
+#include <licq/thread/mutexlocker.h>
+
+namespace LicqDaemon
+{
+
+/**
+ * Queue with many producers and a single consumer that takes items in batches
+ *
+ * Producers only need to wake up the consumer when the queue goes from empty
+ * to non-empty. The consumer takes everything queued so far in one go and
+ * keeps popping from its own batch without locking until it is used up.
+ *
+ * After each wakeup the consumer must pop until the queue is empty,
+ * otherwise items queued later may not cause a new wakeup.
+ *
+ * Items may be queued with a key to replace an item with the same key that is
+ * already waiting. The new item is placed last in the queue so it is not
+ * delivered before items queued in between. Only items not yet taken by the
+ * consumer are checked.
+ */
+template<typename T, typename Key = int>
+class BatchQueue : private boost::noncopyable
+{
+public:
+  BatchQueue()
+    : myMergeCount(0)
+  { /* Empty */ }
+
+  /**
+   * Add an item to the queue
+   *
+   * @param item Item to add
+   * @return True if queue was empty and the consumer needs to be woken up
+   */
+  bool push(const T& item)
+  {
+    Licq::MutexLocker locker(myMutex);
+    bool wasEmpty = myItems.empty();
+    myItems.push_back(item);
+    return wasEmpty;
+  }
+
+  /**
+   * Add an item to the queue, replacing any waiting item with the same key
+   *
+   * @param item Item to add
+   * @param key Key to compare with waiting items
+   * @return True if queue was empty and the consumer needs to be woken up
+   */
+  bool push(const T& item, const Key& key)
+  {
+    Licq::MutexLocker locker(myMutex);
+    bool wasEmpty = myItems.empty();
+    typename KeyMap::iterator iter = myKeys.find(key);
+    if (iter != myKeys.end())
+    {
+      myItems.erase(iter->second);
+      ++myMergeCount;
+    }
+    else
+      iter = myKeys.insert(std::make_pair(key, myItems.end())).first;
+    iter->second = myItems.insert(myItems.end(), item);
+    return wasEmpty;
+  }
+
+  /**
+   * Take the oldest item from the queue
+   * Must only be called from the consumer thread.
+   *
+   * @return Oldest item or a default constructed T if queue is empty
+   */
+  T pop()
+  {
+    if (myBatch.empty())
+    {
+      Licq::MutexLocker locker(myMutex);
+      myBatch.swap(myItems);
+      myKeys.clear();
+    }
+    if (myBatch.empty())
+      return T();
+
+    T item = myBatch.front();
+    myBatch.pop_front();
+    return item;
+  }
+
+  /// Get number of items not yet taken by the consumer
+  size_t waiting() const
+  {
+    Licq::MutexLocker locker(myMutex);
+    return myItems.size();
+  }
+
+  /// Get number of items replaced by a newer item with same key
+  unsigned long mergeCount() const
+  {
+    Licq::MutexLocker locker(myMutex);
+    return myMergeCount;
+  }
+
+private:
+  typedef std::list<T> ItemList;
+  typedef std::map<Key, typename ItemList::iterator> KeyMap;
+
+  mutable Licq::Mutex myMutex;
+  ItemList myItems;
+  KeyMap myKeys;
+  unsigned long myMergeCount;
+
+  // Items taken by the consumer, only accessed from the consumer thread
+  ItemList myBatch;
+};
+
+} // namespace LicqDaemon
+
+#endif
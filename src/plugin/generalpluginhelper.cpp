@@ -23,28 +23,58 @@
 #include <licq/plugin/generalpluginhelper.h>
 
 #include <licq/pipe.h>
-#include <licq/thread/mutex.h>
+#include <licq/pluginsignal.h>
 #include <licq/thread/mutexlocker.h>
+#include <map>
+#include <set>
 
-#include <queue>
+#include "batchqueue.h"
 
 using namespace Licq;
+using LicqDaemon::BatchQueue;
+
+namespace
+{
+
+/// Fields that must be equal for user signals to be merged
+struct SignalKey
+{
+  UserId userId;
+  unsigned subSignal;
+  unsigned long cid;
+
+  bool operator<(const SignalKey& other) const
+  {
+    if (userId != other.userId)
+      return userId < other.userId;
+    if (subSignal != other.subSignal)
+      return subSignal < other.subSignal;
+    return cid < other.cid;
+  }
+};
+
+} // namespace
 
 class GeneralPluginHelper::Private
 {
 public:
-  Private() : mySignalMask(0) { }
+  Private() : mySignalMask(0), myCoalesceSignals(false) { }
 
   void notify(char ch) { myPipe.putChar(ch); }
 
   Licq::Pipe myPipe;
   unsigned long mySignalMask;
+  bool myCoalesceSignals;
 
-  std::queue< boost::shared_ptr<const Licq::PluginSignal> > mySignals;
-  Licq::Mutex mySignalsMutex;
+  // Subscriptions are made by the plugin thread but checked by the daemon
+  mutable Licq::Mutex mySubscriptionMutex;
+  std::map<unsigned long, std::set<unsigned> > mySubSignals;
+  std::set<unsigned long> myProtocols;
+  std::set<UserId> myOwners;
+  std::set<UserId> myUsers;
 
-  std::queue< boost::shared_ptr<const Licq::Event> > myEvents;
-  Licq::Mutex myEventsMutex;
+  BatchQueue< boost::shared_ptr<const Licq::PluginSignal>, SignalKey > mySignals;
+  BatchQueue< boost::shared_ptr<const Licq::Event> > myEvents;
 };
 
 bool GeneralPluginHelper::init(int /*argc*/, char** /*argv*/)
@@ -76,21 +106,57 @@ bool GeneralPluginHelper::wantSignal(unsigned long signalType) const
   return (signalType & d->mySignalMask);
 }
 
+bool GeneralPluginHelper::isSubscribed(const PluginSignal& signal) const
+{
+  LICQ_D_CONST();
+  MutexLocker locker(d->mySubscriptionMutex);
+
+  std::map<unsigned long, std::set<unsigned> >::const_iterator subSignals =
+      d->mySubSignals.find(signal.signal());
+  if (subSignals != d->mySubSignals.end() &&
+      subSignals->second.count(signal.subSignal()) == 0)
+    return false;
+
+  if (signal.signal() != PluginSignal::SignalUser ||
+      (d->myProtocols.empty() && d->myOwners.empty() && d->myUsers.empty()))
+    return true;
+
+  const UserId& userId = signal.userId();
+  return d->myProtocols.count(userId.protocolId()) > 0 ||
+      d->myOwners.count(userId.ownerId()) > 0 ||
+      d->myUsers.count(userId) > 0;
+}
+
 void GeneralPluginHelper::pushSignal(
     boost::shared_ptr<const PluginSignal> signal)
 {
   LICQ_D();
-  MutexLocker locker(d->mySignalsMutex);
-  d->mySignals.push(signal);
-  d->notify(PipeSignal);
+
+  // Each new event must be delivered but other user signals only tell the
+  // plugin to fetch current data so only the newest waiting signal is kept.
+  // The argument is not part of the key as the newest one (e.g. typing
+  // status) is what the plugin must end up with.
+  if (d->myCoalesceSignals && signal->signal() == PluginSignal::SignalUser &&
+      signal->subSignal() != PluginSignal::UserEvents)
+  {
+    SignalKey key;
+    key.userId = signal->userId();
+    key.subSignal = signal->subSignal();
+    key.cid = signal->cid();
+    if (d->mySignals.push(signal, key))
+      d->notify(PipeSignal);
+    return;
+  }
+
+  if (d->mySignals.push(signal))
+    d->notify(PipeSignal);
 }
 
 void GeneralPluginHelper::pushEvent(boost::shared_ptr<const Event> event)
 {
   LICQ_D();
-  MutexLocker locker(d->myEventsMutex);
-  d->myEvents.push(event);
-  d->notify(PipeEvent);
+  if (d->myEvents.push(event))
+    d->notify(PipeEvent);
 }
 
 GeneralPluginHelper::GeneralPluginHelper()
@@ -116,28 +182,71 @@ void GeneralPluginHelper::setSignalMask(unsigned long signalMask)
   d->mySignalMask = signalMask;
 }
 
+void GeneralPluginHelper::subscribeSubSignal(
+    unsigned long signalType, unsigned subSignal)
+{
+  LICQ_D();
+  MutexLocker locker(d->mySubscriptionMutex);
+  d->mySubSignals[signalType].insert(subSignal);
+}
+
+void GeneralPluginHelper::subscribeProtocol(unsigned long protocolId)
+{
+  LICQ_D();
+  MutexLocker locker(d->mySubscriptionMutex);
+  d->myProtocols.insert(protocolId);
+}
+
+void GeneralPluginHelper::subscribeOwner(const UserId& ownerId)
+{
+  LICQ_D();
+  MutexLocker locker(d->mySubscriptionMutex);
+  d->myOwners.insert(ownerId);
+}
+
+void GeneralPluginHelper::subscribeUser(const UserId& userId)
+{
+  LICQ_D();
+  MutexLocker locker(d->mySubscriptionMutex);
+  d->myUsers.insert(userId);
+}
+
+void GeneralPluginHelper::clearSubscriptions()
+{
+  LICQ_D();
+  MutexLocker locker(d->mySubscriptionMutex);
+  d->mySubSignals.clear();
+  d->myProtocols.clear();
+  d->myOwners.clear();
+  d->myUsers.clear();
+}
+
+void GeneralPluginHelper::setSignalCoalescing(bool coalesce)
+{
+  LICQ_D();
+  d->myCoalesceSignals = coalesce;
+}
+
+size_t GeneralPluginHelper::signalQueueLength() const
+{
+  LICQ_D_CONST();
+  return d->mySignals.waiting();
+}
+
+unsigned long GeneralPluginHelper::mergedSignalCount() const
+{
+  LICQ_D_CONST();
+  return d->mySignals.mergeCount();
+}
+
 boost::shared_ptr<const Licq::PluginSignal> GeneralPluginHelper::popSignal()
 {
   LICQ_D();
-  MutexLocker locker(d->mySignalsMutex);
-  if (!d->mySignals.empty())
-  {
-    boost::shared_ptr<const PluginSignal> signal = d->mySignals.front();
-    d->mySignals.pop();
-    return signal;
-  }
-  return boost::shared_ptr<const PluginSignal>();
+  return d->mySignals.pop();
 }
 
 boost::shared_ptr<const Licq::Event> GeneralPluginHelper::popEvent()
 {
   LICQ_D();
-  MutexLocker locker(d->myEventsMutex);
-  if (!d->myEvents.empty())
-  {
-    boost::shared_ptr<const Event> event = d->myEvents.front();
-    d->myEvents.pop();
-    return event;
-  }
-  return boost::shared_ptr<const Event>();
+  return d->myEvents.pop();
 }
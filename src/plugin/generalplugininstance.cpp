@@ -70,6 +70,12 @@ bool GeneralPluginInstance::wantSignal(unsigned long signalType) const
   return myInterface->wantSignal(signalType);
 }
 
+bool GeneralPluginInstance::isSubscribed(
+    const Licq::PluginSignal& signal) const
+{
+  return myInterface->isSubscribed(signal);
+}
+
 void GeneralPluginInstance::pushSignal(
     boost::shared_ptr<const Licq::PluginSignal> signal)
 {
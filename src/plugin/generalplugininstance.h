@@ -57,6 +57,7 @@ public:
   void disable();
 
   bool wantSignal(unsigned long signalType) const;
+  bool isSubscribed(const Licq::PluginSignal& signal) const;
   void pushSignal(boost::shared_ptr<const Licq::PluginSignal> signal);
   void pushEvent(boost::shared_ptr<const Licq::Event> event);
 
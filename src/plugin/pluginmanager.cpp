@@ -854,7 +854,8 @@ void PluginManager::pushPluginSignal(Licq::PluginSignal* rawSignal)
   MutexLocker locker(myGeneralPluginsMutex);
   BOOST_FOREACH(GeneralPluginInstance::Ptr instance, myGeneralInstances)
   {
-    if (instance->wantSignal(signal->signal()))
+    if (instance->wantSignal(signal->signal()) &&
+        instance->isSubscribed(*signal))
       instance->pushSignal(signal);
   }
 }
@@ -25,12 +25,11 @@
 #include <licq/contactlist/owner.h>
 #include <licq/contactlist/user.h>
 #include <licq/pipe.h>
-#include <licq/thread/mutex.h>
-#include <licq/thread/mutexlocker.h>
 
-#include <queue>
+#include "batchqueue.h"
 
 using namespace Licq;
+using LicqDaemon::BatchQueue;
 
 class ProtocolPluginHelper::Private
 {
@@ -38,8 +37,7 @@ public:
   void notify(char ch) { myPipe.putChar(ch); }
 
   Licq::Pipe myPipe;
-  std::queue< boost::shared_ptr<const Licq::ProtocolSignal> > mySignals;
-  Licq::Mutex mySignalsMutex;
+  BatchQueue< boost::shared_ptr<const Licq::ProtocolSignal> > mySignals;
 };
 
 bool ProtocolPluginHelper::init(int /*argc*/, char** /*argv*/)
@@ -57,9 +55,8 @@ void ProtocolPluginHelper::pushSignal(
     boost::shared_ptr<const ProtocolSignal> signal)
 {
   LICQ_D();
-  MutexLocker locker(d->mySignalsMutex);
-  d->mySignals.push(signal);
-  d->notify(PipeSignal);
+  if (d->mySignals.push(signal))
+    d->notify(PipeSignal);
 }
 
 ProtocolPluginHelper::ProtocolPluginHelper()
@@ -82,12 +79,5 @@ int ProtocolPluginHelper::getReadPipe() const
 boost::shared_ptr<const Licq::ProtocolSignal> ProtocolPluginHelper::popSignal()
 {
   LICQ_D();
-  MutexLocker locker(d->mySignalsMutex);
-  if (!d->mySignals.empty())
-  {
-    boost::shared_ptr<const ProtocolSignal> signal = d->mySignals.front();
-    d->mySignals.pop();
-    return signal;
-  }
-  return boost::shared_ptr<const ProtocolSignal>();
+  return d->mySignals.pop();
 }
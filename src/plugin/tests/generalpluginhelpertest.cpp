@@ -21,8 +21,10 @@
  */
 
 #include <licq/plugin/generalpluginhelper.h>
+#include <licq/pluginsignal.h>
 
 #include <gtest/gtest.h>
+#include <poll.h>
 #include <unistd.h>
 
 namespace LicqTest
@@ -40,6 +42,12 @@ public:
   // Make public
   using GeneralPluginHelper::getReadPipe;
   using GeneralPluginHelper::setSignalMask;
+  using GeneralPluginHelper::setSignalCoalescing;
+  using GeneralPluginHelper::subscribeSubSignal;
+  using GeneralPluginHelper::subscribeProtocol;
+  using GeneralPluginHelper::subscribeOwner;
+  using GeneralPluginHelper::subscribeUser;
+  using GeneralPluginHelper::clearSubscriptions;
   using GeneralPluginHelper::popSignal;
   using GeneralPluginHelper::popEvent;
 };
@@ -54,6 +62,14 @@ struct GeneralPluginHelperFixture : public ::testing::Test
     ::read(helper.getReadPipe(), &ch, sizeof(ch));
     return ch;
   };
+
+  bool pipeIsEmpty()
+  {
+    struct pollfd pfd;
+    pfd.fd = helper.getReadPipe();
+    pfd.events = POLLIN;
+    return ::poll(&pfd, 1, 0) == 0;
+  }
 };
 
 TEST_F(GeneralPluginHelperFixture, init)
@@ -87,6 +103,73 @@ TEST_F(GeneralPluginHelperFixture, signalMask)
   EXPECT_FALSE(helper.wantSignal(0x10));
 }
 
+TEST_F(GeneralPluginHelperFixture, subscribeSubSignal)
+{
+  using Licq::PluginSignal;
+
+  PluginSignal status(PluginSignal::SignalUser, PluginSignal::UserStatus);
+  PluginSignal events(PluginSignal::SignalUser, PluginSignal::UserEvents);
+  PluginSignal added(PluginSignal::SignalList, PluginSignal::ListUserAdded);
+
+  EXPECT_TRUE(helper.isSubscribed(status));
+  EXPECT_TRUE(helper.isSubscribed(events));
+
+  helper.subscribeSubSignal(PluginSignal::SignalUser, PluginSignal::UserEvents);
+  EXPECT_FALSE(helper.isSubscribed(status));
+  EXPECT_TRUE(helper.isSubscribed(events));
+
+  // Other signal types are not affected
+  EXPECT_TRUE(helper.isSubscribed(added));
+
+  helper.subscribeSubSignal(PluginSignal::SignalUser, PluginSignal::UserStatus);
+  EXPECT_TRUE(helper.isSubscribed(status));
+
+  helper.clearSubscriptions();
+  helper.subscribeSubSignal(PluginSignal::SignalList,
+      PluginSignal::ListInvalidate);
+  EXPECT_TRUE(helper.isSubscribed(status));
+  EXPECT_FALSE(helper.isSubscribed(added));
+}
+
+TEST_F(GeneralPluginHelperFixture, subscribeUsers)
+{
+  using Licq::PluginSignal;
+  using Licq::UserId;
+
+  UserId owner1(0x54455354, "owner1");
+  UserId owner2(0x54455354, "owner2");
+  UserId owner3(0x4f54484b, "owner3");
+  UserId user1(owner1, "user1");
+  UserId user2(owner2, "user2");
+  UserId user3(owner3, "user3");
+  PluginSignal signal1(
+      PluginSignal::SignalUser, PluginSignal::UserStatus, user1);
+  PluginSignal signal2(
+      PluginSignal::SignalUser, PluginSignal::UserStatus, user2);
+  PluginSignal signal3(
+      PluginSignal::SignalUser, PluginSignal::UserStatus, user3);
+  PluginSignal logon(PluginSignal::SignalLogon, 0, owner3);
+
+  helper.subscribeUser(user1);
+  EXPECT_TRUE(helper.isSubscribed(signal1));
+  EXPECT_FALSE(helper.isSubscribed(signal2));
+  EXPECT_FALSE(helper.isSubscribed(signal3));
+
+  // Only user signals are filtered on user
+  EXPECT_TRUE(helper.isSubscribed(logon));
+
+  helper.subscribeOwner(owner2);
+  EXPECT_TRUE(helper.isSubscribed(signal1));
+  EXPECT_TRUE(helper.isSubscribed(signal2));
+  EXPECT_FALSE(helper.isSubscribed(signal3));
+
+  helper.clearSubscriptions();
+  helper.subscribeProtocol(0x4f54484b);
+  EXPECT_FALSE(helper.isSubscribed(signal1));
+  EXPECT_FALSE(helper.isSubscribed(signal2));
+  EXPECT_TRUE(helper.isSubscribed(signal3));
+}
+
 TEST_F(GeneralPluginHelperFixture, popEmpty)
 {
   EXPECT_TRUE(helper.popSignal() == NULL);
@@ -106,11 +189,96 @@ TEST_F(GeneralPluginHelperFixture, pushPopSignal)
   helper.pushSignal(shared_ptr<PluginSignal>(signal1, &nullDeleter));
   helper.pushSignal(shared_ptr<PluginSignal>(signal2, &nullDeleter));
 
+  // Only the first one notifies, the rest are fetched in the same batch
   EXPECT_EQ('S', getPipeChar());
+  EXPECT_TRUE(pipeIsEmpty());
   EXPECT_EQ(signal1, helper.popSignal().get());
+  EXPECT_EQ(signal2, helper.popSignal().get());
+  EXPECT_TRUE(helper.popSignal() == NULL);
 
+  // Queue is empty again so next signal notifies
+  helper.pushSignal(shared_ptr<PluginSignal>(signal1, &nullDeleter));
   EXPECT_EQ('S', getPipeChar());
-  EXPECT_EQ(signal2, helper.popSignal().get());
+  EXPECT_EQ(signal1, helper.popSignal().get());
+}
+
+TEST_F(GeneralPluginHelperFixture, coalesceSignals)
+{
+  using Licq::PluginSignal;
+  using Licq::UserId;
+  using boost::shared_ptr;
+
+  UserId user1(0x54455354, "user1");
+  UserId user2(0x54455354, "user2");
+  shared_ptr<PluginSignal> status1(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserStatus, user1));
+  shared_ptr<PluginSignal> status2(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserStatus, user2));
+  shared_ptr<PluginSignal> info1(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserInfo, user1));
+  shared_ptr<PluginSignal> event1(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserEvents, user1, 1));
+
+  // Nothing is merged unless enabled
+  helper.pushSignal(status1);
+  helper.pushSignal(status1);
+  EXPECT_EQ(2u, helper.signalQueueLength());
+  EXPECT_EQ(status1.get(), helper.popSignal().get());
+  EXPECT_EQ(status1.get(), helper.popSignal().get());
+  EXPECT_TRUE(helper.popSignal() == NULL);
+  EXPECT_EQ('S', getPipeChar());
+
+  helper.setSignalCoalescing(true);
+  helper.pushSignal(status1);
+  helper.pushSignal(info1);
+  helper.pushSignal(status2);
+  helper.pushSignal(status1);
+  helper.pushSignal(event1);
+  helper.pushSignal(event1);
+  helper.pushSignal(info1);
+  EXPECT_EQ(5u, helper.signalQueueLength());
+  EXPECT_EQ(2u, helper.mergedSignalCount());
+
+  // Replaced signals are moved last in the queue
+  EXPECT_EQ(status2.get(), helper.popSignal().get());
+  EXPECT_EQ(0u, helper.signalQueueLength());
+
+  // Signals taken by the plugin are not merged with
+  helper.pushSignal(status1);
+
+  EXPECT_EQ(status1.get(), helper.popSignal().get());
+  EXPECT_EQ(event1.get(), helper.popSignal().get());
+  EXPECT_EQ(event1.get(), helper.popSignal().get());
+  EXPECT_EQ(info1.get(), helper.popSignal().get());
+  EXPECT_EQ(status1.get(), helper.popSignal().get());
+  EXPECT_TRUE(helper.popSignal() == NULL);
+  EXPECT_EQ(2u, helper.mergedSignalCount());
+}
+
+TEST_F(GeneralPluginHelperFixture, coalesceSignalsKeepsNewestArgument)
+{
+  using Licq::PluginSignal;
+  using Licq::UserId;
+  using boost::shared_ptr;
+
+  UserId user1(0x54455354, "user1");
+  shared_ptr<PluginSignal> typingOn1(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserTyping, user1, 1));
+  shared_ptr<PluginSignal> typingOff(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserTyping, user1, 0));
+  shared_ptr<PluginSignal> typingOn2(new PluginSignal(
+      PluginSignal::SignalUser, PluginSignal::UserTyping, user1, 1));
+
+  helper.setSignalCoalescing(true);
+  helper.pushSignal(typingOn1);
+  helper.pushSignal(typingOff);
+  helper.pushSignal(typingOn2);
+  EXPECT_EQ('S', getPipeChar());
+  EXPECT_EQ(1u, helper.signalQueueLength());
+  EXPECT_EQ(2u, helper.mergedSignalCount());
+
+  EXPECT_EQ(typingOn2.get(), helper.popSignal().get());
+  EXPECT_TRUE(helper.popSignal() == NULL);
 }
 
 TEST_F(GeneralPluginHelperFixture, pushPopEvent)
@@ -124,11 +292,17 @@ TEST_F(GeneralPluginHelperFixture, pushPopEvent)
   helper.pushEvent(shared_ptr<Event>(event1, &nullDeleter));
   helper.pushEvent(shared_ptr<Event>(event2, &nullDeleter));
 
+  // Only the first one notifies, the rest are fetched in the same batch
   EXPECT_EQ('E', getPipeChar());
+  EXPECT_TRUE(pipeIsEmpty());
   EXPECT_EQ(event1, helper.popEvent().get());
+  EXPECT_EQ(event2, helper.popEvent().get());
+  EXPECT_TRUE(helper.popEvent() == NULL);
 
+  // Queue is empty again so next event notifies
+  helper.pushEvent(shared_ptr<Event>(event1, &nullDeleter));
   EXPECT_EQ('E', getPipeChar());
-  EXPECT_EQ(event2, helper.popEvent().get());
+  EXPECT_EQ(event1, helper.popEvent().get());
 }
 
 } // namespace LicqTest
@@ -22,6 +22,7 @@
 
 #include <licq/plugin/generalpluginfactory.h>
 #include <licq/plugin/generalplugininterface.h>
+#include <licq/pluginsignal.h>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -32,6 +33,7 @@ using LicqDaemon::DynamicLibrary;
 using LicqDaemon::PluginThread;
 
 using ::testing::InSequence;
+using ::testing::Ref;
 using ::testing::Return;
 
 namespace LicqTest
@@ -61,6 +63,7 @@ public:
   MOCK_METHOD0(enable, void());
   MOCK_METHOD0(disable, void());
   MOCK_CONST_METHOD1(wantSignal, bool(unsigned long signalType));
+  MOCK_CONST_METHOD1(isSubscribed, bool(const Licq::PluginSignal& signal));
   MOCK_METHOD1(pushSignal,
                void(boost::shared_ptr<const Licq::PluginSignal> signal));
   MOCK_METHOD1(pushEvent, void(boost::shared_ptr<const Licq::Event> event));
@@ -113,6 +116,8 @@ TEST_P(RunnableGeneralPluginFixture, callApiFunctions)
     instance.setIsRunning(true);
 
   unsigned long signalType = 123;
+  Licq::PluginSignal subscribeSignal(Licq::PluginSignal::SignalUser,
+      Licq::PluginSignal::UserStatus);
   shared_ptr<const Licq::PluginSignal> signal(
       reinterpret_cast<Licq::PluginSignal*>(456), &nullDeleter);
   shared_ptr<const Licq::Event> event(
@@ -129,6 +134,7 @@ TEST_P(RunnableGeneralPluginFixture, callApiFunctions)
     EXPECT_CALL(myMockInterface, disable());
   }
   EXPECT_CALL(myMockInterface, wantSignal(signalType));
+  EXPECT_CALL(myMockInterface, isSubscribed(Ref(subscribeSignal)));
   if (GetParam())
   {
     EXPECT_CALL(myMockInterface, pushSignal(signal));
@@ -143,6 +149,7 @@ TEST_P(RunnableGeneralPluginFixture, callApiFunctions)
   instance.enable();
   instance.disable();
   instance.wantSignal(signalType);
+  instance.isSubscribed(subscribeSignal);
   instance.pushSignal(signal);
   instance.pushEvent(event);
 }
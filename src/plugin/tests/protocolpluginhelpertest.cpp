@@ -24,6 +24,7 @@
 #include <licq/userid.h>
 
 #include <gtest/gtest.h>
+#include <poll.h>
 #include <unistd.h>
 
 namespace LicqTest
@@ -50,6 +51,14 @@ struct ProtocolPluginHelperFixture : public ::testing::Test
     ::read(helper.getReadPipe(), &ch, sizeof(ch));
     return ch;
   };
+
+  bool pipeIsEmpty()
+  {
+    struct pollfd pfd;
+    pfd.fd = helper.getReadPipe();
+    pfd.events = POLLIN;
+    return ::poll(&pfd, 1, 0) == 0;
+  }
 };
 
 TEST_F(ProtocolPluginHelperFixture, init)
@@ -81,11 +90,17 @@ TEST_F(ProtocolPluginHelperFixture, pushPopSignal)
   helper.pushSignal(shared_ptr<ProtocolSignal>(signal1, &nullDeleter));
   helper.pushSignal(shared_ptr<ProtocolSignal>(signal2, &nullDeleter));
 
+  // Only the first one notifies, the rest are fetched in the same batch
   EXPECT_EQ('S', getPipeChar());
+  EXPECT_TRUE(pipeIsEmpty());
   EXPECT_EQ(signal1, helper.popSignal().get());
+  EXPECT_EQ(signal2, helper.popSignal().get());
+  EXPECT_TRUE(helper.popSignal() == NULL);
 
+  // Queue is empty again so next signal notifies
+  helper.pushSignal(shared_ptr<ProtocolSignal>(signal1, &nullDeleter));
   EXPECT_EQ('S', getPipeChar());
-  EXPECT_EQ(signal2, helper.popSignal().get());
+  EXPECT_EQ(signal1, helper.popSignal().get());
 }
 
 } // namespace LicqTest
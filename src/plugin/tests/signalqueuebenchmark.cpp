@@ -0,0 +1,164 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2010, 2012-2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <licq/plugin/generalpluginhelper.h>
+#include <licq/pipe.h>
+#include <licq/thread/mutex.h>
+#include <licq/thread/mutexlocker.h>
+
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <queue>
+
+using Licq::PluginSignal;
+using boost::shared_ptr;
+
+namespace LicqTest {
+
+static const int NumSignals = 100000;
+
+static void nullDeleter(void*) { /* Empty */ }
+
+class BenchGeneralPluginHelper : public Licq::GeneralPluginHelper
+{
+public:
+  // From Licq::PluginInterface
+  int run() { return 0; }
+
+  // From Licq::GeneralPluginInterface
+  bool isEnabled() const { return true; }
+
+  // Make public
+  using GeneralPluginHelper::getReadPipe;
+  using GeneralPluginHelper::popSignal;
+};
+
+/// Queue as the plugin helpers had it, one pipe notification per signal
+class OldSignalQueue
+{
+public:
+  void push(shared_ptr<const PluginSignal> signal)
+  {
+    Licq::MutexLocker locker(myMutex);
+    mySignals.push(signal);
+    myPipe.putChar('S');
+  }
+
+  shared_ptr<const PluginSignal> pop()
+  {
+    Licq::MutexLocker locker(myMutex);
+    if (mySignals.empty())
+      return shared_ptr<const PluginSignal>();
+    shared_ptr<const PluginSignal> signal = mySignals.front();
+    mySignals.pop();
+    return signal;
+  }
+
+  Licq::Pipe myPipe;
+  Licq::Mutex myMutex;
+  std::queue< shared_ptr<const PluginSignal> > mySignals;
+};
+
+/**
+ * Measures delivering a storm of signals, like the status updates at logon,
+ * from the daemon to a plugin thread.
+ */
+class SignalQueueBenchmark : public ::testing::Test
+{
+public:
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  static void report(const char* what, double elapsed, int wakeups)
+  {
+    printf("[   BENCH  ] %s: %d signals in %.1f ms (%.3f us/signal, %d wakeups)\n",
+        what, NumSignals, elapsed, elapsed * 1000 / NumSignals, wakeups);
+  }
+
+  static void* oldConsumer(void* arg)
+  {
+    OldSignalQueue* queue = static_cast<OldSignalQueue*>(arg);
+    int received = 0;
+    int wakeups = 0;
+    while (received < NumSignals)
+    {
+      ++wakeups;
+      queue->myPipe.getChar();
+      if (queue->pop())
+        ++received;
+    }
+    return reinterpret_cast<void*>(wakeups);
+  }
+
+  static void* newConsumer(void* arg)
+  {
+    BenchGeneralPluginHelper* helper = static_cast<BenchGeneralPluginHelper*>(arg);
+    int received = 0;
+    int wakeups = 0;
+    while (received < NumSignals)
+    {
+      ++wakeups;
+      char ch;
+      ::read(helper->getReadPipe(), &ch, sizeof(ch));
+      while (helper->popSignal())
+        ++received;
+    }
+    return reinterpret_cast<void*>(wakeups);
+  }
+};
+
+TEST_F(SignalQueueBenchmark, pipePerSignal)
+{
+  OldSignalQueue queue;
+  shared_ptr<const PluginSignal> signal(
+      reinterpret_cast<PluginSignal*>(10), &nullDeleter);
+
+  double start = now();
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, oldConsumer, &queue));
+  for (int i = 0; i < NumSignals; ++i)
+    queue.push(signal);
+  void* wakeups;
+  pthread_join(thread, &wakeups);
+  report("pipe per signal", now() - start, reinterpret_cast<long>(wakeups));
+}
+
+TEST_F(SignalQueueBenchmark, batched)
+{
+  BenchGeneralPluginHelper helper;
+  shared_ptr<const PluginSignal> signal(
+      reinterpret_cast<PluginSignal*>(10), &nullDeleter);
+
+  double start = now();
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, newConsumer, &helper));
+  for (int i = 0; i < NumSignals; ++i)
+    helper.pushSignal(signal);
+  void* wakeups;
+  pthread_join(thread, &wakeups);
+  report("batched", now() - start, reinterpret_cast<long>(wakeups));
+}
+
+} // namespace LicqTest
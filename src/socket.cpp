@@ -23,15 +23,16 @@
 
 #include <licq/socket.h>
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
-#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef USE_OPENSSL
@@ -66,11 +67,14 @@ extern "C" {
 #include <licq/buffer.h>
 #include <licq/proxy.h>
 #include <licq/logging/log.h>
+#include <licq/mainloop.h>
+#include <licq/thread/mutexlocker.h>
 
 #include "gettext.h"
 
 using Licq::Buffer;
 using Licq::INetSocket;
+using Licq::MutexLocker;
 using Licq::TCPSocket;
 using Licq::UDPSocket;
 using Licq::UserId;
@@ -149,6 +153,8 @@ int INetSocket::Error()
       return 0;
     case ErrorInternal:
       return -2;
+    case ErrorQueueFull:
+      return EAGAIN;
     case ErrorProxy:
       if (myProxy != NULL)
         return myProxy->error();
@@ -166,6 +172,9 @@ string INetSocket::errorStr() const
     case ErrorNone:
       return tr("No error detected");
 
+    case ErrorQueueFull:
+      return tr("Send queue full");
+
     case ErrorProxy:
       if (myProxy != NULL)
         return myProxy->errorStr();
@@ -183,7 +192,12 @@ INetSocket::INetSocket(int sockType, const string& logId, const UserId& userId)
     mySockType(sockType),
     myErrorType(ErrorNone),
     myProxy(NULL),
-    myUserId(userId)
+    myUserId(userId),
+    mySendQueueSize(0),
+    mySendQueueOffset(0),
+    mySendQueueLimit(0),
+    myManagerFd(-1),
+    myMainLoop(NULL)
 {
   memset(&myRemoteAddr, 0, sizeof(myRemoteAddrStorage));
   memset(&myLocalAddr, 0, sizeof(myLocalAddrStorage));
@@ -472,10 +486,24 @@ void INetSocket::CloseConnection()
     ::close (myDescriptor);
     myDescriptor = -1;
   }
+
+  MutexLocker locker(mySendMutex);
+  clearSendQueue();
 }
 
 bool INetSocket::send(Buffer& buf)
 {
+  {
+    MutexLocker locker(mySendMutex);
+    if (mySendQueueLimit > 0 || !mySendQueue.empty())
+    {
+      if (!queueSend(buf.getDataStart(), buf.getDataSize()))
+        return false;
+      DumpPacket(&buf, false);
+      return true;
+    }
+  }
+
   // send the packet
   int bytesLeft = buf.getDataSize();
   char* dataPos = buf.getDataStart();
@@ -498,32 +526,174 @@ bool INetSocket::send(Buffer& buf)
   return (true);
 }
 
+void INetSocket::setSendQueueLimit(size_t highWatermark)
+{
+  MutexLocker locker(mySendMutex);
+  mySendQueueLimit = highWatermark;
+}
+
+void INetSocket::setMainLoop(MainLoop* mainLoop)
+{
+  MutexLocker locker(mySendMutex);
+  myMainLoop = mainLoop;
+}
+
+size_t INetSocket::sendQueueSize() const
+{
+  MutexLocker locker(mySendMutex);
+  return mySendQueueSize;
+}
+
+bool INetSocket::flushSendQueue()
+{
+  MutexLocker locker(mySendMutex);
+  return writeSendQueue();
+}
+
+void INetSocket::clearSendQueue()
+{
+  mySendQueue.clear();
+  mySendQueueSize = 0;
+  mySendQueueOffset = 0;
+}
+
+void INetSocket::sendQueueStarted()
+{
+  if (myMainLoop != NULL)
+    myMainLoop->sendQueueStarted(myDescriptor);
+}
+
+bool INetSocket::queueSend(const char* data, size_t size)
+{
+  if (!mySendQueue.empty())
+  {
+    // Socket is already busy, new data goes after what is queued
+    if (mySendQueueSize + size > mySendQueueLimit)
+    {
+      myErrorType = ErrorQueueFull;
+      return false;
+    }
+    mySendQueue.push_back(string(data, size));
+    mySendQueueSize += size;
+    return writeSendQueue();
+  }
+
+  // Queue is empty so try writing directly first. A single packet is always
+  // accepted here even if larger than the limit so it can't get stuck.
+  size_t sent = 0;
+  while (sent < size)
+  {
+    ssize_t bytesSent = ::socket_send(myDescriptor, data + sent, size - sent, MSG_DONTWAIT);
+    if (bytesSent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      myErrorType = ErrorErrno;
+      return false;
+    }
+    sent += bytesSent;
+  }
+
+  if (sent < size)
+  {
+    mySendQueue.push_back(string(data + sent, size - sent));
+    mySendQueueSize += size - sent;
+    sendQueueStarted();
+  }
+  return true;
+}
+
+bool INetSocket::writeSendQueue()
+{
+#ifdef USE_SOCKS5
+  // The SOCKS library only wraps send() so write one packet at a time
+  static const size_t MaxIov = 1;
+#else
+  // Coalesce queued packets into as few writes as possible
+  static const size_t MaxIov = 64;
+#endif
+  struct iovec iov[MaxIov];
+
+  while (!mySendQueue.empty())
+  {
+    size_t count = 0;
+    for (std::deque<string>::iterator i = mySendQueue.begin();
+        i != mySendQueue.end() && count < MaxIov; ++i, ++count)
+    {
+      size_t offset = (count == 0 ? mySendQueueOffset : 0);
+      iov[count].iov_base = const_cast<char*>(i->data()) + offset;
+      iov[count].iov_len = i->size() - offset;
+    }
+
+#ifdef USE_SOCKS5
+    ssize_t bytesSent = ::socket_send(myDescriptor, iov[0].iov_base,
+        iov[0].iov_len, MSG_DONTWAIT);
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    ssize_t bytesSent = ::sendmsg(myDescriptor, &msg, MSG_DONTWAIT);
+#endif
+    if (bytesSent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+      myErrorType = ErrorErrno;
+      return false;
+    }
+
+    // Drop everything that was written
+    size_t left = bytesSent;
+    mySendQueueSize -= left;
+    while (left > 0)
+    {
+      size_t chunk = mySendQueue.front().size() - mySendQueueOffset;
+      if (left < chunk)
+      {
+        mySendQueueOffset += left;
+        break;
+      }
+      left -= chunk;
+      mySendQueue.pop_front();
+      mySendQueueOffset = 0;
+    }
+  }
+  return true;
+}
+
 bool INetSocket::receive(Buffer& buf, size_t maxlength, bool dump)
 {
   // Don't try to read more than the buffer has room for
   if (buf.Full())
     return true;
-  if (!buf.Empty() && maxlength > buf.remainingDataToWrite())
+  if (buf.Empty())
+    buf.Create(maxlength);
+  else if (maxlength > buf.remainingDataToWrite())
     maxlength = buf.remainingDataToWrite();
 
-  char* buffer = new char[maxlength];
-  errno = 0;
-  int f = fcntl(myDescriptor, F_GETFL);
-  fcntl(myDescriptor, F_SETFL, f | O_NONBLOCK);
-  ssize_t bytesReceived = recv(myDescriptor, buffer, maxlength, 0);
-  fcntl(myDescriptor, F_SETFL, f & ~O_NONBLOCK);
+  // Read directly into the buffer, socket stays in blocking mode for others
+  ssize_t bytesReceived;
+  do
+  {
+    bytesReceived = recv(myDescriptor, buf.getDataPosWrite(), maxlength, MSG_DONTWAIT);
+  } while (bytesReceived < 0 && errno == EINTR);
+
   if (bytesReceived <= 0)
   {
-    delete[] buffer;
     myErrorType = ErrorErrno;
-    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    if (bytesReceived == 0)
+      errno = 0;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
       return true;
     return (false);
   }
-  if (buf.Empty())
-    buf.Create(bytesReceived);
-  buf.packRaw(buffer, bytesReceived);
-  delete[] buffer;
+  buf.incDataPosWrite(bytesReceived);
 
   // Print the packet
   if (dump)
@@ -532,6 +702,61 @@ bool INetSocket::receive(Buffer& buf, size_t maxlength, bool dump)
   return (true);
 }
 
+bool INetSocket::receive(const std::vector<Buffer*>& bufs, size_t& bytesReceived)
+{
+  bytesReceived = 0;
+
+  // Only read into buffers that have room left
+  std::vector<struct iovec> iov;
+  iov.reserve(bufs.size());
+  for (std::vector<Buffer*>::const_iterator i = bufs.begin(); i != bufs.end(); ++i)
+  {
+    if ((*i)->Empty() || (*i)->Full())
+      continue;
+    struct iovec v;
+    v.iov_base = (*i)->getDataPosWrite();
+    v.iov_len = (*i)->remainingDataToWrite();
+    iov.push_back(v);
+  }
+  if (iov.empty())
+    return true;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov[0];
+  msg.msg_iovlen = iov.size();
+
+  ssize_t ret;
+  do
+  {
+    ret = recvmsg(myDescriptor, &msg, MSG_DONTWAIT);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret <= 0)
+  {
+    myErrorType = ErrorErrno;
+    if (ret == 0)
+      errno = 0;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return true;
+    return false;
+  }
+  bytesReceived = ret;
+
+  // Advance write position of each buffer that got data
+  size_t left = ret;
+  for (std::vector<Buffer*>::const_iterator i = bufs.begin(); left > 0 && i != bufs.end(); ++i)
+  {
+    if ((*i)->Empty() || (*i)->Full())
+      continue;
+    size_t len = std::min(left, static_cast<size_t>((*i)->remainingDataToWrite()));
+    (*i)->incDataPosWrite(len);
+    left -= len;
+  }
+
+  return true;
+}
+
 
 //=====TCPSocket===============================================================
 TCPSocket::TCPSocket(const UserId& userId)
@@ -607,6 +832,18 @@ void TCPSocket::TransferConnectionFrom(TCPSocket &from)
   myRemoteAddr = from.myRemoteAddr;
   myUserId = from.myUserId;
 
+  {
+    MutexLocker locker(mySendMutex);
+    MutexLocker fromLocker(from.mySendMutex);
+    clearSendQueue();
+    mySendQueue.swap(from.mySendQueue);
+    std::swap(mySendQueueSize, from.mySendQueueSize);
+    std::swap(mySendQueueOffset, from.mySendQueueOffset);
+    mySendQueueLimit = from.mySendQueueLimit;
+    if (!mySendQueue.empty())
+      sendQueueStarted();
+  }
+
   if (from.m_p_SSL)
   {
     pthread_mutex_lock(&from.mutex_ssl);
@@ -676,13 +913,14 @@ bool TCPSocket::receive(Buffer& buf, size_t maxlength, bool dump)
 #ifdef USE_OPENSSL
   if (buf.Full())
     return true;
-  if (!buf.Empty() && maxlength > buf.remainingDataToWrite())
+  if (buf.Empty())
+    buf.Create(maxlength);
+  else if (maxlength > buf.remainingDataToWrite())
     maxlength = buf.remainingDataToWrite();
 
-  char* buffer = new char[maxlength];
   errno = 0;
   pthread_mutex_lock(&mutex_ssl);
-  int nBytesReceived = SSL_read(m_pSSL, buffer, maxlength);
+  int nBytesReceived = SSL_read(m_pSSL, buf.getDataPosWrite(), maxlength);
   int tmp = SSL_get_error(m_pSSL, nBytesReceived);
   pthread_mutex_unlock(&mutex_ssl);
   switch (tmp)
@@ -706,14 +944,10 @@ bool TCPSocket::receive(Buffer& buf, size_t maxlength, bool dump)
   }
   if (nBytesReceived <= 0)
   {
-    delete[] buffer;
     myErrorType = ErrorErrno;
     return (false);
   }
-  if (buf.Empty())
-    buf.Create(nBytesReceived);
-  buf.packRaw(buffer, nBytesReceived);
-  delete[] buffer;
+  buf.incDataPosWrite(nBytesReceived);
 
   // Print the packet
   if (dump)
@@ -725,6 +959,26 @@ bool TCPSocket::receive(Buffer& buf, size_t maxlength, bool dump)
 #endif
 }
 
+bool TCPSocket::receive(const std::vector<Buffer*>& bufs, size_t& bytesReceived)
+{
+  if (m_pSSL == NULL)
+    return INetSocket::receive(bufs, bytesReceived);
+
+  // SSL can't do scatter reads, fill the first buffer that has room
+  bytesReceived = 0;
+  for (std::vector<Buffer*>::const_iterator i = bufs.begin(); i != bufs.end(); ++i)
+  {
+    if ((*i)->Empty() || (*i)->Full())
+      continue;
+    unsigned long before = (*i)->getDataSize();
+    if (!receive(**i, (*i)->remainingDataToWrite(), false))
+      return false;
+    bytesReceived = (*i)->getDataSize() - before;
+    break;
+  }
+  return true;
+}
+
 
 bool TCPSocket::SSL_Pending()
 {
@@ -22,19 +22,21 @@
 #include <licq/socketmanager.h>
 
 #include <licq/contactlist/user.h>
+#include <licq/logging/log.h>
 #include <licq/socket.h>
 #include <licq/thread/mutexlocker.h>
 
+#include "gettext.h"
+
 using Licq::INetSocket;
-using Licq::SocketHashTable;
 using Licq::SocketManager;
 using Licq::SocketSet;
 using Licq::UserId;
 using std::list;
 
-static const unsigned short SOCKET_HASH_SIZE = 128;
-
 SocketSet::SocketSet()
+  : myNextSerial(0),
+    myChangeCount(0)
 {
   FD_ZERO(&sFd);
 }
@@ -47,22 +49,28 @@ SocketSet::~SocketSet()
 void SocketSet::Set(int _nSD)
 {
   MutexLocker lock(myMutex);
-  FD_SET(_nSD, &sFd);
+  if (_nSD < FD_SETSIZE)
+    FD_SET(_nSD, &sFd);
   list<int>::iterator i = lFd.begin();
   while (i != lFd.end() && _nSD < *i)
     ++i;
   lFd.insert(i, _nSD);
+  mySerials[_nSD] = myNextSerial++;
+  ++myChangeCount;
 }
 
 void SocketSet::Clear(int _nSD)
 {
   MutexLocker lock(myMutex);
-  FD_CLR(_nSD, &sFd);
+  if (_nSD < FD_SETSIZE)
+    FD_CLR(_nSD, &sFd);
   list<int>::iterator i = lFd.begin();
   while (i != lFd.end() && *i != _nSD)
     ++i;
   if (i != lFd.end())
     lFd.erase(i);
+  mySerials.erase(_nSD);
+  ++myChangeCount;
 }
 
 unsigned short SocketSet::Num()
@@ -86,136 +94,166 @@ fd_set SocketSet::socketSet()
   return sFd;
 }
 
+SocketSet::SerialMap SocketSet::serials()
+{
+  MutexLocker lock(myMutex);
+  return mySerials;
+}
 
-SocketHashTable::SocketHashTable(unsigned short _nSize)
-  : m_vlTable(_nSize)
+unsigned long SocketSet::changeCount()
 {
-  // Empty
+  MutexLocker lock(myMutex);
+  return myChangeCount;
 }
 
-SocketHashTable::~SocketHashTable()
+
+SocketManager::SocketManager()
 {
-  // Empty
+  for (int i = 0; i < MaxPages; ++i)
+    myPages[i] = NULL;
 }
 
-INetSocket* SocketHashTable::Retrieve(int _nSd)
+SocketManager::~SocketManager()
 {
-  myMutex.lockRead();
+  for (int i = 0; i < MaxPages; ++i)
+    delete[] myPages[i];
+}
 
-  INetSocket *s = NULL;
-  list <INetSocket *> &l = m_vlTable[HashValue(_nSd)];
+SocketManager::Slot* SocketManager::slot(int sd, bool create)
+{
+  if (sd < 0 || sd >= MaxPages * SlotsPerPage)
+    return NULL;
 
-  int nSd;
-  list<INetSocket *>::iterator iter;
-  for (iter = l.begin(); iter != l.end(); ++iter)
+  Slot* page = myPages[sd / SlotsPerPage];
+  if (page == NULL && create)
   {
-    (*iter)->Lock();
-    nSd = (*iter)->Descriptor();
-    (*iter)->Unlock();
-    if (nSd == _nSd)
+    MutexLocker lock(myMutex);
+    page = myPages[sd / SlotsPerPage];
+    if (page == NULL)
     {
-      s = (*iter);
-      break;
+      page = new Slot[SlotsPerPage];
+      for (int i = 0; i < SlotsPerPage; ++i)
+      {
+        page[i].socket = NULL;
+        page[i].refs = 0;
+        page[i].closing = false;
+      }
+      // Make sure the slots are initialized before the page can be seen
+      __sync_synchronize();
+      myPages[sd / SlotsPerPage] = page;
     }
   }
-  if (iter == l.end()) s = NULL;
-
-  myMutex.unlockRead();
-  return s;
-}
-
-void SocketHashTable::Store(INetSocket *s, int _nSd)
-{
-  myMutex.lockWrite();
-  list<INetSocket *> &l = m_vlTable[HashValue(_nSd)];
-  l.push_front(s);
-  myMutex.unlockWrite();
+  if (page == NULL)
+    return NULL;
+  return &page[sd % SlotsPerPage];
 }
 
-void SocketHashTable::Remove(int _nSd)
+INetSocket* SocketManager::FetchSocket(int _nSd)
 {
-  myMutex.lockWrite();
-  list<INetSocket *> &l = m_vlTable[HashValue(_nSd)];
-  int nSd;
-  list<INetSocket *>::iterator iter;
-  for (iter = l.begin(); iter != l.end(); ++iter)
+  Slot* sl = slot(_nSd);
+  if (sl == NULL)
+    return NULL;
+
+  // Count must be increased before reading the pointer, CloseSocket() does
+  // it the other way around so either it waits for us or we see NULL
+  __sync_add_and_fetch(&sl->refs, 1);
+  INetSocket* s = sl->socket;
+  if (s == NULL)
   {
-    (*iter)->Lock();
-    nSd = (*iter)->Descriptor();
-    (*iter)->Unlock();
-    if (nSd == _nSd)
+    if (__sync_sub_and_fetch(&sl->refs, 1) == 0 && sl->closing)
     {
-      l.erase(iter);
-      break;
+      MutexLocker lock(myMutex);
+      myReleased.broadcast();
     }
+    return NULL;
   }
-  myMutex.unlockWrite();
-}
 
-unsigned short SocketHashTable::HashValue(int _nSd)
-{
-  //return _nSd % m_vlTable.size();
-  return _nSd & (unsigned long)(SOCKET_HASH_SIZE - 1);
+  s->Lock();
+  if (s->Descriptor() != _nSd)
+  {
+    // Socket was closed without being removed from the manager
+    DropSocket(s);
+    return NULL;
+  }
+  return s;
 }
 
-
-SocketManager::SocketManager()
-  : m_hSockets(SOCKET_HASH_SIZE)
+void SocketManager::DropSocket(INetSocket *s)
 {
-  // Empty
-}
+  if (s == NULL)
+    return;
 
-SocketManager::~SocketManager()
-{
-  myMutex.lock();
-  myMutex.unlock();
-}
+  s->Unlock();
+  Slot* sl = slot(s->myManagerFd);
+  if (sl == NULL)
+    return;
 
-INetSocket* SocketManager::FetchSocket(int _nSd)
-{
-  MutexLocker lock(myMutex);
-  INetSocket *s = m_hSockets.Retrieve(_nSd);
-  if (s != NULL)
-    s->Lock();
-  return s;
+  if (__sync_sub_and_fetch(&sl->refs, 1) == 0 && sl->closing)
+  {
+    // Take the mutex so the broadcast can't happen between CloseSocket()
+    // checking the count and starting to wait
+    MutexLocker lock(myMutex);
+    myReleased.broadcast();
+  }
 }
 
-void SocketManager::DropSocket(INetSocket *s)
+bool SocketManager::AddSocket(INetSocket *s)
 {
-  if (s != NULL)
-    s->Unlock();
-}
+  int sd = s->Descriptor();
+  Slot* sl = slot(sd, true);
+  if (sl == NULL)
+  {
+    gLog.error(tr("Socket descriptor %d is too large to be managed"), sd);
+    return false;
+  }
 
-void SocketManager::AddSocket(INetSocket *s)
-{
   s->Lock();
-  m_hSockets.Store(s, s->Descriptor());
-  m_sSockets.Set(s->Descriptor());
+  {
+    MutexLocker lock(myMutex);
+    s->myManagerFd = sd;
+    __sync_add_and_fetch(&sl->refs, 1);
+    sl->socket = s;
+    __sync_synchronize();
+  }
+  m_sSockets.Set(sd);
+  return true;
 }
 
 void SocketManager::CloseSocket(int nSd, bool bClearUser, bool bDelete)
 {
   // Quick check that the socket is valid
-  if (nSd == -1) return;
-
-  MutexLocker lock(myMutex);
+  if (nSd < 0) return;
 
   // Clear from the socket list
   m_sSockets.Clear(nSd);
 
-  // Fetch the actual socket
-  INetSocket *s = m_hSockets.Retrieve(nSd);
-  if (s == NULL)
+  Slot* sl = slot(nSd);
+  if (sl == NULL)
     return;
 
-  // First remove the socket from the hash table so it won't be fetched anymore
-  m_hSockets.Remove(nSd);
+  // Remove the socket from the table so it won't be fetched anymore and wait
+  // for anyone that already has it to drop it
+  INetSocket* s;
+  {
+    MutexLocker lock(myMutex);
+    s = sl->socket;
+    if (s == NULL)
+      return;
+    sl->socket = NULL;
+    sl->closing = true;
+    __sync_synchronize();
+
+    while (sl->refs > 0)
+      myReleased.wait(myMutex);
+    sl->closing = false;
+    s->myManagerFd = -1;
+  }
 
+  // A socket that was closed without being removed is not ours to delete
+  if (s->Descriptor() != nSd)
+    return;
 
-  // Now close the connection (we don't have to lock it first, because the
-  // Remove function above guarantees that no one has a lock on the socket
-  // before removing it from the hash table, and once removed from the has
-  // table, no one can get a lock again.
+  // Now close the connection, no one else can have the socket anymore
   s->CloseConnection();
 
   if (bClearUser)
@@ -39,10 +39,11 @@ LicqDaemon::Statistics LicqDaemon::gStatistics;
 Licq::Statistics& Licq::gStatistics(LicqDaemon::gStatistics);
 
 const char* const Statistics::CounterNames[Statistics::NumCounters] =
-    { tr("Events Sent"), tr("Events Received"), tr("Events Rejected"), tr("Auto Response Checked") };
+    { tr("Events Sent"), tr("Events Received"), tr("Events Rejected"), tr("Auto Response Checked"),
+      tr("Events Dropped") };
 
 const char* const Statistics::CounterTags[Statistics::NumCounters] =
-    { "Sent", "Recv", "Reject", "ARC" };
+    { "Sent", "Recv", "Reject", "ARC", "Dropped" };
 
 Statistics::Statistics()
   : myStartTime(time(NULL)),
@@ -0,0 +1,129 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../eventratelimiter.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include <licq/userid.h>
+
+using LicqDaemon::EventRateLimiter;
+using Licq::UserId;
+
+namespace LicqTest {
+
+static const unsigned long TestPpid = 0x54455354;
+static const unsigned long OtherPpid = 0x4F544852;
+
+class EventRateLimiterFixture : public ::testing::Test
+{
+public:
+  EventRateLimiter myLimiter;
+  long long myNow;
+
+  EventRateLimiterFixture() :
+    myNow(1000000)
+  {
+    // Per sender 60/min (one per second), burst 3
+    EventRateLimiter::Budget sender = { 60, 3 };
+    myLimiter.setSenderBudget(0, false, sender);
+    EventRateLimiter::Budget global = { 600, 10 };
+    myLimiter.setGlobalBudget(global);
+  }
+
+  bool admit(const UserId& userId, bool inList = false)
+  {
+    bool started;
+    return myLimiter.admit(userId, inList, myNow, started);
+  }
+
+  static UserId user(int i)
+  {
+    std::ostringstream ss;
+    ss << "user" << i;
+    return UserId(TestPpid, ss.str());
+  }
+};
+
+TEST_F(EventRateLimiterFixture, senderBurstAndRefill)
+{
+  EXPECT_TRUE(admit(user(1)));
+  EXPECT_TRUE(admit(user(1)));
+  EXPECT_TRUE(admit(user(1)));
+  EXPECT_FALSE(admit(user(1)));
+
+  // Other senders have their own bucket
+  EXPECT_TRUE(admit(user(2)));
+
+  // One token per second
+  myNow += 500;
+  EXPECT_FALSE(admit(user(1)));
+  myNow += 500;
+  EXPECT_TRUE(admit(user(1)));
+  EXPECT_FALSE(admit(user(1)));
+}
+
+TEST_F(EventRateLimiterFixture, contactsInListNotLimitedByDefault)
+{
+  for (int i = 0; i < 100; ++i)
+    EXPECT_TRUE(admit(user(1), true));
+}
+
+TEST_F(EventRateLimiterFixture, globalLimitSheds)
+{
+  bool started;
+  for (int i = 0; i < 10; ++i)
+  {
+    EXPECT_TRUE(myLimiter.admit(user(i), false, myNow, started));
+    EXPECT_FALSE(started);
+  }
+
+  EXPECT_FALSE(myLimiter.admit(user(10), false, myNow, started));
+  EXPECT_TRUE(started);
+  EXPECT_FALSE(myLimiter.admit(user(11), false, myNow, started));
+  EXPECT_FALSE(started);
+
+  // Contacts in list are not affected by the global limit
+  EXPECT_TRUE(myLimiter.admit(user(12), true, myNow, started));
+
+  // Global rate is ten per second
+  myNow += 100;
+  EXPECT_TRUE(myLimiter.admit(user(13), false, myNow, started));
+}
+
+TEST_F(EventRateLimiterFixture, protocolBudget)
+{
+  EventRateLimiter::Budget strict = { 1, 1 };
+  myLimiter.setSenderBudget(OtherPpid, false, strict);
+
+  UserId other(OtherPpid, "user1");
+  EXPECT_TRUE(admit(other));
+  EXPECT_FALSE(admit(other));
+
+  // Default budget still used for other protocols
+  EXPECT_TRUE(admit(user(1)));
+  EXPECT_TRUE(admit(user(1)));
+
+  // Slow rates must refill as well
+  myNow += 60000;
+  EXPECT_TRUE(admit(other));
+}
+
+} // namespace LicqTest
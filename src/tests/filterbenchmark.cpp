@@ -0,0 +1,169 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../filterexpression.h"
+
+#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using LicqDaemon::FilterExpression;
+using std::string;
+using std::vector;
+
+namespace LicqTest {
+
+static const int NumRules = 100;
+static const int NumMessages = 1000000;
+static const int NumDistinctMessages = 1000;
+
+/**
+ * Measures matching a stream of messages against a large set of filter
+ * rules, as the daemon does for each event from a contact not in list.
+ */
+class FilterBenchmark : public ::testing::Test
+{
+public:
+  vector<string> myExpressions;
+  vector<string> myMessages;
+  double myMs;
+
+  FilterBenchmark()
+  {
+    for (int i = 0; i < NumRules; ++i)
+    {
+      std::ostringstream ss;
+      ss << ".*(buy|cheap) pill" << i << "s? (now|today).*";
+      myExpressions.push_back(ss.str());
+    }
+
+    // Mostly normal messages, with an occasional spam that hits the last rule
+    for (int i = 0; i < NumDistinctMessages; ++i)
+    {
+      std::ostringstream ss;
+      if (i % 100 == 0)
+        ss << "Hi, buy pill" << (NumRules - 1) << "s now at example.com";
+      else
+        ss << "Hello, it was nice meeting you yesterday. See you at " << i;
+      myMessages.push_back(ss.str());
+    }
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void start()
+  {
+    myMs = now();
+  }
+
+  void report(const char* what, int messages)
+  {
+    double elapsed = now() - myMs;
+    printf("[   BENCH  ] %s: %d messages against %d rules in %.1f ms (%.3f us/message)\n",
+        what, messages, NumRules, elapsed, elapsed * 1000 / messages);
+  }
+};
+
+TEST_F(FilterBenchmark, compileEachEvent)
+{
+  // Compiling for each event is too slow to run for all messages
+  int numMessages = NumMessages / 1000;
+  int matches = 0;
+
+  start();
+  for (int m = 0; m < numMessages; ++m)
+  {
+    const string& msg = myMessages[m % myMessages.size()];
+    for (int r = 0; r < NumRules; ++r)
+    {
+      boost::regex re(myExpressions[r], boost::regex::nosubs);
+      if (boost::regex_match(msg, re))
+      {
+        ++matches;
+        break;
+      }
+    }
+  }
+  report("compile each event", numMessages);
+  EXPECT_EQ(numMessages / 100, matches);
+}
+
+TEST_F(FilterBenchmark, compiledNoPrefilter)
+{
+  vector<boost::shared_ptr<boost::regex> > rules;
+  for (int r = 0; r < NumRules; ++r)
+    rules.push_back(boost::shared_ptr<boost::regex>(
+        new boost::regex(myExpressions[r], boost::regex::nosubs)));
+  int numMessages = NumMessages / 10;
+  int matches = 0;
+
+  start();
+  for (int m = 0; m < numMessages; ++m)
+  {
+    const string& msg = myMessages[m % myMessages.size()];
+    for (int r = 0; r < NumRules; ++r)
+    {
+      if (boost::regex_match(msg, *rules[r]))
+      {
+        ++matches;
+        break;
+      }
+    }
+  }
+  report("compiled", numMessages);
+  EXPECT_EQ(numMessages / 100, matches);
+}
+
+TEST_F(FilterBenchmark, compiledWithPrefilter)
+{
+  vector<boost::shared_ptr<FilterExpression> > rules;
+  for (int r = 0; r < NumRules; ++r)
+    rules.push_back(boost::shared_ptr<FilterExpression>(
+        new FilterExpression(myExpressions[r])));
+  ASSERT_FALSE(rules[0]->literal().empty());
+  int matches = 0;
+
+  start();
+  for (int m = 0; m < NumMessages; ++m)
+  {
+    const string& msg = myMessages[m % myMessages.size()];
+    for (int r = 0; r < NumRules; ++r)
+    {
+      if (rules[r]->match(msg))
+      {
+        ++matches;
+        break;
+      }
+    }
+  }
+  report("compiled with prefilter", NumMessages);
+  EXPECT_EQ(NumMessages / 100, matches);
+}
+
+} // namespace LicqTest
@@ -0,0 +1,95 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../filterexpression.h"
+
+#include <boost/regex.hpp>
+#include <gtest/gtest.h>
+
+using LicqDaemon::FilterExpression;
+
+namespace LicqTest {
+
+TEST(FilterExpression, requiredLiteral)
+{
+  EXPECT_EQ("http://", FilterExpression::requiredLiteral(".*http://.*"));
+  EXPECT_EQ("abc", FilterExpression::requiredLiteral("abc"));
+  EXPECT_EQ("hello", FilterExpression::requiredLiteral("hello?.*hello"));
+  EXPECT_EQ("ab", FilterExpression::requiredLiteral("ab+c*"));
+  EXPECT_EQ("spam", FilterExpression::requiredLiteral("x{2,3}spam[0-9]+"));
+  EXPECT_EQ("a.b", FilterExpression::requiredLiteral("a\\.b\\d"));
+  EXPECT_EQ(" =)", FilterExpression::requiredLiteral("(foo|bar)? =\\)"));
+  EXPECT_EQ("end", FilterExpression::requiredLiteral("[]|(]*end"));
+
+  // Nothing can be said about these
+  EXPECT_EQ("", FilterExpression::requiredLiteral(""));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("foo|bar"));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("(?i)hello"));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("\\Qa.b\\E"));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("a*"));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("\\x41BC"));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("\\pLzz"));
+  EXPECT_EQ("", FilterExpression::requiredLiteral("[\\c]]abc"));
+}
+
+TEST(FilterExpression, escapesWithArguments)
+{
+  // Prefilter must not change the result compared to only using the regex
+  const char* const tests[][2] = {
+    { "\\x41BC", "ABC" },
+    { "\\cIab", "\tab" },
+    { "\\0101", "A" },
+    { "\\pLzz", "azz" },
+  };
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+  {
+    FilterExpression expr(tests[i][0]);
+    boost::regex regex(tests[i][0]);
+    ASSERT_TRUE(expr.isValid()) << tests[i][0];
+    EXPECT_TRUE(boost::regex_match(tests[i][1], regex)) << tests[i][0];
+    EXPECT_EQ(boost::regex_match(tests[i][1], regex), expr.match(tests[i][1]))
+        << tests[i][0];
+  }
+}
+
+TEST(FilterExpression, match)
+{
+  FilterExpression all("");
+  EXPECT_TRUE(all.isValid());
+  EXPECT_TRUE(all.match(""));
+  EXPECT_TRUE(all.match("anything"));
+
+  FilterExpression url(".*http://.*");
+  EXPECT_TRUE(url.isValid());
+  EXPECT_EQ("http://", url.literal());
+  EXPECT_TRUE(url.match("visit http://example.com now"));
+  EXPECT_FALSE(url.match("visit example.com now"));
+
+  // Expression must match entire message
+  FilterExpression word("spam");
+  EXPECT_TRUE(word.match("spam"));
+  EXPECT_FALSE(word.match("more spam"));
+
+  FilterExpression invalid("(unclosed");
+  EXPECT_FALSE(invalid.isValid());
+  EXPECT_FALSE(invalid.match("(unclosed"));
+}
+
+} // namespace LicqTest
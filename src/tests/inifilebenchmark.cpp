@@ -0,0 +1,191 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <licq/inifile.h>
+
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Licq::IniFile;
+using std::string;
+using std::vector;
+
+namespace LicqTest {
+
+static const int NumKeys = 10000;
+static const int NumSections = 100;
+
+/**
+ * Measures access to a large configuration, similar to loading a user file
+ * with many parameters or a configuration with many sections.
+ */
+class IniFileBenchmark : public ::testing::Test
+{
+public:
+  vector<string> myKeys;
+  string myConfig;
+  double myMs;
+
+  IniFileBenchmark()
+  {
+    std::ostringstream config;
+    for (int s = 0; s < NumSections; ++s)
+    {
+      config << "[Section" << s << "]\n# Comment for section " << s << "\n";
+      for (int k = 0; k < NumKeys / NumSections; ++k)
+      {
+        std::ostringstream key;
+        key << "Key" << s << "." << k;
+        myKeys.push_back(key.str());
+        config << key.str() << "=Value " << k << "\n";
+      }
+      config << "\n";
+    }
+    myConfig = config.str();
+  }
+
+  static string sectionOf(const string& key)
+  {
+    return "Section" + key.substr(3, key.find('.') - 3);
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void start()
+  {
+    myMs = now();
+  }
+
+  void report(const char* what, int operations)
+  {
+    double elapsed = now() - myMs;
+    printf("[   BENCH  ] %s: %d operations on %d keys in %.1f ms (%.3f us/operation)\n",
+        what, operations, NumKeys, elapsed, elapsed * 1000 / operations);
+  }
+};
+
+TEST_F(IniFileBenchmark, load)
+{
+  IniFile ini;
+  int numLoads = 20;
+
+  start();
+  for (int i = 0; i < numLoads; ++i)
+    ini.loadRawConfiguration(myConfig);
+  report("load", numLoads);
+
+  EXPECT_EQ(myConfig, ini.getRawConfiguration());
+}
+
+TEST_F(IniFileBenchmark, flatStringLookup)
+{
+  // Reference: searching the raw text as the configuration used to be stored
+  string data = "\n" + myConfig;
+  int found = 0;
+
+  start();
+  for (int i = 0; i < NumKeys; ++i)
+  {
+    const string& key = myKeys[i];
+    string::size_type sectionStart = data.find("\n[" + sectionOf(key) + "]");
+    string::size_type pos = data.find('\n' + key + '=', sectionStart);
+    if (pos != string::npos)
+      ++found;
+  }
+  report("flat string lookup", NumKeys);
+  EXPECT_EQ(NumKeys, found);
+}
+
+TEST_F(IniFileBenchmark, get)
+{
+  IniFile ini;
+  ini.loadRawConfiguration(myConfig);
+  int rounds = 100;
+  int found = 0;
+
+  start();
+  for (int r = 0; r < rounds; ++r)
+  {
+    for (int i = 0; i < NumKeys; ++i)
+    {
+      const string& key = myKeys[i];
+      ini.setSection(sectionOf(key), false);
+      string value;
+      if (ini.get(key, value))
+        ++found;
+    }
+  }
+  report("section and get", rounds * NumKeys);
+  EXPECT_EQ(rounds * NumKeys, found);
+}
+
+TEST_F(IniFileBenchmark, setAndSerialize)
+{
+  IniFile ini;
+  ini.loadRawConfiguration(myConfig);
+  int rounds = 10;
+
+  start();
+  for (int r = 0; r < rounds; ++r)
+  {
+    for (int i = 0; i < NumKeys; ++i)
+    {
+      const string& key = myKeys[i];
+      ini.setSection(sectionOf(key), false);
+      ini.set(key, r);
+    }
+  }
+  report("set", rounds * NumKeys);
+
+  int numSerialize = 20;
+  start();
+  for (int i = 0; i < numSerialize; ++i)
+    ini.getRawConfiguration();
+  report("serialize", numSerialize);
+
+  ini.setSection("Section0", false);
+  unsigned value;
+  EXPECT_TRUE(ini.get("Key0.0", value));
+  EXPECT_EQ(static_cast<unsigned>(rounds - 1), value);
+}
+
+TEST_F(IniFileBenchmark, addKeys)
+{
+  IniFile ini;
+  ini.setSection("Section", true);
+
+  start();
+  for (int i = 0; i < NumKeys; ++i)
+    ini.set(myKeys[i], i);
+  report("add keys", NumKeys);
+
+  std::list<string> keys;
+  ini.getKeyList(keys);
+  EXPECT_EQ(static_cast<size_t>(NumKeys), keys.size());
+}
+
+} // namespace LicqTest
@@ -28,6 +28,7 @@ class LogDummy : public Licq::Log
 {
 public:
   // Licq::Log
+  bool isLogging(Level /*level*/) const { return false; }
   void log(Level /*level*/, const std::string& /*msg*/) {}
   void packet(Level /*level*/, const uint8_t* /*data*/, size_t /*size*/,
               const std::string& /*msg*/) {}
@@ -37,7 +38,7 @@ public:
 
 Licq::ThreadLog Licq::gLog;
 
-Licq::Log* Licq::ThreadLog::getLog()
+Licq::Log* Licq::ThreadLog::getLog() const
 {
   static LicqTest::LogDummy log;
   return &log;
@@ -0,0 +1,160 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <licq/mainloop.h>
+
+#include <licq/pipe.h>
+
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+using Licq::MainLoop;
+using Licq::Pipe;
+
+namespace LicqTest {
+
+static const int NumIdle = 10000;
+static const int NumWakeups = 2000;
+static const int TimeoutId = 1;
+
+/**
+ * Measures the cost of a main loop wakeup with a large number of idle files
+ * and timeouts registered, as the daemon would have with many contacts
+ * connected directly.
+ */
+class MainLoopBenchmark : public ::testing::TestWithParam<MainLoop::Backend>,
+                          public Licq::MainLoopCallback
+{
+public:
+  MainLoop myMainLoop;
+  Pipe myIdlePipe;
+  Pipe myWakeupPipe;
+  std::vector<int> myIdleFds;
+  int myWakeups;
+  double myMs;
+
+  MainLoopBenchmark() :
+    myMainLoop(GetParam()),
+    myWakeups(0)
+  {
+    // Need two fds per idle file, make sure we're allowed to have them
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+
+    int numIdle = NumIdle;
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < NumIdle + 100u)
+      numIdle = limit.rlim_cur - 100;
+
+    // Duplicates of a pipe nobody writes to will never become ready
+    for (int i = 0; i < numIdle; ++i)
+    {
+      int fd = dup(myIdlePipe.getReadFd());
+      if (fd == -1)
+        break;
+      myIdleFds.push_back(fd);
+      myMainLoop.addRawFile(fd, this);
+      myMainLoop.addTimeout(3600000, this, TimeoutId + 1 + i);
+    }
+  }
+
+  ~MainLoopBenchmark()
+  {
+    for (size_t i = 0; i < myIdleFds.size(); ++i)
+    {
+      myMainLoop.removeRawFile(myIdleFds[i]);
+      close(myIdleFds[i]);
+    }
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void start()
+  {
+    myMs = now();
+  }
+
+  void report(const char* what)
+  {
+    double elapsed = now() - myMs;
+    printf("[   BENCH  ] %s %s: %d wakeups with %zu idle files in %.1f ms (%.2f us/wakeup)\n",
+        (myMainLoop.backend() == MainLoop::BackendEpoll ? "epoll" : "poll"),
+        what, myWakeups, myIdleFds.size(), elapsed, elapsed * 1000 / myWakeups);
+  }
+
+  // From Licq::MainLoopCallback
+  void rawFileEvent(int fd, int /* revents */)
+  {
+    char c;
+    if (read(fd, &c, 1) != 1)
+      return;
+    if (++myWakeups == NumWakeups)
+      myMainLoop.quit();
+    else
+      myWakeupPipe.putChar(c);
+  }
+
+  void timeoutEvent(int /* id */)
+  {
+    if (++myWakeups == NumWakeups)
+      myMainLoop.quit();
+    else
+      myMainLoop.addTimeout(0, this, TimeoutId);
+  }
+};
+
+TEST_P(MainLoopBenchmark, fileWakeup)
+{
+  myMainLoop.addRawFile(myWakeupPipe.getReadFd(), this);
+  myWakeupPipe.putChar('x');
+
+  start();
+  myMainLoop.run();
+  report("file");
+  EXPECT_EQ(NumWakeups, myWakeups);
+
+  myMainLoop.removeRawFile(myWakeupPipe.getReadFd());
+}
+
+TEST_P(MainLoopBenchmark, timeoutWakeup)
+{
+  myMainLoop.addTimeout(0, this, TimeoutId);
+
+  start();
+  myMainLoop.run();
+  report("timeout");
+  EXPECT_EQ(NumWakeups, myWakeups);
+}
+
+INSTANTIATE_TEST_CASE_P(backends, MainLoopBenchmark,
+                        ::testing::Values(MainLoop::BackendPoll,
+                                          MainLoop::BackendEpoll));
+
+} // namespace LicqTest
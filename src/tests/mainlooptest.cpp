@@ -0,0 +1,294 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <licq/mainloop.h>
+
+#include <licq/buffer.h>
+#include <licq/pipe.h>
+#include <licq/socket.h>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Licq::MainLoop;
+using Licq::Pipe;
+
+namespace LicqTest {
+
+class MainLoopFixture : public ::testing::TestWithParam<MainLoop::Backend>,
+                        public Licq::MainLoopCallback
+{
+public:
+  MainLoop myMainLoop;
+  std::string myEvents;
+  int myStopAfter;
+  int myRemoveId;
+  int myReaddId;
+
+  MainLoopFixture() :
+    myMainLoop(GetParam()),
+    myStopAfter(-1),
+    myRemoveId(-1),
+    myReaddId(-1)
+  {
+    // Empty
+  }
+
+  void addEvent(char c)
+  {
+    myEvents += c;
+    if (myStopAfter > 0 && --myStopAfter == 0)
+      myMainLoop.quit();
+  }
+
+  // From Licq::MainLoopCallback
+  void rawFileEvent(int fd, int revents)
+  {
+    if (revents & POLLIN)
+    {
+      char c;
+      if (read(fd, &c, 1) == 1)
+        addEvent(c);
+      else
+        addEvent('r');
+    }
+  }
+
+  void socketEvent(Licq::INetSocket* /*inetSocket*/, int /*revents*/)
+  {
+    addEvent('s');
+  }
+
+  void timeoutEvent(int id)
+  {
+    if (myRemoveId != -1)
+      myMainLoop.removeTimeout(myRemoveId);
+    if (myReaddId == id)
+    {
+      myReaddId = -1;
+      myMainLoop.addTimeout(1, this, id);
+    }
+    addEvent('0' + id);
+  }
+};
+
+TEST_P(MainLoopFixture, backend)
+{
+#ifdef __linux__
+  EXPECT_EQ(GetParam(), myMainLoop.backend());
+#else
+  EXPECT_EQ(MainLoop::BackendPoll, myMainLoop.backend());
+#endif
+}
+
+TEST_P(MainLoopFixture, rawFile)
+{
+  Pipe pipe1, pipe2;
+  myMainLoop.addRawFile(pipe1.getReadFd(), this);
+  myMainLoop.addRawFile(pipe2.getReadFd(), this);
+
+  pipe2.putChar('b');
+  myStopAfter = 1;
+  myMainLoop.run();
+  EXPECT_EQ("b", myEvents);
+
+  myMainLoop.removeRawFile(pipe2.getReadFd());
+  pipe2.putChar('x');
+  pipe1.putChar('a');
+  myStopAfter = 1;
+  myMainLoop.run();
+  EXPECT_EQ("ba", myEvents);
+}
+
+TEST_P(MainLoopFixture, regularFileIsAlwaysReady)
+{
+  char name[] = "/tmp/licqmainlooptestXXXXXX";
+  int fd = mkstemp(name);
+  ASSERT_NE(-1, fd);
+  unlink(name);
+  EXPECT_EQ(1, write(fd, "f", 1));
+  lseek(fd, 0, SEEK_SET);
+
+  myMainLoop.addRawFile(fd, this);
+  myStopAfter = 2;
+  myMainLoop.run();
+  EXPECT_EQ("fr", myEvents);
+
+  myMainLoop.removeRawFile(fd);
+  close(fd);
+}
+
+TEST_P(MainLoopFixture, timeoutsInOrder)
+{
+  myMainLoop.addTimeout(30, this, 3);
+  myMainLoop.addTimeout(10, this, 1);
+  myMainLoop.addTimeout(20, this, 2);
+  myStopAfter = 3;
+  myMainLoop.run();
+  EXPECT_EQ("123", myEvents);
+}
+
+TEST_P(MainLoopFixture, repeatingTimeout)
+{
+  myMainLoop.addTimeout(5, this, 1, false);
+  myMainLoop.addTimeout(22, this, 2);
+  myStopAfter = 5;
+  myMainLoop.run();
+  EXPECT_EQ("11112", myEvents);
+}
+
+TEST_P(MainLoopFixture, removeTimeout)
+{
+  myMainLoop.addTimeout(10, this, 1);
+  myMainLoop.addTimeout(20, this, 2);
+  myMainLoop.addTimeout(30, this, 3);
+  myMainLoop.removeTimeout(2);
+  myStopAfter = 2;
+  myMainLoop.run();
+  EXPECT_EQ("13", myEvents);
+}
+
+TEST_P(MainLoopFixture, removeTimeoutFromCallback)
+{
+  // Both expire in the same iteration, first one removes the other
+  myMainLoop.addTimeout(0, this, 1);
+  myMainLoop.addTimeout(0, this, 2);
+  myMainLoop.addTimeout(20, this, 3);
+  myRemoveId = 2;
+  myStopAfter = 2;
+  myMainLoop.run();
+  EXPECT_EQ("13", myEvents);
+}
+
+TEST_P(MainLoopFixture, readdTimeoutFromCallback)
+{
+  myMainLoop.addTimeout(1, this, 1);
+  myReaddId = 1;
+  myStopAfter = 2;
+  myMainLoop.run();
+  EXPECT_EQ("11", myEvents);
+}
+
+TEST_P(MainLoopFixture, removeCallback)
+{
+  Pipe pipe;
+  myMainLoop.addRawFile(pipe.getReadFd(), this);
+  myMainLoop.addTimeout(1, this, 1);
+  myMainLoop.removeCallback(this);
+
+  pipe.putChar('x');
+  myMainLoop.addTimeout(10, this, 2);
+  myStopAfter = 1;
+  myMainLoop.run();
+  EXPECT_EQ("2", myEvents);
+}
+
+TEST_P(MainLoopFixture, refuseFileThatCannotBeMonitored)
+{
+  if (myMainLoop.backend() != MainLoop::BackendEpoll)
+    return;
+
+  // A closed descriptor must not be treated as always ready
+  Pipe pipe;
+  int fd = dup(pipe.getReadFd());
+  close(fd);
+  myMainLoop.addRawFile(fd, this);
+  myMainLoop.addTimeout(20, this, 1);
+  myStopAfter = 1;
+  myMainLoop.run();
+  EXPECT_EQ("1", myEvents);
+}
+
+/// TCPSocket on an existing descriptor
+class QueueTestSocket : public Licq::TCPSocket
+{
+public:
+  QueueTestSocket(int fd) { myDescriptor = fd; }
+};
+
+/// Reads everything from a socket and stops loop after expected amount
+class QueueTestReader : public Licq::MainLoopCallback
+{
+public:
+  QueueTestReader(MainLoop& mainLoop, size_t expected) :
+    myMainLoop(mainLoop), myExpected(expected), myReceived(0)
+  { }
+
+  void rawFileEvent(int fd, int /*revents*/)
+  {
+    char buf[4096];
+    ssize_t ret = read(fd, buf, sizeof(buf));
+    if (ret > 0)
+      myReceived += ret;
+    if (ret <= 0 || myReceived >= myExpected)
+      myMainLoop.quit();
+  }
+
+  void timeoutEvent(int /*id*/)
+  {
+    myMainLoop.quit();
+  }
+
+  MainLoop& myMainLoop;
+  size_t myExpected;
+  size_t myReceived;
+};
+
+TEST_P(MainLoopFixture, flushSendQueue)
+{
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  int bufSize = 4096;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+
+  QueueTestSocket* sock = new QueueTestSocket(fds[0]);
+  sock->setSendQueueLimit(1024*1024);
+  myMainLoop.addSocket(sock, this);
+
+  // Socket is added before data is queued so loop must be told about it
+  const size_t size = 256*1024;
+  Licq::Buffer buf(size);
+  buf.packRaw(std::string(size, 'q'));
+  ASSERT_TRUE(sock->send(buf));
+  EXPECT_GT(sock->sendQueueSize(), 0u);
+
+  QueueTestReader reader(myMainLoop, size);
+  myMainLoop.addRawFile(fds[1], &reader);
+  myMainLoop.addTimeout(5000, &reader, 1);
+  myMainLoop.run();
+
+  EXPECT_EQ(size, reader.myReceived);
+  EXPECT_EQ(0u, sock->sendQueueSize());
+  EXPECT_EQ("", myEvents);
+
+  myMainLoop.removeCallback(&reader);
+  myMainLoop.removeSocket(sock);
+  delete sock;
+  close(fds[1]);
+}
+
+INSTANTIATE_TEST_CASE_P(backends, MainLoopFixture,
+                        ::testing::Values(MainLoop::BackendPoll,
+                                          MainLoop::BackendEpoll));
+
+} // namespace LicqTest
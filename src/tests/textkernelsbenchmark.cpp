@@ -0,0 +1,271 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../textkernels.h"
+
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <iconv.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+namespace TextKernels = LicqDaemon::TextKernels;
+
+namespace LicqTest {
+
+static const int NumMessages = 20000;
+static const int NumRounds = 50;
+
+/**
+ * Measures throughput of the text kernels against the implementations they
+ * replaced, on message sized texts with a few lines each.
+ */
+class TextKernelsBenchmark : public ::testing::Test
+{
+public:
+  vector<string> myMessages;
+  vector<string> myDosMessages;
+  vector<string> myUtf16Messages;
+  size_t myBytes;
+  double myMs;
+
+  TextKernelsBenchmark()
+  {
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      std::ostringstream ss;
+      ss << "Hello,\nit was nice meeting you yesterday. Are you coming to the "
+          << "party on Saturday?\nIt starts at " << (i % 24) << " o'clock.\n"
+          << "See you there!\n";
+      string msg = ss.str();
+      myMessages.push_back(msg);
+
+      string dos;
+      TextKernels::toDos(msg.data(), msg.size(), dos);
+      myDosMessages.push_back(dos);
+
+      string utf16;
+      for (size_t j = 0; j < msg.size(); ++j)
+      {
+        utf16 += '\0';
+        utf16 += msg[j];
+      }
+      myUtf16Messages.push_back(utf16);
+    }
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void start()
+  {
+    myBytes = 0;
+    myMs = now();
+  }
+
+  void report(const char* what)
+  {
+    double elapsed = now() - myMs;
+    printf("[   BENCH  ] %s: %lu bytes in %.1f ms (%.1f MB/s)\n",
+        what, static_cast<unsigned long>(myBytes), elapsed,
+        myBytes / 1000.0 / elapsed);
+  }
+
+  // Implementations from Translator before the kernels were added
+
+  static bool oldIsAscii(const string& s)
+  {
+    for (size_t i = 0; i < s.size(); ++i)
+      if ((unsigned char)s[i] >= 0x80)
+        return false;
+    return true;
+  }
+
+  static string oldReturnToDos(const string& s)
+  {
+    string ret = s;
+    size_t pos = 0;
+    while ((pos = ret.find('\n', pos)) != string::npos)
+    {
+      if (pos+1 == ret.size() || ret[pos+1] != '\r')
+        ret.insert(pos+1, "\r");
+      ++pos;
+    }
+    return ret;
+  }
+
+  static string oldReturnToUnix(const string& s)
+  {
+    string ret = s;
+    size_t pos = 0;
+    while ((pos = ret.find("\n\r", pos)) != string::npos)
+      ret.replace(pos++, 2, "\n");
+    while ((pos = ret.find('\r')) != string::npos)
+      ret.replace(pos, 1, "\n");
+    return ret;
+  }
+};
+
+TEST_F(TextKernelsBenchmark, isAscii)
+{
+  int count = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      count += oldIsAscii(myMessages[i]);
+      myBytes += myMessages[i].size();
+    }
+  report("isAscii, byte loop");
+  EXPECT_EQ(NumRounds * NumMessages, count);
+
+  count = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      count += TextKernels::isAscii(myMessages[i].data(), myMessages[i].size());
+      myBytes += myMessages[i].size();
+    }
+  report("isAscii, kernel");
+  EXPECT_EQ(NumRounds * NumMessages, count);
+
+  count = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      count += TextKernels::isValidUtf8(myMessages[i].data(), myMessages[i].size());
+      myBytes += myMessages[i].size();
+    }
+  report("isValidUtf8, kernel");
+  EXPECT_EQ(NumRounds * NumMessages, count);
+}
+
+TEST_F(TextKernelsBenchmark, returnToDos)
+{
+  size_t size = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      size += oldReturnToDos(myMessages[i]).size();
+      myBytes += myMessages[i].size();
+    }
+  report("returnToDos, string insert");
+
+  size_t newSize = 0;
+  string out;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      TextKernels::toDos(myMessages[i].data(), myMessages[i].size(), out);
+      newSize += out.size();
+      myBytes += myMessages[i].size();
+    }
+  report("returnToDos, kernel");
+  EXPECT_EQ(size, newSize);
+}
+
+TEST_F(TextKernelsBenchmark, returnToUnix)
+{
+  size_t size = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      size += oldReturnToUnix(myDosMessages[i]).size();
+      myBytes += myDosMessages[i].size();
+    }
+  report("returnToUnix, string replace");
+
+  size_t newSize = 0;
+  string s;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      s = myDosMessages[i];
+      TextKernels::toUnix(s);
+      newSize += s.size();
+      myBytes += myDosMessages[i].size();
+    }
+  report("returnToUnix, kernel with copy");
+  EXPECT_EQ(size, newSize);
+
+  // Received messages usually have no CR at all
+  newSize = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      TextKernels::toUnix(myMessages[i]);
+      newSize += myMessages[i].size();
+      myBytes += myMessages[i].size();
+    }
+  report("returnToUnix, kernel in place without CR");
+}
+
+TEST_F(TextKernelsBenchmark, utf16ToUtf8)
+{
+  iconv_t cd = iconv_open("UTF-8", "UCS-2BE");
+  ASSERT_NE((iconv_t)(-1), cd);
+  size_t size = 0;
+  string out;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      const string& s = myUtf16Messages[i];
+      out.resize(s.size() * 2);
+      char* inPtr = const_cast<char*>(s.data());
+      size_t inLen = s.size();
+      char* outPtr = &out[0];
+      size_t outLen = out.size();
+      iconv(cd, &inPtr, &inLen, &outPtr, &outLen);
+      size += out.size() - outLen;
+      myBytes += s.size();
+    }
+  report("UCS-2BE to UTF-8, iconv");
+  iconv_close(cd);
+
+  size_t newSize = 0;
+  start();
+  for (int r = 0; r < NumRounds; ++r)
+    for (int i = 0; i < NumMessages; ++i)
+    {
+      const string& s = myUtf16Messages[i];
+      TextKernels::utf16beToUtf8(s.data(), s.size(), out);
+      newSize += out.size();
+      myBytes += s.size();
+    }
+  report("UCS-2BE to UTF-8, kernel");
+  EXPECT_EQ(size, newSize);
+}
+
+} // namespace LicqTest
@@ -0,0 +1,207 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "../textkernels.h"
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <iconv.h>
+#include <string>
+
+using std::string;
+namespace TextKernels = LicqDaemon::TextKernels;
+
+namespace LicqTest {
+
+// Implementations from Translator before the kernels were added
+static string oldReturnToDos(const string& s)
+{
+  string ret = s;
+  size_t pos = 0;
+  while ((pos = ret.find('\n', pos)) != string::npos)
+  {
+    if (pos+1 == ret.size() || ret[pos+1] != '\r')
+      ret.insert(pos+1, "\r");
+    ++pos;
+  }
+  return ret;
+}
+
+static string oldReturnToUnix(const string& s)
+{
+  string ret = s;
+  size_t pos = 0;
+  while ((pos = ret.find("\n\r", pos)) != string::npos)
+    ret.replace(pos++, 2, "\n");
+  while ((pos = ret.find('\r')) != string::npos)
+    ret.replace(pos, 1, "\n");
+  return ret;
+}
+
+static string toUnix(const string& s)
+{
+  string ret = s;
+  TextKernels::toUnix(ret);
+  return ret;
+}
+
+static string toDos(const string& s)
+{
+  string ret = "old contents";
+  TextKernels::toDos(s.data(), s.size(), ret);
+  return ret;
+}
+
+static bool isAscii(const string& s)
+{
+  return TextKernels::isAscii(s.data(), s.size());
+}
+
+static bool isUtf8(const string& s)
+{
+  return TextKernels::isValidUtf8(s.data(), s.size());
+}
+
+TEST(TextKernels, asciiPrefix)
+{
+  EXPECT_TRUE(isAscii(""));
+  EXPECT_TRUE(isAscii("Hello world"));
+
+  // Check each position in and around the vector blocks
+  for (size_t size = 1; size < 70; ++size)
+  {
+    string s(size, 'a');
+    EXPECT_TRUE(isAscii(s));
+    for (size_t i = 0; i < size; ++i)
+    {
+      string t = s;
+      t[i] = '\x80';
+      EXPECT_EQ(i, TextKernels::asciiPrefix(t.data(), t.size()));
+      t[i] = '\xFF';
+      EXPECT_FALSE(isAscii(t));
+    }
+  }
+}
+
+TEST(TextKernels, validUtf8)
+{
+  EXPECT_TRUE(isUtf8(""));
+  EXPECT_TRUE(isUtf8("plain"));
+  EXPECT_TRUE(isUtf8("\xC3\xA5\xC3\xA4\xC3\xB6"));
+  EXPECT_TRUE(isUtf8("\xE2\x82\xAC"));
+  EXPECT_TRUE(isUtf8("\xF0\x9F\x98\x80"));
+  EXPECT_TRUE(isUtf8("\xF4\x8F\xBF\xBF"));
+  EXPECT_TRUE(isUtf8(string(40, 'x') + "\xC3\xA5" + string(40, 'y')));
+}
+
+TEST(TextKernels, invalidUtf8)
+{
+  EXPECT_FALSE(isUtf8("\x80"));
+  EXPECT_FALSE(isUtf8("\xE5\xE4\xF6"));
+  EXPECT_FALSE(isUtf8("\xC3"));
+  EXPECT_FALSE(isUtf8("\xC3\x28"));
+  EXPECT_FALSE(isUtf8("\xC0\xAF")); // Overlong
+  EXPECT_FALSE(isUtf8("\xE0\x80\xAF")); // Overlong
+  EXPECT_FALSE(isUtf8("\xED\xA0\x80")); // Surrogate
+  EXPECT_FALSE(isUtf8("\xF4\x90\x80\x80")); // Above U+10FFFF
+  EXPECT_FALSE(isUtf8("\xF8\x88\x80\x80\x80"));
+  EXPECT_FALSE(isUtf8(string(40, 'x') + "\xE2\x82"));
+}
+
+TEST(TextKernels, lineBreaks)
+{
+  EXPECT_EQ("", toDos(""));
+  EXPECT_EQ("a\n\rb\n\r", toDos("a\nb\n"));
+  EXPECT_EQ("a\n\rb", toDos("a\n\rb"));
+  EXPECT_EQ("", toUnix(""));
+  EXPECT_EQ("a\nb", toUnix("a\n\rb"));
+  EXPECT_EQ("a\nb", toUnix("a\rb"));
+  EXPECT_EQ("\n\n", toUnix("\n\r\r"));
+}
+
+TEST(TextKernels, lineBreaksMatchOldImplementation)
+{
+  // Random strings with lots of line breaks
+  const char chars[] = "ab\r\n";
+  srand(1);
+  for (int n = 0; n < 10000; ++n)
+  {
+    string s;
+    size_t size = rand() % 40;
+    for (size_t i = 0; i < size; ++i)
+      s += chars[rand() % 4];
+
+    EXPECT_EQ(oldReturnToDos(s), toDos(s));
+    EXPECT_EQ(oldReturnToUnix(s), toUnix(s));
+  }
+}
+
+TEST(TextKernels, utf16)
+{
+  string out = "old contents";
+  EXPECT_TRUE(TextKernels::utf16beToUtf8("", 0, out));
+  EXPECT_EQ("", out);
+
+  EXPECT_TRUE(TextKernels::utf16beToUtf8("\0H\0i\0\xE5\x20\xAC", 8, out));
+  EXPECT_EQ("Hi\xC3\xA5\xE2\x82\xAC", out);
+
+  // Surrogates and odd sizes must be left to iconv
+  EXPECT_FALSE(TextKernels::utf16beToUtf8("\xD8\x3D\xDE\x00", 4, out));
+  EXPECT_FALSE(TextKernels::utf16beToUtf8("\0H\0", 3, out));
+}
+
+TEST(TextKernels, utf16MatchesIconv)
+{
+  // Mix of ASCII runs and other characters at different positions
+  iconv_t cd = iconv_open("UTF-8", "UCS-2BE");
+  ASSERT_NE((iconv_t)(-1), cd);
+  srand(2);
+  for (int n = 0; n < 2000; ++n)
+  {
+    string s;
+    size_t size = rand() % 40;
+    for (size_t i = 0; i < size; ++i)
+    {
+      unsigned c;
+      switch (rand() % 4)
+      {
+        case 0: c = 0x80 + rand() % 0x780; break;
+        case 1: c = 0xE000 + rand() % 0x2000; break;
+        default: c = 0x20 + rand() % 0x60; break;
+      }
+      s += static_cast<char>(c >> 8);
+      s += static_cast<char>(c & 0xFF);
+    }
+
+    string expected(size * 3 + 1, '\0');
+    char* inPtr = const_cast<char*>(s.data());
+    size_t inLen = s.size();
+    char* outPtr = &expected[0];
+    size_t outLen = expected.size();
+    ASSERT_NE((size_t)(-1), iconv(cd, &inPtr, &inLen, &outPtr, &outLen));
+    expected.resize(expected.size() - outLen);
+
+    string out;
+    EXPECT_TRUE(TextKernels::utf16beToUtf8(s.data(), s.size(), out));
+    EXPECT_EQ(expected, out);
+  }
+  iconv_close(cd);
+}
+
+} // namespace LicqTest
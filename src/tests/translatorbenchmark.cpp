@@ -0,0 +1,132 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <licq/translator.h>
+
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <iconv.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Licq::gTranslator;
+using std::string;
+using std::vector;
+
+namespace LicqTest {
+
+static const int NumStrings = 1000000;
+static const int NumDistinctStrings = 1000;
+
+/**
+ * Measures converting short strings, like message texts and user info
+ * fields received from protocols, to UTF-8.
+ */
+class TranslatorBenchmark : public ::testing::Test
+{
+public:
+  vector<string> myAscii;
+  vector<string> myLatin1;
+  double myMs;
+
+  TranslatorBenchmark()
+  {
+    for (int i = 0; i < NumDistinctStrings; ++i)
+    {
+      std::ostringstream ss;
+      ss << "See you at " << i;
+      myAscii.push_back(ss.str());
+      myLatin1.push_back(ss.str() + " p\xE5 caf\xE9");
+    }
+  }
+
+  /// Conversion as it was done before descriptors were kept
+  static string openEachTime(const string& s)
+  {
+    size_t inLen = s.size();
+    size_t outLen = inLen * 2;
+    string result(outLen, '\0');
+    char* outPtr = &result[0];
+    iconv_t cd = iconv_open("UTF-8", "ISO-8859-1");
+    char* inPtr = const_cast<char*>(s.data());
+    iconv(cd, &inPtr, &inLen, &outPtr, &outLen);
+    iconv_close(cd);
+    result.resize(result.size() - outLen);
+    return result;
+  }
+
+  static double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
+
+  void start()
+  {
+    myMs = now();
+  }
+
+  void report(const char* what, int strings)
+  {
+    double elapsed = now() - myMs;
+    printf("[   BENCH  ] %s: %d strings in %.1f ms (%.3f us/string)\n",
+        what, strings, elapsed, elapsed * 1000 / strings);
+  }
+};
+
+TEST_F(TranslatorBenchmark, openEachTime)
+{
+  // Opening a descriptor for each string is too slow to run for all strings
+  int numStrings = NumStrings / 10;
+  size_t size = 0;
+
+  start();
+  for (int i = 0; i < numStrings; ++i)
+    size += openEachTime(myLatin1[i % NumDistinctStrings]).size();
+  report("open for each string", numStrings);
+  EXPECT_GT(size, 0u);
+}
+
+TEST_F(TranslatorBenchmark, pooled)
+{
+  size_t size = 0;
+
+  start();
+  for (int i = 0; i < NumStrings; ++i)
+    size += gTranslator.toUtf8(myLatin1[i % NumDistinctStrings], "ISO-8859-1").size();
+  report("pooled descriptor", NumStrings);
+  EXPECT_EQ(openEachTime(myLatin1[0]), gTranslator.toUtf8(myLatin1[0], "ISO-8859-1"));
+  EXPECT_GT(size, 0u);
+}
+
+TEST_F(TranslatorBenchmark, ascii)
+{
+  size_t size = 0;
+
+  start();
+  for (int i = 0; i < NumStrings; ++i)
+    size += gTranslator.toUtf8(myAscii[i % NumDistinctStrings], "ISO-8859-1").size();
+  report("ascii", NumStrings);
+  EXPECT_GT(size, 0u);
+}
+
+} // namespace LicqTest
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq Developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <licq/translator.h>
+
+#include <gtest/gtest.h>
+#include <string>
+
+using Licq::gTranslator;
+using std::string;
+
+namespace LicqTest {
+
+TEST(Translator, asciiUnchanged)
+{
+  EXPECT_EQ("Hello world", gTranslator.toUtf8("Hello world", "ISO-8859-1"));
+  EXPECT_EQ("Hello world", gTranslator.fromUtf8("Hello world", "CP 1251"));
+  EXPECT_EQ("", gTranslator.toUtf8("", "ISO-8859-1"));
+}
+
+TEST(Translator, asciiToUtf16)
+{
+  // UTF-16 is not ASCII compatible so must still be converted
+  EXPECT_EQ(string("\0H\0i", 4), gTranslator.toUtf16("Hi", "UTF-8"));
+  EXPECT_EQ("Hi", gTranslator.fromUtf16(string("\0H\0i", 4), "UTF-8"));
+}
+
+TEST(Translator, latin1)
+{
+  EXPECT_EQ("\xC3\xA5\xC3\xA4\xC3\xB6", gTranslator.toUtf8("\xE5\xE4\xF6", "ISO-8859-1"));
+  EXPECT_EQ("\xE5\xE4\xF6", gTranslator.fromUtf8("\xC3\xA5\xC3\xA4\xC3\xB6", "ISO-8859-1"));
+
+  // Repeated conversions reuse the same descriptor
+  for (int i = 0; i < 3; ++i)
+    EXPECT_EQ("x\xC3\xA5", gTranslator.toUtf8("x\xE5", "ISO-8859-1"));
+}
+
+TEST(Translator, outputLongerThanTwiceInput)
+{
+  // Euro sign is one byte in CP1252 and three in UTF-8
+  string euros(100, '\x80');
+  string expected;
+  for (int i = 0; i < 100; ++i)
+    expected += "\xE2\x82\xAC";
+  EXPECT_EQ(expected, gTranslator.toUtf8(euros, "CP1252"));
+}
+
+TEST(Translator, invalidInput)
+{
+  // Conversion stops at invalid sequence and next conversion still works
+  EXPECT_EQ("ab", gTranslator.fromUtf8("ab\xFF" "cd", "ISO-8859-1"));
+  EXPECT_EQ("\xE5", gTranslator.fromUtf8("\xC3\xA5", "ISO-8859-1"));
+}
+
+TEST(Translator, unsupportedEncoding)
+{
+  EXPECT_EQ("", gTranslator.toUtf8("\xE5", "NO-SUCH-ENCODING"));
+}
+
+} // namespace LicqTest
@@ -0,0 +1,250 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "textkernels.h"
+
+#include <cstring>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string;
+
+namespace LicqDaemon
+{
+namespace TextKernels
+{
+
+// Highest bit of each byte in a 64 bit word
+static const uint64_t HighBits = 0x8080808080808080ULL;
+
+size_t asciiPrefix(const char* data, size_t size)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  // Check two blocks at once, the loop below finds the exact position
+  for (; i + 32 <= size; i += 32)
+  {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+    if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0)
+      break;
+  }
+  for (; i + 16 <= size; i += 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    int mask = _mm_movemask_epi8(v);
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t v;
+    memcpy(&v, data + i, sizeof(v));
+    if ((v & HighBits) != 0)
+      break;
+  }
+  for (; i < size; ++i)
+    if (static_cast<unsigned char>(data[i]) >= 0x80)
+      return i;
+  return size;
+}
+
+bool isValidUtf8(const char* data, size_t size)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+  while (true)
+  {
+    i += asciiPrefix(data + i, size - i);
+    if (i == size)
+      return true;
+
+    unsigned char c = p[i];
+    size_t length;
+    unsigned long codePoint;
+    if (c < 0xC2)
+      // Continuation byte or overlong two byte sequence
+      return false;
+    else if (c < 0xE0)
+    {
+      length = 2;
+      codePoint = c & 0x1F;
+    }
+    else if (c < 0xF0)
+    {
+      length = 3;
+      codePoint = c & 0x0F;
+    }
+    else if (c < 0xF5)
+    {
+      length = 4;
+      codePoint = c & 0x07;
+    }
+    else
+      return false;
+
+    if (size - i < length)
+      return false;
+    for (size_t j = 1; j < length; ++j)
+    {
+      if ((p[i + j] & 0xC0) != 0x80)
+        return false;
+      codePoint = (codePoint << 6) | (p[i + j] & 0x3F);
+    }
+
+    if (length == 3 && (codePoint < 0x800 ||
+        (codePoint >= 0xD800 && codePoint <= 0xDFFF)))
+      return false;
+    if (length == 4 && (codePoint < 0x10000 || codePoint > 0x10FFFF))
+      return false;
+    i += length;
+  }
+}
+
+void toDos(const char* data, size_t size, string& out)
+{
+  out.clear();
+  out.reserve(size + size / 32 + 16);
+
+  const char* p = data;
+  const char* end = data + size;
+  while (p < end)
+  {
+    const char* lf = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (lf == NULL)
+    {
+      out.append(p, end - p);
+      break;
+    }
+
+    out.append(p, lf + 1 - p);
+    p = lf + 1;
+    if (p == end || *p != '\r')
+      out += '\r';
+  }
+}
+
+void toUnix(string& s)
+{
+  if (s.empty())
+    return;
+
+  char* begin = &s[0];
+  char* end = begin + s.size();
+  char* in = static_cast<char*>(memchr(begin, '\r', s.size()));
+  if (in == NULL)
+    // Nothing to do, this is the common case
+    return;
+
+  // Original character before each \r, the text is moved as we go
+  char prev = (in > begin ? in[-1] : '\0');
+  char* out = in;
+  while (in != NULL)
+  {
+    if (prev != '\n')
+      *out++ = '\n';
+    ++in;
+
+    char* next = static_cast<char*>(memchr(in, '\r', end - in));
+    char* chunkEnd = (next != NULL ? next : end);
+    size_t length = chunkEnd - in;
+    prev = (length > 0 ? chunkEnd[-1] : '\r');
+    memmove(out, in, length);
+    out += length;
+    in = next;
+  }
+  s.resize(out - begin);
+}
+
+bool utf16beToUtf8(const char* data, size_t size, string& out)
+{
+  if (size % 2 != 0)
+    return false;
+
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+  size_t units = size / 2;
+  out.resize(units * 3);
+  if (units == 0)
+    return true;
+
+  char* o = &out[0];
+  size_t w = 0;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  // Loading big endian data swaps the bytes so the high byte of each
+  // character ends up in the low half of the lane
+  const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0x80FF));
+  const __m128i zero = _mm_setzero_si128();
+#endif
+
+  while (i < units)
+  {
+#ifdef __SSE2__
+    if (i + 8 <= units)
+    {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2));
+      __m128i isAscii = _mm_cmpeq_epi16(_mm_and_si128(v, nonAscii), zero);
+      if (_mm_movemask_epi8(isAscii) == 0xFFFF)
+      {
+        __m128i chars = _mm_srli_epi16(v, 8);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(o + w),
+            _mm_packus_epi16(chars, chars));
+        i += 8;
+        w += 8;
+        continue;
+      }
+    }
+#endif
+
+    // Convert a block a character at a time
+    size_t blockEnd = (units - i > 8 ? i + 8 : units);
+    for (; i < blockEnd; ++i)
+    {
+      unsigned c = (in[i * 2] << 8) | in[i * 2 + 1];
+      if (c < 0x80)
+        o[w++] = c;
+      else if (c < 0x800)
+      {
+        o[w++] = 0xC0 | (c >> 6);
+        o[w++] = 0x80 | (c & 0x3F);
+      }
+      else if (c >= 0xD800 && c <= 0xDFFF)
+        return false;
+      else
+      {
+        o[w++] = 0xE0 | (c >> 12);
+        o[w++] = 0x80 | ((c >> 6) & 0x3F);
+        o[w++] = 0x80 | (c & 0x3F);
+      }
+    }
+  }
+
+  out.resize(w);
+  return true;
+}
+
+} // namespace TextKernels
+} // namespace LicqDaemon
@@ -0,0 +1,105 @@
+/*
+ * This file is part of Licq, an instant messaging client for UNIX.
+ * Copyright (C) 2013 Licq developers <licq-dev@googlegroups.com>
+ *
+ * Licq is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Licq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Licq; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LICQDAEMON_TEXTKERNELS_H
+#define LICQDAEMON_TEXTKERNELS_H
+
+#include <cstddef>
+#include <string>
+
+namespace LicqDaemon
+{
+
+/**
+ * Text scanning and conversion functions used on every message
+ *
+ * ASCII detection checks 16 bytes at a time with SSE2 when available and 8
+ * bytes at a time otherwise. UTF-16 transcoding converts runs of ASCII
+ * characters eight at a time with SSE2. Searching for line breaks uses
+ * memchr() which the C library already implements with the best vector
+ * instructions for the running CPU.
+ */
+namespace TextKernels
+{
+
+/**
+ * Get length of the ASCII part at the start of a buffer
+ *
+ * @param data Buffer to check
+ * @param size Size of buffer
+ * @return Offset of first byte above 0x7F, or size if there is none
+ */
+size_t asciiPrefix(const char* data, size_t size);
+
+/**
+ * Check if a buffer only contains ASCII characters
+ *
+ * @param data Buffer to check
+ * @param size Size of buffer
+ * @return True if no byte is above 0x7F
+ */
+inline bool isAscii(const char* data, size_t size)
+{ return asciiPrefix(data, size) == size; }
+
+/**
+ * Check if a buffer is valid UTF-8
+ * Overlong forms, surrogates and code points above U+10FFFF are not valid.
+ *
+ * @param data Buffer to check
+ * @param size Size of buffer
+ * @return True if buffer is valid UTF-8
+ */
+bool isValidUtf8(const char* data, size_t size);
+
+/**
+ * Convert line breaks to the format used by Translator::returnToDos()
+ * A \r is added after each \n that isn't already followed by one.
+ *
+ * @param data Text to convert
+ * @param size Size of text
+ * @param out String to write result to, existing contents are replaced
+ */
+void toDos(const char* data, size_t size, std::string& out);
+
+/**
+ * Convert line breaks to unix style as Translator::returnToUnix() does
+ * A \r directly after a \n is removed, any other \r becomes \n.
+ *
+ * @param s String to convert in place
+ */
+void toUnix(std::string& s);
+
+/**
+ * Convert UTF-16 in big endian byte order to UTF-8
+ *
+ * Only characters in the basic multilingual plane are handled, for anything
+ * else the caller should fall back to a complete converter.
+ *
+ * @param data UTF-16BE data
+ * @param size Size of data in bytes
+ * @param out String to write result to, existing contents are replaced
+ * @return False if data has an odd size or contains surrogates
+ */
+bool utf16beToUtf8(const char* data, size_t size, std::string& out);
+
+} // namespace TextKernels
+
+} // namespace LicqDaemon
+
+#endif
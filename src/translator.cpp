@@ -27,36 +27,169 @@
 
 #include <licq/translator.h>
 
+#include <cerrno>
 #include <string.h>
+#include <strings.h>
 #include <iconv.h>
+#include <langinfo.h>
+#include <list>
 #include <stdlib.h>
+#include <vector>
 
 #include <licq/logging/log.h>
+#include <licq/thread/mutex.h>
+#include <licq/thread/mutexlocker.h>
 
 #include "gettext.h"
+#include "textkernels.h"
 
+using Licq::MutexLocker;
 using Licq::Translator;
 using std::string;
+namespace TextKernels = LicqDaemon::TextKernels;
 
 Licq::Translator Licq::gTranslator;
 
+class Translator::Private
+{
+public:
+  ~Private();
+
+  /**
+   * Get a conversion descriptor, either from the pool or a newly opened one
+   *
+   * @param to Encoding to convert to
+   * @param from Encoding to convert from
+   * @return Descriptor or (iconv_t)(-1) if conversion isn't supported
+   */
+  iconv_t acquire(const string& to, const string& from);
+
+  /**
+   * Reset a descriptor and put it back in the pool
+   *
+   * @param to Encoding to convert to
+   * @param from Encoding to convert from
+   * @param cd Descriptor from acquire()
+   */
+  void release(const string& to, const string& from, iconv_t cd);
+
+  /**
+   * Check if an encoding represents all ASCII characters as themselves
+   *
+   * @param encoding Encoding name, empty for locale encoding
+   * @return True if encoding is known to be ASCII compatible
+   */
+  static bool isAsciiCompatible(const string& encoding);
+
+private:
+  // Descriptors kept for each pair, more than this are closed when released
+  static const size_t MaxIdle = 8;
+
+  // Only a few pairs are ever used so a list is faster than a map
+  struct Pool
+  {
+    string to;
+    string from;
+    std::vector<iconv_t> idle;
+  };
+
+  /// Get pool for a pair of encodings, caller must hold mutex
+  Pool& pool(const string& to, const string& from);
+
+  Licq::Mutex myMutex;
+  std::list<Pool> myPools;
+};
+
+Translator::Private::~Private()
+{
+  for (std::list<Pool>::iterator i = myPools.begin(); i != myPools.end(); ++i)
+    for (size_t j = 0; j < i->idle.size(); ++j)
+      iconv_close(i->idle[j]);
+}
+
+Translator::Private::Pool& Translator::Private::pool(const string& to,
+    const string& from)
+{
+  for (std::list<Pool>::iterator i = myPools.begin(); i != myPools.end(); ++i)
+    if (i->to == to && i->from == from)
+      return *i;
+
+  Pool p;
+  p.to = to;
+  p.from = from;
+  myPools.push_back(p);
+  return myPools.back();
+}
+
+iconv_t Translator::Private::acquire(const string& to, const string& from)
+{
+  {
+    MutexLocker locker(myMutex);
+    std::vector<iconv_t>& idle = pool(to, from).idle;
+    if (!idle.empty())
+    {
+      iconv_t cd = idle.back();
+      idle.pop_back();
+      return cd;
+    }
+  }
+
+  return iconv_open(to.c_str(), from.c_str());
+}
+
+void Translator::Private::release(const string& to, const string& from, iconv_t cd)
+{
+  // Return to initial state in case last conversion failed half way
+  iconv(cd, NULL, NULL, NULL, NULL);
+
+  {
+    MutexLocker locker(myMutex);
+    std::vector<iconv_t>& idle = pool(to, from).idle;
+    if (idle.size() < MaxIdle)
+    {
+      idle.push_back(cd);
+      return;
+    }
+  }
+
+  iconv_close(cd);
+}
+
+bool Translator::Private::isAsciiCompatible(const string& encoding)
+{
+  // Encodings that always use single bytes below 0x80 for ASCII characters
+  static const char* const prefixes[] = {
+    "UTF-8", "UTF8", "ASCII", "US-ASCII", "ANSI_X3.4", "ISO-8859", "ISO8859",
+    "ISO_8859", "LATIN", "CP125", "WINDOWS-125", "KOI8", "EUC",
+    "GB2312", "GBK", "GB18030", "TIS-620", "TIS620",
+  };
+
+  const char* name = (encoding.empty() ? nl_langinfo(CODESET) : encoding.c_str());
+  for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i)
+    if (strncasecmp(name, prefixes[i], strlen(prefixes[i])) == 0)
+      return true;
+  return false;
+}
+
 Translator::Translator()
+  : myPrivate(new Private)
 {
   // Empty
 }
 
 Translator::~Translator()
 {
-  // Empty
+  delete myPrivate;
 }
 
 bool Translator::isAscii(const string& s)
 {
-  for (size_t i = 0; i < s.size(); ++i)
-    if ((unsigned char)s[i] >= 0x80)
-      return false;
+  return TextKernels::isAscii(s.data(), s.size());
+}
 
-  return true;
+bool Translator::isUtf8(const string& s)
+{
+  return TextKernels::isValidUtf8(s.data(), s.size());
 }
 
 string Translator::nameForIconv(const string& licqName)
@@ -189,81 +322,100 @@ bool Translator::utf16to8(unsigned long c, string& s)
 
 string Translator::returnToDos(const string& s)
 {
-  string ret = s;
-  size_t pos = 0;
-  while (1)
-  {
-    pos = ret.find('\n', pos);
-    if (pos == string::npos)
-      break;
-
-    if (pos+1 == ret.size() || ret[pos+1] != '\r')
-      ret.insert(pos+1, "\r");
-    ++pos;
-  }
+  string ret;
+  TextKernels::toDos(s.data(), s.size(), ret);
   return ret;
 }
 
+void Translator::returnToDos(const string& s, string& out)
+{
+  TextKernels::toDos(s.data(), s.size(), out);
+}
+
 string Translator::returnToUnix(const string& s)
 {
   string ret = s;
-
-  // Replace all \n\r with \n, and make sure \n\r\r becomes \n\r, not just \n
-  size_t pos = 0;
-  while ((pos = ret.find("\n\r", pos)) != string::npos)
-    ret.replace(pos++, 2, "\n");
-
-  // Replace all remaining \r with \n
-  while ((pos = ret.find('\r')) != string::npos)
-    ret.replace(pos, 1, "\n");
-
+  TextKernels::toUnix(ret);
   return ret;
 }
 
+void Translator::returnToUnixInPlace(string& s)
+{
+  TextKernels::toUnix(s);
+}
+
 string Translator::iconvConvert(const string& s, const string& to, const string& from,
     bool& ok)
 {
+  LICQ_D();
   ok = true;
 
   if (to == from)
     return s;
 
-  size_t inLen = s.size();
-  size_t outLen = inLen * 2;
-  size_t outSize = outLen;
-
-  char* result = new char[outLen + 1];
+  // Protocols send UCS-2 which is simple enough to convert without iconv
+  string result;
+  if (to == "UTF-8" && from == "UCS-2BE" &&
+      TextKernels::utf16beToUtf8(s.data(), s.size(), result))
+    return result;
 
-  char* outPtr = result;
-  iconv_t tr;
+  // Most messages are plain ASCII which doesn't need any conversion
+  if (isAscii(s) && Private::isAsciiCompatible(to) &&
+      Private::isAsciiCompatible(from))
+    return s;
 
-  tr = iconv_open(to.c_str(), from.c_str());
+  iconv_t tr = d->acquire(to, from);
   if (tr == (iconv_t)(-1))
   {
     ok = false;
     gLog.warning(tr("Unsupported encoding conversion from %s to %s."),
         from.empty() ? "[LOCALE]" : from.c_str(),
         to.empty() ? "[LOCALE]" : to.c_str());
+    return string();
   }
-  else
+
+  // Output is rarely more than twice as long, grow the buffer if it is
+  result.assign(s.size() * 2 + 4, '\0');
+  size_t used = 0;
+  const char* inPtr = s.data();
+  size_t inLen = s.size();
+  bool inputDone = false;
+  while (true)
   {
-    const char* inPtr = s.c_str();
-    size_t ret = iconv(tr, (ICONV_CONST char**)&inPtr, &inLen, &outPtr, &outLen);
-    iconv_close(tr);
+    char* outPtr = &result[0] + used;
+    size_t outLen = result.size() - used;
+    size_t ret;
+    if (!inputDone)
+      ret = iconv(tr, (ICONV_CONST char**)&inPtr, &inLen, &outPtr, &outLen);
+    else
+      // Return to initial state, may write a shift sequence
+      ret = iconv(tr, NULL, NULL, &outPtr, &outLen);
+    used = result.size() - outLen;
+
+    if (ret != (size_t)(-1))
+    {
+      if (inputDone)
+        break;
+      inputDone = true;
+      continue;
+    }
 
-    if (ret == (size_t)(-1))
+    if (errno == E2BIG)
     {
-      ok = false;
-      gLog.warning(tr("Unable to encode from %s to %s."),
-          from.empty() ? "[LOCALE]" : from.c_str(),
-          to.empty() ? "[LOCALE]" : to.c_str());
+      result.resize(result.size() * 2);
+      continue;
     }
+
+    ok = false;
+    gLog.warning(tr("Unable to encode from %s to %s."),
+        from.empty() ? "[LOCALE]" : from.c_str(),
+        to.empty() ? "[LOCALE]" : to.c_str());
+    break;
   }
 
-  *outPtr = '\0';
-  string ret(result, outSize - outLen);
-  delete[] result;
-  return ret;
+  d->release(to, from, tr);
+  result.resize(used);
+  return result;
 }
 
 